@@ -0,0 +1,155 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file cpu.c
+ * \brief Run-time CPU feature detection.
+ * \date 2013
+ */
+
+#include "platform.h"
+#include "common_utils.h"
+#include "cpu.h"
+
+#ifdef CPU_X86
+
+	#ifdef _MSC_VER
+
+		#include <intrin.h>
+
+	#else
+
+		#include <cpuid.h>
+
+	#endif
+
+#endif
+
+
+#ifdef CPU_X86
+
+/**
+ * \brief Execute CPUID.
+ * \param[in] leaf Function number.
+ * \param[in] subleaf Sub-function number.
+ * \param[out] regs Receives EAX, EBX, ECX and EDX.
+ * \return Nothing.
+ */
+PRIVATE void CPU_cpuid( W32 leaf, W32 subleaf, W32 regs[ 4 ] )
+{
+#ifdef _MSC_VER
+
+	int info[ 4 ];
+
+	__cpuidex( info, (int)leaf, (int)subleaf );
+
+	regs[ 0 ] = (W32)info[ 0 ];
+	regs[ 1 ] = (W32)info[ 1 ];
+	regs[ 2 ] = (W32)info[ 2 ];
+	regs[ 3 ] = (W32)info[ 3 ];
+
+#else
+
+	unsigned int a, b, c, d;
+
+	__cpuid_count( leaf, subleaf, a, b, c, d );
+
+	regs[ 0 ] = a;
+	regs[ 1 ] = b;
+	regs[ 2 ] = c;
+	regs[ 3 ] = d;
+
+#endif
+}
+
+/**
+ * \brief Get the register state the operating system saves on a context switch.
+ * \return Low 32 bits of XCR0.
+ * \note Only valid when CPUID reports OSXSAVE.
+ */
+PRIVATE W32 CPU_xcr0( void )
+{
+#ifdef _MSC_VER
+
+	return (W32)_xgetbv( 0 );
+
+#else
+
+	unsigned int a, d;
+
+	/* xgetbv, spelled out for assemblers that do not know it */
+	__asm__ __volatile__ ( ".byte 0x0f, 0x01, 0xd0" : "=a" (a), "=d" (d) : "c" (0) );
+
+	return a;
+
+#endif
+}
+
+#endif /* CPU_X86 */
+
+/**
+ * \brief Get the SIMD instruction sets usable on this machine.
+ * \return Mask of CPU_FEATURE_* flags.
+ * \note AVX2 also needs the operating system to save the YMM registers.
+ */
+PUBLIC W32 CPU_features( void )
+{
+	W32 features = 0;
+
+#ifdef CPU_X86
+
+	W32 regs[ 4 ];
+	W32 maxLeaf;
+
+	CPU_cpuid( 0, 0, regs );
+	maxLeaf = regs[ 0 ];
+
+	if( maxLeaf >= 1 )
+	{
+		CPU_cpuid( 1, 0, regs );
+
+		if( regs[ 3 ] & (1 << 26) )
+		{
+			features |= CPU_FEATURE_SSE2;
+		}
+
+		/* OSXSAVE and AVX, with XMM and YMM state enabled */
+		if( (regs[ 2 ] & (1 << 27)) && (regs[ 2 ] & (1 << 28)) &&
+			(CPU_xcr0() & 0x6) == 0x6 && maxLeaf >= 7 )
+		{
+			CPU_cpuid( 7, 0, regs );
+
+			if( regs[ 1 ] & (1 << 5) )
+			{
+				features |= CPU_FEATURE_AVX2;
+			}
+		}
+	}
+
+#endif
+
+#ifdef CPU_NEON
+
+	features |= CPU_FEATURE_NEON;
+
+#endif
+
+	return features;
+}
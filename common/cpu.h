@@ -0,0 +1,55 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file cpu.h
+ * \brief Run-time CPU feature detection.
+ * \date 2013
+ */
+
+#ifndef __CPU_H__
+#define __CPU_H__
+
+#include "platform.h"
+
+
+#if defined( __i386__ ) || defined( __x86_64__ ) || defined( _M_IX86 ) || defined( _M_X64 )
+
+	#define CPU_X86		1
+
+#endif
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+
+	#define CPU_NEON	1
+
+#endif
+
+
+/* Feature flags */
+#define CPU_FEATURE_SSE2	0x01
+#define CPU_FEATURE_AVX2	0x02
+#define CPU_FEATURE_NEON	0x04
+
+
+W32 CPU_features( void );
+
+
+#endif /* __CPU_H__ */
@@ -147,3 +147,34 @@ PUBLIC SW32 FS_FileLoad( const char *path, void **buffer )
 
 	return length;
 }
+
+/**
+ * \brief Save a block of memory to a file.
+ * \param[in] path File name to save as.
+ * \param[in] buffer Data to write.
+ * \param[in] length Length of data in bytes.
+ * \return On success true, otherwise false.
+ * \note The data goes out in a single write.
+ */
+PUBLIC wtBoolean FS_FileSave( const char *path, const void *buffer, W32 length )
+{
+	FILE	*fhandle;
+	wtBoolean result;
+
+	fhandle = fopen( path, "wb" );
+	if( ! fhandle )
+	{
+		fprintf( stderr, "Could not open file (%s) for write!\n", path );
+
+		return false;
+	}
+
+	result = (fwrite( buffer, 1, length, fhandle ) == length);
+
+	if( fclose( fhandle ) != 0 )
+	{
+		result = false;
+	}
+
+	return result;
+}
@@ -49,6 +49,7 @@ SW32 FS_FileLength( FILE *filestream );
 SW32 FS_FileRead( void *ptr, size_t size, size_t nmemb, FILE *stream );
 SW32 FS_FileOpen( const char *filename, FILE **file );
 SW32 FS_FileLoad( const char *path, void **buffer );
+wtBoolean FS_FileSave( const char *path, const void *buffer, W32 length );
 wtBoolean FS_DeleteFile( const char *filename );
 
 
@@ -201,6 +201,18 @@ PUBLIC wtBoolean FS_ChangeCurrentDirectory( const char *path )
 /////////////////////////////////////////////////
 
 
+/**
+ * \brief Strip the directory glob puts in front of every match.
+ * \param[in] path Path of match.
+ * \return File name part of path.
+ */
+PRIVATE char *FS_FindName( char *path )
+{
+	char *name = strrchr( path, '/' );
+
+	return name ? name + 1 : path;
+}
+
 /**
  * \brief Searches a directory for a file or subdirectory with a name that matches a specific name.
  * \param[in] path Pointer to a NUL-terminated string that specifies a valid directory or path and file name that can contain wildcard characters.
@@ -231,7 +243,8 @@ PUBLIC char *FS_FindFirst( const char *path )
 	bFindOn = true;
 	findCount = 1;
 
-	return glob_results.gl_pathv[ 0 ];
+	/* like FindFirstFile, return the name without the directory */
+	return FS_FindName( glob_results.gl_pathv[ 0 ] );
 
 }
 
@@ -248,7 +261,7 @@ PUBLIC char *FS_FindNext( void )
 		return NULL;
 	}
 
-	if( findCount > glob_results.gl_pathc )
+	if( findCount >= glob_results.gl_pathc )
 	{
 		return NULL;
 	}
@@ -256,7 +269,7 @@ PUBLIC char *FS_FindNext( void )
 	temp = findCount;
 	findCount++;
 
-	return glob_results.gl_pathv[ temp ];
+	return FS_FindName( glob_results.gl_pathv[ temp ] );
 }
 
 /**
@@ -0,0 +1,576 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file writequeue_unix.c
+ * \brief Write-behind queue backend [UNIX].
+ * \date 2013
+ * \note On Linux a batch of files goes through io_uring: one submission
+ *		opens every file, one per round writes them and one closes them.
+ *		Where io_uring is missing, refused or too old to open and close
+ *		files, each file is written with open, write and close.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined( __linux__ )
+
+	#include <sys/syscall.h>
+
+	#if defined( __NR_io_uring_setup )
+
+		#include <sys/mman.h>
+		#include <linux/io_uring.h>
+
+		/* open and close came with the same kernel release */
+		#if defined( IORING_FEAT_RW_CUR_POS )
+			#define WRITEQUEUE_URING	1
+		#endif
+
+	#endif
+
+#endif
+
+#include "../../common/platform.h"
+#include "../../common/common_utils.h"
+#include "../../memory/memory.h"
+#include "../writequeue.h"
+
+
+#define WRITEQUEUE_OPEN_FLAGS	(O_WRONLY | O_CREAT | O_TRUNC)
+#define WRITEQUEUE_OPEN_MODE	0644
+
+
+/**
+ * \brief Write one file with open, write and close.
+ * \param[in] request File to write.
+ * \return true on success, otherwise false.
+ */
+PRIVATE wtBoolean WriteQueue_writePosix( const writeRequest_t *request )
+{
+	ssize_t n;
+	W32 done = 0;
+	int fd;
+
+	fd = open( request->path, WRITEQUEUE_OPEN_FLAGS, WRITEQUEUE_OPEN_MODE );
+	if( fd < 0 )
+	{
+		fprintf( stderr, "[WriteQueue_SysWrite]: Could not open file (%s) for write!\n", request->path );
+
+		return false;
+	}
+
+	while( done < request->length )
+	{
+		n = write( fd, request->data + done, request->length - done );
+		if( n < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+
+			break;
+		}
+
+		done += (W32)n;
+	}
+
+	if( close( fd ) != 0 || done < request->length )
+	{
+		fprintf( stderr, "[WriteQueue_SysWrite]: Could not write file (%s)\n", request->path );
+
+		return false;
+	}
+
+	return true;
+}
+
+
+#ifdef WRITEQUEUE_URING
+
+typedef struct
+{
+	int						fd;
+
+	unsigned				*sqTail;
+	unsigned				*sqMask;
+	unsigned				*sqArray;
+	struct io_uring_sqe		*sqes;
+
+	unsigned				*cqHead;
+	unsigned				*cqTail;
+	unsigned				*cqMask;
+	struct io_uring_cqe		*cqes;
+
+	void					*sqRing;
+	void					*cqRing;
+	size_t					sqRingSize;
+	size_t					cqRingSize;
+	size_t					sqesSize;
+
+} uring_t;
+
+PRIVATE uring_t		uring;
+PRIVATE wtBoolean	uring_active;
+
+/* completion result of each request in the batch */
+PRIVATE int			uring_results[ WRITEQUEUE_BATCH ];
+
+
+/**
+ * \brief Release the io_uring instance.
+ */
+PRIVATE void WriteQueue_uringFree( void )
+{
+	if( uring.sqes && uring.sqes != MAP_FAILED )
+	{
+		munmap( uring.sqes, uring.sqesSize );
+	}
+
+	if( uring.cqRing && uring.cqRing != MAP_FAILED && uring.cqRing != uring.sqRing )
+	{
+		munmap( uring.cqRing, uring.cqRingSize );
+	}
+
+	if( uring.sqRing && uring.sqRing != MAP_FAILED )
+	{
+		munmap( uring.sqRing, uring.sqRingSize );
+	}
+
+	if( uring.fd >= 0 )
+	{
+		close( uring.fd );
+	}
+
+	memset( &uring, 0, sizeof( uring ) );
+	uring.fd = -1;
+
+	uring_active = false;
+}
+
+/**
+ * \brief Check that the kernel can open, write and close through io_uring.
+ */
+PRIVATE wtBoolean WriteQueue_uringProbe( void )
+{
+	struct io_uring_probe *probe;
+	W32 size = sizeof( struct io_uring_probe ) + 256 * sizeof( struct io_uring_probe_op );
+	wtBoolean result = false;
+
+	probe = (struct io_uring_probe *) MM_MALLOC( size );
+	if( NULL == probe )
+	{
+		return false;
+	}
+
+	memset( probe, 0, size );
+
+	if( syscall( __NR_io_uring_register, uring.fd, IORING_REGISTER_PROBE, probe, 256 ) == 0 &&
+		probe->last_op >= IORING_OP_CLOSE &&
+		(probe->ops[ IORING_OP_OPENAT ].flags & IO_URING_OP_SUPPORTED) &&
+		(probe->ops[ IORING_OP_WRITE ].flags & IO_URING_OP_SUPPORTED) &&
+		(probe->ops[ IORING_OP_CLOSE ].flags & IO_URING_OP_SUPPORTED) )
+	{
+		result = true;
+	}
+
+	MM_FREE( probe );
+
+	return result;
+}
+
+/**
+ * \brief Set up an io_uring instance large enough for one batch.
+ */
+PRIVATE void WriteQueue_uringInit( void )
+{
+	struct io_uring_params params;
+
+	memset( &uring, 0, sizeof( uring ) );
+	memset( &params, 0, sizeof( params ) );
+
+	uring.fd = (int) syscall( __NR_io_uring_setup, WRITEQUEUE_BATCH, &params );
+	if( uring.fd < 0 )
+	{
+		uring.fd = -1;
+
+		return;
+	}
+
+	uring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+	uring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+	uring.sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+
+	if( params.features & IORING_FEAT_SINGLE_MMAP )
+	{
+		if( uring.cqRingSize > uring.sqRingSize )
+		{
+			uring.sqRingSize = uring.cqRingSize;
+		}
+		uring.cqRingSize = uring.sqRingSize;
+	}
+
+	uring.sqRing = mmap( NULL, uring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING );
+	if( uring.sqRing == MAP_FAILED )
+	{
+		WriteQueue_uringFree();
+
+		return;
+	}
+
+	if( params.features & IORING_FEAT_SINGLE_MMAP )
+	{
+		uring.cqRing = uring.sqRing;
+	}
+	else
+	{
+		uring.cqRing = mmap( NULL, uring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_CQ_RING );
+		if( uring.cqRing == MAP_FAILED )
+		{
+			WriteQueue_uringFree();
+
+			return;
+		}
+	}
+
+	uring.sqes = (struct io_uring_sqe *) mmap( NULL, uring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES );
+	if( uring.sqes == MAP_FAILED )
+	{
+		WriteQueue_uringFree();
+
+		return;
+	}
+
+	uring.sqTail = (unsigned *)((W8 *)uring.sqRing + params.sq_off.tail);
+	uring.sqMask = (unsigned *)((W8 *)uring.sqRing + params.sq_off.ring_mask);
+	uring.sqArray = (unsigned *)((W8 *)uring.sqRing + params.sq_off.array);
+
+	uring.cqHead = (unsigned *)((W8 *)uring.cqRing + params.cq_off.head);
+	uring.cqTail = (unsigned *)((W8 *)uring.cqRing + params.cq_off.tail);
+	uring.cqMask = (unsigned *)((W8 *)uring.cqRing + params.cq_off.ring_mask);
+	uring.cqes = (struct io_uring_cqe *)((W8 *)uring.cqRing + params.cq_off.cqes);
+
+	if( ! WriteQueue_uringProbe() )
+	{
+		WriteQueue_uringFree();
+
+		return;
+	}
+
+	uring_active = true;
+}
+
+/**
+ * \brief Queue a submission.
+ * \param[in] opcode Operation (IORING_OP_*).
+ * \param[in] fd File descriptor.
+ * \param[in] addr Path or data.
+ * \param[in] len Mode or data length.
+ * \param[in] offset File offset.
+ * \param[in] index Request index in the batch, results go to uring_results.
+ * \return Nothing.
+ */
+PRIVATE void WriteQueue_uringPrep( W8 opcode, int fd, const void *addr, W32 len, W32 offset, W32 index )
+{
+	unsigned tail = *uring.sqTail;
+	unsigned slot = tail & *uring.sqMask;
+	struct io_uring_sqe *sqe = &uring.sqes[ slot ];
+
+	memset( sqe, 0, sizeof( *sqe ) );
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)addr;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = index;
+
+	if( opcode == IORING_OP_OPENAT )
+	{
+		sqe->open_flags = WRITEQUEUE_OPEN_FLAGS;
+	}
+
+	uring.sqArray[ slot ] = slot;
+
+	__atomic_store_n( uring.sqTail, tail + 1, __ATOMIC_RELEASE );
+}
+
+/**
+ * \brief Submit queued submissions and wait for all of them to complete.
+ * \param[in] count Number of queued submissions.
+ * \return true on success, otherwise false.
+ */
+PRIVATE wtBoolean WriteQueue_uringSubmit( W32 count )
+{
+	struct io_uring_cqe *cqe;
+	W32 submitted = 0, completed = 0;
+	unsigned head;
+	long ret;
+
+	while( completed < count )
+	{
+		ret = syscall( __NR_io_uring_enter, uring.fd, count - submitted, count - completed, IORING_ENTER_GETEVENTS, NULL, 0 );
+		if( ret < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		submitted += (W32)ret;
+
+		head = *uring.cqHead;
+		while( head != __atomic_load_n( uring.cqTail, __ATOMIC_ACQUIRE ) )
+		{
+			cqe = &uring.cqes[ head & *uring.cqMask ];
+			uring_results[ cqe->user_data ] = cqe->res;
+
+			++head;
+			++completed;
+		}
+
+		__atomic_store_n( uring.cqHead, head, __ATOMIC_RELEASE );
+	}
+
+	return true;
+}
+
+/**
+ * \brief Write a batch of files through io_uring.
+ * \param[in] requests Files to write.
+ * \param[in] count Number of files, at most WRITEQUEUE_BATCH.
+ * \param[out] failures Number of files that could not be written.
+ * \return false if io_uring itself failed, otherwise true.
+ */
+PRIVATE wtBoolean WriteQueue_writeUring( writeRequest_t **requests, W32 count, W32 *failures )
+{
+	int fds[ WRITEQUEUE_BATCH ];
+	W32 done[ WRITEQUEUE_BATCH ];
+	wtBoolean failed[ WRITEQUEUE_BATCH ];
+	W32 pending;
+	W32 i;
+
+	for( i = 0 ; i < count ; ++i )
+	{
+		uring_results[ i ] = -EBADF;
+		WriteQueue_uringPrep( IORING_OP_OPENAT, AT_FDCWD, requests[ i ]->path, WRITEQUEUE_OPEN_MODE, 0, i );
+	}
+
+	if( ! WriteQueue_uringSubmit( count ) )
+	{
+		/* opens that completed already hold a descriptor */
+		for( i = 0 ; i < count ; ++i )
+		{
+			if( uring_results[ i ] >= 0 )
+			{
+				close( uring_results[ i ] );
+			}
+		}
+
+		return false;
+	}
+
+	for( i = 0 ; i < count ; ++i )
+	{
+		fds[ i ] = uring_results[ i ];
+		done[ i ] = 0;
+		failed[ i ] = (fds[ i ] < 0);
+
+		if( failed[ i ] )
+		{
+			fprintf( stderr, "[WriteQueue_SysWrite]: Could not open file (%s) for write!\n", requests[ i ]->path );
+		}
+	}
+
+	/* short writes go round again for the rest */
+	do
+	{
+		pending = 0;
+		for( i = 0 ; i < count ; ++i )
+		{
+			if( ! failed[ i ] && done[ i ] < requests[ i ]->length )
+			{
+				WriteQueue_uringPrep( IORING_OP_WRITE, fds[ i ], requests[ i ]->data + done[ i ], requests[ i ]->length - done[ i ], done[ i ], i );
+				++pending;
+			}
+		}
+
+		if( pending == 0 )
+		{
+			break;
+		}
+
+		if( ! WriteQueue_uringSubmit( pending ) )
+		{
+			for( i = 0 ; i < count ; ++i )
+			{
+				if( fds[ i ] >= 0 )
+				{
+					close( fds[ i ] );
+				}
+			}
+
+			return false;
+		}
+
+		for( i = 0 ; i < count ; ++i )
+		{
+			if( ! failed[ i ] && done[ i ] < requests[ i ]->length )
+			{
+				if( uring_results[ i ] <= 0 )
+				{
+					fprintf( stderr, "[WriteQueue_SysWrite]: Could not write file (%s)\n", requests[ i ]->path );
+					failed[ i ] = true;
+				}
+				else
+				{
+					done[ i ] += (W32)uring_results[ i ];
+				}
+			}
+		}
+
+	} while( pending );
+
+	pending = 0;
+	for( i = 0 ; i < count ; ++i )
+	{
+		/* close returns 0 or -errno, 1 marks a close that has not completed */
+		uring_results[ i ] = 1;
+
+		if( fds[ i ] >= 0 )
+		{
+			WriteQueue_uringPrep( IORING_OP_CLOSE, fds[ i ], NULL, 0, 0, i );
+			++pending;
+		}
+	}
+
+	if( pending && ! WriteQueue_uringSubmit( pending ) )
+	{
+		/* closes that did not complete are left to us */
+		for( i = 0 ; i < count ; ++i )
+		{
+			if( fds[ i ] >= 0 && uring_results[ i ] == 1 )
+			{
+				close( fds[ i ] );
+			}
+		}
+
+		return false;
+	}
+
+	*failures = 0;
+	for( i = 0 ; i < count ; ++i )
+	{
+		if( fds[ i ] >= 0 && ! failed[ i ] && uring_results[ i ] < 0 )
+		{
+			fprintf( stderr, "[WriteQueue_SysWrite]: Could not write file (%s)\n", requests[ i ]->path );
+			failed[ i ] = true;
+		}
+
+		if( failed[ i ] )
+		{
+			(*failures)++;
+		}
+	}
+
+	return true;
+}
+
+#endif /* WRITEQUEUE_URING */
+
+
+/**
+ * \brief Set up the backend.
+ * \note WriteQueue_SysWrite must not be called from two threads at once
+ *		between WriteQueue_SysInit and WriteQueue_SysShutdown.
+ */
+PUBLIC void WriteQueue_SysInit( void )
+{
+#ifdef WRITEQUEUE_URING
+
+	if( ! uring_active )
+	{
+		WriteQueue_uringInit();
+	}
+
+#endif
+}
+
+/**
+ * \brief Release the backend.
+ */
+PUBLIC void WriteQueue_SysShutdown( void )
+{
+#ifdef WRITEQUEUE_URING
+
+	if( uring_active )
+	{
+		WriteQueue_uringFree();
+	}
+
+#endif
+}
+
+/**
+ * \brief Write a batch of files.
+ * \param[in] requests Files to write.
+ * \param[in] count Number of files, at most WRITEQUEUE_BATCH, each path only once.
+ * \return Number of files that could not be written.
+ */
+PUBLIC W32 WriteQueue_SysWrite( writeRequest_t **requests, W32 count )
+{
+	W32 failures = 0;
+	W32 i;
+
+#ifdef WRITEQUEUE_URING
+
+	if( uring_active )
+	{
+		if( WriteQueue_writeUring( requests, count, &failures ) )
+		{
+			return failures;
+		}
+
+		/* the ring is in an unknown state, do not use it again */
+		fprintf( stderr, "[WriteQueue_SysWrite]: io_uring failed, falling back to write\n" );
+		WriteQueue_uringFree();
+	}
+
+#endif
+
+	for( i = 0 ; i < count ; ++i )
+	{
+		if( ! WriteQueue_writePosix( requests[ i ] ) )
+		{
+			++failures;
+		}
+	}
+
+	return failures;
+}
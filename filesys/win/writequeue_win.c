@@ -0,0 +1,108 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file writequeue_win.c
+ * \brief Write-behind queue backend [Windows].
+ * \date 2013
+ */
+
+#include <windows.h>
+#include <stdio.h>
+
+#include "../../common/platform.h"
+#include "../../common/common_utils.h"
+#include "../writequeue.h"
+
+
+/**
+ * \brief Write one file.
+ * \param[in] request File to write.
+ * \return true on success, otherwise false.
+ */
+PRIVATE wtBoolean WriteQueue_writeFile( const writeRequest_t *request )
+{
+	HANDLE handle;
+	DWORD written;
+	W32 done = 0;
+	wtBoolean result;
+
+	handle = CreateFileA( request->path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if( handle == INVALID_HANDLE_VALUE )
+	{
+		fprintf( stderr, "[WriteQueue_SysWrite]: Could not open file (%s) for write!\n", request->path );
+
+		return false;
+	}
+
+	while( done < request->length )
+	{
+		if( ! WriteFile( handle, request->data + done, request->length - done, &written, NULL ) || written == 0 )
+		{
+			break;
+		}
+
+		done += written;
+	}
+
+	result = CloseHandle( handle ) && done == request->length;
+	if( ! result )
+	{
+		fprintf( stderr, "[WriteQueue_SysWrite]: Could not write file (%s)\n", request->path );
+	}
+
+	return result;
+}
+
+/**
+ * \brief Set up the backend.
+ */
+PUBLIC void WriteQueue_SysInit( void )
+{
+}
+
+/**
+ * \brief Release the backend.
+ */
+PUBLIC void WriteQueue_SysShutdown( void )
+{
+}
+
+/**
+ * \brief Write a batch of files.
+ * \param[in] requests Files to write.
+ * \param[in] count Number of files.
+ * \return Number of files that could not be written.
+ */
+PUBLIC W32 WriteQueue_SysWrite( writeRequest_t **requests, W32 count )
+{
+	W32 failures = 0;
+	W32 i;
+
+	for( i = 0 ; i < count ; ++i )
+	{
+		if( ! WriteQueue_writeFile( requests[ i ] ) )
+		{
+			++failures;
+		}
+	}
+
+	return failures;
+}
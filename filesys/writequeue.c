@@ -0,0 +1,374 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file writequeue.c
+ * \brief Write-behind queue for output files.
+ * \date 2013
+ * \note Decoders hand finished files to WriteQueue_Add and carry on, while
+ *		a dedicated I/O thread passes them to the platform backend in
+ *		batches. The queue holds at most WRITEQUEUE_MAX_BYTES, beyond which
+ *		WriteQueue_Add waits for the I/O thread to catch up. Before the
+ *		queue is started, or after it is shut down, files are written
+ *		straight away on the calling thread.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "../memory/memory.h"
+#include "../memory/membuf.h"
+#include "../threads/threads.h"
+#include "writequeue.h"
+
+
+PRIVATE thread_t		queue_thread;
+PRIVATE mutex_t			queue_lock;
+PRIVATE cond_t			queue_work;		/* signalled when a request is added or on shutdown */
+PRIVATE cond_t			queue_done;		/* signalled when a batch has been written */
+
+PRIVATE writeRequest_t	*queue_head;
+PRIVATE writeRequest_t	*queue_tail;
+PRIVATE W32				queue_bytes;	/* bytes added but not yet written */
+PRIVATE W32				queue_count;	/* requests added but not yet written */
+PRIVATE W32				queue_failures;	/* failed writes since the last flush */
+PRIVATE wtBoolean		queue_quit;
+PRIVATE wtBoolean		queue_running;
+
+
+/**
+ * \brief Free a request and its data.
+ */
+PRIVATE void WriteQueue_freeRequest( writeRequest_t *request )
+{
+	MM_FREE( request->data );
+	MM_FREE( request );
+}
+
+/**
+ * \brief Check if a batch already writes to a path.
+ */
+PRIVATE wtBoolean WriteQueue_inBatch( writeRequest_t **batch, W32 count, const char *path )
+{
+	W32 i;
+
+	for( i = 0 ; i < count ; ++i )
+	{
+		if( 0 == strcmp( batch[ i ]->path, path ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * \brief I/O thread, writes queued files in batches until shut down.
+ */
+PRIVATE void WriteQueue_thread( void *param )
+{
+	writeRequest_t *batch[ WRITEQUEUE_BATCH ];
+	W32 count, bytes, failures;
+	W32 i;
+
+	(void)param;
+
+	Mutex_Lock( queue_lock );
+
+	for( ; ; )
+	{
+		while( queue_head == NULL && ! queue_quit )
+		{
+			Cond_Wait( queue_work, queue_lock );
+		}
+
+		if( queue_head == NULL )
+		{
+			break;
+		}
+
+		/* a path written twice stays in order by ending the batch */
+		count = 0;
+		while( queue_head && count < WRITEQUEUE_BATCH && ! WriteQueue_inBatch( batch, count, queue_head->path ) )
+		{
+			batch[ count++ ] = queue_head;
+			queue_head = queue_head->next;
+		}
+
+		if( queue_head == NULL )
+		{
+			queue_tail = NULL;
+		}
+
+		Mutex_Unlock( queue_lock );
+
+		failures = WriteQueue_SysWrite( batch, count );
+
+		bytes = 0;
+		for( i = 0 ; i < count ; ++i )
+		{
+			bytes += batch[ i ]->length;
+			WriteQueue_freeRequest( batch[ i ] );
+		}
+
+		Mutex_Lock( queue_lock );
+
+		queue_bytes -= bytes;
+		queue_count -= count;
+		queue_failures += failures;
+
+		Cond_Broadcast( queue_done );
+	}
+
+	Mutex_Unlock( queue_lock );
+}
+
+/**
+ * \brief Start the I/O thread.
+ * \return On success true, otherwise false and files are written on the calling thread.
+ */
+PUBLIC wtBoolean WriteQueue_Init( void )
+{
+	if( queue_running )
+	{
+		return true;
+	}
+
+	WriteQueue_SysInit();
+
+	queue_lock = Mutex_New();
+	queue_work = Cond_New();
+	queue_done = Cond_New();
+	if( NULL == queue_lock || NULL == queue_work || NULL == queue_done )
+	{
+		fprintf( stderr, "[WriteQueue_Init]: Unable to create synchronization objects\n" );
+
+		WriteQueue_Shutdown();
+
+		return false;
+	}
+
+	queue_head = queue_tail = NULL;
+	queue_bytes = queue_count = queue_failures = 0;
+	queue_quit = false;
+
+	queue_thread = Thread_Create( WriteQueue_thread, NULL );
+	if( NULL == queue_thread )
+	{
+		fprintf( stderr, "[WriteQueue_Init]: Unable to create I/O thread\n" );
+
+		WriteQueue_Shutdown();
+
+		return false;
+	}
+
+	queue_running = true;
+
+	return true;
+}
+
+/**
+ * \brief Write every queued file and stop the I/O thread.
+ * \return true if every file queued since the last flush was written, otherwise false.
+ */
+PUBLIC wtBoolean WriteQueue_Shutdown( void )
+{
+	wtBoolean result = true;
+
+	if( queue_running )
+	{
+		result = WriteQueue_Flush();
+
+		Mutex_Lock( queue_lock );
+		queue_quit = true;
+		Cond_Signal( queue_work );
+		Mutex_Unlock( queue_lock );
+
+		Thread_Join( queue_thread );
+		queue_thread = NULL;
+
+		queue_running = false;
+	}
+
+	if( queue_lock )
+	{
+		Mutex_Free( queue_lock );
+		queue_lock = NULL;
+	}
+
+	if( queue_work )
+	{
+		Cond_Free( queue_work );
+		queue_work = NULL;
+	}
+
+	if( queue_done )
+	{
+		Cond_Free( queue_done );
+		queue_done = NULL;
+	}
+
+	WriteQueue_SysShutdown();
+
+	return result;
+}
+
+/**
+ * \brief Queue a file to be written.
+ * \param[in] path Name of file to save as.
+ * \param[in] data File data, allocated with MM_MALLOC. The queue takes
+ *		ownership and frees it once written, even on failure.
+ * \param[in] length Length of data in bytes.
+ * \return true if the file was queued or written, otherwise false.
+ * \note Blocks while the queue is full. A write that fails on the I/O
+ *		thread is reported by WriteQueue_Flush.
+ */
+PUBLIC wtBoolean WriteQueue_Add( const char *path, void *data, W32 length )
+{
+	writeRequest_t *request;
+	W32 pathLength = (W32)strlen( path ) + 1;
+	W32 failures;
+
+	request = (writeRequest_t *) MM_MALLOC( sizeof( writeRequest_t ) + pathLength );
+	if( NULL == request )
+	{
+		MM_FREE( data );
+
+		return false;
+	}
+
+	MM_MEMCPY( request + 1, path, pathLength );
+
+	request->next = NULL;
+	request->path = (const char *)(request + 1);
+	request->data = (PW8)data;
+	request->length = length;
+
+	if( ! queue_running )
+	{
+		failures = WriteQueue_SysWrite( &request, 1 );
+		WriteQueue_freeRequest( request );
+
+		return (failures == 0);
+	}
+
+	Mutex_Lock( queue_lock );
+
+	while( queue_bytes && queue_bytes + length > WRITEQUEUE_MAX_BYTES )
+	{
+		Cond_Wait( queue_done, queue_lock );
+	}
+
+	if( queue_tail )
+	{
+		queue_tail->next = request;
+	}
+	else
+	{
+		queue_head = request;
+	}
+	queue_tail = request;
+
+	queue_bytes += length;
+	queue_count++;
+
+	Cond_Signal( queue_work );
+
+	Mutex_Unlock( queue_lock );
+
+	return true;
+}
+
+/**
+ * \brief Queue a copy of a file to be written.
+ * \param[in] path Name of file to save as.
+ * \param[in] data File data, the caller keeps ownership.
+ * \param[in] length Length of data in bytes.
+ * \return true if the file was queued or written, otherwise false.
+ */
+PUBLIC wtBoolean WriteQueue_Copy( const char *path, const void *data, W32 length )
+{
+	void *copy;
+
+	copy = MM_MALLOC( length ? length : 1 );
+	if( NULL == copy )
+	{
+		return false;
+	}
+
+	MM_MEMCPY( copy, data, length );
+
+	return WriteQueue_Add( path, copy, length );
+}
+
+/**
+ * \brief Queue the contents of a memory buffer to be written.
+ * \param[in] path Name of file to save as.
+ * \param[in,out] buffer File data. The queue takes the data, leaving the buffer empty.
+ * \return true if the file was queued or written, otherwise false.
+ */
+PUBLIC wtBoolean WriteQueue_AddBuffer( const char *path, memBuffer_t *buffer )
+{
+	W8 *data = buffer->data;
+	W32 length = buffer->length;
+
+	MemBuffer_Init( buffer );
+
+	return WriteQueue_Add( path, data, length );
+}
+
+/**
+ * \brief Wait until every queued file has been written.
+ * \return true if every file queued since the last flush was written, otherwise false.
+ * \note Call before reading back any file that may still be queued.
+ */
+PUBLIC wtBoolean WriteQueue_Flush( void )
+{
+	W32 failures;
+
+	if( ! queue_running )
+	{
+		return true;
+	}
+
+	Mutex_Lock( queue_lock );
+
+	while( queue_count )
+	{
+		Cond_Wait( queue_done, queue_lock );
+	}
+
+	failures = queue_failures;
+	queue_failures = 0;
+
+	Mutex_Unlock( queue_lock );
+
+	if( failures )
+	{
+		fprintf( stderr, "[WriteQueue_Flush]: Unable to write %d files\n", failures );
+
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,68 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file writequeue.h
+ * \brief Write-behind queue for output files.
+ * \date 2013
+ * \note This module is implemented by writequeue.c and the platform
+ *		backends in unix/writequeue_unix.c and win/writequeue_win.c
+ */
+
+#ifndef __WRITEQUEUE_H__
+#define __WRITEQUEUE_H__
+
+#include "../common/platform.h"
+#include "../memory/membuf.h"
+
+
+/* Most bytes waiting to be written before WriteQueue_Add blocks */
+#define WRITEQUEUE_MAX_BYTES	(32 * 1024 * 1024)
+
+/* Most files handed to the platform backend at once */
+#define WRITEQUEUE_BATCH		32
+
+
+typedef struct writeRequest_s
+{
+	struct writeRequest_s	*next;
+	const char				*path;
+	W8						*data;
+	W32						length;
+
+} writeRequest_t;
+
+
+wtBoolean WriteQueue_Init( void );
+wtBoolean WriteQueue_Shutdown( void );
+
+wtBoolean WriteQueue_Add( const char *path, void *data, W32 length );
+wtBoolean WriteQueue_Copy( const char *path, const void *data, W32 length );
+wtBoolean WriteQueue_AddBuffer( const char *path, memBuffer_t *buffer );
+wtBoolean WriteQueue_Flush( void );
+
+
+/* Platform backend */
+void WriteQueue_SysInit( void );
+void WriteQueue_SysShutdown( void );
+W32 WriteQueue_SysWrite( writeRequest_t **requests, W32 count );
+
+
+#endif /* __WRITEQUEUE_H__ */
@@ -0,0 +1,837 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file dxt.c
+ * \brief BC1 and BC3 (DXT1 and DXT5) texture block compression.
+ * \date 2013
+ * \note Colour endpoints start from the texels furthest apart along the
+ *		principal axis of the block and are refined once by least squares.
+ *		Every texel is then matched to its nearest palette entry, with SSE2
+ *		matching a row of four colours or a whole block of alphas at once.
+ */
+
+#include <string.h>
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "dxt.h"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+
+	#include <emmintrin.h>
+
+	#define DXT_SSE2	1
+
+#endif
+
+
+/* BC1A texels with alpha below this are transparent */
+#define DXT_ALPHA_THRESHOLD		128
+
+
+/**
+ * \brief Choose the block compression format for an image.
+ * \param[in] data Raw image data.
+ * \param[in] numPixels Number of pixels in image.
+ * \param[in] bpp Bytes per pixel, 3 or 4.
+ * \return DXT_FORMAT_BC1 for opaque images, DXT_FORMAT_BC1A when alpha is
+ *		only ever 0 or 255, otherwise DXT_FORMAT_BC3.
+ * \note Formats are ordered, so the format for several images (a mip
+ *		chain say) is the largest of their formats.
+ */
+PUBLIC W32 DXT_chooseFormat( const W8 *data, W32 numPixels, W32 bpp )
+{
+	W32 format = DXT_FORMAT_BC1;
+	W32 i;
+
+	if( bpp != 4 )
+	{
+		return DXT_FORMAT_BC1;
+	}
+
+	for( i = 0 ; i < numPixels ; ++i, data += 4 )
+	{
+		if( data[ 3 ] == 0 )
+		{
+			format = DXT_FORMAT_BC1A;
+		}
+		else if( data[ 3 ] != 255 )
+		{
+			return DXT_FORMAT_BC3;
+		}
+	}
+
+	return format;
+}
+
+/**
+ * \brief Get the size of a compressed block.
+ * \param[in] format Block compression format (DXT_FORMAT_*).
+ * \return Size in bytes of one 4x4 block.
+ */
+PUBLIC W32 DXT_blockSize( W32 format )
+{
+	return (format == DXT_FORMAT_BC3) ? 16 : 8;
+}
+
+/**
+ * \brief Get the size of a compressed image.
+ * \param[in] format Block compression format (DXT_FORMAT_*).
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \return Size in bytes of the compressed image.
+ */
+PUBLIC W32 DXT_imageSize( W32 format, W32 width, W32 height )
+{
+	return ((width + 3) >> 2) * ((height + 3) >> 2) * DXT_blockSize( format );
+}
+
+/**
+ * \brief Quantize an RGB colour to 5:6:5.
+ */
+PRIVATE INLINECALL W16 DXT_pack565( const W8 *c )
+{
+	return (W16)( (((c[ 0 ] * 31 + 127) / 255) << 11) |
+				  (((c[ 1 ] * 63 + 127) / 255) << 5) |
+				   ((c[ 2 ] * 31 + 127) / 255) );
+}
+
+/**
+ * \brief Expand a 5:6:5 colour to RGB, with alpha cleared.
+ */
+PRIVATE INLINECALL void DXT_unpack565( W16 c, W8 *dest )
+{
+	W32 r = c >> 11;
+	W32 g = (c >> 5) & 0x3F;
+	W32 b = c & 0x1F;
+
+	dest[ 0 ] = (W8)((r << 3) | (r >> 2));
+	dest[ 1 ] = (W8)((g << 2) | (g >> 4));
+	dest[ 2 ] = (W8)((b << 3) | (b >> 2));
+	dest[ 3 ] = 0;
+}
+
+/**
+ * \brief Build the colour palette a decoder derives from two endpoints.
+ * \param[in] c0 First endpoint.
+ * \param[in] c1 Second endpoint.
+ * \param[out] palette Four RGB colours.
+ * \return Nothing.
+ * \note With c0 <= c1 the fourth entry is transparent, it is set to the
+ *		third so that it is never a strictly nearer match.
+ */
+PRIVATE void DXT_colorPalette( W16 c0, W16 c1, W8 palette[ 4 ][ 4 ] )
+{
+	W32 i;
+
+	DXT_unpack565( c0, palette[ 0 ] );
+	DXT_unpack565( c1, palette[ 1 ] );
+
+	for( i = 0 ; i < 4 ; ++i )
+	{
+		if( c0 > c1 )
+		{
+			palette[ 2 ][ i ] = (W8)((palette[ 0 ][ i ] * 2 + palette[ 1 ][ i ]) / 3);
+			palette[ 3 ][ i ] = (W8)((palette[ 0 ][ i ] + palette[ 1 ][ i ] * 2) / 3);
+		}
+		else
+		{
+			palette[ 2 ][ i ] = (W8)((palette[ 0 ][ i ] + palette[ 1 ][ i ]) / 2);
+			palette[ 3 ][ i ] = palette[ 2 ][ i ];
+		}
+	}
+}
+
+#ifdef DXT_SSE2
+
+/**
+ * \brief Squared RGB distance of four texels from a colour.
+ * \param[in] lo First two texels, 16 bits per channel, alpha cleared.
+ * \param[in] hi Last two texels, 16 bits per channel, alpha cleared.
+ * \param[in] color Colour, 16 bits per channel, alpha cleared, twice.
+ * \return Four distances.
+ */
+PRIVATE INLINECALL __m128i DXT_distance4( __m128i lo, __m128i hi, __m128i color )
+{
+	lo = _mm_sub_epi16( lo, color );
+	hi = _mm_sub_epi16( hi, color );
+
+	/* r*r + g*g and b*b for each texel */
+	lo = _mm_madd_epi16( lo, lo );
+	hi = _mm_madd_epi16( hi, hi );
+
+	lo = _mm_add_epi32( lo, _mm_shuffle_epi32( lo, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	hi = _mm_add_epi32( hi, _mm_shuffle_epi32( hi, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+
+	return _mm_castps_si128( _mm_shuffle_ps( _mm_castsi128_ps( lo ), _mm_castsi128_ps( hi ), _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+}
+
+#endif
+
+/**
+ * \brief Match every texel of a block to its nearest palette colour.
+ * \param[in] block 16 RGBA texels.
+ * \param[in] mask Per texel, ~0 if its error counts, otherwise 0.
+ * \param[in] palette Four RGB colours, see DXT_colorPalette.
+ * \param[out] indices Two bits per texel, first texel lowest.
+ * \return Sum of squared errors over the masked texels.
+ * \note Ties go to the lowest index.
+ */
+PRIVATE W32 DXT_matchColors( const W8 *block, const W32 *mask, W8 palette[ 4 ][ 4 ], W32 *indices )
+{
+	W32 match[ 16 ];
+	W32 error = 0;
+	W32 bits = 0;
+	W32 i;
+
+#ifdef DXT_SSE2
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgbMask = _mm_set1_epi32( 0x00FFFFFF );
+	__m128i colors[ 4 ];
+	__m128i sum = zero;
+	__m128i pixels, lo, hi, best, index, d, less;
+	W32 errors[ 4 ];
+	W32 k;
+
+	for( k = 0 ; k < 4 ; ++k )
+	{
+		colors[ k ] = _mm_unpacklo_epi8( _mm_set1_epi32( palette[ k ][ 0 ] | (palette[ k ][ 1 ] << 8) | (palette[ k ][ 2 ] << 16) ), zero );
+	}
+
+	for( i = 0 ; i < 16 ; i += 4 )
+	{
+		pixels = _mm_and_si128( _mm_loadu_si128( (const __m128i *)(block + i * 4) ), rgbMask );
+		lo = _mm_unpacklo_epi8( pixels, zero );
+		hi = _mm_unpackhi_epi8( pixels, zero );
+
+		best = DXT_distance4( lo, hi, colors[ 0 ] );
+		index = zero;
+
+		for( k = 1 ; k < 4 ; ++k )
+		{
+			d = DXT_distance4( lo, hi, colors[ k ] );
+			less = _mm_cmplt_epi32( d, best );
+
+			best = _mm_or_si128( _mm_and_si128( less, d ), _mm_andnot_si128( less, best ) );
+			index = _mm_or_si128( _mm_and_si128( less, _mm_set1_epi32( k ) ), _mm_andnot_si128( less, index ) );
+		}
+
+		_mm_storeu_si128( (__m128i *)(match + i), index );
+		sum = _mm_add_epi32( sum, _mm_and_si128( best, _mm_loadu_si128( (const __m128i *)(mask + i) ) ) );
+	}
+
+	_mm_storeu_si128( (__m128i *)errors, sum );
+	error = errors[ 0 ] + errors[ 1 ] + errors[ 2 ] + errors[ 3 ];
+
+#else
+
+	const W8 *p;
+	W32 best, d, k;
+	int dr, dg, db;
+
+	for( i = 0 ; i < 16 ; ++i )
+	{
+		p = block + i * 4;
+
+		for( k = 0 ; k < 4 ; ++k )
+		{
+			dr = p[ 0 ] - palette[ k ][ 0 ];
+			dg = p[ 1 ] - palette[ k ][ 1 ];
+			db = p[ 2 ] - palette[ k ][ 2 ];
+			d = (W32)(dr * dr + dg * dg + db * db);
+
+			if( k == 0 || d < best )
+			{
+				best = d;
+				match[ i ] = k;
+			}
+		}
+
+		error += best & mask[ i ];
+	}
+
+#endif
+
+	for( i = 0 ; i < 16 ; ++i )
+	{
+		bits |= match[ i ] << (i * 2);
+	}
+
+	*indices = bits;
+
+	return error;
+}
+
+/**
+ * \brief Pick colour endpoints along the principal axis of a block.
+ * \param[in] block 16 RGBA texels.
+ * \param[in] mask Per texel, ~0 if it takes part, otherwise 0. At least one must.
+ * \param[out] c0 Endpoint at the top of the axis.
+ * \param[out] c1 Endpoint at the bottom of the axis.
+ * \return Nothing.
+ */
+PRIVATE void DXT_colorEndpoints( const W8 *block, const W32 *mask, W16 *c0, W16 *c1 )
+{
+	float mean[ 3 ] = { 0.0f, 0.0f, 0.0f };
+	float cov[ 6 ] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	float axis[ 3 ], v[ 3 ], r, g, b, scale, dot, dotMin, dotMax;
+	W32 count = 0;
+	W32 iMin = 0, iMax = 0;
+	W32 i, iter;
+	const W8 *p;
+
+	for( i = 0 ; i < 16 ; ++i )
+	{
+		if( mask[ i ] )
+		{
+			mean[ 0 ] += block[ i * 4 + 0 ];
+			mean[ 1 ] += block[ i * 4 + 1 ];
+			mean[ 2 ] += block[ i * 4 + 2 ];
+			++count;
+		}
+	}
+
+	for( i = 0 ; i < 3 ; ++i )
+	{
+		mean[ i ] /= (float)count;
+	}
+
+	for( i = 0 ; i < 16 ; ++i )
+	{
+		if( mask[ i ] )
+		{
+			r = block[ i * 4 + 0 ] - mean[ 0 ];
+			g = block[ i * 4 + 1 ] - mean[ 1 ];
+			b = block[ i * 4 + 2 ] - mean[ 2 ];
+
+			cov[ 0 ] += r * r;
+			cov[ 1 ] += r * g;
+			cov[ 2 ] += r * b;
+			cov[ 3 ] += g * g;
+			cov[ 4 ] += g * b;
+			cov[ 5 ] += b * b;
+		}
+	}
+
+	/* power iteration, starting from the row of the channel that varies most */
+	if( cov[ 0 ] >= cov[ 3 ] && cov[ 0 ] >= cov[ 5 ] )
+	{
+		axis[ 0 ] = cov[ 0 ]; axis[ 1 ] = cov[ 1 ]; axis[ 2 ] = cov[ 2 ];
+	}
+	else if( cov[ 3 ] >= cov[ 5 ] )
+	{
+		axis[ 0 ] = cov[ 1 ]; axis[ 1 ] = cov[ 3 ]; axis[ 2 ] = cov[ 4 ];
+	}
+	else
+	{
+		axis[ 0 ] = cov[ 2 ]; axis[ 1 ] = cov[ 4 ]; axis[ 2 ] = cov[ 5 ];
+	}
+
+	for( iter = 0 ; iter < 4 ; ++iter )
+	{
+		v[ 0 ] = cov[ 0 ] * axis[ 0 ] + cov[ 1 ] * axis[ 1 ] + cov[ 2 ] * axis[ 2 ];
+		v[ 1 ] = cov[ 1 ] * axis[ 0 ] + cov[ 3 ] * axis[ 1 ] + cov[ 4 ] * axis[ 2 ];
+		v[ 2 ] = cov[ 2 ] * axis[ 0 ] + cov[ 4 ] * axis[ 1 ] + cov[ 5 ] * axis[ 2 ];
+
+		scale = v[ 0 ] < 0 ? -v[ 0 ] : v[ 0 ];
+		for( i = 1 ; i < 3 ; ++i )
+		{
+			if( (v[ i ] < 0 ? -v[ i ] : v[ i ]) > scale )
+			{
+				scale = v[ i ] < 0 ? -v[ i ] : v[ i ];
+			}
+		}
+
+		if( scale < 1e-4f )
+		{
+			break;
+		}
+
+		for( i = 0 ; i < 3 ; ++i )
+		{
+			axis[ i ] = v[ i ] / scale;
+		}
+	}
+
+	/* flat block, fall back to luminance */
+	if( iter == 0 )
+	{
+		axis[ 0 ] = 0.299f;
+		axis[ 1 ] = 0.587f;
+		axis[ 2 ] = 0.114f;
+	}
+
+	dotMin = dotMax = 0.0f;
+	count = 0;
+	for( i = 0 ; i < 16 ; ++i )
+	{
+		if( ! mask[ i ] )
+		{
+			continue;
+		}
+
+		p = block + i * 4;
+		dot = p[ 0 ] * axis[ 0 ] + p[ 1 ] * axis[ 1 ] + p[ 2 ] * axis[ 2 ];
+
+		if( count++ == 0 || dot < dotMin )
+		{
+			dotMin = dot;
+			iMin = i;
+		}
+
+		if( count == 1 || dot > dotMax )
+		{
+			dotMax = dot;
+			iMax = i;
+		}
+	}
+
+	*c0 = DXT_pack565( block + iMax * 4 );
+	*c1 = DXT_pack565( block + iMin * 4 );
+}
+
+/**
+ * \brief Refine four colour endpoints by least squares.
+ * \param[in] block 16 RGBA texels.
+ * \param[in] mask Per texel, ~0 if it takes part, otherwise 0.
+ * \param[in] indices Current palette indices, see DXT_matchColors.
+ * \param[out] c0 Refined first endpoint.
+ * \param[out] c1 Refined second endpoint.
+ * \return true if the endpoints could be solved for, otherwise false.
+ * \note Solves for the two endpoints that best reproduce the block with
+ *		the indices held fixed.
+ */
+PRIVATE wtBoolean DXT_refineColors( const W8 *block, const W32 *mask, W32 indices, W16 *c0, W16 *c1 )
+{
+	/* weight of c0 in each palette entry, in thirds */
+	static const int weights[ 4 ] = { 3, 0, 2, 1 };
+	int aa = 0, bb = 0, ab = 0;
+	int ax[ 3 ] = { 0, 0, 0 };
+	int bx[ 3 ] = { 0, 0, 0 };
+	int a, b, det;
+	W8 e0[ 3 ], e1[ 3 ];
+	float v;
+	W32 i, j;
+
+	for( i = 0 ; i < 16 ; ++i )
+	{
+		if( ! mask[ i ] )
+		{
+			continue;
+		}
+
+		a = weights[ (indices >> (i * 2)) & 3 ];
+		b = 3 - a;
+
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+
+		for( j = 0 ; j < 3 ; ++j )
+		{
+			ax[ j ] += a * block[ i * 4 + j ];
+			bx[ j ] += b * block[ i * 4 + j ];
+		}
+	}
+
+	det = aa * bb - ab * ab;
+	if( det == 0 )
+	{
+		return false;
+	}
+
+	for( j = 0 ; j < 3 ; ++j )
+	{
+		v = 3.0f * (float)(ax[ j ] * bb - bx[ j ] * ab) / (float)det;
+		e0[ j ] = (W8)(v < 0.0f ? 0 : v > 255.0f ? 255 : (int)(v + 0.5f));
+
+		v = 3.0f * (float)(bx[ j ] * aa - ax[ j ] * ab) / (float)det;
+		e1[ j ] = (W8)(v < 0.0f ? 0 : v > 255.0f ? 255 : (int)(v + 0.5f));
+	}
+
+	*c0 = DXT_pack565( e0 );
+	*c1 = DXT_pack565( e1 );
+
+	return true;
+}
+
+/**
+ * \brief Store a colour block.
+ */
+PRIVATE void DXT_putColors( W16 c0, W16 c1, W32 indices, W8 *dest )
+{
+	dest[ 0 ] = (W8)(c0);
+	dest[ 1 ] = (W8)(c0 >> 8);
+	dest[ 2 ] = (W8)(c1);
+	dest[ 3 ] = (W8)(c1 >> 8);
+	dest[ 4 ] = (W8)(indices);
+	dest[ 5 ] = (W8)(indices >> 8);
+	dest[ 6 ] = (W8)(indices >> 16);
+	dest[ 7 ] = (W8)(indices >> 24);
+}
+
+/**
+ * \brief Encode the colours of a block.
+ * \param[in] block 16 RGBA texels.
+ * \param[in] mask Per texel, ~0 if its colour matters, otherwise 0.
+ * \param[in] transparent true to encode unmasked texels as transparent, in
+ *		three colour mode.
+ * \param[out] dest 8 byte colour block.
+ * \return Nothing.
+ */
+PRIVATE void DXT_encodeColors( const W8 *block, const W32 *mask, wtBoolean transparent, W8 *dest )
+{
+	W8 palette[ 4 ][ 4 ];
+	W16 c0, c1, r0, r1, t;
+	W32 indices, refined;
+	W32 error;
+	W32 i;
+
+	for( i = 0 ; i < 16 && ! mask[ i ] ; ++i )
+	{
+		;
+	}
+
+	if( i == 16 )
+	{
+		DXT_putColors( 0, 0, transparent ? 0xFFFFFFFF : 0, dest );
+
+		return;
+	}
+
+	DXT_colorEndpoints( block, mask, &c0, &c1 );
+
+	if( transparent )
+	{
+		/* three colour mode needs c0 <= c1 */
+		if( c0 > c1 )
+		{
+			t = c0; c0 = c1; c1 = t;
+		}
+
+		DXT_colorPalette( c0, c1, palette );
+		DXT_matchColors( block, mask, palette, &indices );
+
+		for( i = 0 ; i < 16 ; ++i )
+		{
+			if( ! mask[ i ] )
+			{
+				indices |= 3 << (i * 2);
+			}
+		}
+
+		DXT_putColors( c0, c1, indices, dest );
+
+		return;
+	}
+
+	/* four colour mode needs c0 > c1 */
+	if( c0 < c1 )
+	{
+		t = c0; c0 = c1; c1 = t;
+	}
+
+	if( c0 == c1 )
+	{
+		DXT_putColors( c0, c1, 0, dest );
+
+		return;
+	}
+
+	DXT_colorPalette( c0, c1, palette );
+	error = DXT_matchColors( block, mask, palette, &indices );
+
+	if( DXT_refineColors( block, mask, indices, &r0, &r1 ) )
+	{
+		if( r0 < r1 )
+		{
+			t = r0; r0 = r1; r1 = t;
+		}
+
+		if( r0 != r1 && (r0 != c0 || r1 != c1) )
+		{
+			DXT_colorPalette( r0, r1, palette );
+			if( DXT_matchColors( block, mask, palette, &refined ) < error )
+			{
+				c0 = r0;
+				c1 = r1;
+				indices = refined;
+			}
+		}
+	}
+
+	DXT_putColors( c0, c1, indices, dest );
+}
+
+/**
+ * \brief Match every alpha of a block to its nearest palette alpha.
+ * \param[in] alpha 16 alpha values.
+ * \param[in] palette Eight alpha values.
+ * \param[out] match Palette index for each alpha.
+ * \return Sum of absolute errors.
+ * \note Ties go to the lowest index.
+ */
+PRIVATE W32 DXT_matchAlpha( const W8 *alpha, const W8 *palette, W8 *match )
+{
+#ifdef DXT_SSE2
+
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = _mm_loadu_si128( (const __m128i *)alpha );
+	__m128i p, d, best, index, keep;
+	W32 k;
+
+	p = _mm_set1_epi8( (char)palette[ 0 ] );
+	best = _mm_or_si128( _mm_subs_epu8( a, p ), _mm_subs_epu8( p, a ) );
+	index = zero;
+
+	for( k = 1 ; k < 8 ; ++k )
+	{
+		p = _mm_set1_epi8( (char)palette[ k ] );
+		d = _mm_or_si128( _mm_subs_epu8( a, p ), _mm_subs_epu8( p, a ) );
+
+		/* keep the current index wherever best <= d */
+		keep = _mm_cmpeq_epi8( _mm_subs_epu8( best, d ), zero );
+
+		best = _mm_min_epu8( best, d );
+		index = _mm_or_si128( _mm_and_si128( keep, index ), _mm_andnot_si128( keep, _mm_set1_epi8( (char)k ) ) );
+	}
+
+	_mm_storeu_si128( (__m128i *)match, index );
+
+	best = _mm_sad_epu8( best, zero );
+
+	return (W32)(_mm_cvtsi128_si32( best ) + _mm_cvtsi128_si32( _mm_srli_si128( best, 8 ) ));
+
+#else
+
+	W32 error = 0;
+	W32 best, d, i, k;
+
+	for( i = 0 ; i < 16 ; ++i )
+	{
+		for( k = 0 ; k < 8 ; ++k )
+		{
+			d = alpha[ i ] > palette[ k ] ? alpha[ i ] - palette[ k ] : palette[ k ] - alpha[ i ];
+
+			if( k == 0 || d < best )
+			{
+				best = d;
+				match[ i ] = (W8)k;
+			}
+		}
+
+		error += best;
+	}
+
+	return error;
+
+#endif
+}
+
+/**
+ * \brief Store an alpha block.
+ */
+PRIVATE void DXT_putAlpha( W8 a0, W8 a1, const W8 *match, W8 *dest )
+{
+	W32 bits;
+	W32 i, j;
+
+	dest[ 0 ] = a0;
+	dest[ 1 ] = a1;
+
+	/* two groups of eight three bit indices */
+	for( i = 0 ; i < 2 ; ++i )
+	{
+		bits = 0;
+		for( j = 0 ; j < 8 ; ++j )
+		{
+			bits |= (W32)match[ i * 8 + j ] << (j * 3);
+		}
+
+		dest[ 2 + i * 3 ] = (W8)(bits);
+		dest[ 3 + i * 3 ] = (W8)(bits >> 8);
+		dest[ 4 + i * 3 ] = (W8)(bits >> 16);
+	}
+}
+
+/**
+ * \brief Encode the alpha of a block.
+ * \param[in] block 16 RGBA texels.
+ * \param[out] dest 8 byte alpha block.
+ * \return Nothing.
+ * \note Tries both the eight alpha ramp over the whole range and the six
+ *		alpha ramp over the values between 0 and 255 (which are then exact),
+ *		and keeps the closer one.
+ */
+PRIVATE void DXT_encodeAlpha( const W8 *block, W8 *dest )
+{
+	W8 alpha[ 16 ];
+	W8 palette[ 8 ];
+	W8 match8[ 16 ], match6[ 16 ];
+	W8 aMin = 255, aMax = 0;
+	W8 lo = 255, hi = 0;
+	W32 error8, error6;
+	W32 i;
+
+	for( i = 0 ; i < 16 ; ++i )
+	{
+		alpha[ i ] = block[ i * 4 + 3 ];
+
+		if( alpha[ i ] < aMin ) aMin = alpha[ i ];
+		if( alpha[ i ] > aMax ) aMax = alpha[ i ];
+
+		if( alpha[ i ] != 0 && alpha[ i ] != 255 )
+		{
+			if( alpha[ i ] < lo ) lo = alpha[ i ];
+			if( alpha[ i ] > hi ) hi = alpha[ i ];
+		}
+	}
+
+	if( aMin == aMax )
+	{
+		memset( match8, 0, sizeof( match8 ) );
+		DXT_putAlpha( aMax, aMax, match8, dest );
+
+		return;
+	}
+
+	/* eight alpha mode, a0 > a1 */
+	palette[ 0 ] = aMax;
+	palette[ 1 ] = aMin;
+	for( i = 1 ; i < 7 ; ++i )
+	{
+		palette[ i + 1 ] = (W8)(((7 - i) * aMax + i * aMin) / 7);
+	}
+
+	error8 = DXT_matchAlpha( alpha, palette, match8 );
+
+	/* six alpha mode, a0 <= a1, with 0 and 255 */
+	if( lo > hi )
+	{
+		lo = hi = 0;
+	}
+
+	palette[ 0 ] = lo;
+	palette[ 1 ] = hi;
+	for( i = 1 ; i < 5 ; ++i )
+	{
+		palette[ i + 1 ] = (W8)(((5 - i) * lo + i * hi) / 5);
+	}
+	palette[ 6 ] = 0;
+	palette[ 7 ] = 255;
+
+	error6 = DXT_matchAlpha( alpha, palette, match6 );
+
+	if( error6 < error8 )
+	{
+		DXT_putAlpha( lo, hi, match6, dest );
+	}
+	else
+	{
+		DXT_putAlpha( aMax, aMin, match8, dest );
+	}
+}
+
+/**
+ * \brief Fetch a 4x4 block of texels as RGBA.
+ * \note Texels past the right or bottom edge repeat the edge.
+ */
+PRIVATE void DXT_loadBlock( const W8 *src, W32 width, W32 height, W32 bpp, W32 x, W32 y, W8 *block )
+{
+	const W8 *p;
+	W32 sx, sy;
+	W32 i, j;
+
+	for( j = 0 ; j < 4 ; ++j )
+	{
+		sy = (y + j < height) ? y + j : height - 1;
+
+		for( i = 0 ; i < 4 ; ++i, block += 4 )
+		{
+			sx = (x + i < width) ? x + i : width - 1;
+			p = src + (sy * width + sx) * bpp;
+
+			block[ 0 ] = p[ 0 ];
+			block[ 1 ] = p[ 1 ];
+			block[ 2 ] = p[ 2 ];
+			block[ 3 ] = (bpp == 4) ? p[ 3 ] : 255;
+		}
+	}
+}
+
+/**
+ * \brief Block compress an image.
+ * \param[in] format Block compression format (DXT_FORMAT_*).
+ * \param[in] src Raw image data, RGB or RGBA.
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \param[in] bpp Bytes per pixel, 3 or 4.
+ * \param[out] dest Compressed blocks in row order, DXT_imageSize bytes.
+ * \return Nothing.
+ */
+PUBLIC void DXT_compressImage( W32 format, const W8 *src, W32 width, W32 height, W32 bpp, W8 *dest )
+{
+	W8 block[ 64 ];
+	W32 mask[ 16 ];
+	wtBoolean transparent;
+	W32 x, y, i;
+
+	for( y = 0 ; y < height ; y += 4 )
+	{
+		for( x = 0 ; x < width ; x += 4 )
+		{
+			DXT_loadBlock( src, width, height, bpp, x, y, block );
+
+			if( format == DXT_FORMAT_BC3 )
+			{
+				/* the colour of fully transparent texels does not matter */
+				for( i = 0 ; i < 16 ; ++i )
+				{
+					mask[ i ] = block[ i * 4 + 3 ] ? ~0U : 0;
+				}
+
+				DXT_encodeAlpha( block, dest );
+				DXT_encodeColors( block, mask, false, dest + 8 );
+
+				dest += 16;
+
+				continue;
+			}
+
+			transparent = false;
+			for( i = 0 ; i < 16 ; ++i )
+			{
+				mask[ i ] = ~0U;
+
+				if( format == DXT_FORMAT_BC1A && block[ i * 4 + 3 ] < DXT_ALPHA_THRESHOLD )
+				{
+					mask[ i ] = 0;
+					transparent = true;
+				}
+			}
+
+			DXT_encodeColors( block, mask, transparent, dest );
+
+			dest += 8;
+		}
+	}
+}
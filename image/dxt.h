@@ -0,0 +1,49 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file dxt.h
+ * \brief BC1 and BC3 (DXT1 and DXT5) texture block compression.
+ * \date 2013
+ * \note This module is implemented by dxt.c
+ */
+
+#ifndef __DXT_H__
+#define __DXT_H__
+
+#include "../common/platform.h"
+
+
+/* Block compression formats, in order of increasing alpha support */
+#define DXT_FORMAT_BC1		0	/* DXT1, opaque */
+#define DXT_FORMAT_BC1A		1	/* DXT1, one bit alpha */
+#define DXT_FORMAT_BC3		2	/* DXT5, interpolated alpha */
+
+
+W32 DXT_chooseFormat( const W8 *data, W32 numPixels, W32 bpp );
+
+W32 DXT_blockSize( W32 format );
+
+W32 DXT_imageSize( W32 format, W32 width, W32 height );
+
+void DXT_compressImage( W32 format, const W8 *src, W32 width, W32 height, W32 bpp, W8 *dest );
+
+
+#endif /* __DXT_H__ */
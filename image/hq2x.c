@@ -32,7 +32,6 @@
 
 static int   LUT16to24[65536];
 static int   RGBtoYUV[65536];
-static int   YUV1, YUV2;
 const  int   Ymask = 0x00FF0000;
 const  int   Umask = 0x0000FF00;
 const  int   Vmask = 0x000000FF;
@@ -40,22 +39,22 @@ const  int   trY   = 0x00300000;
 const  int   trU   = 0x00000700;
 const  int   trV   = 0x00000006;
 
-INLINE void Interp1( unsigned char *pc, int c1, int c2 )
+static INLINE void Interp1( unsigned char *pc, int c1, int c2 )
 {
   *((int*)pc) = (c1*3+c2) >> 2;
 }
 
-INLINE void Interp2(unsigned char *pc, int c1, int c2, int c3)
+static INLINE void Interp2(unsigned char *pc, int c1, int c2, int c3)
 {
   *((int*)pc) = (c1*2+c2+c3) >> 2;
 }
 
-INLINE void Interp5(unsigned char *pc, int c1, int c2)
+static INLINE void Interp5(unsigned char *pc, int c1, int c2)
 {
   *((int*)pc) = (c1+c2) >> 1;
 }
 
-INLINE void Interp6(unsigned char *pc, int c1, int c2, int c3)
+static INLINE void Interp6(unsigned char *pc, int c1, int c2, int c3)
 {
   //*((int*)pc) = (c1*5+c2*2+c3)/8;
 
@@ -63,7 +62,7 @@ INLINE void Interp6(unsigned char *pc, int c1, int c2, int c3)
                  (((c1 & 0xFF00FF)*5 + (c2 & 0xFF00FF)*2 + (c3 & 0xFF00FF) ) & 0x07F807F8)) >> 3;
 }
 
-INLINE void Interp7(unsigned char *pc, int c1, int c2, int c3)
+static INLINE void Interp7(unsigned char *pc, int c1, int c2, int c3)
 {
   //*((int*)pc) = (c1*6+c2+c3)/8;
 
@@ -71,7 +70,7 @@ INLINE void Interp7(unsigned char *pc, int c1, int c2, int c3)
                  (((c1 & 0xFF00FF)*6 + (c2 & 0xFF00FF) + (c3 & 0xFF00FF) ) & 0x07F807F8)) >> 3;
 }
 
-INLINE void Interp9(unsigned char *pc, int c1, int c2, int c3)
+static INLINE void Interp9(unsigned char *pc, int c1, int c2, int c3)
 {
   //*((int*)pc) = (c1*2+(c2+c3)*3)/8;
 
@@ -79,7 +78,7 @@ INLINE void Interp9(unsigned char *pc, int c1, int c2, int c3)
                  (((c1 & 0xFF00FF)*2 + ((c2 & 0xFF00FF) + (c3 & 0xFF00FF))*3 ) & 0x07F807F8)) >> 3;
 }
 
-INLINE void Interp10(unsigned char *pc, int c1, int c2, int c3)
+static INLINE void Interp10(unsigned char *pc, int c1, int c2, int c3)
 {
   //*((int*)pc) = (c1*14+c2+c3)/16;
 
@@ -141,21 +140,20 @@ INLINE void Interp10(unsigned char *pc, int c1, int c2, int c3)
 
 int Diff( unsigned int w1, unsigned int w2 )
 {
-  YUV1 = RGBtoYUV[w1];
-  YUV2 = RGBtoYUV[w2];
+  int YUV1 = RGBtoYUV[w1];
+  int YUV2 = RGBtoYUV[w2];
   return ( ( abs((YUV1 & Ymask) - (YUV2 & Ymask)) > trY ) ||
            ( abs((YUV1 & Umask) - (YUV2 & Umask)) > trU ) ||
            ( abs((YUV1 & Vmask) - (YUV2 & Vmask)) > trV ) );
 }
 
-void hq2x_32( unsigned char *pIn, unsigned char *pOut, int Xres, int Yres, int BpL )
+static INLINE int hq2x_pattern( const unsigned short *prev, const unsigned short *cur, const unsigned short *next,
+                                int i, int Xres, int *w )
 {
-    int	i, j, k;
-    int	prevline, nextline;
-    int	w[10];
-    int	c[10];
+    int	k;
     int	pattern;
     int	flag;
+    int	YUV1, YUV2;
 
     //   +----+----+----+
     //   |    |    |    |
@@ -168,76 +166,62 @@ void hq2x_32( unsigned char *pIn, unsigned char *pOut, int Xres, int Yres, int B
     //   | w7 | w8 | w9 |
     //   +----+----+----+
 
-    for( j = 0; j < Yres; ++j )
-    {
-        if( j > 0 )      
-            prevline = -Xres*2; 
-        else 
-            prevline = 0;
-        
-        if( j < Yres-1 ) 
-            nextline =  Xres*2; 
-        else 
-            nextline = 0;
-
-        for( i = 0; i < Xres; ++i )
-        {
-            w[2] = *((unsigned short*)(pIn + prevline));
-            w[5] = *((unsigned short*)pIn);
-            w[8] = *((unsigned short*)(pIn + nextline));
+    w[2] = prev[ i ];
+    w[5] = cur[ i ];
+    w[8] = next[ i ];
 
-            if( i > 0 )
-            {
-                w[1] = *((unsigned short*)(pIn + prevline - 2));
-                w[4] = *((unsigned short*)(pIn - 2));
-                w[7] = *((unsigned short*)(pIn + nextline - 2));
-            }
-            else
-            {
-                w[1] = w[2];
-                w[4] = w[5];
-                w[7] = w[8];
-            }
+    if( i > 0 )
+    {
+        w[1] = prev[ i - 1 ];
+        w[4] = cur[ i - 1 ];
+        w[7] = next[ i - 1 ];
+    }
+    else
+    {
+        w[1] = w[2];
+        w[4] = w[5];
+        w[7] = w[8];
+    }
 
-            if( i < Xres-1 )
-            {
-                w[3] = *((unsigned short*)(pIn + prevline + 2));
-                w[6] = *((unsigned short*)(pIn + 2));
-                w[9] = *((unsigned short*)(pIn + nextline + 2));
-            }
-            else
-            {
-                w[3] = w[2];
-                w[6] = w[5];
-                w[9] = w[8];
-            }
+    if( i < Xres-1 )
+    {
+        w[3] = prev[ i + 1 ];
+        w[6] = cur[ i + 1 ];
+        w[9] = next[ i + 1 ];
+    }
+    else
+    {
+        w[3] = w[2];
+        w[6] = w[5];
+        w[9] = w[8];
+    }
 
-            pattern = 0;
-            flag = 1;
+    pattern = 0;
+    flag = 1;
 
-            YUV1 = RGBtoYUV[ w[ 5 ] ];
+    YUV1 = RGBtoYUV[ w[ 5 ] ];
 
-            for( k = 1; k <= 9; ++k )
-            {
-                if( k == 5 )
-                    continue;
+    for( k = 1; k <= 9; ++k )
+    {
+        if( k == 5 )
+            continue;
 
-                if ( w[ k ] != w[ 5 ] )
-                {
-                    YUV2 = RGBtoYUV[ w[ k ] ];
-                    if( ( abs((YUV1 & Ymask) - (YUV2 & Ymask)) > trY ) ||
-                        ( abs((YUV1 & Umask) - (YUV2 & Umask)) > trU ) ||
-                        ( abs((YUV1 & Vmask) - (YUV2 & Vmask)) > trV ) )
-                            pattern |= flag;
-                }
-                flag <<= 1;
-            }
+        if ( w[ k ] != w[ 5 ] )
+        {
+            YUV2 = RGBtoYUV[ w[ k ] ];
+            if( ( abs((YUV1 & Ymask) - (YUV2 & Ymask)) > trY ) ||
+                ( abs((YUV1 & Umask) - (YUV2 & Umask)) > trU ) ||
+                ( abs((YUV1 & Vmask) - (YUV2 & Vmask)) > trV ) )
+                    pattern |= flag;
+        }
+        flag <<= 1;
+    }
 
-            for( k = 1; k <= 9; ++k )
-            {
-                c[ k ] = LUT16to24[ w[ k ] ];
-            }
+    return pattern;
+}
 
+static INLINE void hq2x_pixel( int pattern, const int *w, const int *c, unsigned char *pOut, int BpL )
+{
             switch( pattern )
             {
                 case 0:
@@ -2880,11 +2864,128 @@ void hq2x_32( unsigned char *pIn, unsigned char *pOut, int Xres, int Yres, int B
           break;
         }
       }
-      pIn += 2;
-      pOut += 8;
+}
+
+void hq2x_32_line( const unsigned short *prev, const unsigned short *cur, const unsigned short *next,
+                   int Xres, unsigned char *pOut, int BpL )
+{
+    int	i, k;
+    int	w[10];
+    int	c[10];
+    int	pattern;
+
+    for( i = 0; i < Xres; ++i )
+    {
+        pattern = hq2x_pattern( prev, cur, next, i, Xres, w );
+
+        for( k = 1; k <= 9; ++k )
+        {
+            c[ k ] = LUT16to24[ w[ k ] ];
+        }
+
+        hq2x_pixel( pattern, w, c, pOut, BpL );
+
+        pOut += 8;
+    }
+}
+
+/*
+    Same as hq2x_32_line, but also scales an 8-bit alpha mask using the
+    pattern decisions made on the keys. Colour is interpolated
+    premultiplied and divided back out, so transparent texels never bleed
+    into the result. Fully transparent output texels are cleared to zero.
+*/
+void hq2x_32_line_alpha( const unsigned short *prev, const unsigned short *cur, const unsigned short *next,
+                         const unsigned char *aprev, const unsigned char *acur, const unsigned char *anext,
+                         int Xres, unsigned char *pOut, int BpL )
+{
+    int	i, k, n;
+    int	w[10];
+    int	c[10];
+    int	a[10];
+    int	alpha[4];
+    int	pattern;
+    int	A;
+    unsigned char *px;
+
+    for( i = 0; i < Xres; ++i )
+    {
+        pattern = hq2x_pattern( prev, cur, next, i, Xres, w );
+
+        a[2] = aprev[ i ];
+        a[5] = acur[ i ];
+        a[8] = anext[ i ];
+
+        a[1] = ( i > 0 ) ? aprev[ i - 1 ] : a[2];
+        a[4] = ( i > 0 ) ? acur[ i - 1 ] : a[5];
+        a[7] = ( i > 0 ) ? anext[ i - 1 ] : a[8];
+
+        a[3] = ( i < Xres-1 ) ? aprev[ i + 1 ] : a[2];
+        a[6] = ( i < Xres-1 ) ? acur[ i + 1 ] : a[5];
+        a[9] = ( i < Xres-1 ) ? anext[ i + 1 ] : a[8];
+
+        for( k = 1; k <= 9; ++k )
+        {
+            c[ k ] = LUT16to24[ w[ k ] ];
+
+            if( a[ k ] == 0 )
+            {
+                c[ k ] = 0;
+            }
+            else if( a[ k ] != 0xFF )
+            {
+                c[ k ] = ((((c[ k ]       ) & 0xFF) * a[ k ] + 127) / 255) |
+                         ((((c[ k ] >>  8) & 0xFF) * a[ k ] + 127) / 255) << 8 |
+                         ((((c[ k ] >> 16) & 0xFF) * a[ k ] + 127) / 255) << 16;
+            }
+        }
+
+        hq2x_pixel( pattern, w, c, pOut, BpL );
+        hq2x_pixel( pattern, w, a, (unsigned char *)alpha, 8 );
+
+        for( n = 0; n < 4; ++n )
+        {
+            px = pOut + (n >> 1) * BpL + (n & 1) * 4;
+            A = alpha[ n ] & 0xFF;
+
+            if( A == 0 )
+            {
+                px[0] = px[1] = px[2] = 0;
+            }
+            else if( A != 0xFF )
+            {
+                for( k = 0; k < 3; ++k )
+                {
+                    int v = (px[ k ] * 255 + A / 2) / A;
+
+                    px[ k ] = (unsigned char) (( v > 255 ) ? 255 : v);
+                }
+            }
+
+            px[3] = (unsigned char) A;
+        }
+
+        pOut += 8;
+    }
+}
+
+void hq2x_32( unsigned char *pIn, unsigned char *pOut, int Xres, int Yres, int BpL )
+{
+    int	j;
+    const unsigned short *line;
+
+    line = (const unsigned short *)pIn;
+
+    for( j = 0; j < Yres; ++j )
+    {
+        hq2x_32_line( (j > 0) ? line - Xres : line,
+                      line,
+                      (j < Yres-1) ? line + Xres : line,
+                      Xres, pOut, BpL );
+
+        line += Xres;
+        pOut += BpL * 2;
     }
-    pOut += BpL;
-  }
 }
 
 void InitLUTs( void )
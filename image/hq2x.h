@@ -26,6 +26,13 @@ extern void InitLUTs( void );
 
 extern void hq2x_32( unsigned char *pIn, unsigned char *pOut, 
                 int Xres, int Yres, int BpL );
+
+extern void hq2x_32_line( const unsigned short *prev, const unsigned short *cur,
+                const unsigned short *next, int Xres, unsigned char *pOut, int BpL );
+
+extern void hq2x_32_line_alpha( const unsigned short *prev, const unsigned short *cur,
+                const unsigned short *next, const unsigned char *aprev, const unsigned char *acur,
+                const unsigned char *anext, int Xres, unsigned char *pOut, int BpL );
                 
 
 #endif /* __HQ2X_H__ */
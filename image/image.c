@@ -25,8 +25,11 @@
  *
  */
 
+#include <string.h>
+
 #include "../common/platform.h"
 #include "../common/common_utils.h"
+#include "image.h"
 
 
 
@@ -212,169 +215,203 @@ PUBLIC void MergeImages( W8 *src, W32 src_bpp, W32 src_totalwidth, W32 src_regio
 }
 
 /**
- * \brief Remove fringe from scaled hq2x images.
- * \param[in,out] data Image data.
- * \param[in] width Width (in pixels) of image data.
- * \param[in] height Height (in pixels) of image image.
+ * \brief Build a table that maps each palette index to its canonical index.
+ * \param[in] palette Palette array (256 RGB triplets).
+ * \param[out] remap 256 entry table receiving the lowest index with the same colour.
  * \return Nothing.
+ * \note Scale2x only tests pixels for equality. Palettes may hold duplicate
+ *		colours, so indices have to be canonical before scaling for the result
+ *		to match scaling the expanded colours.
  */
-PUBLIC void ReduxAlphaChannel_hq2x( W8 *data, W32 width, W32 height )
+PUBLIC void Palette_buildRemap( const W8 *palette, W8 *remap )
 {
+	W32 i, j;
 
-	W8 *ptr;
+	for( i = 0 ; i < 256 ; ++i )
+	{
+		remap[ i ] = (W8) i;
+
+		for( j = 0 ; j < i ; ++j )
+		{
+			if( palette[ j * 3 + 0 ] == palette[ i * 3 + 0 ] &&
+				palette[ j * 3 + 1 ] == palette[ i * 3 + 1 ] &&
+				palette[ j * 3 + 2 ] == palette[ i * 3 + 2 ] )
+			{
+				remap[ i ] = (W8) j;
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * \brief Expand palette indices into RGB24.
+ * \param[in] src Palette indices.
+ * \param[out] dest Destination buffer, npixels * 3 bytes.
+ * \param[in] npixels Number of pixels to expand.
+ * \param[in] palette Palette array.
+ * \return Nothing.
+ */
+PUBLIC void Palette_expandRGB24( const W8 *src, W8 *dest, W32 npixels, const W8 *palette )
+{
 	W32 i;
+	const W8 *colour;
 
-	for( i = 0 ; i < (width * height) ; ++i )
+	for( i = 0 ; i < npixels ; ++i, dest += 3 )
 	{
-		ptr = data + i * 4;
+		colour = palette + src[ i ] * 3;
 
+		dest[ 0 ] = colour[ 0 ];	/* R */
+		dest[ 1 ] = colour[ 1 ];	/* G */
+		dest[ 2 ] = colour[ 2 ];	/* B */
+	}
+}
 
-        if( ptr[ 0 ] >= 150 &&
-            ptr[ 1 ] <= 60 &&
-            ptr[ 2 ] >= 150
-          )
-		{
+/**
+ * \brief Expand palette indices into RGB32.
+ * \param[in] src Palette indices.
+ * \param[out] dest Destination buffer, npixels * 4 bytes.
+ * \param[in] npixels Number of pixels to expand.
+ * \param[in] palette Palette array.
+ * \return Nothing.
+ */
+PUBLIC void Palette_expandRGB32( const W8 *src, W8 *dest, W32 npixels, const W8 *palette )
+{
+	W32 i;
+	const W8 *colour;
 
-			ptr[ 3 ] = 0x00;
-		}
+	for( i = 0 ; i < npixels ; ++i, dest += 4 )
+	{
+		colour = palette + src[ i ] * 3;
 
-        // Start
+		dest[ 0 ] = colour[ 0 ];	/* R */
+		dest[ 1 ] = colour[ 1 ];	/* G */
+		dest[ 2 ] = colour[ 2 ];	/* B */
+		dest[ 3 ] = 0xFF;			/* A */
+	}
+}
 
-        else if( ptr[ 0 ] >= 124 &&
-            ptr[ 1 ] == 0 &&
-            ptr[ 2 ] >= 124
-          )
-		{
+/**
+ * \brief Expand 16-bit palette keys into RGB32.
+ * \param[in] src Palette keys, either a palette index or PALETTE_KEY_TRANSPARENT.
+ * \param[out] dest Destination buffer, npixels * 4 bytes.
+ * \param[in] npixels Number of pixels to expand.
+ * \param[in] palette Palette array.
+ * \return Nothing.
+ * \note Transparent texels are written as magenta with zero alpha.
+ */
+PUBLIC void Palette_expandKeyRGB32( const W16 *src, W8 *dest, W32 npixels, const W8 *palette )
+{
+	W32 i;
+	const W8 *colour;
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 120 &&
-            ptr[ 1 ] <= 60 &&
-            ptr[ 2 ] >= 170
-          )
+	for( i = 0 ; i < npixels ; ++i, dest += 4 )
+	{
+		if( src[ i ] & PALETTE_KEY_TRANSPARENT )
 		{
+			dest[ 0 ] = 0xFF;	/* R */
+			dest[ 1 ] = 0x00;	/* G */
+			dest[ 2 ] = 0xFF;	/* B */
+			dest[ 3 ] = 0x00;	/* A */
 
-			ptr[ 3 ] = 0x00;
+			continue;
 		}
-        else if( ptr[ 0 ] >= 160 &&
-            ptr[ 1 ] <= 100 &&
-            ptr[ 2 ] >= 220
-          )
-		{
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 120 &&
-            ptr[ 1 ] <= 40 &&
-            ptr[ 2 ] >= 150
-          )
-		{
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 140 &&
-            ptr[ 1 ] <= 90 &&
-            ptr[ 2 ] >= 200
-          )
-		{
+		colour = palette + src[ i ] * 3;
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 120 &&
-            ptr[ 1 ] <= 70 &&
-            ptr[ 2 ] >= 190
-          )
-		{
+		dest[ 0 ] = colour[ 0 ];	/* R */
+		dest[ 1 ] = colour[ 1 ];	/* G */
+		dest[ 2 ] = colour[ 2 ];	/* B */
+		dest[ 3 ] = 0xFF;			/* A */
+	}
+}
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 120 &&
-            ptr[ 1 ] <= 70 &&
-            ptr[ 2 ] >= 160
-          )
-		{
+/**
+ * \brief Convert an RGB32 image into 8-bit indices into a colour table.
+ * \param[in] src RGB32 image data.
+ * \param[out] dest Destination buffer, npixels bytes.
+ * \param[in] npixels Number of pixels to convert.
+ * \param[out] colourTable Receives up to 256 RGB32 entries.
+ * \return Number of colours in the table, or 0 if the image holds more than 256 distinct colours.
+ * \note All four bytes take part in the comparison, so two pixels share an index only if they are identical.
+ */
+PUBLIC W32 RGB32_toIndexed( const W8 *src, W8 *dest, W32 npixels, W8 *colourTable )
+{
+	W16 slots[ 1024 ];
+	W32 colours[ 256 ];
+	W32 ncolours;
+	W32 i, colour, hash;
+	W32 lastColour;
+	W8 lastIndex;
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 200 &&
-            ptr[ 1 ] <= 120 &&
-            ptr[ 2 ] >= 230
-          )
-		{
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 150 &&
-            ptr[ 1 ] <= 110 &&
-            ptr[ 2 ] >= 150
-          )
-		{
+	memset( slots, 0xFF, sizeof( slots ) );
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 120 &&
-            ptr[ 1 ] <= 70 &&
-            ptr[ 2 ] >= 120
-          )
-		{
+	ncolours = 0;
+	lastColour = 0;
+	lastIndex = 0;
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 100 &&
-            ptr[ 1 ] <= 55 &&
-            ptr[ 2 ] >= 100
-          )
-		{
+	for( i = 0 ; i < npixels ; ++i, src += 4 )
+	{
+		colour = src[ 0 ] | (src[ 1 ] << 8) | (src[ 2 ] << 16) | ((W32)src[ 3 ] << 24);
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 180 &&
-            ptr[ 1 ] <= 130 &&
-            ptr[ 2 ] >= 180
-          )
+		if( ncolours && colour == lastColour )
 		{
-
-			ptr[ 3 ] = 0x00;
+			dest[ i ] = lastIndex;
+			continue;
 		}
-        else if( ptr[ 0 ] >= 200 &&
-            ptr[ 1 ] <= 150 &&
-            ptr[ 2 ] >= 200
-          )
-		{
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 190 &&
-            ptr[ 1 ] <= 140 &&
-            ptr[ 2 ] >= 190
-          )
+		hash = (colour * 2654435761U) >> 22;
+		while( slots[ hash ] != 0xFFFF && colours[ slots[ hash ] ] != colour )
 		{
-
-			ptr[ 3 ] = 0x00;
+			hash = (hash + 1) & 1023;
 		}
-        else if( ptr[ 0 ] >= 170 &&
-            ptr[ 1 ] <= 120 &&
-            ptr[ 2 ] >= 170
-          )
-		{
 
-			ptr[ 3 ] = 0x00;
-		}
-        else if( ptr[ 0 ] >= 130 &&
-            ptr[ 1 ] <= 80 &&
-            ptr[ 2 ] >= 130
-          )
+		if( slots[ hash ] == 0xFFFF )
 		{
+			if( ncolours == 256 )
+			{
+				return 0;
+			}
+
+			colours[ ncolours ] = colour;
+			colourTable[ ncolours * 4 + 0 ] = src[ 0 ];
+			colourTable[ ncolours * 4 + 1 ] = src[ 1 ];
+			colourTable[ ncolours * 4 + 2 ] = src[ 2 ];
+			colourTable[ ncolours * 4 + 3 ] = src[ 3 ];
 
-			ptr[ 3 ] = 0x00;
+			slots[ hash ] = (W16) ncolours++;
 		}
 
-        // End
+		lastColour = colour;
+		lastIndex = (W8) slots[ hash ];
 
-		else
-		{
-			ptr[ 3 ] = 0xFF;
-		}
+		dest[ i ] = lastIndex;
 	}
 
+	return ncolours;
 }
 
+/**
+ * \brief Expand 8-bit indices through an RGB32 colour table.
+ * \param[in] src Colour table indices.
+ * \param[out] dest Destination buffer, npixels * 4 bytes.
+ * \param[in] npixels Number of pixels to expand.
+ * \param[in] colourTable RGB32 colour table filled by RGB32_toIndexed.
+ * \return Nothing.
+ */
+PUBLIC void Indexed_toRGB32( const W8 *src, W8 *dest, W32 npixels, const W8 *colourTable )
+{
+	W32 i;
+	const W8 *colour;
+
+	for( i = 0 ; i < npixels ; ++i, dest += 4 )
+	{
+		colour = colourTable + src[ i ] * 4;
+
+		dest[ 0 ] = colour[ 0 ];
+		dest[ 1 ] = colour[ 1 ];
+		dest[ 2 ] = colour[ 2 ];
+		dest[ 3 ] = colour[ 3 ];
+	}
+}
@@ -41,13 +41,23 @@ void RGB24_adjustBrightness( void *data, W32 size );
 void RGB32_adjustBrightness( void *data, W32 size );
 
 
-void MergePics( const W8 *src, W8 *dest, W32 width, W32 height, W32 bpp, W16 totalwidth,
+void MergePics( const W8 *src, W8 *dest, W32 width, W32 height, W32 bpp, W32 totalwidth,
 						W32 x_offset, W32 y_offset );
 
 void MergeImages( W8 *src, W32 src_bpp, W32 src_totalwidth, W32 src_region_width, W32 src_region_height, W32 src_x_offset, W32 src_y_offset,
-						  W8 *dest, W16 dest_bpp, W32 dest_totalwidth, W32 dest_region_width, W32 dest_region_height,  W32 dest_x_offset, W32 dest_y_offset );
+						  W8 *dest, W32 dest_bpp, W32 dest_totalwidth, W32 dest_region_width, W32 dest_region_height,  W32 dest_x_offset, W32 dest_y_offset );
 
-void ReduxAlphaChannel_hq2x( W8 *data, W32 width, W32 height );
+
+/* Key value marking a transparent texel in 16-bit palette key images. */
+#define PALETTE_KEY_TRANSPARENT		0x100
+
+void Palette_buildRemap( const W8 *palette, W8 *remap );
+void Palette_expandRGB24( const W8 *src, W8 *dest, W32 npixels, const W8 *palette );
+void Palette_expandRGB32( const W8 *src, W8 *dest, W32 npixels, const W8 *palette );
+void Palette_expandKeyRGB32( const W16 *src, W8 *dest, W32 npixels, const W8 *palette );
+
+W32 RGB32_toIndexed( const W8 *src, W8 *dest, W32 npixels, W8 *colourTable );
+void Indexed_toRGB32( const W8 *src, W8 *dest, W32 npixels, const W8 *colourTable );
 
 
 
@@ -0,0 +1,329 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file mipmap.c
+ * \brief Mip chain generation for extracted textures.
+ * \date 2013
+ * \note Each level is a 2x2 box filter of the one above it. For RGBA
+ *		texels the colour is weighted by alpha, so transparent texels (the
+ *		magenta key) never bleed into the visible edge of a sprite.
+ */
+
+#include <stdio.h>
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "../threads/threads.h"
+#include "mipmap.h"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+
+	#include <emmintrin.h>
+
+	#define MIPMAP_SSE2	1
+
+#endif
+
+
+/**
+ * \brief Get the number of mip levels below the base level.
+ * \param[in] width Width of base level in pixels.
+ * \param[in] height Height of base level in pixels.
+ * \return Number of levels down to 1x1.
+ */
+PUBLIC W32 Mipmap_levels( W32 width, W32 height )
+{
+	W32 levels = 0;
+
+	while( width > 1 || height > 1 )
+	{
+		width = width > 1 ? width >> 1 : 1;
+		height = height > 1 ? height >> 1 : 1;
+		++levels;
+	}
+
+	return levels;
+}
+
+/**
+ * \brief Get the size of a mip chain.
+ * \param[in] width Width of base level in pixels.
+ * \param[in] height Height of base level in pixels.
+ * \param[in] bpp Bytes per pixel.
+ * \return Size in bytes of every level below the base level.
+ */
+PUBLIC W32 Mipmap_chainSize( W32 width, W32 height, W32 bpp )
+{
+	W32 size = 0;
+
+	while( width > 1 || height > 1 )
+	{
+		width = width > 1 ? width >> 1 : 1;
+		height = height > 1 ? height >> 1 : 1;
+		size += width * height * bpp;
+	}
+
+	return size;
+}
+
+/**
+ * \brief Box filter one 2x2 block of RGBA texels, weighted by alpha.
+ * \param[in] t0 Top left texel.
+ * \param[in] t1 Top right texel.
+ * \param[in] t2 Bottom left texel.
+ * \param[in] t3 Bottom right texel.
+ * \param[out] dest Destination texel.
+ * \return Nothing.
+ * \note A block with no visible texels keeps the top left texel as is.
+ */
+PRIVATE INLINECALL void Mipmap_filterRGBA( const W8 *t0, const W8 *t1, const W8 *t2, const W8 *t3, W8 *dest )
+{
+	W32 sumA = t0[ 3 ] + t1[ 3 ] + t2[ 3 ] + t3[ 3 ];
+	W32 sumC;
+	W32 i;
+
+	if( sumA == 0 )
+	{
+		dest[ 0 ] = t0[ 0 ];
+		dest[ 1 ] = t0[ 1 ];
+		dest[ 2 ] = t0[ 2 ];
+		dest[ 3 ] = 0;
+
+		return;
+	}
+
+	for( i = 0 ; i < 3 ; ++i )
+	{
+		sumC = t0[ i ] * t0[ 3 ] + t1[ i ] * t1[ 3 ] + t2[ i ] * t2[ 3 ] + t3[ i ] * t3[ 3 ];
+
+		/* round to nearest, half up */
+		dest[ i ] = (W8) ((sumC * 2 + sumA) / (sumA * 2));
+	}
+
+	dest[ 3 ] = (W8) ((sumA + 2) >> 2);
+}
+
+#ifdef MIPMAP_SSE2
+
+/**
+ * \brief Box filter two adjacent 2x2 blocks of RGBA texels, weighted by alpha.
+ * \param[in] row0 Four texels from the top row.
+ * \param[in] row1 Four texels from the bottom row.
+ * \param[out] dest Two destination texels.
+ * \return Nothing.
+ * \note Gives the same result as Mipmap_filterRGBA. The weighted sums are
+ *		exact in single precision and far enough from a rounding boundary
+ *		that the float quotient rounds the same way as the integer one.
+ */
+PRIVATE INLINECALL void Mipmap_filterRGBA_SSE2( const W8 *row0, const W8 *row1, W8 *dest )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgbMask16 = _mm_set_epi16( 0, -1, -1, -1, 0, -1, -1, -1 );
+	const __m128i alphaOne16 = _mm_set_epi16( 1, 0, 0, 0, 1, 0, 0, 0 );
+	const __m128i alphaMask32 = _mm_set_epi32( -1, 0, 0, 0 );
+	const __m128i two = _mm_set1_epi32( 2 );
+	const __m128 half = _mm_set1_ps( 0.5f );
+	__m128i t[ 4 ];
+	__m128i w, sum, a, colour, first, transparent;
+	__m128i out[ 2 ];
+	__m128 sumF;
+	W32 i;
+
+	t[ 0 ] = _mm_unpacklo_epi8( _mm_loadu_si128( (const __m128i *)row0 ), zero );
+	t[ 1 ] = _mm_unpackhi_epi8( _mm_loadu_si128( (const __m128i *)row0 ), zero );
+	t[ 2 ] = _mm_unpacklo_epi8( _mm_loadu_si128( (const __m128i *)row1 ), zero );
+	t[ 3 ] = _mm_unpackhi_epi8( _mm_loadu_si128( (const __m128i *)row1 ), zero );
+
+	/* weight colour by alpha, alpha itself by one; products fit in 16 bits unsigned */
+	for( i = 0 ; i < 4 ; ++i )
+	{
+		w = _mm_shufflehi_epi16( _mm_shufflelo_epi16( t[ i ], 0xFF ), 0xFF );
+		w = _mm_or_si128( _mm_and_si128( w, rgbMask16 ), alphaOne16 );
+		t[ i ] = _mm_mullo_epi16( t[ i ], w );
+	}
+
+	for( i = 0 ; i < 2 ; ++i )
+	{
+		/* t[ i ] holds the block's top pair of texels, t[ i + 2 ] the bottom pair */
+		sum = _mm_add_epi32( _mm_add_epi32( _mm_unpacklo_epi16( t[ i ], zero ), _mm_unpackhi_epi16( t[ i ], zero ) ),
+							 _mm_add_epi32( _mm_unpacklo_epi16( t[ i + 2 ], zero ), _mm_unpackhi_epi16( t[ i + 2 ], zero ) ) );
+
+		a = _mm_shuffle_epi32( sum, 0xFF );
+
+		sumF = _mm_cvtepi32_ps( sum );
+		colour = _mm_cvttps_epi32( _mm_add_ps( _mm_div_ps( sumF, _mm_cvtepi32_ps( a ) ), half ) );
+
+		colour = _mm_or_si128( _mm_andnot_si128( alphaMask32, colour ),
+							   _mm_and_si128( alphaMask32, _mm_srli_epi32( _mm_add_epi32( sum, two ), 2 ) ) );
+
+		/* no visible texels, keep the top left texel with zero alpha */
+		first = _mm_andnot_si128( alphaMask32, _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)(row0 + i * 8) ), zero ), zero ) );
+		transparent = _mm_cmpeq_epi32( a, zero );
+
+		out[ i ] = _mm_or_si128( _mm_and_si128( transparent, first ), _mm_andnot_si128( transparent, colour ) );
+	}
+
+	_mm_storel_epi64( (__m128i *)dest, _mm_packus_epi16( _mm_packs_epi32( out[ 0 ], out[ 1 ] ), zero ) );
+}
+
+#endif /* MIPMAP_SSE2 */
+
+/**
+ * \brief Generate the next mip level.
+ * \param[in] src Source level.
+ * \param[in] width Width of source level in pixels.
+ * \param[in] height Height of source level in pixels.
+ * \param[in] bpp Bytes per pixel, 3 (RGB) or 4 (RGBA).
+ * \param[out] dest Destination level, half the size of the source level in each dimension.
+ * \return Nothing.
+ * \note RGBA levels are weighted by alpha, RGB levels are a plain box filter.
+ */
+PUBLIC void Mipmap_nextLevel( const W8 *src, W32 width, W32 height, W32 bpp, W8 *dest )
+{
+	W32 destWidth = width > 1 ? width >> 1 : 1;
+	W32 destHeight = height > 1 ? height >> 1 : 1;
+	W32 x, y, i;
+	W32 x0, x1;
+	const W8 *row0, *row1;
+
+	for( y = 0 ; y < destHeight ; ++y )
+	{
+		row0 = src + (y * 2) * width * bpp;
+		row1 = (height > 1) ? row0 + width * bpp : row0;
+
+		x = 0;
+
+#ifdef MIPMAP_SSE2
+
+		if( bpp == 4 && width > 1 )
+		{
+			for( ; x + 1 < destWidth ; x += 2 )
+			{
+				Mipmap_filterRGBA_SSE2( row0 + x * 8, row1 + x * 8, dest );
+				dest += 8;
+			}
+		}
+
+#endif
+
+		for( ; x < destWidth ; ++x )
+		{
+			x0 = (x * 2) * bpp;
+			x1 = (width > 1) ? x0 + bpp : x0;
+
+			if( bpp == 4 )
+			{
+				Mipmap_filterRGBA( row0 + x0, row0 + x1, row1 + x0, row1 + x1, dest );
+			}
+			else
+			{
+				for( i = 0 ; i < bpp ; ++i )
+				{
+					dest[ i ] = (W8) ((row0[ x0 + i ] + row0[ x1 + i ] + row1[ x0 + i ] + row1[ x1 + i ] + 2) >> 2);
+				}
+			}
+
+			dest += bpp;
+		}
+	}
+}
+
+/**
+ * \brief Generate every mip level below an image.
+ * \param[in] src Base level.
+ * \param[in] width Width of base level in pixels.
+ * \param[in] height Height of base level in pixels.
+ * \param[in] bpp Bytes per pixel, 3 (RGB) or 4 (RGBA).
+ * \param[out] dest Destination levels stored largest first, see Mipmap_chainSize.
+ * \return Nothing.
+ */
+PUBLIC void Mipmap_buildChain( const W8 *src, W32 width, W32 height, W32 bpp, W8 *dest )
+{
+	while( width > 1 || height > 1 )
+	{
+		Mipmap_nextLevel( src, width, height, bpp, dest );
+
+		width = width > 1 ? width >> 1 : 1;
+		height = height > 1 ? height >> 1 : 1;
+
+		src = dest;
+		dest += width * height * bpp;
+	}
+}
+
+
+typedef struct
+{
+	const W8	*src;
+	W32			width;
+	W32			height;
+	W32			bpp;
+	W8			*dest;
+	W32			chainSize;
+
+} mipmapBatch_t;
+
+/**
+ * \brief Thread pool job, builds the mip chain of one tile.
+ */
+PRIVATE void Mipmap_tileJob( void *param, W32 index, W32 threadId )
+{
+	mipmapBatch_t *batch = (mipmapBatch_t *)param;
+
+	(void)threadId;
+
+	Mipmap_buildChain( batch->src + index * batch->width * batch->height * batch->bpp,
+						batch->width, batch->height, batch->bpp, batch->dest + index * batch->chainSize );
+}
+
+/**
+ * \brief Build mip chains for a batch of same-sized tiles.
+ * \param[in] src Source tiles, stored one after the other.
+ * \param[in] width Width of a tile in pixels.
+ * \param[in] height Height of a tile in pixels.
+ * \param[in] bpp Bytes per pixel, 3 (RGB) or 4 (RGBA).
+ * \param[in] count Number of tiles.
+ * \param[out] dest Destination chains, stored one after the other, each Mipmap_chainSize bytes.
+ * \return On success true, otherwise false.
+ * \note Tiles are spread across the worker thread pool.
+ */
+PUBLIC wtBoolean Mipmap_buildTiles( const W8 *src, W32 width, W32 height, W32 bpp, W32 count, W8 *dest )
+{
+	mipmapBatch_t batch;
+
+	if( bpp != 3 && bpp != 4 )
+	{
+		fprintf( stderr, "[Mipmap_buildTiles]: Unsupported bytes per pixel (%d)\n", bpp );
+
+		return false;
+	}
+
+	batch.src = src;
+	batch.width = width;
+	batch.height = height;
+	batch.bpp = bpp;
+	batch.dest = dest;
+	batch.chainSize = Mipmap_chainSize( width, height, bpp );
+
+	ThreadPool_Run( Mipmap_tileJob, &batch, count );
+
+	return true;
+}
@@ -0,0 +1,44 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file mipmap.h
+ * \brief Mip chain generation for extracted textures.
+ * \date 2013
+ */
+
+#ifndef __MIPMAP_H__
+#define __MIPMAP_H__
+
+#include "../common/platform.h"
+
+
+W32 Mipmap_levels( W32 width, W32 height );
+
+W32 Mipmap_chainSize( W32 width, W32 height, W32 bpp );
+
+void Mipmap_nextLevel( const W8 *src, W32 width, W32 height, W32 bpp, W8 *dest );
+
+void Mipmap_buildChain( const W8 *src, W32 width, W32 height, W32 bpp, W8 *dest );
+
+wtBoolean Mipmap_buildTiles( const W8 *src, W32 width, W32 height, W32 bpp, W32 count, W8 *dest );
+
+
+#endif /* __MIPMAP_H__ */
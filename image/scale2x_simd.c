@@ -0,0 +1,435 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file scale2x_simd.c
+ * \brief SSE2, AVX2 and NEON Scale2x row kernels with run-time dispatch.
+ * \date 2013
+ * \note Every kernel works like the matching _def function in scale2x.c.
+ *		The vector loop covers the pixels that have both neighbours inside
+ *		the row; the first pixel, the last pixel and any remainder go through
+ *		the scalar rule with the missing neighbour replaced by the centre
+ *		pixel, which is exactly what the _def edge cases compute.
+ */
+
+#include "../common/platform.h"
+#include "../common/cpu.h"
+#include "scale2x.h"
+
+#ifdef CPU_X86
+
+	#include <emmintrin.h>
+	#include <immintrin.h>
+
+	#if defined( __GNUC__ )
+
+		#define SCALE2X_TARGET_SSE2		__attribute__(( target( "sse2" ) ))
+		#define SCALE2X_TARGET_AVX2		__attribute__(( target( "avx2" ) ))
+
+	#else
+
+		#define SCALE2X_TARGET_SSE2
+		#define SCALE2X_TARGET_AVX2
+
+	#endif
+
+#endif
+
+#ifdef CPU_NEON
+
+	#include <arm_neon.h>
+
+#endif
+
+
+/***************************************************************************/
+/* Scalar rule, used for the row edges and the remainder */
+
+#define SCALE2X_PIXEL( bits ) \
+\
+static INLINECALL void scale2x_##bits##_pixel_border( scale2x_uint##bits *dst, const scale2x_uint##bits *src0, \
+		const scale2x_uint##bits *src1, const scale2x_uint##bits *src2, unsigned i, unsigned count ) \
+{ \
+	scale2x_uint##bits c = src1[ i ]; \
+	scale2x_uint##bits l = (i > 0) ? src1[ i - 1 ] : c; \
+	scale2x_uint##bits r = (i + 1 < count) ? src1[ i + 1 ] : c; \
+\
+	if( src0[ i ] != src2[ i ] && l != r ) \
+	{ \
+		dst[ i * 2 + 0 ] = (l == src0[ i ]) ? src0[ i ] : c; \
+		dst[ i * 2 + 1 ] = (r == src0[ i ]) ? src0[ i ] : c; \
+	} \
+	else \
+	{ \
+		dst[ i * 2 + 0 ] = c; \
+		dst[ i * 2 + 1 ] = c; \
+	} \
+} \
+\
+static INLINECALL void scale2x_##bits##_pixel_center( scale2x_uint##bits *dst, const scale2x_uint##bits *src0, \
+		const scale2x_uint##bits *src1, const scale2x_uint##bits *src2, unsigned i, unsigned count ) \
+{ \
+	unsigned il = (i > 0) ? i - 1 : i; \
+	unsigned ir = (i + 1 < count) ? i + 1 : i; \
+	scale2x_uint##bits c = src1[ i ]; \
+	scale2x_uint##bits l = src1[ il ]; \
+	scale2x_uint##bits r = src1[ ir ]; \
+\
+	if( src0[ i ] != src2[ i ] && l != r ) \
+	{ \
+		dst[ i * 2 + 0 ] = ((l == src0[ i ] && c != src2[ il ]) || (l == src2[ i ] && c != src0[ il ])) ? l : c; \
+		dst[ i * 2 + 1 ] = ((r == src0[ i ] && c != src2[ ir ]) || (r == src2[ i ] && c != src0[ ir ])) ? r : c; \
+	} \
+	else \
+	{ \
+		dst[ i * 2 + 0 ] = c; \
+		dst[ i * 2 + 1 ] = c; \
+	} \
+}
+
+SCALE2X_PIXEL( 8 )
+SCALE2X_PIXEL( 16 )
+SCALE2X_PIXEL( 32 )
+
+
+/***************************************************************************/
+/* Vector kernels */
+
+/**
+ * Generates the border and center row kernels of one instruction set and
+ * pixel size from a handful of primitive operations:
+ *	LOAD( p ), EQ( a, b ), OR( a, b ), ANDNOT( a, b ) = ~a & b,
+ *	SEL( m, a, b ) = m ? a : b, STORE2( p, a, b ) interleaves a and b at p.
+ */
+#define SCALE2X_KERNELS( isa, bits, N, TARGET, V, LOAD, EQ, OR, ANDNOT, SEL, STORE2 ) \
+\
+static TARGET void scale2x_##bits##_##isa##_border( scale2x_uint##bits *dst, const scale2x_uint##bits *src0, \
+		const scale2x_uint##bits *src1, const scale2x_uint##bits *src2, unsigned count ) \
+{ \
+	unsigned i; \
+	V c, l, r, u, d, same; \
+	V out0, out1; \
+\
+	scale2x_##bits##_pixel_border( dst, src0, src1, src2, 0, count ); \
+\
+	for( i = 1 ; i + N < count ; i += N ) \
+	{ \
+		c = LOAD( src1 + i ); \
+		l = LOAD( src1 + i - 1 ); \
+		r = LOAD( src1 + i + 1 ); \
+		u = LOAD( src0 + i ); \
+		d = LOAD( src2 + i ); \
+\
+		same = OR( EQ( u, d ), EQ( l, r ) ); \
+\
+		out0 = SEL( ANDNOT( same, EQ( l, u ) ), u, c ); \
+		out1 = SEL( ANDNOT( same, EQ( r, u ) ), u, c ); \
+\
+		STORE2( dst + i * 2, out0, out1 ); \
+	} \
+\
+	for( ; i < count ; ++i ) \
+	{ \
+		scale2x_##bits##_pixel_border( dst, src0, src1, src2, i, count ); \
+	} \
+} \
+\
+static TARGET void scale2x_##bits##_##isa##_center( scale2x_uint##bits *dst, const scale2x_uint##bits *src0, \
+		const scale2x_uint##bits *src1, const scale2x_uint##bits *src2, unsigned count ) \
+{ \
+	unsigned i; \
+	V c, l, r, u, d, same; \
+	V m0, m1, out0, out1; \
+\
+	scale2x_##bits##_pixel_center( dst, src0, src1, src2, 0, count ); \
+\
+	for( i = 1 ; i + N < count ; i += N ) \
+	{ \
+		c = LOAD( src1 + i ); \
+		l = LOAD( src1 + i - 1 ); \
+		r = LOAD( src1 + i + 1 ); \
+		u = LOAD( src0 + i ); \
+		d = LOAD( src2 + i ); \
+\
+		same = OR( EQ( u, d ), EQ( l, r ) ); \
+\
+		m0 = OR( ANDNOT( EQ( c, LOAD( src2 + i - 1 ) ), EQ( l, u ) ), \
+				 ANDNOT( EQ( c, LOAD( src0 + i - 1 ) ), EQ( l, d ) ) ); \
+		m1 = OR( ANDNOT( EQ( c, LOAD( src2 + i + 1 ) ), EQ( r, u ) ), \
+				 ANDNOT( EQ( c, LOAD( src0 + i + 1 ) ), EQ( r, d ) ) ); \
+\
+		out0 = SEL( ANDNOT( same, m0 ), l, c ); \
+		out1 = SEL( ANDNOT( same, m1 ), r, c ); \
+\
+		STORE2( dst + i * 2, out0, out1 ); \
+	} \
+\
+	for( ; i < count ; ++i ) \
+	{ \
+		scale2x_##bits##_pixel_center( dst, src0, src1, src2, i, count ); \
+	} \
+}
+
+/**
+ * Generates the public scale2x, scale2x3 and scale2x4 row functions of one
+ * instruction set and pixel size, arranged like their _def counterparts.
+ */
+#define SCALE2X_ROWS( isa, bits ) \
+\
+void scale2x_##bits##_##isa( scale2x_uint##bits *dst0, scale2x_uint##bits *dst1, const scale2x_uint##bits *src0, \
+		const scale2x_uint##bits *src1, const scale2x_uint##bits *src2, unsigned count ) \
+{ \
+	scale2x_##bits##_##isa##_border( dst0, src0, src1, src2, count ); \
+	scale2x_##bits##_##isa##_border( dst1, src2, src1, src0, count ); \
+} \
+\
+void scale2x3_##bits##_##isa( scale2x_uint##bits *dst0, scale2x_uint##bits *dst1, scale2x_uint##bits *dst2, \
+		const scale2x_uint##bits *src0, const scale2x_uint##bits *src1, const scale2x_uint##bits *src2, unsigned count ) \
+{ \
+	scale2x_##bits##_##isa##_border( dst0, src0, src1, src2, count ); \
+	scale2x_##bits##_##isa##_center( dst1, src0, src1, src2, count ); \
+	scale2x_##bits##_##isa##_border( dst2, src2, src1, src0, count ); \
+} \
+\
+void scale2x4_##bits##_##isa( scale2x_uint##bits *dst0, scale2x_uint##bits *dst1, scale2x_uint##bits *dst2, scale2x_uint##bits *dst3, \
+		const scale2x_uint##bits *src0, const scale2x_uint##bits *src1, const scale2x_uint##bits *src2, unsigned count ) \
+{ \
+	scale2x_##bits##_##isa##_border( dst0, src0, src1, src2, count ); \
+	scale2x_##bits##_##isa##_center( dst1, src0, src1, src2, count ); \
+	scale2x_##bits##_##isa##_center( dst2, src0, src1, src2, count ); \
+	scale2x_##bits##_##isa##_border( dst3, src2, src1, src0, count ); \
+}
+
+
+#ifdef CPU_X86
+
+/* SSE2 */
+
+#define SSE2_LOAD( p )			_mm_loadu_si128( (const __m128i *)(p) )
+#define SSE2_OR( a, b )			_mm_or_si128( a, b )
+#define SSE2_ANDNOT( a, b )		_mm_andnot_si128( a, b )
+#define SSE2_SEL( m, a, b )		_mm_or_si128( _mm_and_si128( m, a ), _mm_andnot_si128( m, b ) )
+
+#define SSE2_STORE2( p, a, b, w ) \
+	_mm_storeu_si128( (__m128i *)(p), _mm_unpacklo_epi##w( a, b ) ); \
+	_mm_storeu_si128( (__m128i *)(p) + 1, _mm_unpackhi_epi##w( a, b ) )
+
+#define SSE2_EQ8( a, b )		_mm_cmpeq_epi8( a, b )
+#define SSE2_EQ16( a, b )		_mm_cmpeq_epi16( a, b )
+#define SSE2_EQ32( a, b )		_mm_cmpeq_epi32( a, b )
+#define SSE2_STORE2_8( p, a, b )	SSE2_STORE2( p, a, b, 8 )
+#define SSE2_STORE2_16( p, a, b )	SSE2_STORE2( p, a, b, 16 )
+#define SSE2_STORE2_32( p, a, b )	SSE2_STORE2( p, a, b, 32 )
+
+SCALE2X_KERNELS( sse2, 8, 16, SCALE2X_TARGET_SSE2, __m128i, SSE2_LOAD, SSE2_EQ8, SSE2_OR, SSE2_ANDNOT, SSE2_SEL, SSE2_STORE2_8 )
+SCALE2X_KERNELS( sse2, 16, 8, SCALE2X_TARGET_SSE2, __m128i, SSE2_LOAD, SSE2_EQ16, SSE2_OR, SSE2_ANDNOT, SSE2_SEL, SSE2_STORE2_16 )
+SCALE2X_KERNELS( sse2, 32, 4, SCALE2X_TARGET_SSE2, __m128i, SSE2_LOAD, SSE2_EQ32, SSE2_OR, SSE2_ANDNOT, SSE2_SEL, SSE2_STORE2_32 )
+
+SCALE2X_ROWS( sse2, 8 )
+SCALE2X_ROWS( sse2, 16 )
+SCALE2X_ROWS( sse2, 32 )
+
+/* AVX2, unpack works within 128-bit lanes so the halves are put back in order */
+
+#define AVX2_LOAD( p )			_mm256_loadu_si256( (const __m256i *)(p) )
+#define AVX2_OR( a, b )			_mm256_or_si256( a, b )
+#define AVX2_ANDNOT( a, b )		_mm256_andnot_si256( a, b )
+#define AVX2_SEL( m, a, b )		_mm256_blendv_epi8( b, a, m )
+
+#define AVX2_STORE2( p, a, b, w ) \
+	_mm256_storeu_si256( (__m256i *)(p), _mm256_permute2x128_si256( _mm256_unpacklo_epi##w( a, b ), _mm256_unpackhi_epi##w( a, b ), 0x20 ) ); \
+	_mm256_storeu_si256( (__m256i *)(p) + 1, _mm256_permute2x128_si256( _mm256_unpacklo_epi##w( a, b ), _mm256_unpackhi_epi##w( a, b ), 0x31 ) )
+
+#define AVX2_EQ8( a, b )		_mm256_cmpeq_epi8( a, b )
+#define AVX2_EQ16( a, b )		_mm256_cmpeq_epi16( a, b )
+#define AVX2_EQ32( a, b )		_mm256_cmpeq_epi32( a, b )
+#define AVX2_STORE2_8( p, a, b )	AVX2_STORE2( p, a, b, 8 )
+#define AVX2_STORE2_16( p, a, b )	AVX2_STORE2( p, a, b, 16 )
+#define AVX2_STORE2_32( p, a, b )	AVX2_STORE2( p, a, b, 32 )
+
+SCALE2X_KERNELS( avx2, 8, 32, SCALE2X_TARGET_AVX2, __m256i, AVX2_LOAD, AVX2_EQ8, AVX2_OR, AVX2_ANDNOT, AVX2_SEL, AVX2_STORE2_8 )
+SCALE2X_KERNELS( avx2, 16, 16, SCALE2X_TARGET_AVX2, __m256i, AVX2_LOAD, AVX2_EQ16, AVX2_OR, AVX2_ANDNOT, AVX2_SEL, AVX2_STORE2_16 )
+SCALE2X_KERNELS( avx2, 32, 8, SCALE2X_TARGET_AVX2, __m256i, AVX2_LOAD, AVX2_EQ32, AVX2_OR, AVX2_ANDNOT, AVX2_SEL, AVX2_STORE2_32 )
+
+SCALE2X_ROWS( avx2, 8 )
+SCALE2X_ROWS( avx2, 16 )
+SCALE2X_ROWS( avx2, 32 )
+
+#endif /* CPU_X86 */
+
+
+#ifdef CPU_NEON
+
+/* NEON, vst2 interleaves the two output vectors on store */
+
+#define NEON_STORE2( p, a, b, t, w ) \
+	{ \
+		t pair; \
+		pair.val[ 0 ] = a; \
+		pair.val[ 1 ] = b; \
+		vst2q_u##w( p, pair ); \
+	}
+
+#define NEON_LOAD8( p )			vld1q_u8( p )
+#define NEON_EQ8( a, b )		vceqq_u8( a, b )
+#define NEON_OR8( a, b )		vorrq_u8( a, b )
+#define NEON_ANDNOT8( a, b )	vbicq_u8( b, a )
+#define NEON_SEL8( m, a, b )	vbslq_u8( m, a, b )
+#define NEON_STORE2_8( p, a, b )	NEON_STORE2( p, a, b, uint8x16x2_t, 8 )
+
+#define NEON_LOAD16( p )		vld1q_u16( p )
+#define NEON_EQ16( a, b )		vceqq_u16( a, b )
+#define NEON_OR16( a, b )		vorrq_u16( a, b )
+#define NEON_ANDNOT16( a, b )	vbicq_u16( b, a )
+#define NEON_SEL16( m, a, b )	vbslq_u16( m, a, b )
+#define NEON_STORE2_16( p, a, b )	NEON_STORE2( p, a, b, uint16x8x2_t, 16 )
+
+#define NEON_LOAD32( p )		vld1q_u32( p )
+#define NEON_EQ32( a, b )		vceqq_u32( a, b )
+#define NEON_OR32( a, b )		vorrq_u32( a, b )
+#define NEON_ANDNOT32( a, b )	vbicq_u32( b, a )
+#define NEON_SEL32( m, a, b )	vbslq_u32( m, a, b )
+#define NEON_STORE2_32( p, a, b )	NEON_STORE2( p, a, b, uint32x4x2_t, 32 )
+
+SCALE2X_KERNELS( neon, 8, 16, , uint8x16_t, NEON_LOAD8, NEON_EQ8, NEON_OR8, NEON_ANDNOT8, NEON_SEL8, NEON_STORE2_8 )
+SCALE2X_KERNELS( neon, 16, 8, , uint16x8_t, NEON_LOAD16, NEON_EQ16, NEON_OR16, NEON_ANDNOT16, NEON_SEL16, NEON_STORE2_16 )
+SCALE2X_KERNELS( neon, 32, 4, , uint32x4_t, NEON_LOAD32, NEON_EQ32, NEON_OR32, NEON_ANDNOT32, NEON_SEL32, NEON_STORE2_32 )
+
+SCALE2X_ROWS( neon, 8 )
+SCALE2X_ROWS( neon, 16 )
+SCALE2X_ROWS( neon, 32 )
+
+#endif /* CPU_NEON */
+
+
+/***************************************************************************/
+/* Run-time dispatch */
+
+typedef struct
+{
+	void (*scale2x_8)( scale2x_uint8 *, scale2x_uint8 *, const scale2x_uint8 *, const scale2x_uint8 *, const scale2x_uint8 *, unsigned );
+	void (*scale2x_16)( scale2x_uint16 *, scale2x_uint16 *, const scale2x_uint16 *, const scale2x_uint16 *, const scale2x_uint16 *, unsigned );
+	void (*scale2x_32)( scale2x_uint32 *, scale2x_uint32 *, const scale2x_uint32 *, const scale2x_uint32 *, const scale2x_uint32 *, unsigned );
+
+	void (*scale2x3_8)( scale2x_uint8 *, scale2x_uint8 *, scale2x_uint8 *, const scale2x_uint8 *, const scale2x_uint8 *, const scale2x_uint8 *, unsigned );
+	void (*scale2x3_16)( scale2x_uint16 *, scale2x_uint16 *, scale2x_uint16 *, const scale2x_uint16 *, const scale2x_uint16 *, const scale2x_uint16 *, unsigned );
+	void (*scale2x3_32)( scale2x_uint32 *, scale2x_uint32 *, scale2x_uint32 *, const scale2x_uint32 *, const scale2x_uint32 *, const scale2x_uint32 *, unsigned );
+
+	void (*scale2x4_8)( scale2x_uint8 *, scale2x_uint8 *, scale2x_uint8 *, scale2x_uint8 *, const scale2x_uint8 *, const scale2x_uint8 *, const scale2x_uint8 *, unsigned );
+	void (*scale2x4_16)( scale2x_uint16 *, scale2x_uint16 *, scale2x_uint16 *, scale2x_uint16 *, const scale2x_uint16 *, const scale2x_uint16 *, const scale2x_uint16 *, unsigned );
+	void (*scale2x4_32)( scale2x_uint32 *, scale2x_uint32 *, scale2x_uint32 *, scale2x_uint32 *, const scale2x_uint32 *, const scale2x_uint32 *, const scale2x_uint32 *, unsigned );
+
+} scale2xFuncs_t;
+
+#define SCALE2X_FUNCS( isa ) \
+	{ scale2x_8_##isa, scale2x_16_##isa, scale2x_32_##isa, \
+	  scale2x3_8_##isa, scale2x3_16_##isa, scale2x3_32_##isa, \
+	  scale2x4_8_##isa, scale2x4_16_##isa, scale2x4_32_##isa }
+
+static const scale2xFuncs_t scale2xDef = SCALE2X_FUNCS( def );
+
+#ifdef CPU_X86
+static const scale2xFuncs_t scale2xSSE2 = SCALE2X_FUNCS( sse2 );
+static const scale2xFuncs_t scale2xAVX2 = SCALE2X_FUNCS( avx2 );
+#endif
+
+#ifdef CPU_NEON
+static const scale2xFuncs_t scale2xNEON = SCALE2X_FUNCS( neon );
+#endif
+
+/* Portable kernels until scale2x_init picks the best ones */
+static const scale2xFuncs_t *scale2xFuncs = &scale2xDef;
+
+
+/**
+ * Select the fastest Scale2x kernels the CPU supports.
+ * Call once at start up, before any worker threads are running.
+ */
+void scale2x_init( void )
+{
+	W32 features = CPU_features();
+
+	scale2xFuncs = &scale2xDef;
+
+#ifdef CPU_X86
+	if( features & CPU_FEATURE_AVX2 )
+	{
+		scale2xFuncs = &scale2xAVX2;
+	}
+	else if( features & CPU_FEATURE_SSE2 )
+	{
+		scale2xFuncs = &scale2xSSE2;
+	}
+#endif
+
+#ifdef CPU_NEON
+	if( features & CPU_FEATURE_NEON )
+	{
+		scale2xFuncs = &scale2xNEON;
+	}
+#endif
+
+	(void)features;
+}
+
+void scale2x_8( scale2x_uint8 *dst0, scale2x_uint8 *dst1, const scale2x_uint8 *src0, const scale2x_uint8 *src1, const scale2x_uint8 *src2, unsigned count )
+{
+	scale2xFuncs->scale2x_8( dst0, dst1, src0, src1, src2, count );
+}
+
+void scale2x_16( scale2x_uint16 *dst0, scale2x_uint16 *dst1, const scale2x_uint16 *src0, const scale2x_uint16 *src1, const scale2x_uint16 *src2, unsigned count )
+{
+	scale2xFuncs->scale2x_16( dst0, dst1, src0, src1, src2, count );
+}
+
+void scale2x_32( scale2x_uint32 *dst0, scale2x_uint32 *dst1, const scale2x_uint32 *src0, const scale2x_uint32 *src1, const scale2x_uint32 *src2, unsigned count )
+{
+	scale2xFuncs->scale2x_32( dst0, dst1, src0, src1, src2, count );
+}
+
+void scale2x3_8( scale2x_uint8 *dst0, scale2x_uint8 *dst1, scale2x_uint8 *dst2, const scale2x_uint8 *src0, const scale2x_uint8 *src1, const scale2x_uint8 *src2, unsigned count )
+{
+	scale2xFuncs->scale2x3_8( dst0, dst1, dst2, src0, src1, src2, count );
+}
+
+void scale2x3_16( scale2x_uint16 *dst0, scale2x_uint16 *dst1, scale2x_uint16 *dst2, const scale2x_uint16 *src0, const scale2x_uint16 *src1, const scale2x_uint16 *src2, unsigned count )
+{
+	scale2xFuncs->scale2x3_16( dst0, dst1, dst2, src0, src1, src2, count );
+}
+
+void scale2x3_32( scale2x_uint32 *dst0, scale2x_uint32 *dst1, scale2x_uint32 *dst2, const scale2x_uint32 *src0, const scale2x_uint32 *src1, const scale2x_uint32 *src2, unsigned count )
+{
+	scale2xFuncs->scale2x3_32( dst0, dst1, dst2, src0, src1, src2, count );
+}
+
+void scale2x4_8( scale2x_uint8 *dst0, scale2x_uint8 *dst1, scale2x_uint8 *dst2, scale2x_uint8 *dst3, const scale2x_uint8 *src0, const scale2x_uint8 *src1, const scale2x_uint8 *src2, unsigned count )
+{
+	scale2xFuncs->scale2x4_8( dst0, dst1, dst2, dst3, src0, src1, src2, count );
+}
+
+void scale2x4_16( scale2x_uint16 *dst0, scale2x_uint16 *dst1, scale2x_uint16 *dst2, scale2x_uint16 *dst3, const scale2x_uint16 *src0, const scale2x_uint16 *src1, const scale2x_uint16 *src2, unsigned count )
+{
+	scale2xFuncs->scale2x4_16( dst0, dst1, dst2, dst3, src0, src1, src2, count );
+}
+
+void scale2x4_32( scale2x_uint32 *dst0, scale2x_uint32 *dst1, scale2x_uint32 *dst2, scale2x_uint32 *dst3, const scale2x_uint32 *src0, const scale2x_uint32 *src1, const scale2x_uint32 *src2, unsigned count )
+{
+	scale2xFuncs->scale2x4_32( dst0, dst1, dst2, dst3, src0, src1, src2, count );
+}
@@ -0,0 +1,90 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file scale3x.c
+ * \brief Scale3x line kernels.
+ * \date 2013
+ * \note Same edge rules as the Scale2x kernels: the pixels beyond either end
+ *		of a line repeat the end pixel, rows beyond the image are passed in
+ *		as copies of the edge row by the caller.
+ */
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "scale3x.h"
+
+
+/**
+ * Generates the Scale3x kernel of one pixel size. For the neighbourhood
+ *	A B C
+ *	D E F
+ *	G H I
+ * E expands to a 3x3 block whenever B != H and D != F, otherwise it is
+ * replicated.
+ */
+#define SCALE3X_KERNEL( bits ) \
+\
+PUBLIC void scale3x_##bits##_def( scale2x_uint##bits *dst0, scale2x_uint##bits *dst1, scale2x_uint##bits *dst2, \
+		const scale2x_uint##bits *src0, const scale2x_uint##bits *src1, const scale2x_uint##bits *src2, unsigned count ) \
+{ \
+	unsigned i, il, ir; \
+	scale2x_uint##bits A, B, C, D, E, F, G, H, I; \
+\
+	for( i = 0 ; i < count ; ++i, dst0 += 3, dst1 += 3, dst2 += 3 ) \
+	{ \
+		il = (i > 0) ? i - 1 : i; \
+		ir = (i + 1 < count) ? i + 1 : i; \
+\
+		B = src0[ i ]; \
+		D = src1[ il ]; \
+		E = src1[ i ]; \
+		F = src1[ ir ]; \
+		H = src2[ i ]; \
+\
+		if( B != H && D != F ) \
+		{ \
+			A = src0[ il ]; \
+			C = src0[ ir ]; \
+			G = src2[ il ]; \
+			I = src2[ ir ]; \
+\
+			dst0[ 0 ] = (D == B) ? D : E; \
+			dst0[ 1 ] = ((D == B && E != C) || (B == F && E != A)) ? B : E; \
+			dst0[ 2 ] = (B == F) ? F : E; \
+			dst1[ 0 ] = ((D == B && E != G) || (D == H && E != A)) ? D : E; \
+			dst1[ 1 ] = E; \
+			dst1[ 2 ] = ((B == F && E != I) || (H == F && E != C)) ? F : E; \
+			dst2[ 0 ] = (D == H) ? D : E; \
+			dst2[ 1 ] = ((D == H && E != I) || (H == F && E != G)) ? H : E; \
+			dst2[ 2 ] = (H == F) ? F : E; \
+		} \
+		else \
+		{ \
+			dst0[ 0 ] = dst0[ 1 ] = dst0[ 2 ] = E; \
+			dst1[ 0 ] = dst1[ 1 ] = dst1[ 2 ] = E; \
+			dst2[ 0 ] = dst2[ 1 ] = dst2[ 2 ] = E; \
+		} \
+	} \
+}
+
+SCALE3X_KERNEL( 8 )
+SCALE3X_KERNEL( 16 )
+SCALE3X_KERNEL( 32 )
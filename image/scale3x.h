@@ -0,0 +1,44 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file scale3x.h
+ * \brief Scale3x line kernels.
+ * \date 2013
+ */
+
+#ifndef __SCALE3X_H__
+#define __SCALE3X_H__
+
+
+#include "scale2x.h"
+
+
+void scale3x_8_def( scale2x_uint8 *dst0, scale2x_uint8 *dst1, scale2x_uint8 *dst2,
+					const scale2x_uint8 *src0, const scale2x_uint8 *src1, const scale2x_uint8 *src2, unsigned count );
+
+void scale3x_16_def( scale2x_uint16 *dst0, scale2x_uint16 *dst1, scale2x_uint16 *dst2,
+					const scale2x_uint16 *src0, const scale2x_uint16 *src1, const scale2x_uint16 *src2, unsigned count );
+
+void scale3x_32_def( scale2x_uint32 *dst0, scale2x_uint32 *dst1, scale2x_uint32 *dst2,
+					const scale2x_uint32 *src0, const scale2x_uint32 *src1, const scale2x_uint32 *src2, unsigned count );
+
+
+#endif /* __SCALE3X_H__ */
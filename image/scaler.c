@@ -0,0 +1,882 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file scaler.c
+ * \brief Fused image scaling pipelines.
+ * \date 2013
+ * \note The pipelines convert one source line at a time into the 565 keys
+ *		hq2x works on, scale it, and write the final pixel format straight
+ *		away. Only a few lines of scratch are ever touched, instead of
+ *		converting the whole image in place between every stage.
+ * \note Scaler_scaleTiles runs a pipeline over many same-sized tiles on the
+ *		worker thread pool, with line scratch allocated once per thread.
+ *		Scaler_scaleImage splits a single large image into bands of rows
+ *		instead. Every band reads the row above and below it from the source
+ *		image as a halo, so the stitched result matches a single pass.
+ * \note The 4x filters run two 2x passes per band of rows. The first pass
+ *		writes the band's intermediate rows, plus one halo row above and
+ *		below, to per-thread scratch, and the second pass scales those into
+ *		the destination. The whole intermediate image never exists.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "../memory/memory.h"
+#include "../threads/threads.h"
+#include "image.h"
+#include "hq2x.h"
+#include "scale2x.h"
+#include "scale3x.h"
+#include "scaler.h"
+
+
+/* Rows per band when Scaler_scaleImage splits an image, also the rows per 4x pass */
+#define SCALER_BAND_HEIGHT	16
+
+/* Intermediate rows of a 4x pass, the band plus a halo row either side at 2x */
+#define SCALER_MID_ROWS		((SCALER_BAND_HEIGHT + 2) * 2)
+
+
+/*
+ * Per-thread line scratch, line is first so it is suitably aligned for 32-bit pixels.
+ * The line and key buffers are sized for the second pass of a 4x filter,
+ * which works on lines twice the source width.
+ */
+typedef struct
+{
+	W8	line[ 3 * SCALER_MAX_WIDTH * 3 * 4 ];
+	W16	keys[ 3 ][ SCALER_MAX_WIDTH * 2 ];
+	W8	alpha[ 3 ][ SCALER_MAX_WIDTH * 2 ];
+	W8	mid[ SCALER_MID_ROWS * SCALER_MAX_WIDTH * 2 * 4 ];
+
+} scalerScratch_t;
+
+
+/**
+ * \brief Pack 8-bit RGB into the 565 key layout hq2x expects.
+ */
+#define SCALER_KEY565( r, g, b )	((W16) ((((b) >> 3) << 11) | (((g) >> 2) << 5) | ((r) >> 3)))
+
+
+/**
+ * \brief Build the palette to hq2x key lookup table.
+ * \param[in] palette Palette array (256 RGB triplets).
+ * \param[out] keyLUT 257 entry table, the last entry is used for PALETTE_KEY_TRANSPARENT.
+ * \return Nothing.
+ * \note Transparent texels map to magenta, as the RGB decoders fill them.
+ */
+PUBLIC void Scaler_buildKeyLUT( const W8 *palette, W16 *keyLUT )
+{
+	W32 i;
+
+	for( i = 0 ; i < 256 ; ++i )
+	{
+		keyLUT[ i ] = SCALER_KEY565( palette[ i * 3 + 0 ], palette[ i * 3 + 1 ], palette[ i * 3 + 2 ] );
+	}
+
+	keyLUT[ PALETTE_KEY_TRANSPARENT ] = SCALER_KEY565( 0xFF, 0x00, 0xFF );
+}
+
+/**
+ * \brief Build the key lookup table for a source format.
+ * \param[in] srcFormat Source pixel format (SCALER_SRC_*).
+ * \param[in] palette Palette array, or colour table for SCALER_SRC_TABLE8.
+ * \param[out] keyLUT 257 entry table, untouched for RGB32 sources.
+ * \return Nothing.
+ */
+PRIVATE void Scaler_buildFormatKeyLUT( W32 srcFormat, const W8 *palette, W16 *keyLUT )
+{
+	W32 i;
+
+	if( srcFormat == SCALER_SRC_TABLE8 )
+	{
+		for( i = 0 ; i < 256 ; ++i )
+		{
+			keyLUT[ i ] = SCALER_KEY565( palette[ i * 4 + 0 ], palette[ i * 4 + 1 ], palette[ i * 4 + 2 ] );
+		}
+	}
+	else if( srcFormat != SCALER_SRC_RGB32 && srcFormat != SCALER_SRC_RGBA32 )
+	{
+		Scaler_buildKeyLUT( palette, keyLUT );
+	}
+}
+
+/**
+ * \brief Convert one source line into hq2x keys.
+ * \param[in] src Source image data.
+ * \param[in] srcFormat Source pixel format (SCALER_SRC_*).
+ * \param[in] width Width of line in pixels.
+ * \param[in] y Line to convert.
+ * \param[in] keyLUT Palette key lookup table (unused for RGB32 sources).
+ * \param[out] keys Receives width keys.
+ * \param[out] alpha Receives width alpha values, may be NULL.
+ * \return Nothing.
+ */
+PRIVATE INLINECALL void Scaler_keyLine( const void *src, W32 srcFormat, W32 width, W32 y, const W16 *keyLUT, W16 *keys, W8 *alpha )
+{
+	W32 x;
+
+	if( srcFormat == SCALER_SRC_INDEX8 || srcFormat == SCALER_SRC_TABLE8 )
+	{
+		const W8 *in = (const W8 *)src + y * width;
+
+		for( x = 0 ; x < width ; ++x )
+		{
+			keys[ x ] = keyLUT[ in[ x ] ];
+		}
+	}
+	else if( srcFormat == SCALER_SRC_KEY16 )
+	{
+		const W16 *in = (const W16 *)src + y * width;
+
+		for( x = 0 ; x < width ; ++x )
+		{
+			keys[ x ] = keyLUT[ in[ x ] ];
+		}
+
+		if( alpha )
+		{
+			for( x = 0 ; x < width ; ++x )
+			{
+				alpha[ x ] = (in[ x ] & PALETTE_KEY_TRANSPARENT) ? 0x00 : 0xFF;
+			}
+		}
+	}
+	else
+	{
+		const W8 *in = (const W8 *)src + y * width * 4;
+
+		for( x = 0 ; x < width ; ++x, in += 4 )
+		{
+			keys[ x ] = SCALER_KEY565( in[ 0 ], in[ 1 ], in[ 2 ] );
+		}
+
+		if( alpha )
+		{
+			in = (const W8 *)src + y * width * 4;
+
+			for( x = 0 ; x < width ; ++x, in += 4 )
+			{
+				alpha[ x ] = in[ 3 ];
+			}
+		}
+	}
+}
+
+/**
+ * \brief Get the scale factor of a filter.
+ * \param[in] filter Scale filter (SCALER_FILTER_*).
+ * \return Scale factor.
+ */
+PUBLIC W32 Scaler_factor( W32 filter )
+{
+	switch( filter )
+	{
+		case SCALER_FILTER_SCALE2X:
+		case SCALER_FILTER_HQ2X:
+			return 2;
+
+		case SCALER_FILTER_SCALE3X:
+			return 3;
+
+		case SCALER_FILTER_SCALE4X:
+		case SCALER_FILTER_HQ4X:
+			return 4;
+	}
+
+	return 1;
+}
+
+/**
+ * \brief Get the size of a source pixel.
+ * \param[in] srcFormat Source pixel format (SCALER_SRC_*).
+ * \return Bytes per source pixel.
+ */
+PRIVATE INLINECALL W32 Scaler_srcPixelSize( W32 srcFormat )
+{
+	if( srcFormat == SCALER_SRC_INDEX8 || srcFormat == SCALER_SRC_TABLE8 )
+	{
+		return 1;
+	}
+	else if( srcFormat == SCALER_SRC_KEY16 )
+	{
+		return 2;
+	}
+
+	return 4;
+}
+
+/**
+ * \brief Expand a run of source pixels into the final pixel format.
+ * \param[in] src Source pixels.
+ * \param[in] srcFormat Source pixel format (SCALER_SRC_*).
+ * \param[in] npixels Number of pixels.
+ * \param[in] palette Palette array, or colour table for SCALER_SRC_TABLE8 (unused for RGB32 sources).
+ * \param[out] dest Destination buffer.
+ * \param[in] destBpp Destination bytes per pixel, 3 or 4.
+ * \return Nothing.
+ */
+PRIVATE INLINECALL void Scaler_expand( const void *src, W32 srcFormat, W32 npixels, const W8 *palette, W8 *dest, W32 destBpp )
+{
+	if( srcFormat == SCALER_SRC_INDEX8 )
+	{
+		if( destBpp == 3 )
+		{
+			Palette_expandRGB24( (const W8 *)src, dest, npixels, palette );
+		}
+		else
+		{
+			Palette_expandRGB32( (const W8 *)src, dest, npixels, palette );
+		}
+	}
+	else if( srcFormat == SCALER_SRC_KEY16 )
+	{
+		Palette_expandKeyRGB32( (const W16 *)src, dest, npixels, palette );
+	}
+	else if( srcFormat == SCALER_SRC_TABLE8 )
+	{
+		Indexed_toRGB32( (const W8 *)src, dest, npixels, palette );
+	}
+	else if( destBpp == 3 )
+	{
+		RGB32toRGB24( (const W8 *)src, dest, npixels * 4 );
+	}
+	else
+	{
+		MM_MEMCPY( dest, src, npixels * 4 );
+	}
+}
+
+/**
+ * \brief Check that an image can go through the line pipelines.
+ * \param[in] function Name of calling function.
+ * \param[in] srcFormat Source pixel format (SCALER_SRC_*).
+ * \param[in] width Width of source image in pixels.
+ * \param[in] height Height of source image in pixels.
+ * \param[in] destBpp Destination bytes per pixel.
+ * \return true if supported, otherwise false.
+ */
+PRIVATE wtBoolean Scaler_check( const char *function, W32 srcFormat, W32 width, W32 height, W32 destBpp )
+{
+	if( width > SCALER_MAX_WIDTH || width < 2 || height < 2 ||
+		(destBpp != 3 && destBpp != 4) ||
+		((srcFormat == SCALER_SRC_KEY16 || srcFormat == SCALER_SRC_TABLE8) && destBpp != 4) )
+	{
+		fprintf( stderr, "[%s]: Unsupported image (%dx%d, %d bpp)\n", function, width, height, destBpp );
+
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Scale2x line pipeline.
+ * \note Scales source lines [y0, y1), height is the full image height.
+ *		src holds source lines from srcFirst on, and dest receives the
+ *		output of source line y at output line (y - destFirst) * 2.
+ * \note Palette indices must be canonical, see Palette_buildRemap.
+ */
+PRIVATE INLINECALL void Scaler_scale2xLines( const void *src, W32 srcFirst, W32 srcFormat, W32 width, W32 height, W32 y0, W32 y1,
+											const W8 *palette, W8 *dest, W32 destFirst, W32 destBpp, scalerScratch_t *scratch )
+{
+	W32 y;
+	W32 srcPitch;
+	W32 outPitch;
+	const W8 *in;
+	const W8 *src0, *src2;
+	W8 *out;
+
+	srcPitch = width * Scaler_srcPixelSize( srcFormat );
+	outPitch = width * 2 * destBpp;
+
+	for( y = y0 ; y < y1 ; ++y )
+	{
+		in = (const W8 *)src + (y - srcFirst) * srcPitch;
+		src0 = (y > 0) ? in - srcPitch : in;
+		src2 = (y + 1 < height) ? in + srcPitch : in;
+
+		out = dest + (y - destFirst) * 2 * outPitch;
+
+		if( srcFormat == SCALER_SRC_INDEX8 || srcFormat == SCALER_SRC_TABLE8 )
+		{
+			W8 *line = scratch->line;
+
+			scale2x_8( line, line + width * 2, src0, in, src2, width );
+			Scaler_expand( line, srcFormat, width * 2 * 2, palette, out, destBpp );
+		}
+		else if( srcFormat == SCALER_SRC_KEY16 )
+		{
+			W16 *line = (PW16)scratch->line;
+
+			scale2x_16( line, line + width * 2, (const W16 *)src0, (const W16 *)in, (const W16 *)src2, width );
+			Scaler_expand( line, srcFormat, width * 2 * 2, palette, out, destBpp );
+		}
+		else if( destBpp == 4 )
+		{
+			scale2x_32( (PW32)out, (PW32)(out + outPitch), (const W32 *)src0, (const W32 *)in, (const W32 *)src2, width );
+		}
+		else
+		{
+			W32 *line = (PW32)scratch->line;
+
+			scale2x_32( line, line + width * 2, (const W32 *)src0, (const W32 *)in, (const W32 *)src2, width );
+			Scaler_expand( line, srcFormat, width * 2 * 2, palette, out, destBpp );
+		}
+	}
+}
+
+/**
+ * \brief Scale2x line pipeline that keeps the source pixel format.
+ * \note Scales source lines [y0, y1) into dest, which receives the output
+ *		of source line y at output line (y - destFirst) * 2. Feeds the
+ *		second pass of Scale4x.
+ */
+PRIVATE INLINECALL void Scaler_scale2xRawLines( const void *src, W32 srcFormat, W32 width, W32 height, W32 y0, W32 y1,
+												W8 *dest, W32 destFirst )
+{
+	W32 y;
+	W32 pixelSize;
+	W32 srcPitch;
+	const W8 *in;
+	const W8 *src0, *src2;
+	W8 *out0, *out1;
+
+	pixelSize = Scaler_srcPixelSize( srcFormat );
+	srcPitch = width * pixelSize;
+
+	for( y = y0 ; y < y1 ; ++y )
+	{
+		in = (const W8 *)src + y * srcPitch;
+		src0 = (y > 0) ? in - srcPitch : in;
+		src2 = (y + 1 < height) ? in + srcPitch : in;
+
+		out0 = dest + (y - destFirst) * 2 * (srcPitch * 2);
+		out1 = out0 + srcPitch * 2;
+
+		if( pixelSize == 1 )
+		{
+			scale2x_8( out0, out1, src0, in, src2, width );
+		}
+		else if( pixelSize == 2 )
+		{
+			scale2x_16( (PW16)out0, (PW16)out1, (const W16 *)src0, (const W16 *)in, (const W16 *)src2, width );
+		}
+		else
+		{
+			scale2x_32( (PW32)out0, (PW32)out1, (const W32 *)src0, (const W32 *)in, (const W32 *)src2, width );
+		}
+	}
+}
+
+/**
+ * \brief Scale3x line pipeline.
+ * \note Scales source lines [y0, y1), height is the full image height.
+ * \note Palette indices must be canonical, see Palette_buildRemap.
+ */
+PRIVATE INLINECALL void Scaler_scale3xLines( const void *src, W32 srcFormat, W32 width, W32 height, W32 y0, W32 y1,
+											const W8 *palette, W8 *dest, W32 destBpp, scalerScratch_t *scratch )
+{
+	W32 y;
+	W32 srcPitch;
+	W32 outPitch;
+	const W8 *in;
+	const W8 *src0, *src2;
+	W8 *out;
+
+	srcPitch = width * Scaler_srcPixelSize( srcFormat );
+	outPitch = width * 3 * destBpp;
+
+	for( y = y0 ; y < y1 ; ++y )
+	{
+		in = (const W8 *)src + y * srcPitch;
+		src0 = (y > 0) ? in - srcPitch : in;
+		src2 = (y + 1 < height) ? in + srcPitch : in;
+
+		out = dest + y * 3 * outPitch;
+
+		if( srcFormat == SCALER_SRC_INDEX8 || srcFormat == SCALER_SRC_TABLE8 )
+		{
+			W8 *line = scratch->line;
+
+			scale3x_8_def( line, line + width * 3, line + width * 6, src0, in, src2, width );
+			Scaler_expand( line, srcFormat, width * 3 * 3, palette, out, destBpp );
+		}
+		else if( srcFormat == SCALER_SRC_KEY16 )
+		{
+			W16 *line = (PW16)scratch->line;
+
+			scale3x_16_def( line, line + width * 3, line + width * 6, (const W16 *)src0, (const W16 *)in, (const W16 *)src2, width );
+			Scaler_expand( line, srcFormat, width * 3 * 3, palette, out, destBpp );
+		}
+		else if( destBpp == 4 )
+		{
+			scale3x_32_def( (PW32)out, (PW32)(out + outPitch), (PW32)(out + outPitch * 2),
+							(const W32 *)src0, (const W32 *)in, (const W32 *)src2, width );
+		}
+		else
+		{
+			W32 *line = (PW32)scratch->line;
+
+			scale3x_32_def( line, line + width * 3, line + width * 6, (const W32 *)src0, (const W32 *)in, (const W32 *)src2, width );
+			Scaler_expand( line, srcFormat, width * 3 * 3, palette, out, destBpp );
+		}
+	}
+}
+
+/**
+ * \brief hq2x line pipeline.
+ * \note Scales source lines [y0, y1), height is the full image height.
+ *		src holds source lines from srcFirst on, and dest receives the
+ *		output of source line y at output line (y - destFirst) * 2.
+ */
+PRIVATE INLINECALL void Scaler_hq2xLines( const void *src, W32 srcFirst, W32 srcFormat, W32 width, W32 height, W32 y0, W32 y1,
+										const W16 *keyLUT, W8 *dest, W32 destFirst, W32 destBpp, scalerScratch_t *scratch )
+{
+	W16 *prev, *cur, *next, *spare;
+	W8 *aprev, *acur, *anext, *aspare;
+	wtBoolean hasAlpha;
+	W8 *out;
+	W32 outPitch;
+	W32 x, y;
+
+	outPitch = width * 2 * destBpp;
+	hasAlpha = ((srcFormat == SCALER_SRC_KEY16 || srcFormat == SCALER_SRC_RGBA32) && destBpp == 4);
+
+	cur = scratch->keys[ 0 ];
+	next = scratch->keys[ 1 ];
+	spare = scratch->keys[ 2 ];
+
+	acur = scratch->alpha[ 0 ];
+	anext = scratch->alpha[ 1 ];
+	aspare = scratch->alpha[ 2 ];
+
+	Scaler_keyLine( src, srcFormat, width, y0 - srcFirst, keyLUT, cur, hasAlpha ? acur : NULL );
+	prev = cur;
+	aprev = acur;
+
+	/* a band below the top of the image starts with the halo line above it */
+	if( y0 > 0 )
+	{
+		Scaler_keyLine( src, srcFormat, width, y0 - 1 - srcFirst, keyLUT, spare, hasAlpha ? aspare : NULL );
+		prev = spare;
+		aprev = aspare;
+	}
+
+	for( y = y0 ; y < y1 ; ++y )
+	{
+		if( y + 1 < height )
+		{
+			Scaler_keyLine( src, srcFormat, width, y + 1 - srcFirst, keyLUT, next, hasAlpha ? anext : NULL );
+		}
+		else
+		{
+			next = cur;
+			anext = acur;
+		}
+
+		out = dest + (y - destFirst) * 2 * outPitch;
+
+		if( hasAlpha )
+		{
+			hq2x_32_line_alpha( prev, cur, next, aprev, acur, anext, width, out, outPitch );
+		}
+		else if( destBpp == 4 )
+		{
+			/* hq2x writes 32-bit pixels, so it can write in place */
+			hq2x_32_line( prev, cur, next, width, out, outPitch );
+		}
+		else
+		{
+			hq2x_32_line( prev, cur, next, width, scratch->line, width * 2 * 4 );
+
+			for( x = 0 ; x < width * 2 * 2 ; ++x, out += 3 )
+			{
+				out[ 0 ] = scratch->line[ x * 4 + 0 ];
+				out[ 1 ] = scratch->line[ x * 4 + 1 ];
+				out[ 2 ] = scratch->line[ x * 4 + 2 ];
+			}
+		}
+
+		/* rotate line buffers, next is refilled before use */
+		spare = (prev == cur) ? spare : prev;
+		prev = cur;
+		cur = next;
+		next = spare;
+
+		aspare = (aprev == acur) ? aspare : aprev;
+		aprev = acur;
+		acur = anext;
+		anext = aspare;
+	}
+}
+
+/**
+ * \brief 4x line pipeline, two 2x passes.
+ * \note Scales source lines [y0, y1), height is the full image height.
+ *		The lines are taken SCALER_BAND_HEIGHT at a time. The first pass
+ *		scales each group, with the line above and below it, into
+ *		scratch->mid, and the second pass scales the group's own
+ *		intermediate lines into dest.
+ * \note Scale4x keeps the source pixel format between passes. hq4x keeps
+ *		hq2x's 32-bit output, with alpha when the source carries it.
+ */
+PRIVATE INLINECALL void Scaler_scale4xLines( W32 filter, const void *src, W32 srcFormat, W32 width, W32 height, W32 y0, W32 y1,
+											const W8 *palette, const W16 *keyLUT, W8 *dest, W32 destBpp, scalerScratch_t *scratch )
+{
+	W32 ys, ye;
+	W32 s0, s1;
+	W32 midFormat;
+
+	/* alpha is only carried through to 32-bit output */
+	if( srcFormat == SCALER_SRC_RGBA32 && destBpp != 4 )
+	{
+		srcFormat = SCALER_SRC_RGB32;
+	}
+
+	if( filter == SCALER_FILTER_SCALE4X )
+	{
+		midFormat = srcFormat;
+	}
+	else if( (srcFormat == SCALER_SRC_KEY16 || srcFormat == SCALER_SRC_RGBA32) && destBpp == 4 )
+	{
+		midFormat = SCALER_SRC_RGBA32;
+	}
+	else
+	{
+		midFormat = SCALER_SRC_RGB32;
+	}
+
+	for( ys = y0 ; ys < y1 ; ys = ye )
+	{
+		ye = ys + SCALER_BAND_HEIGHT;
+		if( ye > y1 )
+		{
+			ye = y1;
+		}
+
+		s0 = (ys > 0) ? ys - 1 : 0;
+		s1 = (ye < height) ? ye + 1 : height;
+
+		if( filter == SCALER_FILTER_SCALE4X )
+		{
+			Scaler_scale2xRawLines( src, srcFormat, width, height, s0, s1, scratch->mid, s0 );
+
+			Scaler_scale2xLines( scratch->mid, s0 * 2, midFormat, width * 2, height * 2, ys * 2, ye * 2,
+								palette, dest, 0, destBpp, scratch );
+		}
+		else
+		{
+			Scaler_hq2xLines( src, 0, srcFormat, width, height, s0, s1, keyLUT, scratch->mid, s0, 4, scratch );
+
+			Scaler_hq2xLines( scratch->mid, s0 * 2, midFormat, width * 2, height * 2, ys * 2, ye * 2,
+								NULL, dest, 0, destBpp, scratch );
+		}
+	}
+}
+
+/**
+ * \brief Run a band of source lines [y0, y1) through a filter pipeline.
+ */
+PRIVATE INLINECALL void Scaler_band( W32 filter, const void *src, W32 srcFormat, W32 width, W32 height, W32 y0, W32 y1,
+									const W8 *palette, const W16 *keyLUT, W8 *dest, W32 destBpp, scalerScratch_t *scratch )
+{
+	switch( filter )
+	{
+		case SCALER_FILTER_SCALE2X:
+			Scaler_scale2xLines( src, 0, srcFormat, width, height, y0, y1, palette, dest, 0, destBpp, scratch );
+			break;
+
+		case SCALER_FILTER_HQ2X:
+			Scaler_hq2xLines( src, 0, srcFormat, width, height, y0, y1, keyLUT, dest, 0, destBpp, scratch );
+			break;
+
+		case SCALER_FILTER_SCALE3X:
+			Scaler_scale3xLines( src, srcFormat, width, height, y0, y1, palette, dest, destBpp, scratch );
+			break;
+
+		case SCALER_FILTER_SCALE4X:
+		case SCALER_FILTER_HQ4X:
+			Scaler_scale4xLines( filter, src, srcFormat, width, height, y0, y1, palette, keyLUT, dest, destBpp, scratch );
+			break;
+
+		default:
+			Scaler_expand( (const W8 *)src + y0 * width * Scaler_srcPixelSize( srcFormat ), srcFormat, (y1 - y0) * width,
+							palette, dest + y0 * width * destBpp, destBpp );
+			break;
+	}
+}
+
+/**
+ * \brief Run one image through a filter pipeline.
+ */
+PRIVATE INLINECALL void Scaler_image( W32 filter, const void *src, W32 srcFormat, W32 width, W32 height,
+									const W8 *palette, const W16 *keyLUT, W8 *dest, W32 destBpp, scalerScratch_t *scratch )
+{
+	Scaler_band( filter, src, srcFormat, width, height, 0, height, palette, keyLUT, dest, destBpp, scratch );
+}
+
+/**
+ * \brief Scale an image with Scale2x in a single fused pass.
+ * \param[in] src Source image data.
+ * \param[in] srcFormat Source pixel format (SCALER_SRC_*).
+ * \param[in] width Width of source image in pixels.
+ * \param[in] height Height of source image in pixels.
+ * \param[in] palette Palette array, or colour table for SCALER_SRC_TABLE8 (unused for RGB32 sources).
+ * \param[out] dest Destination buffer, (width * 2) * (height * 2) * destBpp bytes.
+ * \param[in] destBpp Destination bytes per pixel, 3 or 4.
+ * \return On success true, otherwise false.
+ * \note Palette indices must be canonical, see Palette_buildRemap.
+ */
+PUBLIC wtBoolean Scaler_scale2x( const void *src, W32 srcFormat, W32 width, W32 height,
+								const W8 *palette, W8 *dest, W32 destBpp )
+{
+	scalerScratch_t *scratch;
+
+	if( ! Scaler_check( "Scaler_scale2x", srcFormat, width, height, destBpp ) )
+	{
+		return false;
+	}
+
+	scratch = (scalerScratch_t *) MM_MALLOC( sizeof( scalerScratch_t ) );
+	if( NULL == scratch )
+	{
+		return false;
+	}
+
+	Scaler_scale2xLines( src, 0, srcFormat, width, height, 0, height, palette, dest, 0, destBpp, scratch );
+
+	MM_FREE( scratch );
+
+	return true;
+}
+
+/**
+ * \brief Scale an image with hq2x in a single fused pass.
+ * \param[in] src Source image data.
+ * \param[in] srcFormat Source pixel format (SCALER_SRC_*).
+ * \param[in] width Width of source image in pixels.
+ * \param[in] height Height of source image in pixels.
+ * \param[in] keyLUT Palette key lookup table from Scaler_buildKeyLUT (unused for RGB32 sources).
+ * \param[out] dest Destination buffer, (width * 2) * (height * 2) * destBpp bytes.
+ * \param[in] destBpp Destination bytes per pixel, 3 or 4.
+ * \return On success true, otherwise false.
+ * \note 32-bit output from 16-bit palette keys carries the transparency mask
+ *		through as a real alpha channel, as does 32-bit output from RGBA32
+ *		sources. Other 32-bit output is written the way hq2x_32 writes it,
+ *		with a zero alpha byte.
+ */
+PUBLIC wtBoolean Scaler_hq2x( const void *src, W32 srcFormat, W32 width, W32 height,
+								const W16 *keyLUT, W8 *dest, W32 destBpp )
+{
+	scalerScratch_t *scratch;
+
+	if( ! Scaler_check( "Scaler_hq2x", srcFormat, width, height, destBpp ) )
+	{
+		return false;
+	}
+
+	scratch = (scalerScratch_t *) MM_MALLOC( sizeof( scalerScratch_t ) );
+	if( NULL == scratch )
+	{
+		return false;
+	}
+
+	Scaler_hq2xLines( src, 0, srcFormat, width, height, 0, height, keyLUT, dest, 0, destBpp, scratch );
+
+	MM_FREE( scratch );
+
+	return true;
+}
+
+
+typedef struct
+{
+	W32 filter;
+	const W8 *src;
+	W32 srcFormat;
+	W32 width, height;
+	W32 srcTileSize;	/* in bytes */
+	const W8 *palette;
+	W16 keyLUT[ 257 ];
+	W8 *dest;
+	W32 destTileSize;	/* in bytes */
+	W32 destBpp;
+	scalerScratch_t *scratch;	/* one per thread */
+
+} scalerBatch_t;
+
+
+/**
+ * \brief Thread pool job, scales one tile of a batch.
+ */
+PRIVATE void Scaler_tileJob( void *param, W32 index, W32 threadId )
+{
+	scalerBatch_t *batch = (scalerBatch_t *)param;
+	const W8 *src = batch->src + index * batch->srcTileSize;
+	W8 *dest = batch->dest + index * batch->destTileSize;
+
+	Scaler_image( batch->filter, src, batch->srcFormat, batch->width, batch->height, batch->palette, batch->keyLUT,
+					dest, batch->destBpp, &batch->scratch[ threadId ] );
+}
+
+/**
+ * \brief Scale a batch of same-sized tiles.
+ * \param[in] filter Scale filter (SCALER_FILTER_*).
+ * \param[in] src Source tiles, stored one after the other.
+ * \param[in] srcFormat Source pixel format (SCALER_SRC_*).
+ * \param[in] width Width of a source tile in pixels.
+ * \param[in] height Height of a source tile in pixels.
+ * \param[in] count Number of tiles.
+ * \param[in] palette Palette array, or colour table for SCALER_SRC_TABLE8 (unused for RGB32 sources).
+ * \param[out] dest Destination tiles, stored one after the other.
+ * \param[in] destBpp Destination bytes per pixel, 3 or 4.
+ * \return On success true, otherwise false.
+ * \note Tiles are spread across the worker thread pool. Each thread gets
+ *		its own line scratch up front, so no allocation happens per tile.
+ */
+PUBLIC wtBoolean Scaler_scaleTiles( W32 filter, const void *src, W32 srcFormat, W32 width, W32 height, W32 count,
+									const W8 *palette, W8 *dest, W32 destBpp )
+{
+	scalerBatch_t batch;
+	W32 factor;
+
+	if( ! Scaler_check( "Scaler_scaleTiles", srcFormat, width, height, destBpp ) )
+	{
+		return false;
+	}
+
+	if( count == 0 )
+	{
+		return true;
+	}
+
+	factor = Scaler_factor( filter );
+
+	batch.filter = filter;
+	batch.src = (const W8 *)src;
+	batch.srcFormat = srcFormat;
+	batch.width = width;
+	batch.height = height;
+	batch.srcTileSize = width * height * Scaler_srcPixelSize( srcFormat );
+	batch.palette = palette;
+	batch.dest = dest;
+	batch.destTileSize = (width * factor) * (height * factor) * destBpp;
+	batch.destBpp = destBpp;
+
+	Scaler_buildFormatKeyLUT( srcFormat, palette, batch.keyLUT );
+
+	batch.scratch = (scalerScratch_t *) MM_MALLOC( ThreadPool_NumThreads() * sizeof( scalerScratch_t ) );
+	if( NULL == batch.scratch )
+	{
+		return false;
+	}
+
+	ThreadPool_Run( Scaler_tileJob, &batch, count );
+
+	MM_FREE( batch.scratch );
+
+	return true;
+}
+
+
+typedef struct
+{
+	W32 filter;
+	const void *src;
+	W32 srcFormat;
+	W32 width, height;
+	const W8 *palette;
+	W16 keyLUT[ 257 ];
+	W8 *dest;
+	W32 destBpp;
+	scalerScratch_t *scratch;	/* one per thread */
+
+} scalerBands_t;
+
+
+/**
+ * \brief Thread pool job, scales one band of rows.
+ */
+PRIVATE void Scaler_bandJob( void *param, W32 index, W32 threadId )
+{
+	scalerBands_t *bands = (scalerBands_t *)param;
+	W32 y0 = index * SCALER_BAND_HEIGHT;
+	W32 y1 = y0 + SCALER_BAND_HEIGHT;
+
+	if( y1 > bands->height )
+	{
+		y1 = bands->height;
+	}
+
+	Scaler_band( bands->filter, bands->src, bands->srcFormat, bands->width, bands->height, y0, y1,
+				bands->palette, bands->keyLUT, bands->dest, bands->destBpp, &bands->scratch[ threadId ] );
+}
+
+/**
+ * \brief Scale one image, split into bands of rows across the worker thread pool.
+ * \param[in] filter Scale filter (SCALER_FILTER_*).
+ * \param[in] src Source image data.
+ * \param[in] srcFormat Source pixel format (SCALER_SRC_*).
+ * \param[in] width Width of source image in pixels.
+ * \param[in] height Height of source image in pixels.
+ * \param[in] palette Palette array, or colour table for SCALER_SRC_TABLE8 (unused for RGB32 sources).
+ * \param[out] dest Destination buffer, sized for the filter's scale factor.
+ * \param[in] destBpp Destination bytes per pixel, 3 or 4.
+ * \return On success true, otherwise false.
+ * \note Output is identical to scaling the image in a single pass.
+ */
+PUBLIC wtBoolean Scaler_scaleImage( W32 filter, const void *src, W32 srcFormat, W32 width, W32 height,
+									const W8 *palette, W8 *dest, W32 destBpp )
+{
+	scalerBands_t bands;
+
+	if( ! Scaler_check( "Scaler_scaleImage", srcFormat, width, height, destBpp ) )
+	{
+		return false;
+	}
+
+	bands.filter = filter;
+	bands.src = src;
+	bands.srcFormat = srcFormat;
+	bands.width = width;
+	bands.height = height;
+	bands.palette = palette;
+	bands.dest = dest;
+	bands.destBpp = destBpp;
+
+	Scaler_buildFormatKeyLUT( srcFormat, palette, bands.keyLUT );
+
+	bands.scratch = (scalerScratch_t *) MM_MALLOC( ThreadPool_NumThreads() * sizeof( scalerScratch_t ) );
+	if( NULL == bands.scratch )
+	{
+		return false;
+	}
+
+	ThreadPool_Run( Scaler_bandJob, &bands, (height + SCALER_BAND_HEIGHT - 1) / SCALER_BAND_HEIGHT );
+
+	MM_FREE( bands.scratch );
+
+	return true;
+}
@@ -0,0 +1,70 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file scaler.h
+ * \brief Fused image scaling pipelines.
+ * \date 2013
+ */
+
+#ifndef __SCALER_H__
+#define __SCALER_H__
+
+
+#include "../common/platform.h"
+
+
+/* Widest source line the fused pipelines can handle */
+#define SCALER_MAX_WIDTH	1024
+
+/* Scale filters */
+#define SCALER_FILTER_NONE		0
+#define SCALER_FILTER_SCALE2X	1
+#define SCALER_FILTER_HQ2X		2
+#define SCALER_FILTER_SCALE3X	3
+#define SCALER_FILTER_SCALE4X	4	/* Scale2x applied twice */
+#define SCALER_FILTER_HQ4X		5	/* hq2x applied twice */
+
+/* Source pixel formats */
+#define SCALER_SRC_INDEX8	0	/* 8-bit palette indices */
+#define SCALER_SRC_KEY16	1	/* 16-bit palette keys, see PALETTE_KEY_TRANSPARENT */
+#define SCALER_SRC_RGB32	2	/* RGB32 image data */
+#define SCALER_SRC_TABLE8	3	/* 8-bit indices into an RGBA colour table, see RGB32_toIndexed */
+#define SCALER_SRC_RGBA32	4	/* RGB32 image data with a real alpha channel */
+
+
+W32 Scaler_factor( W32 filter );
+
+void Scaler_buildKeyLUT( const W8 *palette, W16 *keyLUT );
+
+wtBoolean Scaler_scale2x( const void *src, W32 srcFormat, W32 width, W32 height,
+						const W8 *palette, W8 *dest, W32 destBpp );
+
+wtBoolean Scaler_hq2x( const void *src, W32 srcFormat, W32 width, W32 height,
+						const W16 *keyLUT, W8 *dest, W32 destBpp );
+
+wtBoolean Scaler_scaleTiles( W32 filter, const void *src, W32 srcFormat, W32 width, W32 height, W32 count,
+						const W8 *palette, W8 *dest, W32 destBpp );
+
+wtBoolean Scaler_scaleImage( W32 filter, const void *src, W32 srcFormat, W32 width, W32 height,
+						const W8 *palette, W8 *dest, W32 destBpp );
+
+
+#endif /* __SCALER_H__ */
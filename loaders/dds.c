@@ -0,0 +1,171 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file dds.c
+ * \brief Handle DirectDraw Surface (DDS) file format.
+ * \date 2013
+ * \note Images are stored block compressed, DXT1 for opaque and alpha
+ *		tested images and DXT5 otherwise, with the whole mip chain in one
+ *		file so a loader can hand each level straight to the GPU.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "../memory/memory.h"
+#include "../memory/membuf.h"
+#include "../image/dxt.h"
+#include "../image/mipmap.h"
+#include "dds.h"
+
+
+/* Size of the magic number and DDS_HEADER */
+#define DDS_HEADER_SIZE		128
+
+/* DDS_HEADER flags */
+#define DDSD_CAPS			0x00000001
+#define DDSD_HEIGHT			0x00000002
+#define DDSD_WIDTH			0x00000004
+#define DDSD_PIXELFORMAT	0x00001000
+#define DDSD_MIPMAPCOUNT	0x00020000
+#define DDSD_LINEARSIZE		0x00080000
+
+/* DDS_PIXELFORMAT flags */
+#define DDPF_ALPHAPIXELS	0x00000001
+#define DDPF_FOURCC			0x00000004
+
+/* DDS_HEADER caps */
+#define DDSCAPS_COMPLEX		0x00000008
+#define DDSCAPS_TEXTURE		0x00001000
+#define DDSCAPS_MIPMAP		0x00400000
+
+
+/**
+ * \brief Store a 32-bit value in little endian byte order.
+ */
+PRIVATE INLINECALL void DDS_put32( W8 *p, W32 value )
+{
+	p[ 0 ] = (W8)(value);
+	p[ 1 ] = (W8)(value >> 8);
+	p[ 2 ] = (W8)(value >> 16);
+	p[ 3 ] = (W8)(value >> 24);
+}
+
+/**
+ * \brief Encode DDS image file into memory.
+ * \param[in,out] out Buffer the file is appended to.
+ * \param[in] bpp Bits per pixel, 24 (RGB) or 32 (RGBA).
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \param[in] Data Raw image data, top row first.
+ * \param[in] mips Mip levels below Data, see Mipmap_buildChain, or NULL.
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean DDS_encode( memBuffer_t *out, W16 bpp, W32 width, W32 height,
+            const void *Data, const void *mips )
+{
+	W8 *header;
+	const W8 *src = (const W8 *)Data;
+	W32 bytes = bpp >> 3;
+	W32 levels, format, mipFormat, size, level;
+	W32 flags, caps;
+
+	if( bpp != 24 && bpp != 32 )
+	{
+		fprintf( stderr, "[DDS_encode]: Unsupported bits per pixel (%d)\n", bpp );
+
+		return false;
+	}
+
+	levels = 1;
+	format = DXT_chooseFormat( src, width * height, bytes );
+	if( mips )
+	{
+		levels += Mipmap_levels( width, height );
+		mipFormat = DXT_chooseFormat( (const W8 *)mips, Mipmap_chainSize( width, height, bytes ) / bytes, bytes );
+		if( mipFormat > format )
+		{
+			format = mipFormat;
+		}
+	}
+
+	if( ! MemBuffer_Reserve( out, DDS_HEADER_SIZE ) )
+	{
+		return false;
+	}
+
+	header = out->data + out->length;
+	memset( header, 0, DDS_HEADER_SIZE );
+
+	flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+	caps = DDSCAPS_TEXTURE;
+	if( levels > 1 )
+	{
+		flags |= DDSD_MIPMAPCOUNT;
+		caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	}
+
+	MM_MEMCPY( header, "DDS ", 4 );
+	DDS_put32( header + 4, 124 );					/* dwSize */
+	DDS_put32( header + 8, flags );
+	DDS_put32( header + 12, height );
+	DDS_put32( header + 16, width );
+	DDS_put32( header + 20, DXT_imageSize( format, width, height ) );	/* dwPitchOrLinearSize */
+	DDS_put32( header + 28, levels );				/* dwMipMapCount */
+
+	/* DDS_PIXELFORMAT */
+	DDS_put32( header + 76, 32 );
+	DDS_put32( header + 80, DDPF_FOURCC | (format == DXT_FORMAT_BC1A ? DDPF_ALPHAPIXELS : 0) );
+	MM_MEMCPY( header + 84, format == DXT_FORMAT_BC3 ? "DXT5" : "DXT1", 4 );
+
+	DDS_put32( header + 108, caps );
+
+	out->length += DDS_HEADER_SIZE;
+
+	for( level = 0 ; level < levels ; ++level )
+	{
+		if( level == 1 )
+		{
+			src = (const W8 *)mips;
+		}
+
+		size = DXT_imageSize( format, width, height );
+		if( ! MemBuffer_Reserve( out, size ) )
+		{
+			return false;
+		}
+
+		DXT_compressImage( format, src, width, height, bytes, out->data + out->length );
+		out->length += size;
+
+		if( level > 0 )
+		{
+			src += width * height * bytes;
+		}
+
+		width = width > 1 ? width >> 1 : 1;
+		height = height > 1 ? height >> 1 : 1;
+	}
+
+	return true;
+}
@@ -0,0 +1,39 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file dds.h
+ * \brief Handles DDS file saving.
+ * \date 2013
+ * \note This module is implemented by dds.c
+ */
+
+#ifndef __DDS_H__
+#define __DDS_H__
+
+#include "../common/platform.h"
+#include "../memory/membuf.h"
+
+
+wtBoolean DDS_encode( memBuffer_t *out, W16 bpp, W32 width, W32 height,
+            const void *Data, const void *mips );
+
+
+#endif /* __DDS_H__ */
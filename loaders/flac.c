@@ -0,0 +1,884 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file flac.c
+ * \brief Handle FLAC file format.
+ * \date 2013
+ * \note Each channel of a block is stored with whichever subframe is
+ *		smallest: constant, verbatim, the fixed polynomial predictor of
+ *		order 0 to 4 with the least residual, or a quantized LPC predictor
+ *		of up to order 8 found with Levinson-Durbin on a Welch windowed
+ *		block. Residuals are Rice coded with the partition order and
+ *		parameters that give the fewest bits. Channels are coded
+ *		independently and the STREAMINFO MD5 signature is left unset.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "../common/platform.h"
+#include "../memory/memory.h"
+#include "../memory/membuf.h"
+#include "../common/common_utils.h"
+#include "../filesys/writequeue.h"
+#include "flac.h"
+
+
+#define FLAC_BLOCKSIZE				4096	/* samples per channel in a frame */
+#define FLAC_MAX_CHANNELS			8
+#define FLAC_MAX_FIXED_ORDER		4
+#define FLAC_MAX_LPC_ORDER			8
+#define FLAC_MAX_PARTITION_ORDER	8
+#define FLAC_MAX_RICE_PARAM			14		/* 15 is the escape code */
+
+#define FLAC_STREAMINFO_SIZE		42		/* "fLaC", block header and STREAMINFO */
+
+#define FLAC_SUBFRAME_CONSTANT		0
+#define FLAC_SUBFRAME_VERBATIM		1
+#define FLAC_SUBFRAME_FIXED			8		/* + order */
+#define FLAC_SUBFRAME_LPC			32		/* + order - 1 */
+
+
+/* Bit writer, most significant bit first */
+typedef struct
+{
+	W8 *ptr;		/* next byte to write */
+	W64 bits;		/* pending bits */
+	W32 count;		/* number of pending bits, always < 8 between calls */
+
+} flacBits_t;
+
+/* How one channel of a block is coded */
+typedef struct
+{
+	W32 type;
+	W32 order;
+	W32 precision;		/* LPC coefficient precision */
+	W32 shift;			/* LPC quantization shift */
+	SW32 coeffs[ FLAC_MAX_LPC_ORDER ];
+	W32 partitionOrder;
+	W8 params[ 1 << FLAC_MAX_PARTITION_ORDER ];
+	W64 bits;			/* size of the subframe */
+
+} flacSubframe_t;
+
+/* Scratch space of one encode */
+typedef struct
+{
+	SW32 *samples[ FLAC_MAX_CHANNELS ];
+	W32 *residual;		/* zig-zag coded residual of the best subframe so far */
+	W32 *candidate;		/* residual being tried */
+	double *window;
+
+} flacWork_t;
+
+
+PRIVATE W8 crc8Table[ 256 ];
+PRIVATE W16 crc16Table[ 256 ];
+
+
+/**
+ * \brief Build the CRC-8 (x^8+x^2+x+1) and CRC-16 (x^16+x^15+x^2+1) tables.
+ * \note Call once at start up, before any worker threads are running.
+ */
+PUBLIC void FLAC_init( void )
+{
+	W32 i, j;
+	W32 crc;
+
+	for( i = 0 ; i < 256 ; ++i )
+	{
+		crc = i;
+		for( j = 0 ; j < 8 ; ++j )
+		{
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+		}
+		crc8Table[ i ] = (W8)crc;
+
+		crc = i << 8;
+		for( j = 0 ; j < 8 ; ++j )
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : (crc << 1);
+		}
+		crc16Table[ i ] = (W16)crc;
+	}
+}
+
+PRIVATE W8 FLAC_crc8( const W8 *data, W32 length )
+{
+	W8 crc = 0;
+
+	while( length-- )
+	{
+		crc = crc8Table[ crc ^ *data++ ];
+	}
+
+	return crc;
+}
+
+PRIVATE W16 FLAC_crc16( const W8 *data, W32 length )
+{
+	W16 crc = 0;
+
+	while( length-- )
+	{
+		crc = (W16)((crc << 8) ^ crc16Table[ (crc >> 8) ^ *data++ ]);
+	}
+
+	return crc;
+}
+
+
+/**
+ * \brief Append the low n bits of value, n is at most 32.
+ */
+PRIVATE INLINECALL void FLAC_putBits( flacBits_t *bw, W32 value, W32 n )
+{
+	bw->bits = (bw->bits << n) | (value & (W32)(((W64)1 << n) - 1));
+	bw->count += n;
+
+	while( bw->count >= 8 )
+	{
+		bw->count -= 8;
+		*bw->ptr++ = (W8)(bw->bits >> bw->count);
+	}
+}
+
+/**
+ * \brief Append a Rice code, value >> k in unary then the low k bits.
+ */
+PRIVATE INLINECALL void FLAC_putRice( flacBits_t *bw, W32 value, W32 k )
+{
+	W32 q = value >> k;
+
+	while( q + 1 + k > 32 )
+	{
+		W32 zeros = (q > 32) ? 32 : q;
+
+		FLAC_putBits( bw, 0, zeros );
+		q -= zeros;
+	}
+
+	FLAC_putBits( bw, (1 << k) | (value & ((1 << k) - 1)), q + 1 + k );
+}
+
+/**
+ * \brief Pad with zero bits up to the next byte.
+ */
+PRIVATE void FLAC_alignBits( flacBits_t *bw )
+{
+	if( bw->count )
+	{
+		FLAC_putBits( bw, 0, 8 - bw->count );
+	}
+}
+
+/**
+ * \brief Append value in the UTF-8 like coding FLAC uses for frame numbers.
+ */
+PRIVATE void FLAC_putUTF8( flacBits_t *bw, W32 value )
+{
+	W32 bytes;
+	W32 i;
+
+	if( value < 0x80 )
+	{
+		FLAC_putBits( bw, value, 8 );
+		return;
+	}
+
+	for( bytes = 2 ; bytes < 6 && value >= (1U << (5 * bytes + 1)) ; ++bytes )
+	{
+		;
+	}
+
+	FLAC_putBits( bw, ((0xFF00 >> bytes) & 0xFF) | (value >> (6 * (bytes - 1))), 8 );
+	for( i = bytes - 1 ; i > 0 ; --i )
+	{
+		FLAC_putBits( bw, 0x80 | ((value >> (6 * (i - 1))) & 0x3F), 8 );
+	}
+}
+
+
+/**
+ * \brief Bits needed to Rice code a partition with parameter k.
+ * \note sum >> k is never less than the sum of each value >> k, so the
+ *		count is an upper bound of what FLAC_putRice writes.
+ */
+PRIVATE INLINECALL W64 FLAC_riceBits( W64 sum, W32 count, W32 k )
+{
+	return (W64)count * (k + 1) + (sum >> k);
+}
+
+/**
+ * \brief Pick the Rice partition order and parameters for a residual.
+ * \param[in] residual Zig-zag coded residual, blocksize - order values.
+ * \param[in] blocksize Samples in the block.
+ * \param[in] order Predictor order, the warm up samples have no residual.
+ * \param[out] sub Receives partitionOrder and params.
+ * \return Size of the residual section in bits.
+ */
+PRIVATE W64 FLAC_chooseRice( const W32 *residual, W32 blocksize, W32 order, flacSubframe_t *sub )
+{
+	W64 sums[ 1 << FLAC_MAX_PARTITION_ORDER ];
+	W8 params[ 1 << FLAC_MAX_PARTITION_ORDER ];
+	W32 maxOrder = 0;
+	W32 partitionOrder;
+	W32 partitions, partitionSize;
+	W32 p, i, k, start, count;
+	W64 bits, best = 0;
+
+	/* finest partitioning the block allows */
+	while( maxOrder < FLAC_MAX_PARTITION_ORDER &&
+		   (blocksize & ((2U << maxOrder) - 1)) == 0 &&
+		   (blocksize >> (maxOrder + 1)) > order )
+	{
+		maxOrder++;
+	}
+
+	partitions = 1 << maxOrder;
+	partitionSize = blocksize >> maxOrder;
+	for( p = 0, i = 0 ; p < partitions ; ++p )
+	{
+		count = partitionSize - (p ? 0 : order);
+		sums[ p ] = 0;
+		for( start = i ; i < start + count ; ++i )
+		{
+			sums[ p ] += residual[ i ];
+		}
+	}
+
+	/* work up from the finest partitioning, merging neighbours */
+	for( partitionOrder = maxOrder ; ; --partitionOrder )
+	{
+		partitions = 1 << partitionOrder;
+		partitionSize = blocksize >> partitionOrder;
+
+		bits = 2 + 4;
+		for( p = 0 ; p < partitions ; ++p )
+		{
+			W64 partBits, kBits;
+
+			count = partitionSize - (p ? 0 : order);
+
+			params[ p ] = 0;
+			partBits = FLAC_riceBits( sums[ p ], count, 0 );
+			for( k = 1 ; k <= FLAC_MAX_RICE_PARAM ; ++k )
+			{
+				kBits = FLAC_riceBits( sums[ p ], count, k );
+				if( kBits < partBits )
+				{
+					partBits = kBits;
+					params[ p ] = (W8)k;
+				}
+			}
+
+			bits += 4 + partBits;
+		}
+
+		if( partitionOrder == maxOrder || bits < best )
+		{
+			best = bits;
+			sub->partitionOrder = partitionOrder;
+			MM_MEMCPY( sub->params, params, partitions );
+		}
+
+		if( partitionOrder == 0 )
+		{
+			break;
+		}
+
+		for( p = 0 ; p < partitions / 2 ; ++p )
+		{
+			sums[ p ] = sums[ 2 * p ] + sums[ 2 * p + 1 ];
+		}
+	}
+
+	return best;
+}
+
+PRIVATE INLINECALL W32 FLAC_zigzag( SW32 value )
+{
+	return ((W32)value << 1) ^ (W32)(value >> 31);
+}
+
+/**
+ * \brief Residual of a fixed polynomial predictor.
+ */
+PRIVATE void FLAC_fixedResidual( const SW32 *x, W32 n, W32 order, W32 *residual )
+{
+	W32 i;
+
+	for( i = order ; i < n ; ++i )
+	{
+		SW32 r;
+
+		switch( order )
+		{
+			case 0:  r = x[ i ]; break;
+			case 1:  r = x[ i ] - x[ i - 1 ]; break;
+			case 2:  r = x[ i ] - 2 * x[ i - 1 ] + x[ i - 2 ]; break;
+			case 3:  r = x[ i ] - 3 * x[ i - 1 ] + 3 * x[ i - 2 ] - x[ i - 3 ]; break;
+			default: r = x[ i ] - 4 * x[ i - 1 ] + 6 * x[ i - 2 ] - 4 * x[ i - 3 ] + x[ i - 4 ]; break;
+		}
+
+		residual[ i - order ] = FLAC_zigzag( r );
+	}
+}
+
+/**
+ * \brief Fixed predictor order with the smallest residual.
+ */
+PRIVATE W32 FLAC_bestFixedOrder( const SW32 *x, W32 n )
+{
+	W64 error[ FLAC_MAX_FIXED_ORDER + 1 ] = { 0, 0, 0, 0, 0 };
+	W32 order, best;
+	W32 i;
+
+	for( i = FLAC_MAX_FIXED_ORDER ; i < n ; ++i )
+	{
+		SW32 e0 = x[ i ];
+		SW32 e1 = e0 - x[ i - 1 ];
+		SW32 e2 = e1 - (x[ i - 1 ] - x[ i - 2 ]);
+		SW32 e3 = e2 - (x[ i - 1 ] - 2 * x[ i - 2 ] + x[ i - 3 ]);
+		SW32 e4 = e3 - (x[ i - 1 ] - 3 * x[ i - 2 ] + 3 * x[ i - 3 ] - x[ i - 4 ]);
+
+		error[ 0 ] += (W32)(e0 < 0 ? -e0 : e0);
+		error[ 1 ] += (W32)(e1 < 0 ? -e1 : e1);
+		error[ 2 ] += (W32)(e2 < 0 ? -e2 : e2);
+		error[ 3 ] += (W32)(e3 < 0 ? -e3 : e3);
+		error[ 4 ] += (W32)(e4 < 0 ? -e4 : e4);
+	}
+
+	best = 0;
+	for( order = 1 ; order <= FLAC_MAX_FIXED_ORDER && order < n ; ++order )
+	{
+		if( error[ order ] < error[ best ] )
+		{
+			best = order;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * \brief Find the LPC predictor for a block and quantize it.
+ * \param[in] x Samples of one channel.
+ * \param[in] n Samples in the block.
+ * \param[in] bits Bits per sample.
+ * \param[in] window Welch window for n samples.
+ * \param[out] sub Receives order, precision, shift and coeffs.
+ * \return false if the block has no usable predictor.
+ */
+PRIVATE wtBoolean FLAC_computeLPC( const SW32 *x, W32 n, W32 bits, const double *window, flacSubframe_t *sub )
+{
+	double autoc[ FLAC_MAX_LPC_ORDER + 1 ];
+	double lpc[ FLAC_MAX_LPC_ORDER ];
+	double coeffs[ FLAC_MAX_LPC_ORDER ][ FLAC_MAX_LPC_ORDER ];
+	double error[ FLAC_MAX_LPC_ORDER ];
+	double err, r, tmp, cmax, qerror, bestBits, estimate;
+	W32 maxOrder, order, precision;
+	W32 i, j, lag;
+	int log2cmax;
+	SW32 qmax, qmin, q;
+	SW32 shift;
+
+	maxOrder = FLAC_MAX_LPC_ORDER;
+	if( maxOrder >= n )
+	{
+		return false;
+	}
+
+	/* autocorrelation of the windowed block */
+	for( lag = 0 ; lag <= maxOrder ; ++lag )
+	{
+		double sum = 0.0;
+
+		for( i = lag ; i < n ; ++i )
+		{
+			sum += (x[ i ] * window[ i ]) * (x[ i - lag ] * window[ i - lag ]);
+		}
+		autoc[ lag ] = sum;
+	}
+
+	if( autoc[ 0 ] <= 0.0 )
+	{
+		return false;
+	}
+
+	/* Levinson-Durbin recursion */
+	err = autoc[ 0 ];
+	for( i = 0 ; i < maxOrder ; ++i )
+	{
+		r = -autoc[ i + 1 ];
+		for( j = 0 ; j < i ; ++j )
+		{
+			r -= lpc[ j ] * autoc[ i - j ];
+		}
+		r /= err;
+
+		lpc[ i ] = r;
+		for( j = 0 ; j < (i >> 1) ; ++j )
+		{
+			tmp = lpc[ j ];
+			lpc[ j ] += r * lpc[ i - 1 - j ];
+			lpc[ i - 1 - j ] += r * tmp;
+		}
+		if( i & 1 )
+		{
+			lpc[ j ] += lpc[ j ] * r;
+		}
+
+		err *= (1.0 - r * r);
+
+		for( j = 0 ; j <= i ; ++j )
+		{
+			coeffs[ i ][ j ] = -lpc[ j ];
+		}
+		error[ i ] = err;
+
+		if( err <= 0.0 )
+		{
+			maxOrder = i + 1;
+			break;
+		}
+	}
+
+	/* coefficient precision grows with the block size, as in the reference encoder */
+	precision = (n <= 192) ? 7 : (n <= 384) ? 8 : (n <= 576) ? 9 :
+				(n <= 1152) ? 10 : (n <= 2304) ? 11 : 12;
+
+	/* order with the smallest expected size */
+	order = 1;
+	bestBits = 0.0;
+	for( i = 0 ; i < maxOrder ; ++i )
+	{
+		double perSample = (error[ i ] > 0.0) ?
+			0.5 * log( 0.5 * error[ i ] / n ) / 0.6931471805599453 : 0.0;
+
+		if( perSample < 0.0 )
+		{
+			perSample = 0.0;
+		}
+
+		estimate = perSample * (n - i - 1) + (i + 1) * (bits + precision);
+		if( i == 0 || estimate < bestBits )
+		{
+			bestBits = estimate;
+			order = i + 1;
+		}
+	}
+
+	/* quantize */
+	cmax = 0.0;
+	for( j = 0 ; j < order ; ++j )
+	{
+		if( fabs( coeffs[ order - 1 ][ j ] ) > cmax )
+		{
+			cmax = fabs( coeffs[ order - 1 ][ j ] );
+		}
+	}
+
+	if( cmax <= 0.0 )
+	{
+		return false;
+	}
+
+	(void)frexp( cmax, &log2cmax );
+	log2cmax--;
+	shift = (SW32)precision - 1 - log2cmax - 1;
+	if( shift > 15 )
+	{
+		shift = 15;
+	}
+	if( shift < 0 )
+	{
+		return false;
+	}
+
+	qmax = (1 << (precision - 1)) - 1;
+	qmin = -(1 << (precision - 1));
+	qerror = 0.0;
+	for( j = 0 ; j < order ; ++j )
+	{
+		qerror += coeffs[ order - 1 ][ j ] * (1 << shift);
+		q = (SW32)floor( qerror + 0.5 );
+		if( q > qmax ) q = qmax;
+		if( q < qmin ) q = qmin;
+		qerror -= q;
+		sub->coeffs[ j ] = q;
+	}
+
+	sub->order = order;
+	sub->precision = precision;
+	sub->shift = (W32)shift;
+
+	return true;
+}
+
+/**
+ * \brief Residual of a quantized LPC predictor.
+ */
+PRIVATE void FLAC_lpcResidual( const SW32 *x, W32 n, const flacSubframe_t *sub, W32 *residual )
+{
+	W32 i, j;
+
+	for( i = sub->order ; i < n ; ++i )
+	{
+		SW64 sum = 0;
+
+		for( j = 0 ; j < sub->order ; ++j )
+		{
+			sum += (SW64)sub->coeffs[ j ] * x[ i - j - 1 ];
+		}
+
+		residual[ i - sub->order ] = FLAC_zigzag( x[ i ] - (SW32)(sum >> sub->shift) );
+	}
+}
+
+/**
+ * \brief Choose how to code one channel of a block.
+ * \param[in] x Samples of the channel.
+ * \param[in] n Samples in the block.
+ * \param[in] bits Bits per sample.
+ * \param[in,out] work Scratch space, the chosen residual is left in work->residual.
+ * \param[out] sub Chosen coding.
+ */
+PRIVATE void FLAC_chooseSubframe( const SW32 *x, W32 n, W32 bits, flacWork_t *work, flacSubframe_t *sub )
+{
+	flacSubframe_t trial;
+	W32 *swap;
+	W32 i;
+	W64 residualBits;
+
+	/* subframe header is 8 bits */
+	for( i = 1 ; i < n && x[ i ] == x[ 0 ] ; ++i )
+	{
+		;
+	}
+	if( i == n )
+	{
+		sub->type = FLAC_SUBFRAME_CONSTANT;
+		sub->order = 0;
+		sub->bits = 8 + bits;
+		return;
+	}
+
+	sub->type = FLAC_SUBFRAME_VERBATIM;
+	sub->order = 0;
+	sub->bits = 8 + (W64)n * bits;
+
+	/* fixed polynomial predictor */
+	trial.precision = 0;
+	trial.shift = 0;
+	trial.order = FLAC_bestFixedOrder( x, n );
+	if( trial.order < n )
+	{
+		FLAC_fixedResidual( x, n, trial.order, work->candidate );
+		residualBits = FLAC_chooseRice( work->candidate, n, trial.order, &trial );
+		trial.bits = 8 + (W64)trial.order * bits + residualBits;
+		if( trial.bits < sub->bits )
+		{
+			trial.type = FLAC_SUBFRAME_FIXED + trial.order;
+			*sub = trial;
+			swap = work->residual; work->residual = work->candidate; work->candidate = swap;
+		}
+	}
+
+	/* linear predictor */
+	if( FLAC_computeLPC( x, n, bits, work->window, &trial ) )
+	{
+		FLAC_lpcResidual( x, n, &trial, work->candidate );
+		residualBits = FLAC_chooseRice( work->candidate, n, trial.order, &trial );
+		trial.bits = 8 + (W64)trial.order * bits + 4 + 5 + (W64)trial.order * trial.precision + residualBits;
+		if( trial.bits < sub->bits )
+		{
+			trial.type = FLAC_SUBFRAME_LPC + trial.order - 1;
+			*sub = trial;
+			swap = work->residual; work->residual = work->candidate; work->candidate = swap;
+		}
+	}
+}
+
+/**
+ * \brief Write one channel of a block.
+ */
+PRIVATE void FLAC_writeSubframe( flacBits_t *bw, const SW32 *x, W32 n, W32 bits, const flacSubframe_t *sub, const W32 *residual )
+{
+	W32 i, p;
+	W32 partitions, partitionSize, count;
+
+	FLAC_putBits( bw, sub->type << 1, 8 );	/* zero pad, type, no wasted bits */
+
+	if( sub->type == FLAC_SUBFRAME_CONSTANT )
+	{
+		FLAC_putBits( bw, (W32)x[ 0 ], bits );
+		return;
+	}
+
+	if( sub->type == FLAC_SUBFRAME_VERBATIM )
+	{
+		for( i = 0 ; i < n ; ++i )
+		{
+			FLAC_putBits( bw, (W32)x[ i ], bits );
+		}
+		return;
+	}
+
+	/* warm up samples */
+	for( i = 0 ; i < sub->order ; ++i )
+	{
+		FLAC_putBits( bw, (W32)x[ i ], bits );
+	}
+
+	if( sub->type >= FLAC_SUBFRAME_LPC )
+	{
+		FLAC_putBits( bw, sub->precision - 1, 4 );
+		FLAC_putBits( bw, sub->shift, 5 );
+		for( i = 0 ; i < sub->order ; ++i )
+		{
+			FLAC_putBits( bw, (W32)sub->coeffs[ i ], sub->precision );
+		}
+	}
+
+	/* Rice coded residual with 4 bit parameters */
+	FLAC_putBits( bw, 0, 2 );
+	FLAC_putBits( bw, sub->partitionOrder, 4 );
+
+	partitions = 1 << sub->partitionOrder;
+	partitionSize = n >> sub->partitionOrder;
+	for( p = 0 ; p < partitions ; ++p )
+	{
+		count = partitionSize - (p ? 0 : sub->order);
+
+		FLAC_putBits( bw, sub->params[ p ], 4 );
+		for( i = 0 ; i < count ; ++i )
+		{
+			FLAC_putRice( bw, *residual++, sub->params[ p ] );
+		}
+	}
+}
+
+/**
+ * \brief Encode PCM data to a FLAC stream in memory.
+ * \param[in,out] out Initialized buffer the stream is appended to.
+ * \param[in] data Interleaved PCM data, 8 bit unsigned or 16 bit signed little endian as in a wav file.
+ * \param[in] size Length of data in bytes.
+ * \param[in] channels Number of channels, 1 to 8.
+ * \param[in] sample_rate Sample rate in Hz.
+ * \param[in] bits Bits per sample, 8 or 16.
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean FLAC_encode( memBuffer_t *out, const void *data, W32 size,
+			W16 channels, W32 sample_rate, W16 bits )
+{
+	const W8 *src = (const W8 *)data;
+	flacWork_t work;
+	flacSubframe_t sub;
+	flacBits_t bw;
+	W8 *buffer;
+	W32 bytesPerSample;
+	W32 totalSamples;
+	W32 frame, numFrames;
+	W32 start, n, i, c;
+	W32 frameStart, frameSize;
+	W32 minFrame = ~0U, maxFrame = 0;
+	W16 crc;
+
+	if( (bits != 8 && bits != 16) || channels < 1 || channels > FLAC_MAX_CHANNELS ||
+		sample_rate < 1 || sample_rate > 655350 )
+	{
+		fprintf( stderr, "[FLAC_encode]: Unsupported format (%d channels, %d Hz, %d bits)\n", channels, sample_rate, bits );
+
+		return false;
+	}
+
+	bytesPerSample = bits / 8;
+	totalSamples = size / (bytesPerSample * channels);
+	numFrames = (totalSamples + FLAC_BLOCKSIZE - 1) / FLAC_BLOCKSIZE;
+
+	buffer = (PW8) MM_MALLOC( (channels + 2) * FLAC_BLOCKSIZE * sizeof( SW32 ) + FLAC_BLOCKSIZE * sizeof( double ) );
+	if( buffer == NULL )
+	{
+		return false;
+	}
+
+	for( c = 0 ; c < channels ; ++c )
+	{
+		work.samples[ c ] = (SW32 *)buffer + c * FLAC_BLOCKSIZE;
+	}
+	work.residual = (W32 *)buffer + channels * FLAC_BLOCKSIZE;
+	work.candidate = (W32 *)buffer + (channels + 1) * FLAC_BLOCKSIZE;
+	work.window = (double *)(buffer + (channels + 2) * FLAC_BLOCKSIZE * sizeof( SW32 ));
+
+
+	/* STREAMINFO is filled in once the frame sizes are known */
+	start = out->length;
+	if( ! MemBuffer_Reserve( out, FLAC_STREAMINFO_SIZE ) )
+	{
+		MM_FREE( buffer );
+
+		return false;
+	}
+	out->length += FLAC_STREAMINFO_SIZE;
+
+
+	for( frame = 0 ; frame < numFrames ; ++frame )
+	{
+		n = totalSamples - frame * FLAC_BLOCKSIZE;
+		if( n > FLAC_BLOCKSIZE )
+		{
+			n = FLAC_BLOCKSIZE;
+		}
+
+		/* deinterleave, 8 bit data is unsigned */
+		for( i = 0 ; i < n ; ++i )
+		{
+			for( c = 0 ; c < channels ; ++c )
+			{
+				if( bits == 8 )
+				{
+					work.samples[ c ][ i ] = (SW32)src[ 0 ] - 128;
+				}
+				else
+				{
+					work.samples[ c ][ i ] = (SW16)(src[ 0 ] | (src[ 1 ] << 8));
+				}
+				src += bytesPerSample;
+			}
+		}
+
+		for( i = 0 ; i < n ; ++i )
+		{
+			double t = (n > 1) ? (2.0 * i / (n - 1) - 1.0) : 0.0;
+
+			work.window[ i ] = 1.0 - t * t;
+		}
+
+
+		/* Every channel fits verbatim, so this bounds the frame */
+		if( ! MemBuffer_Reserve( out, 32 + channels * (2 + n * bytesPerSample) ) )
+		{
+			MM_FREE( buffer );
+
+			return false;
+		}
+
+		frameStart = out->length;
+		bw.ptr = out->data + frameStart;
+		bw.bits = 0;
+		bw.count = 0;
+
+		/* frame header, fixed block size stream */
+		FLAC_putBits( &bw, 0x3FFE, 14 );
+		FLAC_putBits( &bw, 0, 2 );
+		FLAC_putBits( &bw, (n == FLAC_BLOCKSIZE) ? 12 : (n <= 256) ? 6 : 7, 4 );
+		FLAC_putBits( &bw, 0, 4 );					/* sample rate from STREAMINFO */
+		FLAC_putBits( &bw, channels - 1, 4 );		/* independent channels */
+		FLAC_putBits( &bw, (bits == 8) ? 1 : 4, 3 );
+		FLAC_putBits( &bw, 0, 1 );
+		FLAC_putUTF8( &bw, frame );
+		if( n != FLAC_BLOCKSIZE )
+		{
+			FLAC_putBits( &bw, n - 1, (n <= 256) ? 8 : 16 );
+		}
+		FLAC_putBits( &bw, FLAC_crc8( out->data + frameStart, (W32)(bw.ptr - (out->data + frameStart)) ), 8 );
+
+		for( c = 0 ; c < channels ; ++c )
+		{
+			FLAC_chooseSubframe( work.samples[ c ], n, bits, &work, &sub );
+			FLAC_writeSubframe( &bw, work.samples[ c ], n, bits, &sub, work.residual );
+		}
+
+		FLAC_alignBits( &bw );
+		crc = FLAC_crc16( out->data + frameStart, (W32)(bw.ptr - (out->data + frameStart)) );
+		FLAC_putBits( &bw, crc, 16 );
+
+		frameSize = (W32)(bw.ptr - (out->data + frameStart));
+		out->length += frameSize;
+
+		if( frameSize < minFrame ) minFrame = frameSize;
+		if( frameSize > maxFrame ) maxFrame = frameSize;
+	}
+
+	MM_FREE( buffer );
+
+	if( numFrames == 0 )
+	{
+		minFrame = 0;
+	}
+
+
+	bw.ptr = out->data + start;
+	bw.bits = 0;
+	bw.count = 0;
+
+	FLAC_putBits( &bw, ('f' << 24) | ('L' << 16) | ('a' << 8) | 'C', 32 );
+	FLAC_putBits( &bw, 0x80, 8 );				/* last metadata block, STREAMINFO */
+	FLAC_putBits( &bw, 34, 24 );
+	FLAC_putBits( &bw, FLAC_BLOCKSIZE, 16 );	/* min block size */
+	FLAC_putBits( &bw, FLAC_BLOCKSIZE, 16 );	/* max block size */
+	FLAC_putBits( &bw, minFrame, 24 );
+	FLAC_putBits( &bw, maxFrame, 24 );
+	FLAC_putBits( &bw, sample_rate, 20 );
+	FLAC_putBits( &bw, channels - 1, 3 );
+	FLAC_putBits( &bw, bits - 1, 5 );
+	FLAC_putBits( &bw, 0, 4 );					/* total samples, upper bits */
+	FLAC_putBits( &bw, totalSamples, 32 );
+	for( i = 0 ; i < 4 ; ++i )
+	{
+		FLAC_putBits( &bw, 0, 32 );				/* MD5 signature unset */
+	}
+
+	return true;
+}
+
+/**
+ * \brief Write FLAC file.
+ * \param[in] filename Name of FLAC file to save as.
+ * \param[in] data Interleaved PCM data, 8 bit unsigned or 16 bit signed little endian.
+ * \param[in] size Length of data in bytes.
+ * \param[in] channels Number of channels.
+ * \param[in] sample_rate Sample rate in Hz.
+ * \param[in] bits Bits per sample, 8 or 16.
+ * \return On success true, otherwise false.
+ * \note The file is encoded in memory and handed to the write queue.
+ */
+PUBLIC wtBoolean FLAC_write( const char *filename, const void *data, W32 size,
+			W16 channels, W32 sample_rate, W16 bits )
+{
+	memBuffer_t buffer;
+	wtBoolean result = false;
+
+	MemBuffer_Init( &buffer );
+
+	if( FLAC_encode( &buffer, data, size, channels, sample_rate, bits ) &&
+		WriteQueue_AddBuffer( filename, &buffer ) )
+	{
+		result = true;
+	}
+
+	MemBuffer_Free( &buffer );
+
+	return result;
+}
@@ -0,0 +1,44 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file flac.h
+ * \brief Handles FLAC file saving.
+ * \date 2013
+ * \note This module is implemented by flac.c
+ */
+
+#ifndef __FLAC_H__
+#define __FLAC_H__
+
+#include "../common/platform.h"
+#include "../memory/membuf.h"
+
+
+void FLAC_init( void );
+
+wtBoolean FLAC_encode( memBuffer_t *out, const void *data, W32 size,
+			W16 channels, W32 sample_rate, W16 bits );
+
+wtBoolean FLAC_write( const char *filename, const void *data, W32 size,
+			W16 channels, W32 sample_rate, W16 bits );
+
+
+#endif /* __FLAC_H__ */
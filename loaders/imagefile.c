@@ -0,0 +1,233 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file imagefile.c
+ * \brief Image file output in the selected file format.
+ * \date 2013
+ * \note ImageFile_writeBatch encodes a list of images on the worker thread
+ *		pool. Each thread encodes into its own reusable memory buffer and
+ *		hands a copy of the file to the write queue.
+ */
+
+#include <stdio.h>
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "../memory/memory.h"
+#include "../memory/membuf.h"
+#include "../string/wtstring.h"
+#include "../filesys/writequeue.h"
+#include "../threads/threads.h"
+#include "tga.h"
+#include "png.h"
+#include "dds.h"
+#include "ktx.h"
+#include "imagefile.h"
+
+
+/**
+ * \brief Get the file extension of an image file format.
+ * \param[in] format Image file format (IMAGE_FILE_*).
+ * \return File extension, without the dot.
+ */
+PUBLIC const char *ImageFile_extension( W32 format )
+{
+	switch( format )
+	{
+		case IMAGE_FILE_PNG:
+			return "png";
+
+		case IMAGE_FILE_DDS:
+			return "dds";
+
+		case IMAGE_FILE_KTX:
+			return "ktx";
+
+		default:
+			return "tga";
+	}
+}
+
+/**
+ * \brief Check if an image file format stores a mip chain.
+ * \param[in] format Image file format (IMAGE_FILE_*).
+ * \return true if mip levels go in the same file as the image, false if
+ *		each level needs a file of its own.
+ */
+PUBLIC wtBoolean ImageFile_hasMipChain( W32 format )
+{
+	return (format == IMAGE_FILE_DDS || format == IMAGE_FILE_KTX);
+}
+
+/**
+ * \brief Encode an image file into memory.
+ * \param[in] format Image file format (IMAGE_FILE_*).
+ * \param[in,out] out Buffer the file is appended to.
+ * \param[in] bpp Bits per pixel, 24 or 32.
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \param[in] data Raw image data, top row first.
+ * \param[in] mips Mip levels below data, see Mipmap_buildChain, or NULL.
+ *		Ignored unless ImageFile_hasMipChain( format ).
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean ImageFile_encode( W32 format, memBuffer_t *out, W16 bpp, W32 width, W32 height, const void *data, const void *mips )
+{
+	switch( format )
+	{
+		case IMAGE_FILE_PNG:
+			return PNG_encode( out, bpp, width, height, data, 0 );
+
+		case IMAGE_FILE_DDS:
+			return DDS_encode( out, bpp, width, height, data, mips );
+
+		case IMAGE_FILE_KTX:
+			return KTX_encode( out, bpp, width, height, data, mips );
+
+		default:
+			return TGA_encode( out, bpp, width, height, data, 0, 1 );
+	}
+}
+
+/**
+ * \brief Encode an image file and save it.
+ * \param[in] format Image file format (IMAGE_FILE_*).
+ * \param[in] filename Name of file to save as, without extension.
+ * \param[in] bpp Bits per pixel, 24 or 32.
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \param[in] data Raw image data, top row first.
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean ImageFile_write( W32 format, const char *filename, W16 bpp, W32 width, W32 height, const void *data )
+{
+	memBuffer_t buffer;
+	char path[ 1024 ];
+	wtBoolean result = false;
+
+	wt_snprintf( path, sizeof( path ), "%s.%s", filename, ImageFile_extension( format ) );
+
+	MemBuffer_Init( &buffer );
+
+	if( ImageFile_encode( format, &buffer, bpp, width, height, data, NULL ) &&
+		WriteQueue_AddBuffer( path, &buffer ) )
+	{
+		result = true;
+	}
+
+	MemBuffer_Free( &buffer );
+
+	return result;
+}
+
+
+typedef struct
+{
+	W32 format;
+	const imageFile_t *images;
+	memBuffer_t *buffers;	/* one per thread */
+	W32 *failures;			/* one per thread */
+
+} imageFileBatch_t;
+
+
+/**
+ * \brief Thread pool job, encodes and saves one image of a batch.
+ */
+PRIVATE void ImageFile_job( void *param, W32 index, W32 threadId )
+{
+	imageFileBatch_t *batch = (imageFileBatch_t *)param;
+	const imageFile_t *image = &batch->images[ index ];
+	memBuffer_t *buffer = &batch->buffers[ threadId ];
+	char path[ 1024 ];
+
+	wt_snprintf( path, sizeof( path ), "%s.%s", image->filename, ImageFile_extension( batch->format ) );
+
+	MemBuffer_Reset( buffer );
+
+	if( ! ImageFile_encode( batch->format, buffer, image->bpp, image->width, image->height, image->data, image->mips ) ||
+		! WriteQueue_Copy( path, buffer->data, buffer->length ) )
+	{
+		batch->failures[ threadId ]++;
+	}
+}
+
+/**
+ * \brief Encode and save a list of images.
+ * \param[in] format Image file format (IMAGE_FILE_*).
+ * \param[in] images Images to save.
+ * \param[in] count Number of images.
+ * \return true if every image was saved, otherwise false.
+ * \note Images are spread across the worker thread pool.
+ */
+PUBLIC wtBoolean ImageFile_writeBatch( W32 format, const imageFile_t *images, W32 count )
+{
+	imageFileBatch_t batch;
+	W32 numThreads;
+	W32 failures;
+	W32 i;
+
+	if( count == 0 )
+	{
+		return true;
+	}
+
+	numThreads = ThreadPool_NumThreads();
+
+	batch.format = format;
+	batch.images = images;
+	batch.buffers = (memBuffer_t *) MM_MALLOC( numThreads * sizeof( memBuffer_t ) );
+	batch.failures = (PW32) MM_MALLOC( numThreads * sizeof( W32 ) );
+	if( NULL == batch.buffers || NULL == batch.failures )
+	{
+		MM_FREE( batch.buffers );
+		MM_FREE( batch.failures );
+
+		return false;
+	}
+
+	for( i = 0 ; i < numThreads ; ++i )
+	{
+		MemBuffer_Init( &batch.buffers[ i ] );
+		batch.failures[ i ] = 0;
+	}
+
+	ThreadPool_Run( ImageFile_job, &batch, count );
+
+	failures = 0;
+	for( i = 0 ; i < numThreads ; ++i )
+	{
+		MemBuffer_Free( &batch.buffers[ i ] );
+		failures += batch.failures[ i ];
+	}
+
+	MM_FREE( batch.buffers );
+	MM_FREE( batch.failures );
+
+	if( failures )
+	{
+		fprintf( stderr, "[ImageFile_writeBatch]: Unable to save %d of %d images\n", failures, count );
+
+		return false;
+	}
+
+	return true;
+}
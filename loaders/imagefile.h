@@ -0,0 +1,64 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file imagefile.h
+ * \brief Image file output in the selected file format.
+ * \date 2013
+ * \note This module is implemented by imagefile.c
+ */
+
+#ifndef __IMAGEFILE_H__
+#define __IMAGEFILE_H__
+
+#include "../common/platform.h"
+#include "../memory/membuf.h"
+
+
+/* Image file formats */
+#define IMAGE_FILE_TGA	0	/* run length encoded Targa */
+#define IMAGE_FILE_PNG	1
+#define IMAGE_FILE_DDS	2	/* block compressed, with mip chain */
+#define IMAGE_FILE_KTX	3	/* block compressed, with mip chain */
+
+
+typedef struct
+{
+	char filename[ 256 ];	/* without extension */
+	W16 bpp;				/* bits per pixel, 24 or 32 */
+	W32 width, height;
+	const void *data;		/* top row first */
+	const void *mips;		/* levels below data, see Mipmap_buildChain, or NULL */
+
+} imageFile_t;
+
+
+const char *ImageFile_extension( W32 format );
+
+wtBoolean ImageFile_hasMipChain( W32 format );
+
+wtBoolean ImageFile_encode( W32 format, memBuffer_t *out, W16 bpp, W32 width, W32 height, const void *data, const void *mips );
+
+wtBoolean ImageFile_write( W32 format, const char *filename, W16 bpp, W32 width, W32 height, const void *data );
+
+wtBoolean ImageFile_writeBatch( W32 format, const imageFile_t *images, W32 count );
+
+
+#endif /* __IMAGEFILE_H__ */
@@ -0,0 +1,176 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file ktx.c
+ * \brief Handle Khronos texture (KTX) file format.
+ * \date 2013
+ * \note Images are stored block compressed with the S3TC internal formats,
+ *		with the whole mip chain in one file. Rows are stored top first,
+ *		which the KTXorientation key records.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "../memory/memory.h"
+#include "../memory/membuf.h"
+#include "../image/dxt.h"
+#include "../image/mipmap.h"
+#include "ktx.h"
+
+
+/* Size of the identifier and header fields */
+#define KTX_HEADER_SIZE		64
+
+/* OpenGL internal formats, from EXT_texture_compression_s3tc */
+#define GL_RGB								0x1907
+#define GL_RGBA								0x1908
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT		0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT	0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT	0x83F3
+
+
+PRIVATE const W8 ktxIdentifier[ 12 ] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+/* keyAndValueByteSize, key and value, padded to four bytes */
+PRIVATE const W8 ktxOrientation[ 28 ] = { 23, 0, 0, 0, 'K', 'T', 'X', 'o', 'r', 'i', 'e', 'n', 't', 'a', 't', 'i', 'o', 'n', 0, 'S', '=', 'r', ',', 'T', '=', 'd', 0, 0 };
+
+
+/**
+ * \brief Store a 32-bit value in little endian byte order.
+ */
+PRIVATE INLINECALL void KTX_put32( W8 *p, W32 value )
+{
+	p[ 0 ] = (W8)(value);
+	p[ 1 ] = (W8)(value >> 8);
+	p[ 2 ] = (W8)(value >> 16);
+	p[ 3 ] = (W8)(value >> 24);
+}
+
+/**
+ * \brief Encode KTX image file into memory.
+ * \param[in,out] out Buffer the file is appended to.
+ * \param[in] bpp Bits per pixel, 24 (RGB) or 32 (RGBA).
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \param[in] Data Raw image data, top row first.
+ * \param[in] mips Mip levels below Data, see Mipmap_buildChain, or NULL.
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean KTX_encode( memBuffer_t *out, W16 bpp, W32 width, W32 height,
+            const void *Data, const void *mips )
+{
+	W8 *header;
+	const W8 *src = (const W8 *)Data;
+	W32 bytes = bpp >> 3;
+	W32 levels, format, mipFormat, size, level;
+	W32 internalFormat;
+
+	if( bpp != 24 && bpp != 32 )
+	{
+		fprintf( stderr, "[KTX_encode]: Unsupported bits per pixel (%d)\n", bpp );
+
+		return false;
+	}
+
+	levels = 1;
+	format = DXT_chooseFormat( src, width * height, bytes );
+	if( mips )
+	{
+		levels += Mipmap_levels( width, height );
+		mipFormat = DXT_chooseFormat( (const W8 *)mips, Mipmap_chainSize( width, height, bytes ) / bytes, bytes );
+		if( mipFormat > format )
+		{
+			format = mipFormat;
+		}
+	}
+
+	switch( format )
+	{
+		case DXT_FORMAT_BC1:
+			internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+			break;
+
+		case DXT_FORMAT_BC1A:
+			internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+			break;
+
+		default:
+			internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			break;
+	}
+
+	if( ! MemBuffer_Reserve( out, KTX_HEADER_SIZE + sizeof( ktxOrientation ) ) )
+	{
+		return false;
+	}
+
+	header = out->data + out->length;
+
+	MM_MEMCPY( header, ktxIdentifier, sizeof( ktxIdentifier ) );
+	KTX_put32( header + 12, 0x04030201 );		/* endianness */
+	KTX_put32( header + 16, 0 );				/* glType */
+	KTX_put32( header + 20, 1 );				/* glTypeSize */
+	KTX_put32( header + 24, 0 );				/* glFormat */
+	KTX_put32( header + 28, internalFormat );
+	KTX_put32( header + 32, format == DXT_FORMAT_BC1 ? GL_RGB : GL_RGBA );
+	KTX_put32( header + 36, width );
+	KTX_put32( header + 40, height );
+	KTX_put32( header + 44, 0 );				/* pixelDepth */
+	KTX_put32( header + 48, 0 );				/* numberOfArrayElements */
+	KTX_put32( header + 52, 1 );				/* numberOfFaces */
+	KTX_put32( header + 56, levels );
+	KTX_put32( header + 60, sizeof( ktxOrientation ) );
+	MM_MEMCPY( header + KTX_HEADER_SIZE, ktxOrientation, sizeof( ktxOrientation ) );
+
+	out->length += KTX_HEADER_SIZE + sizeof( ktxOrientation );
+
+	for( level = 0 ; level < levels ; ++level )
+	{
+		if( level == 1 )
+		{
+			src = (const W8 *)mips;
+		}
+
+		/* compressed blocks are a multiple of four bytes, so no mip padding */
+		size = DXT_imageSize( format, width, height );
+		if( ! MemBuffer_Reserve( out, 4 + size ) )
+		{
+			return false;
+		}
+
+		KTX_put32( out->data + out->length, size );
+		DXT_compressImage( format, src, width, height, bytes, out->data + out->length + 4 );
+		out->length += 4 + size;
+
+		if( level > 0 )
+		{
+			src += width * height * bytes;
+		}
+
+		width = width > 1 ? width >> 1 : 1;
+		height = height > 1 ? height >> 1 : 1;
+	}
+
+	return true;
+}
@@ -0,0 +1,470 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file oplfile.c
+ * \brief OPL register stream output in the selected file format.
+ * \date 2013
+ * \note Register writes are collected with their time in 700 Hz ticks and
+ *		only turned into the delays of a file format when encoded. IMF keeps
+ *		the tick rate, DRO rounds to milliseconds and VGM counts 63 samples
+ *		of 44100 Hz per tick, so no format loses timing it can represent.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "../memory/memory.h"
+#include "../memory/membuf.h"
+#include "../string/wtstring.h"
+#include "../filesys/writequeue.h"
+#include "oplfile.h"
+
+
+#define VGM_HEADER_SIZE		0x80
+#define VGM_SAMPLES_PER_TICK	(44100 / OPL_FILE_TICK_RATE)
+#define VGM_YM3812_CLOCK	3579545		/* AdLib crystal in Hz */
+
+#define DRO_MAX_CODES		128		/* the high bit of a code selects the second chip */
+
+
+typedef struct
+{
+	W32 time;		/* in ticks */
+	W8 reg;
+	W8 value;
+
+} oplEvent_t;
+
+
+/**
+ * \brief Start an empty register stream.
+ * \param[out] stream Stream to set up.
+ * \note Must call OPLFile_free() when done.
+ */
+PUBLIC void OPLFile_init( oplStream_t *stream )
+{
+	MemBuffer_Init( &stream->events );
+	stream->time = 0;
+}
+
+/**
+ * \brief Release the memory of a register stream.
+ * \param[in,out] stream Stream to free.
+ */
+PUBLIC void OPLFile_free( oplStream_t *stream )
+{
+	MemBuffer_Free( &stream->events );
+	stream->time = 0;
+}
+
+/**
+ * \brief Add a register write at the current time.
+ * \param[in,out] stream Register stream.
+ * \param[in] reg OPL register.
+ * \param[in] value Value written to the register.
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean OPLFile_out( oplStream_t *stream, W8 reg, W8 value )
+{
+	oplEvent_t event;
+
+	event.time = stream->time;
+	event.reg = reg;
+	event.value = value;
+
+	return MemBuffer_Append( &stream->events, &event, sizeof( oplEvent_t ) );
+}
+
+/**
+ * \brief Advance the current time of a register stream.
+ * \param[in,out] stream Register stream.
+ * \param[in] ticks Number of 700 Hz ticks to wait.
+ */
+PUBLIC void OPLFile_wait( oplStream_t *stream, W32 ticks )
+{
+	stream->time += ticks;
+}
+
+/**
+ * \brief Get the file extension of an OPL file format.
+ * \param[in] format OPL file format (OPL_FILE_*).
+ * \return File extension, without the dot.
+ */
+PUBLIC const char *OPLFile_extension( W32 format )
+{
+	switch( format )
+	{
+		case OPL_FILE_DRO:
+			return "dro";
+
+		case OPL_FILE_VGM:
+			return "vgm";
+
+		default:
+			return "imf";
+	}
+}
+
+
+PRIVATE INLINECALL void OPLFile_putShort( W8 *ptr, W32 value )
+{
+	ptr[ 0 ] = (W8)value;
+	ptr[ 1 ] = (W8)(value >> 8);
+}
+
+PRIVATE INLINECALL void OPLFile_putLong( W8 *ptr, W32 value )
+{
+	ptr[ 0 ] = (W8)value;
+	ptr[ 1 ] = (W8)(value >> 8);
+	ptr[ 2 ] = (W8)(value >> 16);
+	ptr[ 3 ] = (W8)(value >> 24);
+}
+
+/**
+ * \brief Append an IMF record, followed by writes to the unused register 0
+ *		for a delay that does not fit in 16 bits.
+ */
+PRIVATE wtBoolean OPLFile_putIMF( memBuffer_t *out, W8 reg, W8 value, W32 delay )
+{
+	W8 record[ 4 ];
+	W32 step;
+
+	record[ 0 ] = reg;
+	record[ 1 ] = value;
+
+	do
+	{
+		step = (delay > 0xFFFF) ? 0xFFFF : delay;
+		OPLFile_putShort( record + 2, step );
+
+		if( ! MemBuffer_Append( out, record, 4 ) )
+		{
+			return false;
+		}
+
+		record[ 0 ] = 0;
+		record[ 1 ] = 0;
+		delay -= step;
+
+	} while( delay );
+
+	return true;
+}
+
+/**
+ * \brief Encode a register stream as IMF.
+ * \note Each record carries the delay to the next one, a wait before the
+ *		first write goes in a write to the unused register 0.
+ */
+PRIVATE wtBoolean OPLFile_encodeIMF( memBuffer_t *out, const oplStream_t *stream )
+{
+	const oplEvent_t *events = (const oplEvent_t *)stream->events.data;
+	W32 numEvents = stream->events.length / sizeof( oplEvent_t );
+	W32 start = out->length;
+	W32 i, next;
+
+	if( ! MemBuffer_Reserve( out, 2 + (numEvents + 1) * 4 ) )
+	{
+		return false;
+	}
+	out->length += 2;
+
+	next = numEvents ? events[ 0 ].time : stream->time;
+	if( next && ! OPLFile_putIMF( out, 0, 0, next ) )
+	{
+		return false;
+	}
+
+	for( i = 0 ; i < numEvents ; ++i )
+	{
+		next = (i + 1 < numEvents) ? events[ i + 1 ].time : stream->time;
+
+		if( ! OPLFile_putIMF( out, events[ i ].reg, events[ i ].value,
+				(next > events[ i ].time) ? next - events[ i ].time : 0 ) )
+		{
+			return false;
+		}
+	}
+
+	if( out->length - start - 2 > 0xFFFF )
+	{
+		fprintf( stderr, "[OPLFile_encodeIMF]: Song too long for a type 1 IMF file\n" );
+
+		return false;
+	}
+
+	OPLFile_putShort( out->data + start, out->length - start - 2 );
+
+	return true;
+}
+
+/**
+ * \brief Time of a tick in milliseconds.
+ */
+PRIVATE INLINECALL W32 OPLFile_tickToMS( W32 ticks )
+{
+	return (W32)(((W64)ticks * 1000 + OPL_FILE_TICK_RATE / 2) / OPL_FILE_TICK_RATE);
+}
+
+/**
+ * \brief Encode a register stream as DRO 2.0.
+ * \note Registers are mapped to codes in the order they are first written,
+ *		the two codes after them mark short (1 to 256 ms) and long (multiples
+ *		of 256 ms) delays.
+ */
+PRIVATE wtBoolean OPLFile_encodeDRO( memBuffer_t *out, const oplStream_t *stream )
+{
+	const oplEvent_t *events = (const oplEvent_t *)stream->events.data;
+	W32 numEvents = stream->events.length / sizeof( oplEvent_t );
+	SW32 codes[ 256 ];
+	W8 codemap[ DRO_MAX_CODES ];
+	W32 numCodes = 0;
+	W32 numPairs = 0;
+	W32 start, header;
+	W32 i, now, ms, delay, step;
+	W8 pair[ 2 ];
+
+	for( i = 0 ; i < 256 ; ++i )
+	{
+		codes[ i ] = -1;
+	}
+
+	for( i = 0 ; i < numEvents ; ++i )
+	{
+		if( codes[ events[ i ].reg ] < 0 )
+		{
+			if( numCodes + 2 > DRO_MAX_CODES )
+			{
+				fprintf( stderr, "[OPLFile_encodeDRO]: Too many registers for a codemap\n" );
+
+				return false;
+			}
+
+			codes[ events[ i ].reg ] = numCodes;
+			codemap[ numCodes++ ] = events[ i ].reg;
+		}
+	}
+
+
+	start = out->length;
+	header = 26 + numCodes;
+	if( ! MemBuffer_Reserve( out, header + numEvents * 2 ) )
+	{
+		return false;
+	}
+	MM_MEMCPY( out->data + start, "DBRAWOPL", 8 );
+	OPLFile_putShort( out->data + start + 8, 2 );			/* version 2.0 */
+	OPLFile_putShort( out->data + start + 10, 0 );
+	out->data[ start + 20 ] = 0;							/* OPL2 */
+	out->data[ start + 21 ] = 0;							/* interleaved */
+	out->data[ start + 22 ] = 0;							/* uncompressed */
+	out->data[ start + 23 ] = (W8)numCodes;					/* short delay code */
+	out->data[ start + 24 ] = (W8)(numCodes + 1);			/* long delay code */
+	out->data[ start + 25 ] = (W8)numCodes;
+	MM_MEMCPY( out->data + start + 26, codemap, numCodes );
+	out->length += header;
+
+
+	now = 0;
+	for( i = 0 ; i <= numEvents ; ++i )
+	{
+		ms = OPLFile_tickToMS( (i < numEvents) ? events[ i ].time : stream->time );
+		delay = (ms > now) ? ms - now : 0;
+		now += delay;
+
+		while( delay )
+		{
+			if( delay >= 256 )
+			{
+				step = (delay > 256 * 256) ? 256 : delay / 256;
+				pair[ 0 ] = (W8)(numCodes + 1);
+				pair[ 1 ] = (W8)(step - 1);
+				delay -= step * 256;
+			}
+			else
+			{
+				pair[ 0 ] = (W8)numCodes;
+				pair[ 1 ] = (W8)(delay - 1);
+				delay = 0;
+			}
+
+			if( ! MemBuffer_Append( out, pair, 2 ) )
+			{
+				return false;
+			}
+			numPairs++;
+		}
+
+		if( i < numEvents )
+		{
+			pair[ 0 ] = (W8)codes[ events[ i ].reg ];
+			pair[ 1 ] = events[ i ].value;
+
+			if( ! MemBuffer_Append( out, pair, 2 ) )
+			{
+				return false;
+			}
+			numPairs++;
+		}
+	}
+
+	OPLFile_putLong( out->data + start + 12, numPairs );
+	OPLFile_putLong( out->data + start + 16, now );
+
+	return true;
+}
+
+/**
+ * \brief Encode a register stream as VGM 1.51.
+ */
+PRIVATE wtBoolean OPLFile_encodeVGM( memBuffer_t *out, const oplStream_t *stream )
+{
+	const oplEvent_t *events = (const oplEvent_t *)stream->events.data;
+	W32 numEvents = stream->events.length / sizeof( oplEvent_t );
+	W32 start = out->length;
+	W32 i, now, samples, delay, step;
+	W8 command[ 3 ];
+	W32 size;
+
+	if( ! MemBuffer_Reserve( out, VGM_HEADER_SIZE + numEvents * 3 + 1 ) )
+	{
+		return false;
+	}
+	memset( out->data + start, 0, VGM_HEADER_SIZE );
+	MM_MEMCPY( out->data + start, "Vgm ", 4 );
+	OPLFile_putLong( out->data + start + 0x08, 0x151 );
+	OPLFile_putLong( out->data + start + 0x34, VGM_HEADER_SIZE - 0x34 );
+	OPLFile_putLong( out->data + start + 0x50, VGM_YM3812_CLOCK );
+	out->length += VGM_HEADER_SIZE;
+
+
+	now = 0;
+	for( i = 0 ; i <= numEvents ; ++i )
+	{
+		samples = ((i < numEvents) ? events[ i ].time : stream->time) * VGM_SAMPLES_PER_TICK;
+		delay = (samples > now) ? samples - now : 0;
+		now += delay;
+
+		while( delay )
+		{
+			if( delay <= 16 )
+			{
+				command[ 0 ] = (W8)(0x70 + delay - 1);
+				size = 1;
+				step = delay;
+			}
+			else if( delay == 735 || delay == 882 )
+			{
+				command[ 0 ] = (delay == 735) ? 0x62 : 0x63;	/* one 60 Hz or 50 Hz frame */
+				size = 1;
+				step = delay;
+			}
+			else
+			{
+				step = (delay > 0xFFFF) ? 0xFFFF : delay;
+				command[ 0 ] = 0x61;
+				OPLFile_putShort( command + 1, step );
+				size = 3;
+			}
+
+			if( ! MemBuffer_Append( out, command, size ) )
+			{
+				return false;
+			}
+			delay -= step;
+		}
+
+		if( i < numEvents )
+		{
+			command[ 0 ] = 0x5A;	/* YM3812 write */
+			command[ 1 ] = events[ i ].reg;
+			command[ 2 ] = events[ i ].value;
+
+			if( ! MemBuffer_Append( out, command, 3 ) )
+			{
+				return false;
+			}
+		}
+	}
+
+	command[ 0 ] = 0x66;	/* end of sound data */
+	if( ! MemBuffer_Append( out, command, 1 ) )
+	{
+		return false;
+	}
+
+	OPLFile_putLong( out->data + start + 0x04, out->length - start - 0x04 );
+	OPLFile_putLong( out->data + start + 0x18, now );
+
+	return true;
+}
+
+/**
+ * \brief Encode a register stream into memory.
+ * \param[in] format OPL file format (OPL_FILE_*).
+ * \param[in,out] out Buffer the file is appended to.
+ * \param[in] stream Register writes, the file lasts until its current time.
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean OPLFile_encode( W32 format, memBuffer_t *out, const oplStream_t *stream )
+{
+	switch( format )
+	{
+		case OPL_FILE_DRO:
+			return OPLFile_encodeDRO( out, stream );
+
+		case OPL_FILE_VGM:
+			return OPLFile_encodeVGM( out, stream );
+
+		default:
+			return OPLFile_encodeIMF( out, stream );
+	}
+}
+
+/**
+ * \brief Encode a register stream and save it.
+ * \param[in] format OPL file format (OPL_FILE_*).
+ * \param[in] filename Name of file to save as, without extension.
+ * \param[in] stream Register writes, the file lasts until its current time.
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean OPLFile_write( W32 format, const char *filename, const oplStream_t *stream )
+{
+	memBuffer_t buffer;
+	char path[ 1024 ];
+	wtBoolean result = false;
+
+	wt_snprintf( path, sizeof( path ), "%s.%s", filename, OPLFile_extension( format ) );
+
+	MemBuffer_Init( &buffer );
+
+	if( OPLFile_encode( format, &buffer, stream ) &&
+		WriteQueue_AddBuffer( path, &buffer ) )
+	{
+		result = true;
+	}
+
+	MemBuffer_Free( &buffer );
+
+	return result;
+}
@@ -0,0 +1,66 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file oplfile.h
+ * \brief OPL register stream output in the selected file format.
+ * \date 2013
+ * \note This module is implemented by oplfile.c
+ */
+
+#ifndef __OPLFILE_H__
+#define __OPLFILE_H__
+
+#include "../common/platform.h"
+#include "../memory/membuf.h"
+
+
+/* OPL file formats */
+#define OPL_FILE_NONE	0	/* render to PCM instead */
+#define OPL_FILE_IMF	1	/* id Software Music Format, type 1 */
+#define OPL_FILE_DRO	2	/* DOSBox Raw OPL, version 2.0 */
+#define OPL_FILE_VGM	3	/* Video Game Music, version 1.51 */
+
+#define OPL_FILE_TICK_RATE	700	/* ticks per second, the IMF rate of Wolfenstein 3-D */
+
+
+/* Register writes of one OPL2 chip, in order */
+typedef struct
+{
+	memBuffer_t events;		/* oplEvent_t list */
+	W32 time;				/* current time in ticks */
+
+} oplStream_t;
+
+
+void OPLFile_init( oplStream_t *stream );
+void OPLFile_free( oplStream_t *stream );
+
+wtBoolean OPLFile_out( oplStream_t *stream, W8 reg, W8 value );
+void OPLFile_wait( oplStream_t *stream, W32 ticks );
+
+const char *OPLFile_extension( W32 format );
+
+wtBoolean OPLFile_encode( W32 format, memBuffer_t *out, const oplStream_t *stream );
+
+wtBoolean OPLFile_write( W32 format, const char *filename, const oplStream_t *stream );
+
+
+#endif /* __OPLFILE_H__ */
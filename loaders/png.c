@@ -0,0 +1,364 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file png.c
+ * \brief Handle PNG file format.
+ * \date 2013
+ * \note Every scanline is filtered with each of the five PNG filters and
+ *		the one with the smallest sum of absolute differences is kept, the
+ *		heuristic suggested by the PNG specification. The filtered image is
+ *		deflated with zlib into a single IDAT chunk.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <zlib.h>
+
+#include "../common/platform.h"
+#include "../memory/memory.h"
+#include "../memory/membuf.h"
+#include "../common/common_utils.h"
+#include "../filesys/writequeue.h"
+#include "png.h"
+
+
+/* Scanline filter types */
+#define PNG_FILTER_NONE		0
+#define PNG_FILTER_SUB		1
+#define PNG_FILTER_UP		2
+#define PNG_FILTER_AVERAGE	3
+#define PNG_FILTER_PAETH	4
+
+#define PNG_NUM_FILTERS		5
+
+
+PRIVATE const W8 pngSignature[ 8 ] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+
+/**
+ * \brief Store a 32-bit value in network byte order.
+ */
+PRIVATE INLINECALL void PNG_put32( W8 *p, W32 value )
+{
+	p[ 0 ] = (W8)(value >> 24);
+	p[ 1 ] = (W8)(value >> 16);
+	p[ 2 ] = (W8)(value >> 8);
+	p[ 3 ] = (W8)(value);
+}
+
+/**
+ * \brief Close a chunk whose type and data have been written.
+ * \param[in,out] out Buffer holding the chunk.
+ * \param[in] start Offset of the chunk's length field.
+ * \return On success true, otherwise false.
+ * \note Fills in the length and appends the CRC of the type and data.
+ */
+PRIVATE wtBoolean PNG_endChunk( memBuffer_t *out, W32 start )
+{
+	W8 crc[ 4 ];
+	W32 length = out->length - start - 8;
+
+	PNG_put32( out->data + start, length );
+	PNG_put32( crc, crc32( crc32( 0, Z_NULL, 0 ), out->data + start + 4, length + 4 ) );
+
+	return MemBuffer_Append( out, crc, 4 );
+}
+
+/**
+ * \brief Write a complete chunk.
+ * \param[in,out] out Buffer to append to.
+ * \param[in] type Four character chunk type.
+ * \param[in] data Chunk data.
+ * \param[in] length Length of data in bytes.
+ * \return On success true, otherwise false.
+ */
+PRIVATE wtBoolean PNG_chunk( memBuffer_t *out, const char *type, const W8 *data, W32 length )
+{
+	W32 start = out->length;
+	W8 head[ 8 ];
+
+	PNG_put32( head, 0 );
+	MM_MEMCPY( head + 4, type, 4 );
+
+	if( ! MemBuffer_Append( out, head, 8 ) ||
+		(length && ! MemBuffer_Append( out, data, length )) )
+	{
+		return false;
+	}
+
+	return PNG_endChunk( out, start );
+}
+
+/**
+ * \brief Paeth predictor.
+ */
+PRIVATE INLINECALL W8 PNG_paeth( W8 a, W8 b, W8 c )
+{
+	SW32 p = (SW32)a + b - c;
+	SW32 pa = p > a ? p - a : a - p;
+	SW32 pb = p > b ? p - b : b - p;
+	SW32 pc = p > c ? p - c : c - p;
+
+	if( pa <= pb && pa <= pc )
+	{
+		return a;
+	}
+
+	return (pb <= pc) ? b : c;
+}
+
+/**
+ * \brief Filter a scanline.
+ * \param[in] filter Filter type (PNG_FILTER_*).
+ * \param[in] row Scanline.
+ * \param[in] prev Previous scanline, all zero for the first.
+ * \param[in] pitch Length of scanline in bytes.
+ * \param[in] bytes Bytes per pixel.
+ * \param[out] dest Filter type byte followed by the filtered scanline.
+ * \return Sum of the filtered bytes taken as signed values, smaller tends to deflate better.
+ */
+PRIVATE W32 PNG_filterRow( W32 filter, const W8 *row, const W8 *prev, W32 pitch, W32 bytes, W8 *dest )
+{
+	W32 i;
+	W32 sum = 0;
+
+	*dest++ = (W8)filter;
+
+	switch( filter )
+	{
+		case PNG_FILTER_NONE:
+			MM_MEMCPY( dest, row, pitch );
+			break;
+
+		case PNG_FILTER_SUB:
+			for( i = 0 ; i < bytes ; ++i )
+			{
+				dest[ i ] = row[ i ];
+			}
+			for( ; i < pitch ; ++i )
+			{
+				dest[ i ] = (W8)(row[ i ] - row[ i - bytes ]);
+			}
+			break;
+
+		case PNG_FILTER_UP:
+			for( i = 0 ; i < pitch ; ++i )
+			{
+				dest[ i ] = (W8)(row[ i ] - prev[ i ]);
+			}
+			break;
+
+		case PNG_FILTER_AVERAGE:
+			for( i = 0 ; i < bytes ; ++i )
+			{
+				dest[ i ] = (W8)(row[ i ] - (prev[ i ] >> 1));
+			}
+			for( ; i < pitch ; ++i )
+			{
+				dest[ i ] = (W8)(row[ i ] - ((row[ i - bytes ] + prev[ i ]) >> 1));
+			}
+			break;
+
+		case PNG_FILTER_PAETH:
+			for( i = 0 ; i < bytes ; ++i )
+			{
+				dest[ i ] = (W8)(row[ i ] - prev[ i ]);
+			}
+			for( ; i < pitch ; ++i )
+			{
+				dest[ i ] = (W8)(row[ i ] - PNG_paeth( row[ i - bytes ], prev[ i ], prev[ i - bytes ] ));
+			}
+			break;
+	}
+
+	for( i = 0 ; i < pitch ; ++i )
+	{
+		sum += (dest[ i ] < 128) ? dest[ i ] : 256 - dest[ i ];
+	}
+
+	return sum;
+}
+
+/**
+ * \brief Encode PNG image into memory.
+ * \param[in,out] out Buffer the file is appended to.
+ * \param[in] depth Bits per pixel, 24 (RGB) or 32 (RGBA).
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \param[in] Data Raw image data, top row first.
+ * \param[in] upsideDown Is the data upside down? 1 yes, 0 no.
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean PNG_encode( memBuffer_t *out, W16 bpp, W32 width, W32 height,
+            const void *Data, W8 upsideDown )
+{
+	W8 header[ 13 ];
+	W32 bytes, pitch;
+	W32 y, filter, best, sum, bestSum;
+	W8 *filtered, *zero, *candidates;
+	const W8 *row, *prev;
+	W32 start;
+	z_stream c_stream;
+	int err;
+
+	if( (bpp != 24 && bpp != 32) || width == 0 || height == 0 )
+	{
+		fprintf( stderr, "[PNG_encode]: Unsupported image (%dx%d, %d bpp)\n", width, height, bpp );
+
+		return false;
+	}
+
+	bytes = bpp >> 3;
+	pitch = width * bytes;
+
+	/* filtered image, a zero scanline for the first Up/Average/Paeth pass, and the candidate filters of one scanline */
+	filtered = (PW8) MM_MALLOC( height * (pitch + 1) + pitch + PNG_NUM_FILTERS * (pitch + 1) );
+	if( NULL == filtered )
+	{
+		return false;
+	}
+
+	zero = filtered + height * (pitch + 1);
+	candidates = zero + pitch;
+
+	memset( zero, 0, pitch );
+
+	prev = zero;
+	for( y = 0 ; y < height ; ++y )
+	{
+		row = (const W8 *)Data + (upsideDown ? height - y - 1 : y) * pitch;
+
+		best = PNG_FILTER_NONE;
+		bestSum = PNG_filterRow( PNG_FILTER_NONE, row, prev, pitch, bytes, candidates );
+
+		for( filter = PNG_FILTER_SUB ; filter < PNG_NUM_FILTERS ; ++filter )
+		{
+			sum = PNG_filterRow( filter, row, prev, pitch, bytes, candidates + filter * (pitch + 1) );
+			if( sum < bestSum )
+			{
+				best = filter;
+				bestSum = sum;
+			}
+		}
+
+		MM_MEMCPY( filtered + y * (pitch + 1), candidates + best * (pitch + 1), pitch + 1 );
+
+		prev = row;
+	}
+
+
+	PNG_put32( header + 0, width );
+	PNG_put32( header + 4, height );
+	header[ 8 ] = 8;					/* bit depth */
+	header[ 9 ] = (bpp == 32) ? 6 : 2;	/* colour type, RGBA or RGB */
+	header[ 10 ] = 0;					/* deflate */
+	header[ 11 ] = 0;					/* adaptive filtering */
+	header[ 12 ] = 0;					/* no interlace */
+
+	if( ! MemBuffer_Append( out, pngSignature, sizeof( pngSignature ) ) ||
+		! PNG_chunk( out, "IHDR", header, sizeof( header ) ) )
+	{
+		MM_FREE( filtered );
+
+		return false;
+	}
+
+
+//
+//	Compression, deflate straight into the IDAT chunk
+//
+	c_stream.zalloc = (alloc_func)0;
+	c_stream.zfree = (free_func)0;
+	c_stream.opaque = (voidpf)0;
+
+	err = deflateInit2( &c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS, 8, Z_FILTERED );
+	if( err != Z_OK )
+	{
+		MM_FREE( filtered );
+
+		return false;
+	}
+
+	start = out->length;
+
+	if( ! MemBuffer_Reserve( out, 8 + deflateBound( &c_stream, height * (pitch + 1) ) ) )
+	{
+		deflateEnd( &c_stream );
+		MM_FREE( filtered );
+
+		return false;
+	}
+
+	MM_MEMCPY( out->data + start + 4, "IDAT", 4 );
+
+	c_stream.next_in = filtered;
+	c_stream.avail_in = (uInt)(height * (pitch + 1));
+
+	c_stream.next_out = out->data + start + 8;
+	c_stream.avail_out = (uInt)(out->size - start - 8);
+
+	err = deflate( &c_stream, Z_FINISH );
+
+	out->length = start + 8 + c_stream.total_out;
+
+	deflateEnd( &c_stream );
+	MM_FREE( filtered );
+
+	if( err != Z_STREAM_END )
+	{
+		fprintf( stderr, "[PNG_encode]: deflate failed\n" );
+
+		return false;
+	}
+
+	return PNG_endChunk( out, start ) &&
+			PNG_chunk( out, "IEND", NULL, 0 );
+}
+
+/**
+ * \brief Write PNG image file.
+ * \param[in] filename Name of PNG file to save as.
+ * \param[in] depth Bits per pixel, 24 (RGB) or 32 (RGBA).
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \param[in] Data Raw image data, top row first.
+ * \param[in] upsideDown Is the data upside down? 1 yes, 0 no.
+ * \return 0 on error, otherwise 1.
+ * \note The file is encoded in memory and handed to the write queue.
+ */
+PUBLIC W8 PNG_write( const char *filename, W16 bpp, W32 width, W32 height,
+            void *Data, W8 upsideDown )
+{
+	memBuffer_t buffer;
+	W8 result = 0;
+
+	MemBuffer_Init( &buffer );
+
+	if( PNG_encode( &buffer, bpp, width, height, Data, upsideDown ) &&
+		WriteQueue_AddBuffer( filename, &buffer ) )
+	{
+		result = 1;
+	}
+
+	MemBuffer_Free( &buffer );
+
+	return result;
+}
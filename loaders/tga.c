@@ -32,36 +32,178 @@
 
 #include "../common/platform.h"
 #include "../memory/memory.h"
+#include "../memory/membuf.h"
 #include "../common/common_utils.h"
+#include "../filesys/writequeue.h"
+#include "tga.h"
+
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+
+	#include <emmintrin.h>
+
+	#define TGA_SSE2	1
+
+#endif
 
 
 /**
- * \brief Run length encode scanline.
- * \param[in] fp Pointer to valid FILE structure.
+ * \brief Copy pixels, swapping RGB to BGR.
+ * \param[in] src Source pixels.
+ * \param[out] dest Destination pixels.
+ * \param[in] width Number of pixels.
+ * \param[in] bytes Bytes per pixel, pixels of less than 3 bytes are copied as is.
+ * \return Nothing.
+ */
+PRIVATE void TGA_swizzle( const W8 *src, W8 *dest, W32 width, W32 bytes )
+{
+	W32 x = 0;
+
+	if( bytes < 3 )
+	{
+		MM_MEMCPY( dest, src, width * bytes );
+
+		return;
+	}
+
+#ifdef TGA_SSE2
+
+	if( bytes == 4 )
+	{
+		const __m128i agMask = _mm_set1_epi32( 0xFF00FF00 );
+		const __m128i lowMask = _mm_set1_epi32( 0x000000FF );
+		__m128i p;
+
+		for( ; x + 4 <= width ; x += 4 )
+		{
+			p = _mm_loadu_si128( (const __m128i *)(src + x * 4) );
+			p = _mm_or_si128( _mm_and_si128( p, agMask ),
+							  _mm_or_si128( _mm_and_si128( _mm_srli_epi32( p, 16 ), lowMask ),
+											_mm_slli_epi32( _mm_and_si128( p, lowMask ), 16 ) ) );
+			_mm_storeu_si128( (__m128i *)(dest + x * 4), p );
+		}
+	}
+	else
+	{
+		/* 16 bytes hold five whole pixels, the last byte is rewritten by the next store */
+		const __m128i rMask = _mm_setr_epi8( -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, 0 );
+		const __m128i gMask = _mm_setr_epi8( 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0 );
+		const __m128i bMask = _mm_setr_epi8( 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0 );
+		__m128i p;
+
+		for( ; x + 6 <= width ; x += 5 )
+		{
+			p = _mm_loadu_si128( (const __m128i *)(src + x * 3) );
+			p = _mm_or_si128( _mm_and_si128( p, gMask ),
+							  _mm_or_si128( _mm_and_si128( _mm_srli_si128( p, 2 ), rMask ),
+											_mm_and_si128( _mm_slli_si128( p, 2 ), bMask ) ) );
+			_mm_storeu_si128( (__m128i *)(dest + x * 3), p );
+		}
+	}
+
+#endif /* TGA_SSE2 */
+
+	for( ; x < width ; ++x )
+	{
+		dest[ x * bytes + 0 ] = src[ x * bytes + 2 ];
+		dest[ x * bytes + 1 ] = src[ x * bytes + 1 ];
+		dest[ x * bytes + 2 ] = src[ x * bytes + 0 ];
+
+		if( bytes == 4 )
+		{
+			dest[ x * bytes + 3 ] = src[ x * bytes + 3 ];
+		}
+	}
+}
+
+/**
+ * \brief Flag the pixels of a scanline that equal the pixel after them.
  * \param[in] buffer Scanline data.
  * \param[in] width Image scanline width.
  * \param[in] bytes Bytes per pixel.
+ * \param[out] same Receives width - 1 flags, non-zero where pixel x equals pixel x + 1.
  * \return Nothing.
  */
-PRIVATE void rle_write( FILE   *fp,
-						W8	*buffer,
-						W32	width,
-						W32	bytes )
+PRIVATE void TGA_matchPixels( const W8 *buffer, W32 width, W32 bytes, W8 *same )
+{
+	W32 x = 0;
+
+#ifdef TGA_SSE2
+
+	if( bytes == 4 )
+	{
+		const W8 *p;
+		__m128i e0, e1, e2, e3;
+
+		/* 16 pixels at a time, each compared with its neighbour */
+		for( ; x + 17 <= width ; x += 16 )
+		{
+			p = buffer + x * 4;
+
+			e0 = _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i *)p ), _mm_loadu_si128( (const __m128i *)(p + 4) ) );
+			e1 = _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i *)(p + 16) ), _mm_loadu_si128( (const __m128i *)(p + 20) ) );
+			e2 = _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i *)(p + 32) ), _mm_loadu_si128( (const __m128i *)(p + 36) ) );
+			e3 = _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i *)(p + 48) ), _mm_loadu_si128( (const __m128i *)(p + 52) ) );
+
+			_mm_storeu_si128( (__m128i *)(same + x), _mm_packs_epi16( _mm_packs_epi32( e0, e1 ), _mm_packs_epi32( e2, e3 ) ) );
+		}
+	}
+	else if( bytes == 3 )
+	{
+		const W8 *p;
+		W32 m;
+
+		/* five pixels at a time, a pixel matches when all three of its bytes do */
+		for( ; x + 7 <= width ; x += 5 )
+		{
+			p = buffer + x * 3;
+
+			m = (W32)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)p ),
+														_mm_loadu_si128( (const __m128i *)(p + 3) ) ) );
+
+			same[ x + 0 ] = ((m >> 0) & 7) == 7;
+			same[ x + 1 ] = ((m >> 3) & 7) == 7;
+			same[ x + 2 ] = ((m >> 6) & 7) == 7;
+			same[ x + 3 ] = ((m >> 9) & 7) == 7;
+			same[ x + 4 ] = ((m >> 12) & 7) == 7;
+		}
+	}
+
+#endif /* TGA_SSE2 */
+
+	for( ; x + 1 < width ; ++x )
+	{
+		same[ x ] = ! memcmp( buffer + x * bytes, buffer + (x + 1) * bytes, bytes );
+	}
+}
+
+/**
+ * \brief Run length encode scanline.
+ * \param[out] out Where to write the packets.
+ * \param[in] buffer Scanline data, in RGB order.
+ * \param[in] same Pixel match flags from TGA_matchPixels.
+ * \param[in] width Image scanline width.
+ * \param[in] bytes Bytes per pixel.
+ * \return Pointer past the last packet written.
+ * \note Pixels are swapped to BGR as they are copied into the packets.
+ */
+PRIVATE W8 *TGA_rle( W8 *out, const W8 *buffer, const W8 *same, W32 width, W32 bytes )
 {
 	SW32    repeat = 0;
 	SW32    direct = 0;
-	W8	 *from   = buffer;
+	const W8 *from = buffer;
 	W32    x;
 
 	for( x = 1 ; x < width ; ++x )
 	{
-		if( memcmp( buffer, buffer + bytes, bytes ) )
+		if( ! same[ x - 1 ] )
 		{
 			/* next pixel is different */
 			if( repeat )
 			{
-				putc( 128 + repeat, fp );
-				fwrite( from, bytes, 1, fp );
+				*out++ = (W8)(128 + repeat);
+				TGA_swizzle( from, out, 1, bytes );
+				out += bytes;
 				from = buffer + bytes; /* point to first different pixel */
 				repeat = 0;
 				direct = 0;
@@ -76,8 +218,9 @@ PRIVATE void rle_write( FILE   *fp,
 			/* next pixel is the same */
 			if( direct )
 			{
-				putc( direct - 1, fp );
-				fwrite( from, bytes, direct, fp );
+				*out++ = (W8)(direct - 1);
+				TGA_swizzle( from, out, direct, bytes );
+				out += direct * bytes;
 				from = buffer; /* point to first identical pixel */
 				direct = 0;
 				repeat = 1;
@@ -90,16 +233,18 @@ PRIVATE void rle_write( FILE   *fp,
 
 		if( repeat == 128 )
 		{
-			putc( 255, fp );
-			fwrite( from, bytes, 1, fp );
+			*out++ = 255;
+			TGA_swizzle( from, out, 1, bytes );
+			out += bytes;
 			from = buffer + bytes;
 			direct = 0;
 			repeat = 0;
 		}
 		else if( direct == 128 )
 		{
-			putc( 127, fp );
-			fwrite( from, bytes, direct, fp );
+			*out++ = 127;
+			TGA_swizzle( from, out, direct, bytes );
+			out += direct * bytes;
 			from = buffer + bytes;
 			direct = 0;
 			repeat = 0;
@@ -110,47 +255,44 @@ PRIVATE void rle_write( FILE   *fp,
 
 	if( repeat > 0 )
 	{
-		putc( 128 + repeat, fp );
-		fwrite( from, bytes, 1, fp );
+		*out++ = (W8)(128 + repeat);
+		TGA_swizzle( from, out, 1, bytes );
+		out += bytes;
 	}
 	else
 	{
-		putc( direct, fp );
-		fwrite( from, bytes, direct + 1, fp );
+		*out++ = (W8)direct;
+		TGA_swizzle( from, out, direct + 1, bytes );
+		out += (direct + 1) * bytes;
 	}
+
+	return out;
 }
 
 
 /**
- * \brief Write targa image file.
- * \param[in] filename Name of TGA file to save as.
+ * \brief Encode targa image into memory.
+ * \param[in,out] out Buffer the file is appended to.
  * \param[in] depth Bytes per pixel. (16, 24 or 32).
  * \param[in] width Width of image in pixels.
  * \param[in] height Height of image in pixels.
  * \param[in] Data Raw image data.
  * \param[in] upsideDown Is the data upside down? 1 yes, 0 no.
  * \param[in] rle Run Length encode? 1 yes, 0 no.
- * \return 0 on error, otherwise 1.
+ * \return On success true, otherwise false.
  */
-PUBLIC W8 TGA_write( const char *filename, W16 bpp, W32 width, W32 height,
-            void *Data, W8 upsideDown, W8 rle )
+PUBLIC wtBoolean TGA_encode( memBuffer_t *out, W16 bpp, W32 width, W32 height,
+            const void *Data, W8 upsideDown, W8 rle )
 {
-    W16	i, x, y, BytesPerPixel;
-	W8	*scanline;
+	W32	y, BytesPerPixel, pitch;
 	W8 header[ 18 ];
-	FILE *filestream;
-	W8 *ptr = (PW8) Data;
-	W8 temp;
+	W8 *same = NULL;
+	W8 *dest;
+	const W8 *ptr = (const W8 *) Data;
+	const W8 *row;
 
 	BytesPerPixel = bpp >> 3;
-
-	filestream = fopen( filename, "wb" );
-    if( filestream == NULL )
-	{
-		fprintf( stderr, "Could not open file (%s) for write!\n", filename );
-
-		return 0;
-	}
+	pitch = width * BytesPerPixel;
 
 	memset( header, 0, 18 );
     header[ 2 ] = rle ? 10 : 2;
@@ -169,54 +311,80 @@ PUBLIC W8 TGA_write( const char *filename, W16 bpp, W32 width, W32 height,
     }
 
 
-	fwrite( header, sizeof( W8 ), sizeof( header ), filestream  );
-
-
-
-	scanline = (PW8) MM_MALLOC( width * BytesPerPixel );
-    if( scanline == NULL )
+	/* worst case run length encoding spends a packet header on every pixel */
+	if( ! MemBuffer_Reserve( out, sizeof( header ) + height * (rle ? pitch + width : pitch) ) )
 	{
-		fclose( filestream );
-
-		return 0;
+		return false;
 	}
 
-	for( y = 0 ; y < height ; ++y )
+	if( rle && width > 0 )
 	{
-		W32 k = 0;
-
-		for( i = 0 ; i < (width * BytesPerPixel) ; ++i )
+		same = (PW8) MM_MALLOC( width );
+	    if( same == NULL )
 		{
-			scanline[ k++ ] = ptr[ (height - y - 1) * width * BytesPerPixel + i ];
+			return false;
 		}
+	}
 
+	MemBuffer_Append( out, header, sizeof( header ) );
 
+	dest = out->data + out->length;
 
-		if( bpp == 24 || bpp == 32 )
-		{
-			// swap rgb to bgr
-			for( x = 0 ; x < (width * BytesPerPixel) ; x += BytesPerPixel )
-			{
-				temp = scanline[ x ];
-				scanline[ x ] = scanline[ x + 2 ];
-				scanline[ x + 2 ] = temp;
-			}
-		}
-
+	for( y = 0 ; y < height ; ++y )
+	{
+		row = ptr + (height - y - 1) * pitch;
 
-		if( rle )
+		if( same )
 		{
-			rle_write( filestream, scanline, width, BytesPerPixel );
+			TGA_matchPixels( row, width, BytesPerPixel, same );
+
+			dest = TGA_rle( dest, row, same, width, BytesPerPixel );
 		}
 		else
 		{
-			fwrite( scanline, sizeof( W8 ), width * BytesPerPixel, filestream );
+			TGA_swizzle( row, dest, width, BytesPerPixel );
+
+			dest += pitch;
 		}
 	}
 
-	MM_FREE( scanline );
+	out->length = (W32)(dest - out->data);
+
+	if( same )
+	{
+		MM_FREE( same );
+	}
+
+	return true;
+}
+
+/**
+ * \brief Write targa image file.
+ * \param[in] filename Name of TGA file to save as.
+ * \param[in] depth Bytes per pixel. (16, 24 or 32).
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \param[in] Data Raw image data.
+ * \param[in] upsideDown Is the data upside down? 1 yes, 0 no.
+ * \param[in] rle Run Length encode? 1 yes, 0 no.
+ * \return 0 on error, otherwise 1.
+ * \note The file is encoded in memory and handed to the write queue.
+ */
+PUBLIC W8 TGA_write( const char *filename, W16 bpp, W32 width, W32 height,
+            void *Data, W8 upsideDown, W8 rle )
+{
+	memBuffer_t buffer;
+	W8 result = 0;
+
+	MemBuffer_Init( &buffer );
+
+	if( TGA_encode( &buffer, bpp, width, height, Data, upsideDown, rle ) &&
+		WriteQueue_AddBuffer( filename, &buffer ) )
+	{
+		result = 1;
+	}
 
-	fclose( filestream );
+	MemBuffer_Free( &buffer );
 
-	return 1;
+	return result;
 }
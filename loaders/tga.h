@@ -33,8 +33,12 @@
 #define __TGA_H__
 
 #include "../common/platform.h"
+#include "../memory/membuf.h"
 
 
+wtBoolean TGA_encode( memBuffer_t *out, W16 depth, W32 width, W32 height,
+            const void *Data, W8 upsideDown, W8 rle );
+
 W8 TGA_write( const char *filename, W16 depth, W32 width, W32 height, 
             void *Data, W8 upsideDown, W8 rle );
 
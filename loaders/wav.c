@@ -27,10 +27,13 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "../common/platform.h"
 #include "../common/common_utils.h"
 #include "../console/console.h"
+#include "../memory/memory.h"
+#include "../filesys/writequeue.h"
 
 typedef struct
 {
@@ -62,16 +65,17 @@ typedef struct
  *               2 = 8 bit Stereo or 16 bit Mono, 
  *               4 = 16 bit Stereo
  * \return On success true, otherwise false.
+ * \note The file is handed to the write queue, see WriteQueue_Add.
  */
 PUBLIC wtBoolean wav_write( const char *filename, void *data, W32 size, 
 					W16 channels, W32 sample_rate, 
 					W16 sample_size  )
 {
     wavheader_t header;
-    FILE *handle;
+    W8 *file;
     
-    handle = fopen( filename, "wb" );
-    if( handle == NULL )
+    file = (PW8) MM_MALLOC( sizeof( wavheader_t ) + size );
+    if( file == NULL )
     {
 		fprintf( stderr, "Unable to write file (%s)\n", filename );
         
@@ -128,12 +132,10 @@ PUBLIC wtBoolean wav_write( const char *filename, void *data, W32 size,
     
     
     
-    fwrite( &header, 1, sizeof( wavheader_t ), handle );
+    MM_MEMCPY( file, &header, sizeof( wavheader_t ) );
     
-    fwrite( data, 1, size, handle );
+    MM_MEMCPY( file + sizeof( wavheader_t ), data, size );
     
-    fclose( handle );
 
-
-	return true;
+	return WriteQueue_Add( filename, file, sizeof( wavheader_t ) + size );
 }
@@ -44,7 +44,8 @@
 
 			-h		Prints out a help message.
 
-            -s X	Set graphic scale filter [ 0 = No scaling, 1 = Use Scale2x, 2 = Use hq2x ]
+            -s X	Set graphic scale filter [ 0 = No scaling, 1 = Use Scale2x, 2 = Use hq2x,
+            		3 = Use Scale3x, 4 = Use Scale4x, 5 = Use hq4x ]
 
             -n      Do not Redux image data.
 
@@ -52,6 +53,34 @@
 
             -w      Save audio data as WAV.
 
+            -o      Save sound effects as Ogg Vorbis.
+
+            -l      Save audio data as FLAC.
+
+            -r X    Save AdLib sound effects and music as OPL register streams
+                    instead of rendering them [ imf, dro, vgm ].
+
+            -q X    Ogg Vorbis quality [ -1 (lowest) to 10 (highest), 0 = default ]
+
+            -b X:Y  Ogg Vorbis hard bitrate limits in kbit/s [ min:max, 0 = no limit ]
+
+            -a      Add precomputed level data to maps.
+
+            -m      Generate mipmaps for walls and sprites.
+
+            -p      Save walls and sprites as PNG.
+
+            -c      Save walls and sprites as block compressed DDS textures.
+
+            -k      Save walls and sprites as block compressed KTX textures.
+
+            -j X	Number of worker threads [ 0 = One per CPU (default) ]
+
+            -g X    Pak load-order profile. One file pattern per line, files
+                    are packed in the order of the first pattern they match.
+                    @level packs each map together with its walls, static
+                    sprites and music.
+
 		SEE ALSO
 
 */
@@ -66,6 +95,13 @@
 #include "console/console.h"
 #include "filesys/file.h"
 #include "image/hq2x.h"
+#include "image/scale2x.h"
+#include "threads/threads.h"
+#include "loaders/imagefile.h"
+#include "loaders/oplfile.h"
+#include "loaders/flac.h"
+#include "filesys/writequeue.h"
+#include "vorbis/vorbisenc_inter.h"
 
 
 
@@ -92,7 +128,15 @@ wtBoolean _doRedux = true;
 wtBoolean _outputInDirectory = false;
 wtBoolean _saveAudioAsWav = true;
 wtBoolean _saveMusicAsWav = false;
+wtBoolean _saveAudioAsFlac = false;
 W32 _gameVersion = 0;
+W32 _numThreads = 0;
+wtBoolean _generateMipmaps = false;
+wtBoolean _mapSections = false;
+W32 _imageFormat = IMAGE_FILE_TGA;
+W32 _oplFormat = OPL_FILE_NONE;
+const char *_pakProfile = NULL;
+vorbisSettings_t _vorbisSettings = { 0.0f, 0, 0 };
 
 
 extern const char *APPLICATION_STRING;
@@ -110,7 +154,7 @@ PRIVATE wtBoolean ParseCommandLine( int argc, char *const *argv )
 
 	SW32 retValue;
 
-    while( (retValue = getopt( argc, argv, "fndws:" )) != -1 )
+    while( (retValue = getopt( argc, argv, "fndwolampcks:j:q:b:r:g:" )) != -1 )
 	{
 		switch( retValue )
 		{
@@ -135,6 +179,41 @@ PRIVATE wtBoolean ParseCommandLine( int argc, char *const *argv )
                 _saveMusicAsWav = true;
 				break;
 
+            case 'O':
+            case 'o':
+				_saveAudioAsWav = false;
+				break;
+
+            case 'L':
+            case 'l':
+				_saveAudioAsFlac = true;
+				break;
+
+            case 'A':
+            case 'a':
+				_mapSections = true;
+				break;
+
+            case 'M':
+            case 'm':
+				_generateMipmaps = true;
+				break;
+
+            case 'P':
+            case 'p':
+				_imageFormat = IMAGE_FILE_PNG;
+				break;
+
+            case 'C':
+            case 'c':
+				_imageFormat = IMAGE_FILE_DDS;
+				break;
+
+            case 'K':
+            case 'k':
+				_imageFormat = IMAGE_FILE_KTX;
+				break;
+
             case 'S':
             case 's':
                 if( 0 == wt_stricmp( "0", optarg ) ) // original
@@ -152,15 +231,101 @@ PRIVATE wtBoolean ParseCommandLine( int argc, char *const *argv )
                    _filterScale = 2;
                    _filterScale_Sprites = 2;
                 }
+                else if( 0 == wt_stricmp( "3", optarg ) )  // Scale3x
+                {
+                   _filterScale = 3;
+                   _filterScale_Sprites = 3;
+                }
+                else if( 0 == wt_stricmp( "4", optarg ) )  // Scale4x
+                {
+                   _filterScale = 4;
+                   _filterScale_Sprites = 4;
+                }
+                else if( 0 == wt_stricmp( "5", optarg ) )  // hq4x
+                {
+                   _filterScale = 5;
+                   _filterScale_Sprites = 5;
+                }
                 else
                 {
-                    fprintf (stderr, "Option -%c requires a valid argument [0 -Original, 1 -Scale2x, 2 - hq2x].\n", optopt );
+                    fprintf (stderr, "Option -%c requires a valid argument [0 -Original, 1 -Scale2x, 2 - hq2x, 3 - Scale3x, 4 - Scale4x, 5 - hq4x].\n", optopt );
                     return false;
                 }
+                break;
+
+            case 'Q':
+            case 'q':
+                {
+                    float quality = (float) atof( optarg );
+
+                    if( quality < -1.0f || quality > 10.0f )
+                    {
+                        fprintf( stderr, "Option -%c requires a quality from -1 to 10.\n", retValue );
+                        return false;
+                    }
+                    _vorbisSettings.quality = quality / 10.0f;
+                }
+                break;
+
+            case 'B':
+            case 'b':
+                {
+                    int minRate = 0, maxRate = 0;
+
+                    if( sscanf( optarg, "%d:%d", &minRate, &maxRate ) != 2 || minRate < 0 || maxRate < 0 ||
+                        (maxRate && minRate > maxRate) )
+                    {
+                        fprintf( stderr, "Option -%c requires bitrate limits as min:max in kbit/s.\n", retValue );
+                        return false;
+                    }
+                    _vorbisSettings.minBitrate = (W32) minRate * 1000;
+                    _vorbisSettings.maxBitrate = (W32) maxRate * 1000;
+                }
+                break;
+
+            case 'R':
+            case 'r':
+                if( 0 == wt_stricmp( "imf", optarg ) )
+                {
+                    _oplFormat = OPL_FILE_IMF;
+                }
+                else if( 0 == wt_stricmp( "dro", optarg ) )
+                {
+                    _oplFormat = OPL_FILE_DRO;
+                }
+                else if( 0 == wt_stricmp( "vgm", optarg ) )
+                {
+                    _oplFormat = OPL_FILE_VGM;
+                }
+                else
+                {
+                    fprintf( stderr, "Option -%c requires a valid argument [imf, dro, vgm].\n", retValue );
+                    return false;
+                }
+                break;
+
+            case 'J':
+            case 'j':
+                {
+                    char *end;
+                    long threads = strtol( optarg, &end, 10 );
+
+                    if( *optarg == '\0' || *end != '\0' || threads < 0 || (long)(W32) threads != threads )
+                    {
+                        fprintf( stderr, "Option -%c requires a valid argument [0 or a number of threads].\n", retValue );
+                        return false;
+                    }
+                    _numThreads = (W32) threads;
+                }
+                break;
+
+            case 'G':
+            case 'g':
+                _pakProfile = optarg;
                 break;
 
 			case '?':
-                if (optopt == 's')
+                if (optopt == 's' || optopt == 'j' || optopt == 'q' || optopt == 'b' || optopt == 'r' || optopt == 'g')
                 {
                     fprintf (stderr, "Option -%c requires an argument.\n", optopt);
                 }
@@ -206,11 +371,22 @@ PRIVATE void displayVersionMsg( void )
  */
 PUBLIC int main( int argc, char *argv[] )
 {
+	wtBoolean written;
 
 	ParseCommandLine( argc, argv );
 
 	InitLUTs();
 
+	scale2x_init();
+
+	vorbis_init();
+
+	FLAC_init();
+
+	ThreadPool_Init( _numThreads );
+
+	WriteQueue_Init();
+
 	/* Setup our console window */
 	ConsoleWindow_Init();
 
@@ -219,14 +395,17 @@ PUBLIC int main( int argc, char *argv[] )
 
 	wolfDataDecipher();
 
+	written = WriteQueue_Shutdown();
 
 	/* Wait until a key is pressed before shutting down. */
 	CWaitForConsoleKeyInput();
 
 
+	ThreadPool_Shutdown();
+
 	/* Shut down our console window */
 	ConsoleWindow_Shutdown();
 
-	return 0;
+	return written ? 0 : 1;
 
 }
@@ -0,0 +1,141 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file membuf.c
+ * \brief Growable memory buffer.
+ * \date 2013
+ * \note Encoders write whole files into a buffer so they can be handed on
+ *		with a single write, instead of many small stdio calls.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../common/platform.h"
+#include "../common/common_utils.h"
+#include "memory.h"
+#include "membuf.h"
+
+
+/* Smallest allocation made for a buffer */
+#define MEMBUF_MIN_SIZE	4096
+
+
+/**
+ * \brief Initialize an empty buffer.
+ * \param[out] buffer Buffer to initialize.
+ * \return Nothing.
+ */
+PUBLIC void MemBuffer_Init( memBuffer_t *buffer )
+{
+	buffer->data = NULL;
+	buffer->length = 0;
+	buffer->size = 0;
+}
+
+/**
+ * \brief Release the memory held by a buffer.
+ * \param[in,out] buffer Buffer to release, left empty.
+ * \return Nothing.
+ */
+PUBLIC void MemBuffer_Free( memBuffer_t *buffer )
+{
+	if( buffer->data )
+	{
+		MM_FREE( buffer->data );
+	}
+
+	buffer->length = 0;
+	buffer->size = 0;
+}
+
+/**
+ * \brief Empty a buffer, keeping its memory for reuse.
+ * \param[in,out] buffer Buffer to empty.
+ * \return Nothing.
+ */
+PUBLIC void MemBuffer_Reset( memBuffer_t *buffer )
+{
+	buffer->length = 0;
+}
+
+/**
+ * \brief Make room for more data.
+ * \param[in,out] buffer Buffer to grow.
+ * \param[in] bytes Bytes that must fit after the data in use.
+ * \return On success true, otherwise false.
+ * \note The buffer at least doubles when it grows, so appending one
+ *		piece at a time stays linear.
+ */
+PUBLIC wtBoolean MemBuffer_Reserve( memBuffer_t *buffer, W32 bytes )
+{
+	W8 *data;
+	W32 size;
+
+	if( buffer->size - buffer->length >= bytes )
+	{
+		return true;
+	}
+
+	if( bytes > (W32)~0 - buffer->length )
+	{
+		fprintf( stderr, "[MemBuffer_Reserve]: Buffer too large\n" );
+
+		return false;
+	}
+
+	size = buffer->size < MEMBUF_MIN_SIZE ? MEMBUF_MIN_SIZE : buffer->size;
+	while( size < buffer->length + bytes )
+	{
+		size = (size > (W32)~0 / 2) ? buffer->length + bytes : size * 2;
+	}
+
+	data = (PW8) MM_REALLOC( buffer->data, size );
+	if( NULL == data )
+	{
+		return false;
+	}
+
+	buffer->data = data;
+	buffer->size = size;
+
+	return true;
+}
+
+/**
+ * \brief Append data to a buffer.
+ * \param[in,out] buffer Buffer to append to.
+ * \param[in] data Data to append.
+ * \param[in] bytes Length of data in bytes.
+ * \return On success true, otherwise false.
+ */
+PUBLIC wtBoolean MemBuffer_Append( memBuffer_t *buffer, const void *data, W32 bytes )
+{
+	if( ! MemBuffer_Reserve( buffer, bytes ) )
+	{
+		return false;
+	}
+
+	MM_MEMCPY( buffer->data + buffer->length, data, bytes );
+	buffer->length += bytes;
+
+	return true;
+}
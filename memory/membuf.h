@@ -0,0 +1,50 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file membuf.h
+ * \brief Growable memory buffer.
+ * \date 2013
+ */
+
+#ifndef __MEMBUF_H__
+#define __MEMBUF_H__
+
+#include "../common/platform.h"
+
+
+typedef struct
+{
+	W8	*data;
+	W32	length;		/* bytes in use */
+	W32	size;		/* bytes allocated */
+
+} memBuffer_t;
+
+
+void MemBuffer_Init( memBuffer_t *buffer );
+void MemBuffer_Free( memBuffer_t *buffer );
+void MemBuffer_Reset( memBuffer_t *buffer );
+
+wtBoolean MemBuffer_Reserve( memBuffer_t *buffer, W32 bytes );
+wtBoolean MemBuffer_Append( memBuffer_t *buffer, const void *data, W32 bytes );
+
+
+#endif /* __MEMBUF_H__ */
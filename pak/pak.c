@@ -26,6 +26,7 @@
  */
 
 #include <string.h>
+#include <time.h>
 #include <zlib.h>
 
 #include "../memory/memory.h"
@@ -34,15 +35,48 @@
 #include "../string/wtstring.h"
 #include "../common/linklist.h"
 #include "../filesys/file.h"
+#include "../filesys/writequeue.h"
 #include "../zip/zip.h"
 
+#include "../memory/membuf.h"
+
 #include "../wolf/wolfcore_decoder.h"
+#include "../wolf/core/wolfcore.h"
 
 
 #define SCRIPTNAME		"DEFAULT.CFG"
 
 #define SCRIPT_DIR		"script"
 
+/* Load-order profile rule that makes one group per level */
+#define PAK_LEVEL_RULE	"@level"
+#define PAK_MAX_RULES	64
+
+#define PAK_UNCLAIMED	0xFFFFFFFF		/* no rule has claimed the file yet */
+
+/* Map tiles that pull assets into a level group, see wolfcore_map.c */
+#define PAK_WALL_LAST		89		/* plane 0 tiles 1 to 89 are walls */
+#define PAK_STATIC_FIRST	23		/* plane 1 static objects */
+#define PAK_STATIC_LAST		74
+#define PAK_STATIC_SPRITE	2		/* sprite of the first static object */
+
+/* Size of the fixed buffers data is streamed through */
+#define PAK_CHUNK_SIZE	(64 * 1024)
+
+
+/* 64-bit file offsets, packs may grow beyond 4 GB */
+#if OS_WINDOWS
+
+	#define Pak_Seek( f, o, w )		_fseeki64( f, o, w )
+	#define Pak_Tell( f )			_ftelli64( f )
+
+#else
+
+	#define Pak_Seek( f, o, w )		fseeko( f, o, w )
+	#define Pak_Tell( f )			ftello( f )
+
+#endif
+
 
 PRIVATE char defaultscript[] =
 "\n \
@@ -93,160 +127,401 @@ PRIVATE char defaultscript[] =
  set g_version      \n\n";
 
 extern W32 _gameVersion;
+extern const char *_pakProfile;
 
 
 PRIVATE linkList_t *zipChain = NULL;
 PRIVATE linkList_t *zipChainLast = NULL;	/* pointer to last element in zipChain */
 
+PRIVATE W8 pakInput[ PAK_CHUNK_SIZE ];
+PRIVATE W8 pakOutput[ PAK_CHUNK_SIZE ];
+
+PRIVATE z_stream pakStream;		/* compression stream, reset for every entry */
+
 
 /**
- * \brief Writes the Local file chunk for a Zip file.
- * \param[in] filename Pointer to a NUL-terminated string that specifies the path of the file to zip.
- * \param[in,out] fout File stream to add compressed file to.
- * \return On success pointer to zipHead_t structure, otherwise NULL..
+ * \brief How entries of one file type are packed.
  */
-PRIVATE zipHead_t *Pak_WriteLocalFileChunk( const char *filename, FILE *fout )
+typedef struct pakPolicy_s
 {
-	W8 *data;
-	zipHead_t *zentry;
-	struct filestats fs;
-	int err;
-	W8 *compr;
-	W32 retval;
-	z_stream c_stream; /* compression stream */
+	const char *extension;
+	int level;				/* Z_NO_COMPRESSION stores the data as is */
+	int strategy;
 
+} pakPolicy_t;
 
-	zentry = (zipHead_t *) MM_MALLOC( sizeof( *zentry ) );
+PRIVATE const pakPolicy_t pakPolicies[] =
+{
+	/* Already compressed, deflating again only costs time */
+	{ ".png",	Z_NO_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".ogg",	Z_NO_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".flac",	Z_NO_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".jpg",	Z_NO_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".mp3",	Z_NO_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".zip",	Z_NO_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".pk3",	Z_NO_COMPRESSION,		Z_DEFAULT_STRATEGY },
+
+	/* Small and highly redundant, best ratio is nearly free */
+	{ ".map",	Z_BEST_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".tga",	Z_BEST_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".imf",	Z_BEST_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".dro",	Z_BEST_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".vgm",	Z_BEST_COMPRESSION,		Z_DEFAULT_STRATEGY },
+	{ ".cfg",	Z_BEST_COMPRESSION,		Z_DEFAULT_STRATEGY }
+};
+
+PRIVATE const pakPolicy_t pakDefaultPolicy = { NULL, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY };
 
-	memset( zentry, 0, sizeof( *zentry ) );
 
-	zentry->versionmadeby = VMB_VFAT;
-	zentry->versionneeded = 20;
-	zentry->disknumstart = 0;
-	zentry->compression_method = CM_DEFLATED;
+/**
+ * \brief File to pack and its place in the load order.
+ */
+typedef struct pakFile_s
+{
+	char name[ 256 ];
+	W32 rule;		/* profile rule that claimed the file, PAK_UNCLAIMED if none */
+	W32 group;		/* level group inside a PAK_LEVEL_RULE rule */
 
-	zentry->deletefile = 1;
+} pakFile_t;
 
-	zentry->uncompressed_size = FS_FileLoad( filename, (void *) &data );
+/* Directories that are packed. Their order is also the default profile,
+   with the maps directory standing for the level groups. */
+#define PAK_DIR_SPRITES		4
 
-	if( zentry->uncompressed_size == -1 || data == NULL )
-	{
-		fprintf( stderr, "[Pak_WriteLocalFileChunk]: Could not open file (%s)\n", filename );
-		MM_FREE( zentry );
-		MM_FREE( data );
+PRIVATE const char *pakDirsWolf[] =
+{
+	SCRIPT_DIR, DIR_PICS, DIR_MAPS, DIR_WALLS, DIR_SPRITES, DIR_DSOUND, DIR_SOUNDFX, DIR_MUSIC, NULL
+};
 
-		return NULL;
+PRIVATE const char *pakDirsSpear[] =
+{
+	SCRIPT_DIR, DIR_PICS, DIR_MAPS, DIR_WALLS, DIR_SOD_SPRITES, DIR_SOD_DSOUND, DIR_SOD_SOUNDFX, DIR_MUSIC, NULL
+};
+
+
+/**
+ * \brief Get packing policy for a file.
+ * \param[in] filename Name of file.
+ * \return Policy that matches the file extension.
+ */
+PRIVATE const pakPolicy_t *Pak_GetPolicy( const char *filename )
+{
+	const char *ext = strrchr( filename, '.' );
+	W32 i;
+
+	if( ext )
+	{
+		for( i = 0 ; i < sizeof( pakPolicies ) / sizeof( pakPolicies[ 0 ] ) ; ++i )
+		{
+			if( ! wt_stricmp( ext, pakPolicies[ i ].extension ) )
+			{
+				return &pakPolicies[ i ];
+			}
+		}
 	}
 
+	return &pakDefaultPolicy;
+}
 
-	FS_GetFileAttributes( filename, &fs );
+/**
+ * \brief Create new zip entry.
+ * \param[in] filename Name of entry inside the zip file.
+ * \return Pointer to zipHead_t structure, free with Pak_FreeEntry.
+ */
+PRIVATE zipHead_t *Pak_NewEntry( const char *filename )
+{
+	zipHead_t *zentry;
+	W32 length = (W32) strlen( filename );
 
-	zentry->timedate = UnixTimeToDosTime( &fs.lastwritetime );
+	zentry = (zipHead_t *) MM_MALLOC( sizeof( *zentry ) );
+	memset( zentry, 0, sizeof( *zentry ) );
 
+	zentry->filename = (char *) MM_MALLOC( length + 1 );
+	MM_MEMCPY( zentry->filename, filename, length + 1 );
+	zentry->filename_length = (W16) length;
 
-//
-//	Compression
-//
-	c_stream.zalloc = (alloc_func)0;
-	c_stream.zfree = (free_func)0;
-	c_stream.opaque = (voidpf)0;
+	zentry->flag = ZIP_FLAG_DATA_DESCRIPTOR;
+
+	return zentry;
+}
+
+/**
+ * \brief Free zip entry.
+ * \param[in] zentry zip entry to free.
+ */
+PRIVATE void Pak_FreeEntry( zipHead_t *zentry )
+{
+	MM_FREE( zentry->filename );
+	MM_FREE( zentry );
+}
 
-	err = deflateInit( &c_stream, Z_DEFAULT_COMPRESSION );
-	if( err != Z_OK )
+/**
+ * \brief Read next chunk of entry data.
+ * \param[in] in File to read data from, or NULL to read from data.
+ * \param[in] data Data to zip if in is NULL.
+ * \param[in] size Size of data in bytes.
+ * \param[in] done Number of bytes already read.
+ * \param[out] chunk Start of chunk.
+ * \param[out] count Size of chunk in bytes.
+ * \param[out] finish Set to true if this is the last chunk.
+ * \return On success true, otherwise false.
+ */
+PRIVATE wtBoolean Pak_ReadChunk( FILE *in, const W8 *data, W64 size, W64 done,
+			const W8 **chunk, W32 *count, wtBoolean *finish )
+{
+	if( in )
 	{
-		MM_FREE( data );
-		MM_FREE( zentry );
+		*count = (W32) fread( pakInput, 1, sizeof( pakInput ), in );
+		*chunk = pakInput;
+		*finish = feof( in ) != 0;
 
-		return NULL;
+		return ! ferror( in );
 	}
 
+	*count = sizeof( pakInput );
+	if( size - done < *count )
+	{
+		*count = (W32)(size - done);
+	}
+	*chunk = data + done;
+	*finish = done + *count == size;
 
-	zentry->compressed_size = (zentry->uncompressed_size / 10) + 12 + zentry->uncompressed_size;
+	return true;
+}
 
+/**
+ * \brief Stream data into the zip file as a single entry.
+ * \param[in,out] zentry zip entry, compression method, crc and sizes are filled in.
+ * \param[in] policy How to pack the entry.
+ * \param[in] in File to read data from, or NULL to read from data.
+ * \param[in] data Data to zip if in is NULL.
+ * \param[in] size Expected size of data in bytes.
+ * \param[in,out] fout File stream to add compressed data to.
+ * \return On success true, otherwise false.
+ * \note Data passes through fixed size buffers, so memory use does not
+ *  depend on the size of the entry. The crc is updated as each chunk
+ *  passes by, and together with the sizes follows the data in a data
+ *  descriptor since they are only known once the data is written.
+ *
+ *  The first chunk is deflated up front into a buffer no larger than
+ *  the chunk itself. If it does not fit, deflate does not help and the
+ *  entry is stored. Entries that fit into one chunk are done after that.
+ */
+PRIVATE wtBoolean Pak_WriteEntry( zipHead_t *zentry, const pakPolicy_t *policy,
+			FILE *in, const W8 *data, W64 size, FILE *fout )
+{
+	const W8 *chunk;
+	W32 count, have;
+	wtBoolean deflated = false;
+	wtBoolean finish;
+	wtBoolean ok = true;
+	W64 bound = size;
+
+	if( ! Pak_ReadChunk( in, data, size, 0, &chunk, &count, &finish ) )
+	{
+		fprintf( stderr, "[Pak_WriteEntry]: Error reading file (%s)\n", zentry->filename );
 
-	compr = (PW8) MM_MALLOC( zentry->compressed_size );
+		return false;
+	}
 
+	if( policy->level != Z_NO_COMPRESSION )
+	{
+		if( deflateReset( &pakStream ) != Z_OK ||
+			deflateParams( &pakStream, policy->level, policy->strategy ) != Z_OK )
+		{
+			fprintf( stderr, "[Pak_WriteEntry]: Could not set compression level %d, strategy %d for (%s)\n",
+					policy->level, policy->strategy, zentry->filename );
 
+			return false;
+		}
 
+		pakStream.next_in = (Bytef *) chunk;
+		pakStream.avail_in = count;
+		pakStream.next_out = pakOutput;
+		pakStream.avail_out = count;
 
+		deflated = deflate( &pakStream, Z_FINISH ) == Z_STREAM_END;
+	}
 
-	c_stream.next_out = compr;
-	c_stream.avail_out = (uInt)zentry->compressed_size;
+	zentry->compression_method = deflated ? CM_DEFLATED : CM_NO_COMPRESSION;
 
-	c_stream.next_in = data;
-	c_stream.avail_in = (uInt)zentry->uncompressed_size;
+	if( deflated && ! finish )
+	{
+		/* Same worst case as deflateBound(), which is limited to uLong. */
+		bound += (size >> 12) + (size >> 14) + (size >> 25) + 7;
+	}
 
+	zentry->zip64 = bound >= ZIP64_LIMIT;
+	zentry->offset = (W64) Pak_Tell( fout );
+	zentry->crc32 = crc32( 0L, Z_NULL, 0 );
 
-	err = deflate( &c_stream, Z_FINISH );
-	if( err != Z_STREAM_END )
+	if( ! zip_WriteLocalChunk( zentry, fout ) )
 	{
-		MM_FREE( compr );
-		MM_FREE( data );
-		MM_FREE( zentry );
+		fprintf( stderr, "[Pak_WriteEntry]: Error writing local header to zip file\n" );
 
-		return NULL;
+		return false;
 	}
 
+	if( deflated && finish )
+	{
+		/* The whole entry went through deflate already */
+		have = count - pakStream.avail_out;
+		if( fwrite( pakOutput, 1, have, fout ) != have )
+		{
+			fprintf( stderr, "[Pak_WriteEntry]: Error writing data after local header to zip file\n" );
+
+			return false;
+		}
+
+		zentry->crc32 = crc32( zentry->crc32, chunk, count );
+		zentry->uncompressed_size = count;
+		zentry->compressed_size = have;
+
+		return zip_WriteDataDescriptor( zentry, fout );
+	}
 
-	err = deflateEnd( &c_stream );
-    if( err != Z_OK )
+	if( deflated && deflateReset( &pakStream ) != Z_OK )
 	{
-		MM_FREE( compr );
-		MM_FREE( data );
-		MM_FREE( zentry );
+		fprintf( stderr, "[Pak_WriteEntry]: Could not reset deflate for (%s)\n", zentry->filename );
 
-		return NULL;
+		return false;
 	}
 
+	for( ; ; )
+	{
+		zentry->crc32 = crc32( zentry->crc32, chunk, count );
+		zentry->uncompressed_size += count;
+
+		if( ! deflated )
+		{
+			if( fwrite( chunk, 1, count, fout ) != count )
+			{
+				ok = false;
+				break;
+			}
+			zentry->compressed_size += count;
+		}
+		else
+		{
+			pakStream.next_in = (Bytef *) chunk;
+			pakStream.avail_in = count;
 
-	//	When using the deflate method, ZLib adds a 2 byte head
-	//	and a 4 byte tail. The head must be removed for zip
-	//	compatability and the tail is not necessary.
-	zentry->compressed_size = c_stream.total_out - 6;
+			do
+			{
+				pakStream.next_out = pakOutput;
+				pakStream.avail_out = sizeof( pakOutput );
 
-//
-//	End of compression
-//
+				have = (W32) sizeof( pakOutput );
+				if( deflate( &pakStream, finish ? Z_FINISH : Z_NO_FLUSH ) == Z_STREAM_ERROR )
+				{
+					ok = false;
+					break;
+				}
 
+				have -= pakStream.avail_out;
+				if( fwrite( pakOutput, 1, have, fout ) != have )
+				{
+					ok = false;
+					break;
+				}
+				zentry->compressed_size += have;
 
-	zentry->crc32 = crc32( 0, data, zentry->uncompressed_size );
+			} while( pakStream.avail_out == 0 );
 
-	wt_strlcpy( zentry->filename, filename, sizeof( zentry->filename ) );
-	zentry->filename_length = strlen( zentry->filename );
+			if( ! ok )
+			{
+				break;
+			}
+		}
 
-	zentry->offset = ftell( fout );
+		if( finish )
+		{
+			break;
+		}
 
-//
-// Write header to file
-//
-	if( ! zip_WriteLocalChunk( zentry, fout ) )
+		if( ! Pak_ReadChunk( in, data, size, zentry->uncompressed_size, &chunk, &count, &finish ) )
+		{
+			fprintf( stderr, "[Pak_WriteEntry]: Error reading file (%s)\n", zentry->filename );
+
+			return false;
+		}
+	}
+
+	if( ! ok )
 	{
-		fprintf( stderr, "[Pak_WriteLocalFileChunk]: Error writing local header to zip file\n" );
+		fprintf( stderr, "[Pak_WriteEntry]: Error writing data after local header to zip file\n" );
 
-		MM_FREE( compr );
-		MM_FREE( data );
-		MM_FREE( zentry );
+		return false;
+	}
+
+	if( ! zentry->zip64 && (zentry->uncompressed_size >= ZIP64_LIMIT || zentry->compressed_size >= ZIP64_LIMIT) )
+	{
+		fprintf( stderr, "[Pak_WriteEntry]: File grew while being zipped (%s)\n", zentry->filename );
+
+		return false;
+	}
+
+	if( ! zip_WriteDataDescriptor( zentry, fout ) )
+	{
+		fprintf( stderr, "[Pak_WriteEntry]: Error writing data descriptor to zip file\n" );
+
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Writes the Local file chunk for a Zip file.
+ * \param[in] filename Pointer to a NUL-terminated string that specifies the path of the file to zip.
+ * \param[in,out] fout File stream to add compressed file to.
+ * \return On success pointer to zipHead_t structure, otherwise NULL..
+ */
+PRIVATE zipHead_t *Pak_WriteLocalFileChunk( const char *filename, FILE *fout )
+{
+	FILE *in;
+	zipHead_t *zentry;
+	struct filestats fs;
+	SW64 size;
+
+
+	in = fopen( filename, "rb" );
+	if( in == NULL )
+	{
+		fprintf( stderr, "[Pak_WriteLocalFileChunk]: Could not open file (%s)\n", filename );
 
 		return NULL;
 	}
 
-//
-// Write data to file
-//
-	retval = fwrite( compr+2, 1, zentry->compressed_size, fout );
-	if( retval != zentry->compressed_size )
+	Pak_Seek( in, 0, SEEK_END );
+	size = Pak_Tell( in );
+	Pak_Seek( in, 0, SEEK_SET );
+
+	if( size < 0 )
 	{
-		fprintf( stderr, "Error writing data after local header to zip file\n" );
+		fprintf( stderr, "[Pak_WriteLocalFileChunk]: Could not get size of file (%s)\n", filename );
+		fclose( in );
 
-		MM_FREE( compr );
-		MM_FREE( data );
-		MM_FREE( zentry );
+		return NULL;
+	}
+
+	zentry = Pak_NewEntry( filename );
+
+	zentry->deletefile = 1;
+
+	FS_GetFileAttributes( filename, &fs );
+
+	zentry->timedate = UnixTimeToDosTime( &fs.lastwritetime );
+
+	if( ! Pak_WriteEntry( zentry, Pak_GetPolicy( filename ), in, NULL, (W64) size, fout ) )
+	{
+		fclose( in );
+		Pak_FreeEntry( zentry );
 
 		return NULL;
 	}
 
-	MM_FREE( compr );
-	MM_FREE( data );
+	fclose( in );
 
 	return zentry;
 }
@@ -259,9 +534,9 @@ PRIVATE zipHead_t *Pak_WriteLocalFileChunk( const char *filename, FILE *fout )
  */
 PRIVATE wtBoolean Pak_WriteCentralChunk( linkList_t *zipList, FILE *fout )
 {
-	W32 central_offset;
-	W32 central_size;
-	W32 num = 0;
+	W64 central_offset;
+	W64 central_size;
+	W64 num = 0;
 	zipHead_t *tempZipHead;
 
 	if( zipList == NULL )
@@ -271,7 +546,7 @@ PRIVATE wtBoolean Pak_WriteCentralChunk( linkList_t *zipList, FILE *fout )
 		return false;
 	}
 
-	central_offset = ftell( fout );
+	central_offset = (W64) Pak_Tell( fout );
 
 	tempZipHead = zipList->element;
 	do
@@ -286,7 +561,7 @@ PRIVATE wtBoolean Pak_WriteCentralChunk( linkList_t *zipList, FILE *fout )
 
 	} while( (tempZipHead = linkList_GetNextElement( zipList )) );
 
-	central_size = ftell( fout ) - central_offset;
+	central_size = (W64) Pak_Tell( fout ) - central_offset;
 
 	if( ! zip_WriteEndChunk( num, central_size, central_offset, 0, NULL, fout ) )
 	{
@@ -299,196 +574,439 @@ PRIVATE wtBoolean Pak_WriteCentralChunk( linkList_t *zipList, FILE *fout )
 }
 
 /**
- * \brief Add directory to zip file.
- * \param[in] path Directory path that will be added to zip file.
- * \param[in,out] f File stream to write compressed files to.
- * \return On success true, otherwise false.
+ * \brief Match file name against a load-order profile pattern.
+ * \param[in] pattern Pattern, '*' matches any run of characters and '?' any single one.
+ * \param[in] name File name.
+ * \return true if name matches pattern, otherwise false.
+ * \note Case is ignored, as it is for file names in the engine.
  */
-PRIVATE wtBoolean Pak_addDirectoryToZipFile( const char *path, FILE *f )
+PRIVATE wtBoolean Pak_MatchPattern( const char *pattern, const char *name )
 {
-	char temp[ 256 ];
-	char *ptr;
-	zipHead_t *newZipNode = NULL;
+	for( ; *pattern ; ++pattern, ++name )
+	{
+		if( *pattern == '*' )
+		{
+			do
+			{
+				if( Pak_MatchPattern( pattern + 1, name ) )
+				{
+					return true;
+				}
 
+			} while( *name++ );
 
-	wt_strlcpy( temp, path, sizeof( temp ) );
+			return false;
+		}
 
-	if( strstr( temp, "*" ) == NULL )
-	{
-		wt_strlcat( temp, "/*", sizeof( temp ) );
+		if( *name == '\0' || (*pattern != '?' && TOLOWER( *pattern ) != TOLOWER( *name )) )
+		{
+			return false;
+		}
 	}
 
+	return *name == '\0';
+}
+
+/**
+ * \brief Add the files of a directory to the list of files to pack.
+ * \param[in] path Directory path.
+ * \param[in,out] files List of pakFile_t.
+ */
+PRIVATE void Pak_addDirectoryToList( const char *path, memBuffer_t *files )
+{
+	char temp[ 256 ];
+	char *ptr;
+	pakFile_t file;
+
+
+	wt_snprintf( temp, sizeof( temp ), "%s/*", path );
+
 	// Look for files
 	ptr = FS_FindFirst( temp );
 
-	do {
-		wt_snprintf( temp, sizeof( temp ), "%s/%s", path, ptr );
-
-		if ( temp[strlen(temp)-1] == '.' )
-		{
-			continue;
-		}
-
-		if( ! FS_CompareFileAttributes( temp, 0, FA_DIR ) )
+	for( ; ptr != NULL ; ptr = FS_FindNext() )
+	{
+		if( ptr[ strlen( ptr ) - 1 ] == '.' )
 		{
 			continue;
 		}
 
-		newZipNode = Pak_WriteLocalFileChunk( temp, f );
-		if( newZipNode == NULL )
+		memset( &file, 0, sizeof( file ) );
+		wt_snprintf( file.name, sizeof( file.name ), "%s/%s", path, ptr );
+
+		if( ! FS_CompareFileAttributes( file.name, 0, FA_DIR ) )
 		{
 			continue;
 		}
 
-		// add new zipHead_t to chain
-		zipChainLast = linkList_addList( zipChainLast, newZipNode );
-	} while( (ptr = FS_FindNext()) != NULL );
+		file.rule = PAK_UNCLAIMED;
 
-	FS_FindClose();
+		MemBuffer_Append( files, &file, sizeof( file ) );
+	}
 
-	return true;
+	FS_FindClose();
 }
 
 /**
- * \brief Add script file to zip file.
- * \param[in,out] fout File stream to write compressed files to.
- * \param[in] version  Version to write into script file.
- * \return On success pointer to zlist structure, otherwise NULL.
+ * \brief Get index of a wall, sprite or sound file.
+ * \param[in] name File name.
+ * \param[in] dir Directory the asset belongs in.
+ * \return Index from the file name, or -1 if name is not in dir.
+ * \note Mip levels (XXX_mipN) belong to the same index as their base level.
  */
-PRIVATE zipHead_t *Pak_addScriptToZipFile( FILE *fout, W8 version )
+PRIVATE SW32 Pak_AssetIndex( const char *name, const char *dir )
 {
+	size_t length = strlen( dir );
+	SW32 index = 0;
+
+	if( strncmp( name, dir, length ) || name[ length ] != '/' )
+	{
+		return -1;
+	}
+
+	for( name += length + 1 ; *name >= '0' && *name <= '9' ; ++name )
+	{
+		index = index * 10 + (*name - '0');
+	}
+
+	return (*name == '.' || *name == '_') ? index : -1;
+}
 
+/**
+ * \brief Claim a map and the assets it references as one level group.
+ * \param[in,out] files Files to pack, sorted by name.
+ * \param[in] count Number of files.
+ * \param[in] map Index of map file.
+ * \param[in] rule Index of level rule in profile.
+ * \param[in] group Level group number.
+ * \param[in] spritePath Directory sprites are saved in.
+ * \note The walls of solid tiles, the sprites of static objects and the
+ *  level music are added to the group, unless an earlier group has them.
+ *  Guards, doors and sounds are used everywhere and left to later rules.
+ */
+PRIVATE void Pak_ClaimLevel( pakFile_t *files, W32 count, W32 map, W32 rule, W32 group, const char *spritePath )
+{
 	W8 *data;
-	zipHead_t *zentry;
-	struct filestats fs;
-	SW32 err;
-	W32 retval;
-	W32 scriptSize;
-	W8 *compr;
-	z_stream c_stream; /* compression stream */
+	SW32 size;
+	W8 walls[ PAK_WALL_LAST * 2 ];
+	W8 sprites[ PAK_STATIC_SPRITE + PAK_STATIC_LAST - PAK_STATIC_FIRST + 1 ];
+	char music[ 256 ];
+	size_t musicLength = 0;
+	W32 width, height, nameLength, tiles, offset[ 2 ];
+	W32 i, tile;
+	SW32 index;
+
+	files[ map ].rule = rule;
+	files[ map ].group = group * 2;
+
+	memset( walls, 0, sizeof( walls ) );
+	memset( sprites, 0, sizeof( sprites ) );
+
+	size = FS_FileLoad( files[ map ].name, (void *) &data );
+	if( size < 0 )
+	{
+		return;
+	}
 
+	if( size < MAP_HEADER_SIZE || memcmp( data, MAP_SIGNATURE, 4 ) )
+	{
+		/* not a Redux map, nothing more to group with it */
+		MM_FREE( data );
 
+		return;
+	}
 
-	scriptSize = sizeof( defaultscript ) / sizeof( defaultscript[ 0 ] );
+	width = data[ 6 ] | (data[ 7 ] << 8);
+	height = data[ 8 ] | (data[ 9 ] << 8);
+	tiles = width * height;
+	for( i = 0 ; i < 2 ; ++i )
+	{
+		offset[ i ] = data[ 20 + i * 4 ] | (data[ 21 + i * 4 ] << 8) | (data[ 22 + i * 4 ] << 16) | ((W32)data[ 23 + i * 4 ] << 24);
+	}
+	nameLength = data[ 32 ] | (data[ 33 ] << 8);
+	musicLength = data[ 34 ] | (data[ 35 ] << 8);
 
-	defaultscript[ scriptSize - 5 ] = version + 48;
+	/* keep the music name up to its extension, so the entry matches whatever format the music was saved in */
+	if( MAP_HEADER_SIZE + nameLength + musicLength <= (W32) size && musicLength < sizeof( music ) )
+	{
+		MM_MEMCPY( music, data + MAP_HEADER_SIZE + nameLength, musicLength );
+		music[ musicLength ] = '\0';
 
-	data = (PW8) &defaultscript;
+		while( musicLength && music[ musicLength - 1 ] != '.' )
+		{
+			--musicLength;
+		}
+	}
+	else
+	{
+		musicLength = 0;
+	}
 
+	if( tiles <= (W32) size / 2 &&
+		offset[ 0 ] <= (W32) size - tiles * 2 && offset[ 1 ] <= (W32) size - tiles * 2 )
+	{
+		for( i = 0 ; i < tiles ; ++i )
+		{
+			tile = data[ offset[ 0 ] + i * 2 ] | (data[ offset[ 0 ] + i * 2 + 1 ] << 8);
+			if( tile >= 1 && tile <= PAK_WALL_LAST )
+			{
+				/* light and dark side of the wall */
+				walls[ (tile - 1) * 2 ] = 1;
+				walls[ (tile - 1) * 2 + 1 ] = 1;
+			}
 
-	zentry = (zipHead_t *) MM_MALLOC( sizeof( *zentry ) );
-	memset( zentry, 0, sizeof( *zentry ) );
+			tile = data[ offset[ 1 ] + i * 2 ] | (data[ offset[ 1 ] + i * 2 + 1 ] << 8);
+			if( tile >= PAK_STATIC_FIRST && tile <= PAK_STATIC_LAST )
+			{
+				sprites[ PAK_STATIC_SPRITE + tile - PAK_STATIC_FIRST ] = 1;
+			}
+		}
+	}
 
+	MM_FREE( data );
 
-	zentry->versionmadeby = VMB_VFAT;
-	zentry->versionneeded = 20;
-	zentry->disknumstart = 0;
-	zentry->compression_method = CM_DEFLATED;
+	for( i = 0 ; i < count ; ++i )
+	{
+		if( files[ i ].rule != PAK_UNCLAIMED )
+		{
+			continue;
+		}
 
-	zentry->deletefile = 0;
+		if( ( (index = Pak_AssetIndex( files[ i ].name, DIR_WALLS )) >= 0 &&
+			  index < (SW32) sizeof( walls ) && walls[ index ] ) ||
+			( (index = Pak_AssetIndex( files[ i ].name, spritePath )) >= 0 &&
+			  index < (SW32) sizeof( sprites ) && sprites[ index ] ) ||
+			( musicLength && ! wt_strnicmp( files[ i ].name, music, musicLength ) ) )
+		{
+			files[ i ].rule = rule;
+			files[ i ].group = group * 2 + 1;
+		}
+	}
+}
 
-	zentry->uncompressed_size = scriptSize;
+/**
+ * \brief qsort compare function, file name order.
+ */
+PRIVATE int Pak_compareNames( const void *a, const void *b )
+{
+	return strcmp( ((const pakFile_t *)a)->name, ((const pakFile_t *)b)->name );
+}
 
-	//FS_GetFileAttributes( filename, &fs );
+/**
+ * \brief qsort compare function, load order.
+ */
+PRIVATE int Pak_compareOrder( const void *a, const void *b )
+{
+	const pakFile_t *fa = (const pakFile_t *)a;
+	const pakFile_t *fb = (const pakFile_t *)b;
 
-	zentry->timedate = UnixTimeToDosTime( &fs.lastwritetime );
+	if( fa->rule != fb->rule )
+	{
+		return fa->rule < fb->rule ? -1 : 1;
+	}
 
-//
-//	Compression
-//
-	c_stream.zalloc = (alloc_func)0;
-	c_stream.zfree = (free_func)0;
-	c_stream.opaque = (voidpf)0;
+	if( fa->group != fb->group )
+	{
+		return fa->group < fb->group ? -1 : 1;
+	}
 
-	err = deflateInit( &c_stream, Z_DEFAULT_COMPRESSION );
-	if( err != Z_OK )
+	return strcmp( fa->name, fb->name );
+}
+
+/**
+ * \brief Load a load-order profile from file.
+ * \param[in] filename Name of profile file.
+ * \param[out] rules Receives pointers to the rules inside the returned buffer.
+ * \param[out] count Receives number of rules.
+ * \return Buffer the rules point into, free with MM_FREE. NULL on error.
+ * \note One rule per line. Blank lines and lines starting with # are ignored.
+ */
+PRIVATE char *Pak_LoadProfile( const char *filename, const char **rules, W32 *count )
+{
+	char *data;
+	char *line, *end;
+	SW32 size;
+
+	/* FS_FileLoad terminates the data with a NUL */
+	size = FS_FileLoad( filename, (void *) &data );
+	if( size < 0 )
 	{
-		MM_FREE( zentry );
+		fprintf( stderr, "[Pak_LoadProfile]: Could not open file (%s)\n", filename );
 
 		return NULL;
 	}
 
+	*count = 0;
+	for( line = data ; *line ; line = end )
+	{
+		end = line + strcspn( line, "\r\n" );
+		if( *end )
+		{
+			*end++ = '\0';
+		}
 
-	zentry->compressed_size = (zentry->uncompressed_size / 10) + 12 + zentry->uncompressed_size;
+		while( *line == ' ' || *line == '\t' )
+		{
+			++line;
+		}
 
+		if( *line == '\0' || *line == '#' )
+		{
+			continue;
+		}
 
-	compr = (PW8) MM_MALLOC( zentry->compressed_size );
+		if( *count == PAK_MAX_RULES )
+		{
+			fprintf( stderr, "[Pak_LoadProfile]: Too many rules in (%s), only %d are used\n", filename, PAK_MAX_RULES );
+			break;
+		}
 
+		rules[ (*count)++ ] = line;
+	}
 
+	return data;
+}
 
+/**
+ * \brief Add files to zip file in load order.
+ * \param[in] version Game version, selects directories.
+ * \param[in,out] fout File stream to write compressed files to.
+ * \note Each profile rule claims the files it matches that no earlier
+ *  rule has, in name order. The PAK_LEVEL_RULE rule makes one group per
+ *  map, so a level loads from one contiguous run of the pak. Files no
+ *  rule matches go last. The layout only depends on file names, so
+ *  rebuilding from the same files gives the same pak.
+ */
+PRIVATE void Pak_addFilesToZipFile( W8 version, FILE *fout )
+{
+	memBuffer_t list;
+	pakFile_t *files;
+	W32 count, i, j, level;
+	const char *rules[ PAK_MAX_RULES ];
+	char patterns[ PAK_MAX_RULES ][ 32 ];
+	W32 numRules = 0;
+	char *profile = NULL;
+	const char **dirs = version == 1 ? pakDirsSpear : pakDirsWolf;
+	zipHead_t *newZipNode;
 
 
-	c_stream.next_out = compr;
-	c_stream.avail_out = (uInt)zentry->compressed_size;
+	MemBuffer_Init( &list );
 
-	c_stream.next_in = data;
-	c_stream.avail_in = (uInt)zentry->uncompressed_size;
+	for( i = 0 ; dirs[ i ] ; ++i )
+	{
+		Pak_addDirectoryToList( dirs[ i ], &list );
+	}
 
+	files = (pakFile_t *) list.data;
+	count = list.length / sizeof( pakFile_t );
 
-	err = deflate( &c_stream, Z_FINISH );
-	if( err != Z_STREAM_END )
+	if( count == 0 )
 	{
-		MM_FREE( compr );
-		MM_FREE( zentry );
+		MemBuffer_Free( &list );
 
-		return NULL;
+		return;
 	}
 
+	if( _pakProfile )
+	{
+		profile = Pak_LoadProfile( _pakProfile, rules, &numRules );
+	}
 
-	err = deflateEnd( &c_stream );
-	if( err != Z_OK )
+	if( profile == NULL )
 	{
-		MM_FREE( compr );
-		MM_FREE( zentry );
+		/* default profile: script and pics for startup, one group per level, then the shared rest */
+		for( numRules = 0 ; dirs[ numRules ] ; ++numRules )
+		{
+			if( ! strcmp( dirs[ numRules ], DIR_MAPS ) )
+			{
+				rules[ numRules ] = PAK_LEVEL_RULE;
+			}
+			else
+			{
+				wt_snprintf( patterns[ numRules ], sizeof( patterns[ numRules ] ), "%s/*", dirs[ numRules ] );
+				rules[ numRules ] = patterns[ numRules ];
+			}
+		}
+	}
 
-		return NULL;
+	qsort( files, count, sizeof( pakFile_t ), Pak_compareNames );
+
+	for( i = 0 ; i < numRules ; ++i )
+	{
+		if( ! wt_stricmp( rules[ i ], PAK_LEVEL_RULE ) )
+		{
+			level = 0;
+			for( j = 0 ; j < count ; ++j )
+			{
+				if( files[ j ].rule == PAK_UNCLAIMED && Pak_MatchPattern( DIR_MAPS "/*.map", files[ j ].name ) )
+				{
+					Pak_ClaimLevel( files, count, j, i, level++, dirs[ PAK_DIR_SPRITES ] );
+				}
+			}
+
+			continue;
+		}
+
+		for( j = 0 ; j < count ; ++j )
+		{
+			if( files[ j ].rule == PAK_UNCLAIMED && Pak_MatchPattern( rules[ i ], files[ j ].name ) )
+			{
+				files[ j ].rule = i;
+			}
+		}
+	}
+
+	qsort( files, count, sizeof( pakFile_t ), Pak_compareOrder );
+
+	for( i = 0 ; i < count ; ++i )
+	{
+		newZipNode = Pak_WriteLocalFileChunk( files[ i ].name, fout );
+		if( newZipNode == NULL )
+		{
+			continue;
+		}
+
+		// add new zipHead_t to chain
+		zipChainLast = linkList_addList( zipChainLast, newZipNode );
 	}
 
+	MM_FREE( profile );
+	MemBuffer_Free( &list );
+}
+
+/**
+ * \brief Add script file to zip file.
+ * \param[in,out] fout File stream to write compressed files to.
+ * \param[in] version  Version to write into script file.
+ * \return On success pointer to zlist structure, otherwise NULL.
+ */
+PRIVATE zipHead_t *Pak_addScriptToZipFile( FILE *fout, W8 version )
+{
+	zipHead_t *zentry;
+	W32 scriptSize;
+	time_t now;
 
-	//	When using the deflate method, ZLib adds a 2 byte head
-	//	and a 4 byte tail. The head must be removed for zip
-	//	compatability and the tail is not necessary.
-	zentry->compressed_size = c_stream.total_out - 6;
 
-//
-//	End of compression
-//
+	scriptSize = sizeof( defaultscript ) / sizeof( defaultscript[ 0 ] );
 
+	defaultscript[ scriptSize - 5 ] = version + 48;
 
-	zentry->crc32 = crc32( 0, data, zentry->uncompressed_size );
 
-	wt_strlcpy( zentry->filename, SCRIPTNAME, sizeof( zentry->filename ) );
-	zentry->filename_length = strlen( zentry->filename );
+	zentry = Pak_NewEntry( SCRIPTNAME );
 
-	zentry->offset = ftell( fout );
+	zentry->deletefile = 0;
 
-//
-// Write header to file
-//
-	if( ! zip_WriteLocalChunk( zentry, fout ) )
-	{
-		fprintf( stderr, "Error writing local header to zip file\n" );
-		MM_FREE( compr );
-		MM_FREE( zentry );
+	now = time( NULL );
 
-		return NULL;
-	}
+	zentry->timedate = UnixTimeToDosTime( &now );
 
-//
-// Write data to file
-//
-	retval = fwrite( compr+2, 1, zentry->compressed_size, fout );
-	if( retval != zentry->compressed_size )
+	if( ! Pak_WriteEntry( zentry, Pak_GetPolicy( SCRIPTNAME ), NULL, (const W8 *) defaultscript, scriptSize, fout ) )
 	{
-		fprintf( stderr, "Error writing data after local header to zip file\n" );
-		MM_FREE( compr );
-		MM_FREE( zentry );
+		Pak_FreeEntry( zentry );
 
 		return NULL;
 	}
 
-	MM_FREE( compr );
-
 	return zentry;
 }
 
@@ -529,7 +1047,7 @@ PRIVATE void Pak_DeleteZipFileList( linkList_t *in, wtBoolean deletefile )
 				}
 			}
 
-			MM_FREE( tempZipHead );
+			Pak_FreeEntry( tempZipHead );
 		}
 
 	} while( (tempZipHead = (zipHead_t *)linkList_GetNextElement( in )) );
@@ -568,6 +1086,14 @@ PUBLIC wtBoolean PAK_builder( const char *packname, W8 version, wtBoolean delete
 
 	printf( "\n\nGenerating pak file (%s)\nThis could take a few minutes.\n", packname );
 
+	/* every extracted file must be on disk before it is read back */
+	if( ! WriteQueue_Flush() )
+	{
+		fprintf( stderr, "[PAK_builder]: Extracted files are missing, pak file not built\n" );
+
+		return false;
+	}
+
 
 	fout = fopen( packname, "wb" );
 	if( fout == NULL )
@@ -577,6 +1103,18 @@ PUBLIC wtBoolean PAK_builder( const char *packname, W8 version, wtBoolean delete
 		return false;
 	}
 
+	/* One stream for all entries, each entry only resets it */
+	memset( &pakStream, 0, sizeof( pakStream ) );
+
+	if( deflateInit2( &pakStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+	{
+		fprintf( stderr, "[PAK_builder]: Could not initialize deflate\n" );
+		fclose( fout );
+		FS_DeleteFile( packname );
+
+		return false;
+	}
+
 	zipChainLast = zipChain = linkList_new();
 
 
@@ -594,29 +1132,9 @@ PUBLIC wtBoolean PAK_builder( const char *packname, W8 version, wtBoolean delete
 
 
 
-	Pak_addDirectoryToZipFile( DIR_MAPS, fout );
-	Pak_addDirectoryToZipFile( DIR_PICS, fout );
-	Pak_addDirectoryToZipFile( DIR_WALLS, fout );
-	Pak_addDirectoryToZipFile( DIR_MUSIC, fout );
-
-
-	if( version == 1 )
-	{
-		Pak_addDirectoryToZipFile( DIR_SOD_SPRITES, fout );
-		Pak_addDirectoryToZipFile( DIR_SOD_DSOUND, fout );
-		Pak_addDirectoryToZipFile( DIR_SOD_SOUNDFX, fout );
-	}
-	else
-	{
-		Pak_addDirectoryToZipFile( DIR_SPRITES, fout );
-		Pak_addDirectoryToZipFile( DIR_DSOUND, fout );
-		Pak_addDirectoryToZipFile( DIR_SOUNDFX, fout );
-	}
-
-
-
-	Pak_addDirectoryToZipFile( "script", fout );
+	Pak_addFilesToZipFile( version, fout );
 
+	deflateEnd( &pakStream );
 
 
 
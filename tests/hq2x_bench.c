@@ -0,0 +1,161 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file hq2x_bench.c
+ * \brief Timing harness for the fused hq2x pipeline.
+ * \date 2013
+ * \note Scales 64x64 palette-indexed walls to 24-bit output two ways:
+ *		the old five pass chain (expand to RGB32, RGB32toRGB24,
+ *		RGB24toBGR565, hq2x_32, RGB32toRGB24) and the single fused pass
+ *		of Scaler_hq2x. Prints the time of each and fails if the outputs
+ *		differ. Usage: hq2x_bench [tiles], 2000 tiles by default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/platform.h"
+#include "../image/image.h"
+#include "../image/hq2x.h"
+#include "../image/scaler.h"
+
+
+#define BENCH_TILES			16		/* distinct source tiles, reused round robin */
+#define BENCH_TILE_SIZE		64
+
+
+static W8 palette[ 256 * 3 ];
+static W16 keyLUT[ 257 ];
+static W8 tiles[ BENCH_TILES ][ BENCH_TILE_SIZE * BENCH_TILE_SIZE ];
+
+static W8 chainSrc[ BENCH_TILE_SIZE * BENCH_TILE_SIZE * 4 ];
+static W8 chainDest[ BENCH_TILE_SIZE * 2 * BENCH_TILE_SIZE * 2 * 4 ];
+static W8 fusedDest[ BENCH_TILE_SIZE * 2 * BENCH_TILE_SIZE * 2 * 3 ];
+
+
+/**
+ * \brief Fill the tiles with short runs of a few colours, like wall art,
+ *		so hq2x sees both flat areas and edges.
+ */
+static void Bench_fillTiles( void )
+{
+	W32 i, j;
+	W8 colour = 0;
+
+	for( i = 0 ; i < 256 * 3 ; ++i )
+	{
+		palette[ i ] = (W8)rand();
+	}
+
+	for( i = 0 ; i < BENCH_TILES ; ++i )
+	{
+		for( j = 0 ; j < BENCH_TILE_SIZE * BENCH_TILE_SIZE ; ++j )
+		{
+			if( rand() % 4 == 0 )
+			{
+				colour = (W8)(i * 8 + rand() % 8);
+			}
+
+			tiles[ i ][ j ] = colour;
+		}
+	}
+}
+
+/**
+ * \brief The conversion chain the hq2x paths ran before the fused pipeline.
+ */
+static void Bench_chain( const W8 *src )
+{
+	Palette_expandRGB32( src, chainSrc, BENCH_TILE_SIZE * BENCH_TILE_SIZE, palette );
+	RGB32toRGB24( chainSrc, chainSrc, BENCH_TILE_SIZE * BENCH_TILE_SIZE * 4 );
+	RGB24toBGR565( chainSrc, chainSrc, BENCH_TILE_SIZE * BENCH_TILE_SIZE * 3 );
+	hq2x_32( chainSrc, chainDest, BENCH_TILE_SIZE, BENCH_TILE_SIZE, BENCH_TILE_SIZE * 2 * 4 );
+	RGB32toRGB24( chainDest, chainDest, BENCH_TILE_SIZE * 2 * BENCH_TILE_SIZE * 2 * 4 );
+}
+
+/**
+ * \brief The fused pipeline, palette indices straight to 24-bit output.
+ */
+static wtBoolean Bench_fused( const W8 *src )
+{
+	return Scaler_hq2x( src, SCALER_SRC_INDEX8, BENCH_TILE_SIZE, BENCH_TILE_SIZE, keyLUT, fusedDest, 3 );
+}
+
+static double Bench_ms( clock_t start )
+{
+	return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+
+int main( int argc, char *argv[] )
+{
+	W32 count = 2000;
+	W32 i;
+	clock_t start;
+	double chainMs, fusedMs;
+
+	if( argc > 1 )
+	{
+		count = (W32)atoi( argv[ 1 ] );
+	}
+
+	InitLUTs();
+
+	srand( 0x4B2 );
+	Bench_fillTiles();
+	Scaler_buildKeyLUT( palette, keyLUT );
+
+	/* Both paths must produce the same pixels before their times mean anything */
+	for( i = 0 ; i < BENCH_TILES ; ++i )
+	{
+		Bench_chain( tiles[ i ] );
+
+		if( ! Bench_fused( tiles[ i ] ) ||
+			memcmp( chainDest, fusedDest, sizeof( fusedDest ) ) != 0 )
+		{
+			fprintf( stderr, "[hq2x_bench]: fused output differs from the conversion chain on tile %u\n", i );
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	start = clock();
+	for( i = 0 ; i < count ; ++i )
+	{
+		Bench_chain( tiles[ i % BENCH_TILES ] );
+	}
+	chainMs = Bench_ms( start );
+
+	start = clock();
+	for( i = 0 ; i < count ; ++i )
+	{
+		Bench_fused( tiles[ i % BENCH_TILES ] );
+	}
+	fusedMs = Bench_ms( start );
+
+	printf( "hq2x, %u walls of %ux%u to 24-bit:\n", count, BENCH_TILE_SIZE, BENCH_TILE_SIZE );
+	printf( "  conversion chain  5 passes  %8.1f ms\n", chainMs );
+	printf( "  fused pipeline    1 pass    %8.1f ms\n", fusedMs );
+
+	return EXIT_SUCCESS;
+}
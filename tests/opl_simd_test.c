@@ -0,0 +1,478 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file opl_simd_test.c
+ * \brief Bit-exact check of the OPL update paths against the plain scalar loop.
+ * \date 2013
+ * \note Register streams laid out like the ones adlib.c plays, an AdLib
+ *		sound effect at 22050 Hz and an IMF song at 44100 Hz, are rendered
+ *		three ways: OPL_UPDATE_SCALAR over every channel as the reference,
+ *		YM3812UpdateOne with OPL_CALC_LANES forced to NULL, and
+ *		YM3812UpdateOne with the AVX2 kernel when the CPU has AVX2.
+ *		The song walks through all nine channels, one channel, silence
+ *		and rhythm mode, and the test fails unless YM3812UpdateOne took
+ *		each of those paths. Every mismatch is reported and makes the
+ *		exit status non-zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Built in, so the test can reach the static update paths and kernels */
+#include "../wolf/core/fmopl.c"
+
+
+#define TEST_OPL_FREQ		3600000		/* same as OPL_INTERNAL_FREQ in adlib.c */
+#define TEST_MAX_EVENTS		32768
+#define TEST_MAX_SAMPLES	(1 << 20)
+
+#define TEST_SFX_RATE		22050
+#define TEST_SFX_TICK		157			/* samples per tick, as ADLIB_DecodeSound */
+#define TEST_MUSIC_RATE		44100
+#define TEST_MUSIC_TICK		63			/* ADLIB_MUSIC_TICK */
+
+#define TEST_RELEASE_SECONDS	2		/* long enough for any release rate used below to reach EG_OFF */
+
+
+typedef struct
+{
+	W8 reg;
+	W8 value;
+	W16 wait;	/* ticks to render after the write */
+
+} testEvent_t;
+
+typedef struct
+{
+	const char *name;
+	int rate;
+	int tick;
+	testEvent_t events[ TEST_MAX_EVENTS ];
+	W32 count;
+
+} testStream_t;
+
+typedef void (*testUpdate_t)( FM_OPL *OPL, OPLSAMPLE *buf, int length );
+
+
+/* Operator offsets of the modulator of each channel, the carrier is 3 above */
+static const W8 testOperator[ 9 ] = { 0, 1, 2, 8, 9, 10, 16, 17, 18 };
+
+static testStream_t sfxStream;
+static testStream_t musicStream;
+
+static OPLSAMPLE expect[ TEST_MAX_SAMPLES ];
+static OPLSAMPLE result[ TEST_MAX_SAMPLES ];
+
+/* Blocks of YM3812UpdateOne by path taken */
+static W32 blocksSilence, blocksChannel, blocksMulti, blocksRhythm;
+
+
+static void Test_write( testStream_t *stream, W8 reg, W8 value, W16 wait )
+{
+	if( stream->count >= TEST_MAX_EVENTS )
+	{
+		fprintf( stderr, "[opl_simd_test]: %s stream is full\n", stream->name );
+
+		exit( EXIT_FAILURE );
+	}
+
+	stream->events[ stream->count ].reg = reg;
+	stream->events[ stream->count ].value = value;
+	stream->events[ stream->count ].wait = wait;
+	stream->count++;
+}
+
+/**
+ * \brief Random instrument on a channel, as ADLIB_SetFXInst or an IMF
+ *		song would program it.
+ * \param[in] stream Stream to append to.
+ * \param[in] channel Channel number, 0 to 8.
+ * \note Release rates stay fast enough for TEST_RELEASE_SECONDS.
+ */
+static void Test_instrument( testStream_t *stream, W32 channel )
+{
+	W32 op;
+	W8 reg;
+
+	for( op = 0 ; op < 2 ; ++op )
+	{
+		reg = testOperator[ channel ] + (W8)(op * 3);
+
+		Test_write( stream, 0x20 + reg, (W8)rand(), 0 );
+		Test_write( stream, 0x40 + reg, (W8)(rand() & 0xC0) | (W8)(rand() % 0x30), 0 );
+		Test_write( stream, 0x60 + reg, (W8)((1 + rand() % 15) << 4) | (W8)(rand() & 0x0F), 0 );
+		Test_write( stream, 0x80 + reg, (W8)((rand() & 0x0F) << 4) | (W8)(8 + rand() % 8), 0 );
+		Test_write( stream, 0xE0 + reg, (W8)(rand() & 3), 0 );
+	}
+
+	Test_write( stream, 0xC0 + (W8)channel, (W8)(rand() & 0x0F), 0 );
+}
+
+/**
+ * \brief Ticks a stream waits after a key off for the channel to go idle.
+ */
+static W16 Test_release( const testStream_t *stream )
+{
+	return (W16)(stream->rate * TEST_RELEASE_SECONDS / stream->tick);
+}
+
+static void Test_keyOn( testStream_t *stream, W32 channel, W16 wait )
+{
+	Test_write( stream, 0xA0 + (W8)channel, (W8)rand(), 0 );
+	Test_write( stream, 0xB0 + (W8)channel, 0x20 | (W8)((2 + rand() % 5) << 2) | (W8)(rand() & 3), wait );
+}
+
+static void Test_keyOff( testStream_t *stream, W32 channel, W16 wait )
+{
+	Test_write( stream, 0xB0 + (W8)channel, 0, wait );
+}
+
+/**
+ * \brief Sound effects the way ADLIB_DecodeSound plays them: one instrument
+ *		on channel 0, a note byte per tick where 0 keys off, and a final
+ *		key off that is left to ring out.
+ */
+static void Test_buildSfx( testStream_t *stream )
+{
+	W32 sound, tick, length;
+	W8 block, note;
+
+	stream->name = "sfx";
+	stream->rate = TEST_SFX_RATE;
+	stream->tick = TEST_SFX_TICK;
+	stream->count = 0;
+
+	for( sound = 0 ; sound < 8 ; ++sound )
+	{
+		Test_instrument( stream, 0 );
+
+		block = (W8)(((rand() & 7) << 2) | 0x20);
+		length = 20 + (W32)rand() % 80;
+
+		for( tick = 0 ; tick < length ; ++tick )
+		{
+			note = (rand() % 6) ? (W8)rand() : 0;
+
+			if( note == 0 )
+			{
+				Test_write( stream, 0xB0, 0, 1 );
+			}
+			else
+			{
+				Test_write( stream, 0xA0, note, 0 );
+				Test_write( stream, 0xB0, block, 1 );
+			}
+		}
+
+		Test_write( stream, 0xB0, 0, (W16)(Test_release( stream ) / 4 + (W32)rand() % Test_release( stream )) );
+	}
+}
+
+/**
+ * \brief An IMF style song that spends time in every update path of
+ *		YM3812UpdateOne: all nine channels, every channel but the last,
+ *		a single channel, silence and rhythm mode.
+ */
+static void Test_buildMusic( testStream_t *stream )
+{
+	W32 c, tick;
+
+	stream->name = "music";
+	stream->rate = TEST_MUSIC_RATE;
+	stream->tick = TEST_MUSIC_TICK;
+	stream->count = 0;
+
+	/* Deep tremolo and vibrato, so the LFO tables matter */
+	Test_write( stream, 0xBD, 0xC0, 0 );
+
+	for( c = 0 ; c < 9 ; ++c )
+	{
+		Test_instrument( stream, c );
+		Test_keyOn( stream, c, 0 );
+	}
+
+	/* All channels, with notes and levels changing underneath */
+	for( tick = 0 ; tick < 300 ; ++tick )
+	{
+		c = (W32)rand() % 9;
+
+		switch( rand() % 3 )
+		{
+			case 0:
+				Test_keyOn( stream, c, 0 );
+				break;
+
+			case 1:
+				Test_write( stream, 0x40 + testOperator[ c ] + 3, (W8)(rand() % 0x30), 0 );
+				break;
+
+			default:
+				Test_write( stream, 0xA0 + (W8)c, (W8)rand(), 0 );
+				break;
+		}
+
+		Test_write( stream, 0xBD, (W8)(rand() & 0xC0), 1 );
+	}
+
+	/* Channel 0 alone, the others released until idle */
+	Test_keyOn( stream, 0, 0 );
+	for( c = 1 ; c < 9 ; ++c )
+	{
+		Test_keyOff( stream, c, 0 );
+	}
+	Test_write( stream, 0xBD, 0, Test_release( stream ) );
+
+	Test_keyOff( stream, 0, Test_release( stream ) );
+
+	/* Lanes without the channel 8 tail, then a few channels at a time */
+	for( c = 0 ; c < 8 ; ++c )
+	{
+		Test_instrument( stream, c );
+		Test_keyOn( stream, c, 0 );
+	}
+	Test_write( stream, 0xBD, 0x80, 200 );
+
+	for( tick = 0 ; tick < 200 ; ++tick )
+	{
+		c = (W32)rand() % 9;
+
+		if( rand() & 1 )
+		{
+			Test_keyOn( stream, c, (W16)(rand() % 4) );
+		}
+		else
+		{
+			Test_keyOff( stream, c, (W16)(rand() % 4) );
+		}
+	}
+
+	/* Rhythm mode, drums toggled over melodic channels 0-5 */
+	for( c = 6 ; c < 9 ; ++c )
+	{
+		Test_instrument( stream, c );
+		Test_write( stream, 0xA0 + (W8)c, (W8)rand(), 0 );
+		Test_write( stream, 0xB0 + (W8)c, (W8)(((2 + rand() % 5) << 2) | (rand() & 3)), 0 );
+	}
+	for( tick = 0 ; tick < 300 ; ++tick )
+	{
+		Test_write( stream, 0xBD, 0x20 | (W8)(rand() & 0xDF), 1 );
+	}
+
+	/* Back to melodic mode and into silence */
+	Test_write( stream, 0xBD, 0, 0 );
+	for( c = 0 ; c < 9 ; ++c )
+	{
+		Test_keyOff( stream, c, 0 );
+	}
+	Test_write( stream, 0xB0, 0, Test_release( stream ) );
+}
+
+
+/**
+ * \brief The plain scalar loop over every channel, no idle skipping.
+ */
+static void Test_updateReference( FM_OPL *OPL, OPLSAMPLE *buf, int length )
+{
+	OPL_UPDATE_SCALAR( OPL, buf, length, (OPL->rythm & 0x20) ? 0x3F : 0x1FF );
+}
+
+/**
+ * \brief YM3812UpdateOne, counting the path it takes for each block.
+ */
+static void Test_updateChip( FM_OPL *OPL, OPLSAMPLE *buf, int length )
+{
+	int chans = (OPL->rythm & 0x20) ? 6 : 9;
+	UINT32 active;
+	int done, n, c;
+
+	for( done = 0 ; done < length ; done += n )
+	{
+		n = length - done;
+		if( n > OPL_IDLE_BLOCK )
+		{
+			n = OPL_IDLE_BLOCK;
+		}
+
+		active = 0;
+		for( c = 0 ; c < chans ; ++c )
+		{
+			if( ! OPL_CH_IDLE( &OPL->P_CH[ c ] ) )
+			{
+				active |= 1 << c;
+			}
+		}
+
+		if( OPL->rythm & 0x20 )
+		{
+			blocksRhythm++;
+		}
+		else if( ! active )
+		{
+			blocksSilence++;
+		}
+		else if( ! (active & (active - 1)) )
+		{
+			blocksChannel++;
+		}
+		else
+		{
+			blocksMulti++;
+		}
+
+		YM3812UpdateOne( OPL, buf + done, n );
+	}
+}
+
+/**
+ * \brief Play a stream into a fresh chip.
+ * \param[in] stream Register writes to play.
+ * \param[in] kernel Value forced into OPL_CALC_LANES.
+ * \param[in] update Update function to render with.
+ * \param[out] out Sample buffer.
+ * \return Number of samples rendered, 0 on error.
+ */
+static W32 Test_render( const testStream_t *stream, OPL_LANE_KERNEL kernel, testUpdate_t update, OPLSAMPLE *out )
+{
+	FM_OPL *OPL;
+	W32 i, length;
+	W32 pos = 0;
+
+	OPL = OPLCreate( OPL_TYPE_YM3812, TEST_OPL_FREQ, stream->rate );
+	if( OPL == NULL )
+	{
+		fprintf( stderr, "[opl_simd_test]: Could not create OPL Emulator\n" );
+
+		return 0;
+	}
+
+	/* OPLCreate picked a kernel for this CPU, override it */
+	OPL_CALC_LANES = kernel;
+
+	OPLWrite( OPL, 0x01, 0x20 );
+	OPLWrite( OPL, 0x08, 0x00 );
+
+	for( i = 0 ; i < stream->count ; ++i )
+	{
+		OPLWrite( OPL, stream->events[ i ].reg, stream->events[ i ].value );
+
+		length = (W32)stream->events[ i ].wait * (W32)stream->tick;
+		if( pos + length > TEST_MAX_SAMPLES )
+		{
+			fprintf( stderr, "[opl_simd_test]: %s stream is too long\n", stream->name );
+			OPLDestroy( OPL );
+
+			return 0;
+		}
+
+		if( length )
+		{
+			update( OPL, out + pos, (int)length );
+			pos += length;
+		}
+	}
+
+	OPLDestroy( OPL );
+
+	return pos;
+}
+
+static int Test_compare( const testStream_t *stream, const char *kernel, W32 samples )
+{
+	W32 i;
+
+	for( i = 0 ; i < samples ; ++i )
+	{
+		if( expect[ i ] != result[ i ] )
+		{
+			fprintf( stderr, "[opl_simd_test]: %s with %s differs from the scalar loop at sample %u (%d, expected %d)\n",
+				stream->name, kernel, i, result[ i ], expect[ i ] );
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Render a stream with the reference and with a kernel, and compare.
+ */
+static int Test_stream( const testStream_t *stream, const char *name, OPL_LANE_KERNEL kernel )
+{
+	W32 samples;
+
+	memset( expect, 0, sizeof( expect ) );
+	memset( result, 0x5A, sizeof( result ) );
+
+	samples = Test_render( stream, kernel, Test_updateReference, expect );
+	if( samples == 0 || Test_render( stream, kernel, Test_updateChip, result ) != samples )
+	{
+		return 1;
+	}
+
+	return Test_compare( stream, name, samples );
+}
+
+
+int main( void )
+{
+	W32 features = CPU_features();
+	int tested = 0;
+	int failed = 0;
+
+	srand( 0x0B12 );
+	Test_buildSfx( &sfxStream );
+	Test_buildMusic( &musicStream );
+
+	failed |= Test_stream( &sfxStream, "scalar", NULL );
+	failed |= Test_stream( &musicStream, "scalar", NULL );
+	++tested;
+
+#ifdef CPU_X86
+	if( features & CPU_FEATURE_AVX2 )
+	{
+		failed |= Test_stream( &sfxStream, "avx2", OPL_CALC_LANES_AVX2 );
+		failed |= Test_stream( &musicStream, "avx2", OPL_CALC_LANES_AVX2 );
+		++tested;
+	}
+	else
+	{
+		printf( "avx2 skipped, not supported by this CPU\n" );
+	}
+#endif
+
+	(void)features;
+
+	/* The song must have driven every path, or it checked less than it claims */
+	if( ! blocksSilence || ! blocksChannel || ! blocksMulti || ! blocksRhythm )
+	{
+		fprintf( stderr, "[opl_simd_test]: update paths not all taken (silence %u, one channel %u, several %u, rhythm %u)\n",
+			blocksSilence, blocksChannel, blocksMulti, blocksRhythm );
+
+		failed = 1;
+	}
+
+	printf( "%d OPL kernels checked against the scalar loop: %s\n", tested, failed ? "FAILED" : "ok" );
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
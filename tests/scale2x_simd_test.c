@@ -0,0 +1,233 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file scale2x_simd_test.c
+ * \brief Bit-exact check of the SIMD Scale2x kernels against the _def kernels.
+ * \date 2013
+ * \note Every kernel the CPU supports is run on random rows of edge and
+ *		random widths, with few colours so the neighbour compares hit both
+ *		ways, and with the border rows aliased as at the top and bottom of
+ *		an image. Output rows carry a guard tail to catch overruns.
+ *		Every mismatch is reported and makes the exit status non-zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/platform.h"
+#include "../common/cpu.h"
+#include "../image/scale2x.h"
+
+
+#define TEST_MAX_WIDTH		1024
+#define TEST_GUARD			16
+#define TEST_RANDOM_ROWS	200
+
+/* Edges of the 16 and 32 byte vector loops */
+static const unsigned testWidths[] = { 2, 3, 4, 5, 6, 7, 8, 9, 15, 16, 17, 18, 31, 32, 33, 34, 35, 63, 64, 65, 66, 127, 128, 129, 320, 640, 1023, 1024 };
+
+/* Colour counts for the random rows, 0 means full range */
+static const unsigned testColours[] = { 2, 3, 0 };
+
+
+#define SCALE2X_TEST( bits ) \
+\
+typedef struct \
+{ \
+	const char *name; \
+	void (*scale2x)( scale2x_uint##bits *, scale2x_uint##bits *, const scale2x_uint##bits *, const scale2x_uint##bits *, const scale2x_uint##bits *, unsigned ); \
+	void (*scale2x3)( scale2x_uint##bits *, scale2x_uint##bits *, scale2x_uint##bits *, const scale2x_uint##bits *, const scale2x_uint##bits *, const scale2x_uint##bits *, unsigned ); \
+	void (*scale2x4)( scale2x_uint##bits *, scale2x_uint##bits *, scale2x_uint##bits *, scale2x_uint##bits *, const scale2x_uint##bits *, const scale2x_uint##bits *, const scale2x_uint##bits *, unsigned ); \
+\
+} kernels##bits##_t; \
+\
+static scale2x_uint##bits src##bits[ 3 ][ TEST_MAX_WIDTH ]; \
+static scale2x_uint##bits expect##bits[ 4 ][ TEST_MAX_WIDTH * 2 + TEST_GUARD ]; \
+static scale2x_uint##bits result##bits[ 4 ][ TEST_MAX_WIDTH * 2 + TEST_GUARD ]; \
+\
+static void fill_##bits( unsigned width, unsigned colours ) \
+{ \
+	unsigned row, x; \
+\
+	for( row = 0 ; row < 3 ; ++row ) \
+	{ \
+		for( x = 0 ; x < width ; ++x ) \
+		{ \
+			W32 value = ((W32)rand() << 16) ^ (W32)rand(); \
+\
+			src##bits[ row ][ x ] = (scale2x_uint##bits)(colours ? value % colours : value); \
+		} \
+	} \
+} \
+\
+static void clear_##bits( void ) \
+{ \
+	memset( expect##bits, 0xA5, sizeof( expect##bits ) ); \
+	memset( result##bits, 0xA5, sizeof( result##bits ) ); \
+} \
+\
+static int compare_##bits( const kernels##bits##_t *kernels, const char *kernel, unsigned rows, unsigned width, unsigned colours, unsigned alias ) \
+{ \
+	unsigned row; \
+\
+	for( row = 0 ; row < rows ; ++row ) \
+	{ \
+		if( memcmp( expect##bits[ row ], result##bits[ row ], sizeof( expect##bits[ row ] ) ) != 0 ) \
+		{ \
+			fprintf( stderr, "[scale2x_simd_test]: %s %s_%d differs from _def in row %u (width %u, colours %u, alias %u)\n", \
+				kernels->name, kernel, bits, row, width, colours, alias ); \
+\
+			return 1; \
+		} \
+	} \
+\
+	return 0; \
+} \
+\
+static int run_##bits( const kernels##bits##_t *def, const kernels##bits##_t *simd, unsigned width, unsigned colours, unsigned alias ) \
+{ \
+	const scale2x_uint##bits *s0 = (alias & 1) ? src##bits[ 1 ] : src##bits[ 0 ]; \
+	const scale2x_uint##bits *s1 = src##bits[ 1 ]; \
+	const scale2x_uint##bits *s2 = (alias & 2) ? src##bits[ 1 ] : src##bits[ 2 ]; \
+	int failed = 0; \
+\
+	clear_##bits(); \
+	def->scale2x( expect##bits[ 0 ], expect##bits[ 1 ], s0, s1, s2, width ); \
+	simd->scale2x( result##bits[ 0 ], result##bits[ 1 ], s0, s1, s2, width ); \
+	failed |= compare_##bits( simd, "scale2x", 2, width, colours, alias ); \
+\
+	clear_##bits(); \
+	def->scale2x3( expect##bits[ 0 ], expect##bits[ 1 ], expect##bits[ 2 ], s0, s1, s2, width ); \
+	simd->scale2x3( result##bits[ 0 ], result##bits[ 1 ], result##bits[ 2 ], s0, s1, s2, width ); \
+	failed |= compare_##bits( simd, "scale2x3", 3, width, colours, alias ); \
+\
+	clear_##bits(); \
+	def->scale2x4( expect##bits[ 0 ], expect##bits[ 1 ], expect##bits[ 2 ], expect##bits[ 3 ], s0, s1, s2, width ); \
+	simd->scale2x4( result##bits[ 0 ], result##bits[ 1 ], result##bits[ 2 ], result##bits[ 3 ], s0, s1, s2, width ); \
+	failed |= compare_##bits( simd, "scale2x4", 4, width, colours, alias ); \
+\
+	return failed; \
+} \
+\
+static int test_##bits( const kernels##bits##_t *def, const kernels##bits##_t *simd ) \
+{ \
+	unsigned i, c, alias; \
+	int failed = 0; \
+\
+	for( c = 0 ; c < sizeof( testColours ) / sizeof( testColours[ 0 ] ) ; ++c ) \
+	{ \
+		for( i = 0 ; i < sizeof( testWidths ) / sizeof( testWidths[ 0 ] ) ; ++i ) \
+		{ \
+			fill_##bits( testWidths[ i ], testColours[ c ] ); \
+\
+			for( alias = 0 ; alias < 4 ; ++alias ) \
+			{ \
+				failed |= run_##bits( def, simd, testWidths[ i ], testColours[ c ], alias ); \
+			} \
+		} \
+\
+		for( i = 0 ; i < TEST_RANDOM_ROWS ; ++i ) \
+		{ \
+			unsigned width = 2 + (unsigned)rand() % (TEST_MAX_WIDTH - 1); \
+\
+			fill_##bits( width, testColours[ c ] ); \
+			failed |= run_##bits( def, simd, width, testColours[ c ], 0 ); \
+		} \
+	} \
+\
+	return failed; \
+}
+
+SCALE2X_TEST( 8 )
+SCALE2X_TEST( 16 )
+SCALE2X_TEST( 32 )
+
+
+#define TEST_KERNELS( bits, isa ) \
+	{ #isa, scale2x_##bits##_##isa, scale2x3_##bits##_##isa, scale2x4_##bits##_##isa }
+
+#define TEST_ISA( isa ) \
+	failed |= test_8( &def8, &isa##8 ); \
+	failed |= test_16( &def16, &isa##16 ); \
+	failed |= test_32( &def32, &isa##32 ); \
+	++tested
+
+
+int main( void )
+{
+	static const kernels8_t def8 = TEST_KERNELS( 8, def );
+	static const kernels16_t def16 = TEST_KERNELS( 16, def );
+	static const kernels32_t def32 = TEST_KERNELS( 32, def );
+	W32 features = CPU_features();
+	int tested = 0;
+	int failed = 0;
+
+	srand( 0x5CA1E2 );
+
+#ifdef CPU_X86
+	if( features & CPU_FEATURE_SSE2 )
+	{
+		static const kernels8_t sse28 = TEST_KERNELS( 8, sse2 );
+		static const kernels16_t sse216 = TEST_KERNELS( 16, sse2 );
+		static const kernels32_t sse232 = TEST_KERNELS( 32, sse2 );
+
+		TEST_ISA( sse2 );
+	}
+
+	if( features & CPU_FEATURE_AVX2 )
+	{
+		static const kernels8_t avx28 = TEST_KERNELS( 8, avx2 );
+		static const kernels16_t avx216 = TEST_KERNELS( 16, avx2 );
+		static const kernels32_t avx232 = TEST_KERNELS( 32, avx2 );
+
+		TEST_ISA( avx2 );
+	}
+#endif
+
+#ifdef CPU_NEON
+	if( features & CPU_FEATURE_NEON )
+	{
+		static const kernels8_t neon8 = TEST_KERNELS( 8, neon );
+		static const kernels16_t neon16 = TEST_KERNELS( 16, neon );
+		static const kernels32_t neon32 = TEST_KERNELS( 32, neon );
+
+		TEST_ISA( neon );
+	}
+#endif
+
+	/* The dispatched entry points must match too, whatever they picked */
+	{
+		static const kernels8_t dispatch8 = { "dispatch", scale2x_8, scale2x3_8, scale2x4_8 };
+		static const kernels16_t dispatch16 = { "dispatch", scale2x_16, scale2x3_16, scale2x4_16 };
+		static const kernels32_t dispatch32 = { "dispatch", scale2x_32, scale2x3_32, scale2x4_32 };
+
+		scale2x_init();
+
+		TEST_ISA( dispatch );
+	}
+
+	(void)features;
+
+	printf( "%d kernel sets checked against _def: %s\n", tested, failed ? "FAILED" : "ok" );
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
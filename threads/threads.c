@@ -0,0 +1,285 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file threads.c
+ * \brief Worker thread pool.
+ * \date 2013
+ * \note The calling thread always takes part in ThreadPool_Run as thread 0,
+ *		so a pool of one thread runs everything serially without any workers.
+ */
+
+#include <stdio.h>
+
+#include "threads.h"
+#include "../common/common_utils.h"
+
+
+typedef struct
+{
+	W32 id;
+
+} worker_t;
+
+
+PRIVATE thread_t	pool_threads[ MAX_THREADS ];
+PRIVATE worker_t	pool_workers[ MAX_THREADS ];
+PRIVATE W32			pool_numThreads = 1;
+
+PRIVATE mutex_t		pool_mutex = NULL;
+PRIVATE cond_t		pool_wake = NULL;		/* signalled when a new run starts */
+PRIVATE cond_t		pool_done = NULL;		/* signalled when a run finishes */
+
+PRIVATE threadJob_t	pool_job = NULL;
+PRIVATE void		*pool_param = NULL;
+PRIVATE W32			pool_count = 0;			/* number of jobs in current run */
+PRIVATE W32			pool_next = 0;			/* next job index to hand out */
+PRIVATE W32			pool_finished = 0;		/* jobs completed in current run */
+PRIVATE W32			pool_generation = 0;	/* bumped for every run */
+PRIVATE wtBoolean	pool_running = false;
+PRIVATE wtBoolean	pool_quit = false;
+
+
+/**
+ * \brief Take and run jobs from the current run until none are left.
+ * \param[in] threadId Id of calling thread.
+ * \return Nothing.
+ * \note pool_mutex must be held on entry, it is held again on return.
+ */
+PRIVATE void ThreadPool_work( W32 threadId )
+{
+	W32 index;
+
+	while( pool_next < pool_count )
+	{
+		index = pool_next++;
+
+		Mutex_Unlock( pool_mutex );
+
+		pool_job( pool_param, index, threadId );
+
+		Mutex_Lock( pool_mutex );
+
+		if( ++pool_finished == pool_count )
+		{
+			Cond_Broadcast( pool_done );
+		}
+	}
+}
+
+/**
+ * \brief Worker thread entry point.
+ * \param[in] param Worker description.
+ * \return Nothing.
+ */
+PRIVATE void ThreadPool_worker( void *param )
+{
+	worker_t *worker = (worker_t *)param;
+	W32 generation = 0;
+
+	Mutex_Lock( pool_mutex );
+
+	for( ; ; )
+	{
+		while( ! pool_quit && generation == pool_generation )
+		{
+			Cond_Wait( pool_wake, pool_mutex );
+		}
+
+		if( pool_quit )
+		{
+			break;
+		}
+
+		generation = pool_generation;
+
+		ThreadPool_work( worker->id );
+	}
+
+	Mutex_Unlock( pool_mutex );
+}
+
+/**
+ * \brief Start worker threads.
+ * \param[in] numThreads Number of threads to use including the caller, 0 for one per CPU.
+ * \return On success true, otherwise false.
+ * \note On failure the pool falls back to running jobs on the calling thread.
+ */
+PUBLIC wtBoolean ThreadPool_Init( W32 numThreads )
+{
+	W32 i;
+
+	if( numThreads == 0 )
+	{
+		numThreads = Thread_NumCPUs();
+	}
+
+	if( numThreads > MAX_THREADS )
+	{
+		numThreads = MAX_THREADS;
+	}
+
+	pool_numThreads = 1;
+	pool_quit = false;
+
+	pool_mutex = Mutex_New();
+	pool_wake = Cond_New();
+	pool_done = Cond_New();
+	if( NULL == pool_mutex || NULL == pool_wake || NULL == pool_done )
+	{
+		fprintf( stderr, "[ThreadPool_Init]: Unable to create synchronization objects\n" );
+
+		ThreadPool_Shutdown();
+
+		return false;
+	}
+
+	for( i = 1 ; i < numThreads ; ++i )
+	{
+		pool_workers[ i ].id = i;
+
+		pool_threads[ i ] = Thread_Create( ThreadPool_worker, &pool_workers[ i ] );
+		if( NULL == pool_threads[ i ] )
+		{
+			fprintf( stderr, "[ThreadPool_Init]: Unable to create worker thread (%d)\n", i );
+
+			break;
+		}
+
+		pool_numThreads++;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Stop worker threads.
+ * \return Nothing.
+ */
+PUBLIC void ThreadPool_Shutdown( void )
+{
+	W32 i;
+
+	if( pool_mutex )
+	{
+		Mutex_Lock( pool_mutex );
+		pool_quit = true;
+		Cond_Broadcast( pool_wake );
+		Mutex_Unlock( pool_mutex );
+	}
+
+	for( i = 1 ; i < pool_numThreads ; ++i )
+	{
+		Thread_Join( pool_threads[ i ] );
+		pool_threads[ i ] = NULL;
+	}
+
+	pool_numThreads = 1;
+
+	if( pool_done )
+	{
+		Cond_Free( pool_done );
+		pool_done = NULL;
+	}
+
+	if( pool_wake )
+	{
+		Cond_Free( pool_wake );
+		pool_wake = NULL;
+	}
+
+	if( pool_mutex )
+	{
+		Mutex_Free( pool_mutex );
+		pool_mutex = NULL;
+	}
+}
+
+/**
+ * \brief Get number of threads jobs are spread across.
+ * \return Number of threads, including the caller.
+ */
+PUBLIC W32 ThreadPool_NumThreads( void )
+{
+	return pool_numThreads;
+}
+
+/**
+ * \brief Run a job for every index in [0, count) and wait for completion.
+ * \param[in] job Job to run.
+ * \param[in] param Parameter passed to job.
+ * \param[in] count Number of job indices.
+ * \return Nothing.
+ * \note Runs started from inside a job, or before ThreadPool_Init, execute
+ *		serially on the calling thread with threadId 0, so jobs that index
+ *		per-thread data by threadId must only be started from the top level.
+ */
+PUBLIC void ThreadPool_Run( threadJob_t job, void *param, W32 count )
+{
+	W32 i;
+
+	if( count == 0 )
+	{
+		return;
+	}
+
+	if( pool_numThreads > 1 && pool_mutex )
+	{
+		Mutex_Lock( pool_mutex );
+
+		if( ! pool_running )
+		{
+			pool_running = true;
+
+			pool_job = job;
+			pool_param = param;
+			pool_count = count;
+			pool_next = 0;
+			pool_finished = 0;
+			pool_generation++;
+
+			Cond_Broadcast( pool_wake );
+
+			ThreadPool_work( 0 );
+
+			while( pool_finished < pool_count )
+			{
+				Cond_Wait( pool_done, pool_mutex );
+			}
+
+			pool_job = NULL;
+			pool_param = NULL;
+			pool_count = 0;
+			pool_next = 0;
+			pool_running = false;
+
+			Mutex_Unlock( pool_mutex );
+
+			return;
+		}
+
+		Mutex_Unlock( pool_mutex );
+	}
+
+	for( i = 0 ; i < count ; ++i )
+	{
+		job( param, i, 0 );
+	}
+}
@@ -0,0 +1,72 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file threads.h
+ * \brief Interface to threads and the worker thread pool.
+ * \date 2013
+ */
+
+#ifndef __THREADS_H__
+#define __THREADS_H__
+
+#include "../common/platform.h"
+
+
+/* Upper limit on the size of the worker thread pool (including the caller) */
+#define MAX_THREADS		32
+
+
+typedef struct thread_s		*thread_t;
+typedef struct mutex_s		*mutex_t;
+typedef struct cond_s		*cond_t;
+
+typedef void (*threadFunc_t)( void *param );
+
+/* A job is called once for every index in [0, count), threadId is in [0, ThreadPool_NumThreads()) */
+typedef void (*threadJob_t)( void *param, W32 index, W32 threadId );
+
+
+/* Platform primitives */
+W32 Thread_NumCPUs( void );
+
+thread_t Thread_Create( threadFunc_t func, void *param );
+void Thread_Join( thread_t thread );
+
+mutex_t Mutex_New( void );
+void Mutex_Free( mutex_t mutex );
+void Mutex_Lock( mutex_t mutex );
+void Mutex_Unlock( mutex_t mutex );
+
+cond_t Cond_New( void );
+void Cond_Free( cond_t cond );
+void Cond_Wait( cond_t cond, mutex_t mutex );
+void Cond_Signal( cond_t cond );
+void Cond_Broadcast( cond_t cond );
+
+
+/* Worker thread pool */
+wtBoolean ThreadPool_Init( W32 numThreads );
+void ThreadPool_Shutdown( void );
+W32 ThreadPool_NumThreads( void );
+void ThreadPool_Run( threadJob_t job, void *param, W32 count );
+
+
+#endif /* __THREADS_H__ */
@@ -0,0 +1,250 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file threads_unix.c
+ * \brief Thread primitives [UNIX].
+ * \date 2013
+ * \note When doing a port these functions need to be converted.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../threads.h"
+#include "../../common/common_utils.h"
+#include "../../memory/memory.h"
+
+
+struct thread_s
+{
+	pthread_t	handle;
+	threadFunc_t	func;
+	void		*param;
+};
+
+struct mutex_s
+{
+	pthread_mutex_t	handle;
+};
+
+struct cond_s
+{
+	pthread_cond_t	handle;
+};
+
+
+/**
+ * \brief Get the number of online processors.
+ * \return Number of processors, at least 1.
+ */
+PUBLIC W32 Thread_NumCPUs( void )
+{
+	long n = -1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	n = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+
+	return (n > 0) ? (W32)n : 1;
+}
+
+/**
+ * \brief pthread entry point.
+ * \param[in] param Thread description.
+ * \return NULL.
+ */
+PRIVATE void *Thread_start( void *param )
+{
+	thread_t thread = (thread_t)param;
+
+	thread->func( thread->param );
+
+	return NULL;
+}
+
+/**
+ * \brief Create a thread.
+ * \param[in] func Thread entry point.
+ * \param[in] param Parameter passed to func.
+ * \return On success thread handle, otherwise NULL.
+ */
+PUBLIC thread_t Thread_Create( threadFunc_t func, void *param )
+{
+	thread_t thread;
+
+	thread = (thread_t) MM_MALLOC( sizeof( struct thread_s ) );
+	if( NULL == thread )
+	{
+		return NULL;
+	}
+
+	thread->func = func;
+	thread->param = param;
+
+	if( pthread_create( &thread->handle, NULL, Thread_start, thread ) != 0 )
+	{
+		MM_FREE( thread );
+
+		return NULL;
+	}
+
+	return thread;
+}
+
+/**
+ * \brief Wait for a thread to exit and release it.
+ * \param[in] thread Thread handle.
+ * \return Nothing.
+ */
+PUBLIC void Thread_Join( thread_t thread )
+{
+	if( NULL == thread )
+	{
+		return;
+	}
+
+	pthread_join( thread->handle, NULL );
+
+	MM_FREE( thread );
+}
+
+/**
+ * \brief Create a mutex.
+ * \return On success mutex handle, otherwise NULL.
+ */
+PUBLIC mutex_t Mutex_New( void )
+{
+	mutex_t mutex;
+
+	mutex = (mutex_t) MM_MALLOC( sizeof( struct mutex_s ) );
+	if( NULL == mutex )
+	{
+		return NULL;
+	}
+
+	if( pthread_mutex_init( &mutex->handle, NULL ) != 0 )
+	{
+		MM_FREE( mutex );
+
+		return NULL;
+	}
+
+	return mutex;
+}
+
+/**
+ * \brief Release a mutex.
+ * \param[in] mutex Mutex handle.
+ * \return Nothing.
+ */
+PUBLIC void Mutex_Free( mutex_t mutex )
+{
+	pthread_mutex_destroy( &mutex->handle );
+
+	MM_FREE( mutex );
+}
+
+/**
+ * \brief Lock a mutex.
+ * \param[in] mutex Mutex handle.
+ * \return Nothing.
+ */
+PUBLIC void Mutex_Lock( mutex_t mutex )
+{
+	pthread_mutex_lock( &mutex->handle );
+}
+
+/**
+ * \brief Unlock a mutex.
+ * \param[in] mutex Mutex handle.
+ * \return Nothing.
+ */
+PUBLIC void Mutex_Unlock( mutex_t mutex )
+{
+	pthread_mutex_unlock( &mutex->handle );
+}
+
+/**
+ * \brief Create a condition variable.
+ * \return On success condition variable handle, otherwise NULL.
+ */
+PUBLIC cond_t Cond_New( void )
+{
+	cond_t cond;
+
+	cond = (cond_t) MM_MALLOC( sizeof( struct cond_s ) );
+	if( NULL == cond )
+	{
+		return NULL;
+	}
+
+	if( pthread_cond_init( &cond->handle, NULL ) != 0 )
+	{
+		MM_FREE( cond );
+
+		return NULL;
+	}
+
+	return cond;
+}
+
+/**
+ * \brief Release a condition variable.
+ * \param[in] cond Condition variable handle.
+ * \return Nothing.
+ */
+PUBLIC void Cond_Free( cond_t cond )
+{
+	pthread_cond_destroy( &cond->handle );
+
+	MM_FREE( cond );
+}
+
+/**
+ * \brief Wait on a condition variable.
+ * \param[in] cond Condition variable handle.
+ * \param[in] mutex Locked mutex, released while waiting.
+ * \return Nothing.
+ */
+PUBLIC void Cond_Wait( cond_t cond, mutex_t mutex )
+{
+	pthread_cond_wait( &cond->handle, &mutex->handle );
+}
+
+/**
+ * \brief Wake one thread waiting on a condition variable.
+ * \param[in] cond Condition variable handle.
+ * \return Nothing.
+ */
+PUBLIC void Cond_Signal( cond_t cond )
+{
+	pthread_cond_signal( &cond->handle );
+}
+
+/**
+ * \brief Wake all threads waiting on a condition variable.
+ * \param[in] cond Condition variable handle.
+ * \return Nothing.
+ */
+PUBLIC void Cond_Broadcast( cond_t cond )
+{
+	pthread_cond_broadcast( &cond->handle );
+}
@@ -0,0 +1,237 @@
+/*
+
+	Copyright (C) 2013 Michael Liebscher <johnnycanuck@users.sourceforge.net>
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+/**
+ * \file threads_win.c
+ * \brief Thread primitives [Windows].
+ * \date 2013
+ * \note Condition variables require Windows Vista or later.
+ */
+
+#include <windows.h>
+
+#include "../threads.h"
+#include "../../common/common_utils.h"
+#include "../../memory/memory.h"
+
+
+struct thread_s
+{
+	HANDLE			handle;
+	threadFunc_t	func;
+	void			*param;
+};
+
+struct mutex_s
+{
+	CRITICAL_SECTION	handle;
+};
+
+struct cond_s
+{
+	CONDITION_VARIABLE	handle;
+};
+
+
+/**
+ * \brief Get the number of online processors.
+ * \return Number of processors, at least 1.
+ */
+PUBLIC W32 Thread_NumCPUs( void )
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+
+	return (info.dwNumberOfProcessors > 0) ? (W32)info.dwNumberOfProcessors : 1;
+}
+
+/**
+ * \brief Win32 thread entry point.
+ * \param[in] param Thread description.
+ * \return 0.
+ */
+PRIVATE DWORD WINAPI Thread_start( LPVOID param )
+{
+	thread_t thread = (thread_t)param;
+
+	thread->func( thread->param );
+
+	return 0;
+}
+
+/**
+ * \brief Create a thread.
+ * \param[in] func Thread entry point.
+ * \param[in] param Parameter passed to func.
+ * \return On success thread handle, otherwise NULL.
+ */
+PUBLIC thread_t Thread_Create( threadFunc_t func, void *param )
+{
+	thread_t thread;
+
+	thread = (thread_t) MM_MALLOC( sizeof( struct thread_s ) );
+	if( NULL == thread )
+	{
+		return NULL;
+	}
+
+	thread->func = func;
+	thread->param = param;
+
+	thread->handle = CreateThread( NULL, 0, Thread_start, thread, 0, NULL );
+	if( NULL == thread->handle )
+	{
+		MM_FREE( thread );
+
+		return NULL;
+	}
+
+	return thread;
+}
+
+/**
+ * \brief Wait for a thread to exit and release it.
+ * \param[in] thread Thread handle.
+ * \return Nothing.
+ */
+PUBLIC void Thread_Join( thread_t thread )
+{
+	if( NULL == thread )
+	{
+		return;
+	}
+
+	WaitForSingleObject( thread->handle, INFINITE );
+	CloseHandle( thread->handle );
+
+	MM_FREE( thread );
+}
+
+/**
+ * \brief Create a mutex.
+ * \return On success mutex handle, otherwise NULL.
+ */
+PUBLIC mutex_t Mutex_New( void )
+{
+	mutex_t mutex;
+
+	mutex = (mutex_t) MM_MALLOC( sizeof( struct mutex_s ) );
+	if( NULL == mutex )
+	{
+		return NULL;
+	}
+
+	InitializeCriticalSection( &mutex->handle );
+
+	return mutex;
+}
+
+/**
+ * \brief Release a mutex.
+ * \param[in] mutex Mutex handle.
+ * \return Nothing.
+ */
+PUBLIC void Mutex_Free( mutex_t mutex )
+{
+	DeleteCriticalSection( &mutex->handle );
+
+	MM_FREE( mutex );
+}
+
+/**
+ * \brief Lock a mutex.
+ * \param[in] mutex Mutex handle.
+ * \return Nothing.
+ */
+PUBLIC void Mutex_Lock( mutex_t mutex )
+{
+	EnterCriticalSection( &mutex->handle );
+}
+
+/**
+ * \brief Unlock a mutex.
+ * \param[in] mutex Mutex handle.
+ * \return Nothing.
+ */
+PUBLIC void Mutex_Unlock( mutex_t mutex )
+{
+	LeaveCriticalSection( &mutex->handle );
+}
+
+/**
+ * \brief Create a condition variable.
+ * \return On success condition variable handle, otherwise NULL.
+ */
+PUBLIC cond_t Cond_New( void )
+{
+	cond_t cond;
+
+	cond = (cond_t) MM_MALLOC( sizeof( struct cond_s ) );
+	if( NULL == cond )
+	{
+		return NULL;
+	}
+
+	InitializeConditionVariable( &cond->handle );
+
+	return cond;
+}
+
+/**
+ * \brief Release a condition variable.
+ * \param[in] cond Condition variable handle.
+ * \return Nothing.
+ */
+PUBLIC void Cond_Free( cond_t cond )
+{
+	MM_FREE( cond );
+}
+
+/**
+ * \brief Wait on a condition variable.
+ * \param[in] cond Condition variable handle.
+ * \param[in] mutex Locked mutex, released while waiting.
+ * \return Nothing.
+ */
+PUBLIC void Cond_Wait( cond_t cond, mutex_t mutex )
+{
+	SleepConditionVariableCS( &cond->handle, &mutex->handle, INFINITE );
+}
+
+/**
+ * \brief Wake one thread waiting on a condition variable.
+ * \param[in] cond Condition variable handle.
+ * \return Nothing.
+ */
+PUBLIC void Cond_Signal( cond_t cond )
+{
+	WakeConditionVariable( &cond->handle );
+}
+
+/**
+ * \brief Wake all threads waiting on a condition variable.
+ * \param[in] cond Condition variable handle.
+ * \return Nothing.
+ */
+PUBLIC void Cond_Broadcast( cond_t cond )
+{
+	WakeAllConditionVariable( &cond->handle );
+}
@@ -40,64 +40,171 @@
 
 #include "../common/platform.h"
 #include "../common/common_utils.h"
+#include "../common/cpu.h"
+#include "../memory/membuf.h"
+#include "../filesys/writequeue.h"
+#include "../threads/threads.h"
+#include "vorbisenc_inter.h"
+
+#ifdef CPU_X86
+
+	#include <emmintrin.h>
+
+	#if defined( __GNUC__ )
+
+		#define VORBIS_TARGET_SSE2		__attribute__(( target( "sse2" ) ))
+
+	#else
+
+		#define VORBIS_TARGET_SSE2
+
+	#endif
+
+#endif
 
 #define READSIZE 1024
 
 
-PRIVATE W32 channels;
-PRIVATE W32 samplesize;
+/* PCM input of one encode, kept on the stack so encodes can run in parallel */
+typedef struct
+{
+	W32 channels;
+
+	W8 *ptrCurrent;
+	W8 *ptrEnd;
+
+} sampleReader_t;
+
+/* Converts count 16 bit little endian mono samples to float */
+typedef void (*convertMono_t)( float *dest, const W8 *src, SW32 count );
 
-PRIVATE W8 *ptrCurrent;
-PRIVATE W8 *ptrEnd;
 
-HOTSPOT PRIVATE SW32 read_samples( float **buffer, SW32 samples )
+PRIVATE void convertMono_def( float *dest, const W8 *src, SW32 count )
 {
-	SW32 sampbyte = samplesize / 8;
-	SW8 *buf;
-	SW32 bytes_read;
-	SW32 i,j;
-	SW32 realsamples;
+	SW32 i;
+
+	for( i = 0 ; i < count ; ++i )
+	{
+		dest[ i ] = (SW16)(src[ i * 2 ] | (src[ i * 2 + 1 ] << 8)) * (1.0f / 32768.0f);
+	}
+}
 
-	buf = ptrCurrent;
+#ifdef CPU_X86
+
+/* x86 is little endian, so the samples load as they are */
+VORBIS_TARGET_SSE2 PRIVATE void convertMono_sse2( float *dest, const W8 *src, SW32 count )
+{
+	const __m128 scale = _mm_set1_ps( 1.0f / 32768.0f );
+	SW32 i;
 
-	if( (samples * sampbyte * channels) > (ptrEnd - ptrCurrent) )
+	for( i = 0 ; i + 8 <= count ; i += 8 )
 	{
-		bytes_read = ptrEnd - ptrCurrent;
-		ptrCurrent = ptrEnd;
+		__m128i s = _mm_loadu_si128( (const __m128i *)(src + i * 2) );
 
-		if( bytes_read == 0 )
-		{
-			return 0;
-		}
+		/* sign extend each sample into the high half, then shift it down */
+		__m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( s, s ), 16 );
+		__m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( s, s ), 16 );
+
+		_mm_storeu_ps( dest + i, _mm_mul_ps( _mm_cvtepi32_ps( lo ), scale ) );
+		_mm_storeu_ps( dest + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( hi ), scale ) );
 	}
-	else
+
+	convertMono_def( dest + i, src + i * 2, count - i );
+}
+
+#endif
+
+/* Portable conversion until vorbis_init picks the best one */
+static convertMono_t convertMono = convertMono_def;
+
+
+/**
+ * \brief Select the fastest sample conversion the CPU supports.
+ * \note Call once at start up, before any worker threads are running.
+ */
+PUBLIC void vorbis_init( void )
+{
+	W32 features = CPU_features();
+
+	convertMono = convertMono_def;
+
+#ifdef CPU_X86
+	if( features & CPU_FEATURE_SSE2 )
 	{
-		bytes_read = samples * sampbyte * channels;
-		ptrCurrent += samples * sampbyte * channels;
+		convertMono = convertMono_sse2;
 	}
+#endif
 
+	(void)features;
+}
 
+HOTSPOT PRIVATE SW32 read_samples( void *param, float **buffer, SW32 samples )
+{
+	sampleReader_t *reader = (sampleReader_t *)param;
+	W32 channels = reader->channels;
+	W8 *buf = reader->ptrCurrent;
+	SW32 available;
+	SW32 i,j;
 
-	realsamples = bytes_read / (sampbyte * channels);
+	available = (SW32)((reader->ptrEnd - buf) / (2 * channels));
+	if( samples > available )
+	{
+		samples = available;
+	}
+
+	reader->ptrCurrent += samples * 2 * channels;
 
 
-	for( i = 0 ; i < realsamples ; ++i )
+	if( channels == 1 )
+	{
+		convertMono( buffer[ 0 ], buf, samples );
+
+		return samples;
+	}
+
+	for( i = 0 ; i < samples ; ++i )
 	{
 		for( j = 0 ; j < channels ; ++j )
 		{
-			buffer[j][i] = ((buf[ i * 2 * channels + 2 * j + 1 ] << 8) |
-							(buf[ i * 2 * channels + 2 * j ] & 0xFF)) / 32768.0f;
+			buffer[j][i] = (SW16)(buf[ i * 2 * channels + 2 * j ] |
+							(buf[ i * 2 * channels + 2 * j + 1 ] << 8)) * (1.0f / 32768.0f);
 		}
 	}
 
 
-	return realsamples;
+	return samples;
 }
 
-HOTSPOT PUBLIC SW32 vorbis_encode( const char *filename, void *data, W32 size, W32 in_channels, W32 in_samplesize,
-			   W32 rate, W32 quality, W32 max_bitrate, W32 min_bitrate  )
+/**
+ * \brief Set up an encode with the default settings.
+ * \param[out] encoder Encoder to set up.
+ * \param[in] channels Number of channels.
+ * \param[in] rate Sample rate in Hz.
+ * \param[in] readSamples Sample source, called until it returns 0.
+ * \param[in] param User data handed to readSamples.
+ * \return Nothing.
+ */
+PUBLIC void vorbis_encoderInit( vorbisEncoder_t *encoder, W32 channels, W32 rate, vorbisRead_t readSamples, void *param )
+{
+	encoder->channels = channels;
+	encoder->rate = rate;
+	encoder->settings.quality = 0.0f;
+	encoder->settings.maxBitrate = 0;
+	encoder->settings.minBitrate = 0;
+	encoder->readSamples = readSamples;
+	encoder->param = param;
+}
+
+/**
+ * \brief Encode to an Ogg Vorbis stream in memory.
+ * \param[in] encoder Encode to run.
+ * \param[in,out] output Initialized buffer the stream is appended to.
+ * \return On success true, otherwise false.
+ * \note Only the compressed stream is held in memory, samples are pulled
+ *		from the source READSIZE at a time.
+ */
+HOTSPOT PUBLIC wtBoolean vorbis_encodeBuffer( const vorbisEncoder_t *encoder, memBuffer_t *output )
 {
-	FILE			*fp;
 	ogg_stream_state	os;
 	ogg_page 		og;
 	ogg_packet 		op;
@@ -109,60 +216,44 @@ HOTSPOT PUBLIC SW32 vorbis_encode( const char *filename, void *data, W32 size, W
 	ogg_packet		header_main;
 	ogg_packet		header_comments;
 	ogg_packet		header_codebooks;
-	SW32			result;
 	W32			serialno = 0;
 
 	vorbis_comment		comments;
 
-	SW32			ret = 0;
 	SW32			eos;
-	W32			samplesdone = 0;
-	W32			packetsdone = 0;
-	W32			bytes_written = 0;
+	wtBoolean		failed = false;
 
 
 
-	fp = fopen( filename, "wb" );
-	if( fp == NULL )
-	{
-		return 0;
-	}
-
 	memset( &comments, 0, sizeof( comments ) );
 
-	channels = in_channels;
-	samplesize = in_samplesize;
-	ptrCurrent = (PW8)data;
-	ptrEnd = (PW8)data + size;
-
-
 	vorbis_info_init( &vi );
 
-	if( vorbis_encode_setup_vbr( &vi, channels, rate, quality ) )
+	if( vorbis_encode_setup_vbr( &vi, encoder->channels, encoder->rate, encoder->settings.quality ) )
 	{
-		fprintf( stderr, "Mode initialisation failed: invalid parameters for quality\n" );
+		fprintf( stderr, "[vorbis_encodeBuffer]: Mode initialisation failed: invalid parameters for quality\n" );
 		vorbis_info_clear( &vi );
-// Añadido como consejo de cppcheck.
-		fclose(fp);
-		return 1;
+		return false;
 	}
 
 	/* do we have optional hard quality restrictions? */
-	if( max_bitrate > 0 || min_bitrate > 0 )
+	if( encoder->settings.maxBitrate > 0 || encoder->settings.minBitrate > 0 )
 	{
 		struct ovectl_ratemanage_arg ai;
 
 		vorbis_encode_ctl( &vi, OV_ECTL_RATEMANAGE_GET, &ai );
 
-		ai.bitrate_hard_min = min_bitrate;
-		ai.bitrate_hard_max = max_bitrate;
+		ai.bitrate_hard_min = encoder->settings.minBitrate;
+		ai.bitrate_hard_max = encoder->settings.maxBitrate;
 		ai.management_active = 1;
 
 		vorbis_encode_ctl( &vi, OV_ECTL_RATEMANAGE_SET, &ai );
 	}
-
-	/* Turn off management entirely (if it was turned on). */
-	vorbis_encode_ctl( &vi, OV_ECTL_RATEMANAGE_SET, NULL );
+	else
+	{
+		/* Turn off management entirely (if it was turned on). */
+		vorbis_encode_ctl( &vi, OV_ECTL_RATEMANAGE_SET, NULL );
+	}
 
 
 	vorbis_encode_setup_init( &vi );
@@ -177,7 +268,7 @@ HOTSPOT PUBLIC SW32 vorbis_encode( const char *filename, void *data, W32 size, W
 
 
 	/* Build the packets */
-	ret = vorbis_analysis_headerout( &vd, &comments,
+	vorbis_analysis_headerout( &vd, &comments,
 			&header_main, &header_comments, &header_codebooks );
 
 	/* And stream them out */
@@ -185,15 +276,13 @@ HOTSPOT PUBLIC SW32 vorbis_encode( const char *filename, void *data, W32 size, W
 	ogg_stream_packetin( &os, &header_comments );
 	ogg_stream_packetin( &os, &header_codebooks );
 
-	while( (result = ogg_stream_flush( &os, &og )) )
+	while( ogg_stream_flush( &os, &og ) )
 	{
-		ret = fwrite( og.header, 1, og.header_len, fp );
-		ret += fwrite( og.body, 1, og.body_len, fp );
-
-		if(ret != og.header_len + og.body_len)
+		if( ! MemBuffer_Append( output, og.header, og.header_len ) ||
+			! MemBuffer_Append( output, og.body, og.body_len ) )
 		{
-			fprintf( stderr, "[vorbis_encode]: Failed writing header to output stream\n") ;
-			ret = 1;
+			fprintf( stderr, "[vorbis_encodeBuffer]: Failed writing header to output stream\n") ;
+			failed = true;
 
 			goto cleanup; /* Bail and try to clean up stuff */
 		}
@@ -206,29 +295,11 @@ HOTSPOT PUBLIC SW32 vorbis_encode( const char *filename, void *data, W32 size, W
 	while( ! eos )
 	{
 		float **buffer = vorbis_analysis_buffer( &vd, READSIZE );
-		SW32 samples_read = read_samples( buffer, READSIZE );
-
-		if( samples_read == 0 )
-		{
-			/* Tell the library that we wrote 0 bytes - signalling the end */
-			vorbis_analysis_wrote( &vd, 0 );
-		}
-		else
-		{
-			samplesdone += samples_read;
+		SW32 samples_read = encoder->readSamples( encoder->param, buffer, READSIZE );
 
-			/* Call progress update every 40 pages */
-			if( packetsdone >= 40 )
-			{
-				packetsdone = 0;
-
-				// progress bar here
-			}
-
-			/* Tell the library how many samples (per channel) we wrote
-			   into the supplied buffer */
-			vorbis_analysis_wrote( &vd, samples_read );
-		}
+		/* Tell the library how many samples (per channel) we wrote
+		   into the supplied buffer, 0 signals the end */
+		vorbis_analysis_wrote( &vd, samples_read );
 
 		/* While we can get enough data from the library to analyse, one
 		   block at a time... */
@@ -243,33 +314,25 @@ HOTSPOT PUBLIC SW32 vorbis_encode( const char *filename, void *data, W32 size, W
 			{
 				/* Add packet to bitstream */
 				ogg_stream_packetin( &os, &op );
-				packetsdone++;
 
 				/* If we've gone over a page boundary, we can do actual output,
 				   so do so (for however many pages are available) */
 
 				while( ! eos )
 				{
-					SW32 result = ogg_stream_pageout( &os, &og );
-					if( ! result )
+					if( ! ogg_stream_pageout( &os, &og ) )
 					{
 						break;
 					}
 
-					ret = fwrite( og.header, 1, og.header_len, fp );
-					ret += fwrite( og.body, 1, og.body_len, fp );
-
-					if(ret != og.header_len + og.body_len)
+					if( ! MemBuffer_Append( output, og.header, og.header_len ) ||
+						! MemBuffer_Append( output, og.body, og.body_len ) )
 					{
-						fprintf( stderr, "[vorbis_encode]: Failed writing data to output stream\n" );
-						ret = 1;
+						fprintf( stderr, "[vorbis_encodeBuffer]: Failed writing data to output stream\n" );
+						failed = true;
 
 						goto cleanup; /* Bail */
 					}
-					else
-					{
-						bytes_written += ret;
-					}
 
 					if( ogg_page_eos( &og ) )
 					{
@@ -283,13 +346,122 @@ HOTSPOT PUBLIC SW32 vorbis_encode( const char *filename, void *data, W32 size, W
 
 cleanup:
 
-	fclose( fp );
-
 	ogg_stream_clear( &os );
 
 	vorbis_block_clear( &vb );
 	vorbis_dsp_clear( &vd );
 	vorbis_info_clear( &vi );
 
-	return 0;
+	return ! failed;
+}
+
+/**
+ * \brief Encode to an Ogg Vorbis file.
+ * \param[in] filename Output file name.
+ * \param[in] encoder Encode to run.
+ * \return On success true, otherwise false.
+ * \note The file is written through the write queue.
+ */
+PUBLIC wtBoolean vorbis_encodeFile( const char *filename, const vorbisEncoder_t *encoder )
+{
+	memBuffer_t output;
+	wtBoolean result;
+
+	MemBuffer_Init( &output );
+
+	result = vorbis_encodeBuffer( encoder, &output );
+	if( result )
+	{
+		result = WriteQueue_AddBuffer( filename, &output );
+	}
+
+	MemBuffer_Free( &output );
+
+	return result;
+}
+
+/**
+ * \brief Encode PCM data to an Ogg Vorbis file.
+ * \param[in] filename Output file name.
+ * \param[in] data 16 bit little endian PCM data.
+ * \param[in] size Size of data in bytes.
+ * \return 0 on success.
+ */
+PUBLIC SW32 vorbis_encode( const char *filename, void *data, W32 size, W32 in_channels, W32 in_samplesize,
+			   W32 rate, W32 quality, W32 max_bitrate, W32 min_bitrate  )
+{
+	vorbisEncoder_t		encoder;
+	sampleReader_t		reader;
+
+	(void)in_samplesize;
+
+	reader.channels = in_channels;
+	reader.ptrCurrent = (PW8)data;
+	reader.ptrEnd = (PW8)data + size;
+
+	vorbis_encoderInit( &encoder, in_channels, rate, read_samples, &reader );
+	encoder.settings.quality = (float)quality;
+	encoder.settings.maxBitrate = max_bitrate;
+	encoder.settings.minBitrate = min_bitrate;
+
+	return vorbis_encodeFile( filename, &encoder ) ? 0 : 1;
+}
+
+
+/* vorbis_encodeBatch() run */
+typedef struct
+{
+	vorbisJob_t *jobs;
+	const vorbisSettings_t *settings;
+
+} vorbisBatch_t;
+
+/**
+ * \brief Thread pool job, encodes one batch entry.
+ */
+PRIVATE void vorbis_batchJob( void *param, W32 index, W32 threadId )
+{
+	vorbisBatch_t *batch = (vorbisBatch_t *)param;
+	vorbisJob_t *job = &batch->jobs[ index ];
+	vorbisEncoder_t encoder;
+	sampleReader_t reader;
+
+	(void)threadId;
+
+	reader.channels = job->channels;
+	reader.ptrCurrent = (PW8)job->data;
+	reader.ptrEnd = (PW8)job->data + job->size;
+
+	vorbis_encoderInit( &encoder, job->channels, job->rate, read_samples, &reader );
+	encoder.settings = *batch->settings;
+
+	job->result = vorbis_encodeFile( job->filename, &encoder );
+}
+
+/**
+ * \brief Encode a list of PCM buffers to Ogg Vorbis files.
+ * \param[in] jobs PCM buffers and their file names.
+ * \param[in] count Number of jobs.
+ * \param[in] settings Encoder settings used for every job.
+ * \return true if every file was encoded, otherwise false.
+ * \note The jobs are spread across the worker thread pool. Each encoder
+ *		setup is small, so many short sounds encode well in parallel.
+ */
+PUBLIC wtBoolean vorbis_encodeBatch( vorbisJob_t *jobs, W32 count, const vorbisSettings_t *settings )
+{
+	vorbisBatch_t batch;
+	wtBoolean result = true;
+	W32 i;
+
+	batch.jobs = jobs;
+	batch.settings = settings;
+
+	ThreadPool_Run( vorbis_batchJob, &batch, count );
+
+	for( i = 0 ; i < count ; ++i )
+	{
+		result = result && jobs[ i ].result;
+	}
+
+	return result;
 }
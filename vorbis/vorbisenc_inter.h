@@ -34,6 +34,60 @@
 #ifndef __VORBISENC_INTER_H__
 #define __VORBISENC_INTER_H__
 
+#include "../common/platform.h"
+#include "../memory/membuf.h"
+
+
+/**
+ * \brief Sample source of an encode.
+ * \param[in] param User data of the encoder.
+ * \param[out] buffer One float buffer per channel.
+ * \param[in] samples Room in each buffer.
+ * \return Samples written per channel, 0 at the end of the stream.
+ */
+typedef SW32 (*vorbisRead_t)( void *param, float **buffer, SW32 samples );
+
+typedef struct
+{
+	float quality;		/* -0.1 (lowest) to 1.0 (highest) */
+	W32 maxBitrate;		/* hard limits in bits per second, 0 for none */
+	W32 minBitrate;
+
+} vorbisSettings_t;
+
+/* One encode, everything the encoder needs so encodes can run in parallel */
+typedef struct
+{
+	W32 channels;
+	W32 rate;			/* Hz */
+	vorbisSettings_t settings;
+
+	vorbisRead_t readSamples;
+	void *param;
+
+} vorbisEncoder_t;
+
+/* 16 bit little endian PCM buffer for vorbis_encodeBatch() */
+typedef struct
+{
+	const char *filename;
+	void *data;
+	W32 size;			/* bytes */
+	W32 channels;
+	W32 rate;			/* Hz */
+
+	wtBoolean result;	/* set by vorbis_encodeBatch() */
+
+} vorbisJob_t;
+
+
+void vorbis_init( void );
+
+void vorbis_encoderInit( vorbisEncoder_t *encoder, W32 channels, W32 rate, vorbisRead_t readSamples, void *param );
+wtBoolean vorbis_encodeBuffer( const vorbisEncoder_t *encoder, memBuffer_t *output );
+wtBoolean vorbis_encodeFile( const char *filename, const vorbisEncoder_t *encoder );
+wtBoolean vorbis_encodeBatch( vorbisJob_t *jobs, W32 count, const vorbisSettings_t *settings );
+
 int vorbis_encode( const char *filename, void *data, W32 size, W32 in_channels, W32 in_samplesize,
 			   W32 rate, W32 quality, W32 max_bitrate, W32 min_bitrate  );
 
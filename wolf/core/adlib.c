@@ -28,6 +28,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 
 #include "adlib.h"
@@ -42,6 +43,7 @@
 #define OPL_INTERNAL_FREQ   3600000 // The OPL operates at 3.6MHz
 #define OPL_NUM_CHIPS       1       // Number of OPL chips
 #define ADLIB_FREQ          22050   // Frequency in Hz
+#define ADLIB_SOUND_TICKS   (OPL_FILE_TICK_RATE / 140) // register stream ticks per sound byte
 
 
 // 	Registers for the AdLib card
@@ -69,17 +71,20 @@ PRIVATE	W8	carriers[  9 ] = { 3, 4, 5, 11, 12,13, 19, 20, 21 };
 PRIVATE	W8	modifiers[ 9 ] = { 0, 1, 2, 8, 9, 10, 16, 17, 18 };
 
 
-PRIVATE FM_OPL *hAdLib = NULL;
-
-
-
 /**
  * \brief Start adlib hardware.
+ * \param[out] adlib AdLib instance to start.
+ * \param[in] freq Output sample rate in Hz.
  * \return 1 on success, otherwise 0.
  * \note Must call ADLIB_Shutdown() when done.
+ * \note Instances may run on different threads, but must be started and shut down from one thread.
  */
-PUBLIC wtBoolean ADLIB_Init( W32 freq )
+PUBLIC wtBoolean ADLIB_Init( adlib_t *adlib, W32 freq )
 {
+	FM_OPL *hAdLib;
+
+	memset( adlib, 0, sizeof( adlib_t ) );
+
     hAdLib = OPLCreate( OPL_TYPE_YM3812, OPL_INTERNAL_FREQ, freq );
 
     if( hAdLib == NULL )
@@ -92,23 +97,31 @@ PUBLIC wtBoolean ADLIB_Init( W32 freq )
 	OPLWrite( hAdLib, 0x01, 0x20 ); /* Set WSE=1 */
 	OPLWrite( hAdLib, 0x08, 0x00 ); /* Set CSM=0 & SEL=0 */
 
+	adlib->opl = hAdLib;
+
     return true;
 }
 
 /**
  * \brief Shutdown adlib hardware.
+ * \param[in] adlib AdLib instance to shut down.
  */
-PUBLIC void ADLIB_Shutdown( void )
+PUBLIC void ADLIB_Shutdown( adlib_t *adlib )
 {
-    OPLDestroy( hAdLib );
+	if( adlib->opl )
+	{
+		OPLDestroy( adlib->opl );
+		adlib->opl = NULL;
+	}
 }
 
 /**
  * \brief Set Adlib FX instruction.
+ * \param[in] hAdLib OPL emulator.
  * \param[in] inst Valid pointer to Instrument structure.
  * \return Nothing.
  */
-PRIVATE void ADLIB_SetFXInst( Instrument *inst )
+PRIVATE void ADLIB_SetFXInst( FM_OPL *hAdLib, Instrument *inst )
 {
     W8   c, m;
 
@@ -132,12 +145,14 @@ PRIVATE void ADLIB_SetFXInst( Instrument *inst )
 
 /**
  * \brief Decode adlib sound.
- * \param[in] inst Valid pointer to Instrument structure.
+ * \param[in] adlib AdLib instance.
+ * \param[in] sound Valid pointer to AdLibSound structure.
  * \param[out] length Length of decoded sound data in bytes.
  * \return On success true, otherwise false.
  */
-PUBLIC void *ADLIB_DecodeSound( AdLibSound *sound, W32 *length )
+PUBLIC void *ADLIB_DecodeSound( adlib_t *adlib, AdLibSound *sound, W32 *length )
 {
+	FM_OPL *hAdLib = adlib->opl;
     Instrument  inst;
 	W32 alLengthLeft;
 	W32 alBlock;
@@ -167,7 +182,7 @@ PUBLIC void *ADLIB_DecodeSound( AdLibSound *sound, W32 *length )
     OPLWrite( hAdLib, alFreqL, 0 );
 	OPLWrite( hAdLib, alFreqH, 0 );
 
-	ADLIB_SetFXInst( &inst );
+	ADLIB_SetFXInst( hAdLib, &inst );
 
     while( alLengthLeft )
 	{
@@ -194,16 +209,97 @@ PUBLIC void *ADLIB_DecodeSound( AdLibSound *sound, W32 *length )
 	return (void *)buffer;
 }
 
+/**
+ * \brief Set Adlib FX instruction in a register stream.
+ * \param[in,out] stream Register stream.
+ * \param[in] inst Valid pointer to Instrument structure.
+ * \return On success true, otherwise false.
+ */
+PRIVATE wtBoolean ADLIB_ExportFXInst( oplStream_t *stream, Instrument *inst )
+{
+	W8 c, m;
+
+	m = modifiers[ 0 ];
+	c = carriers[ 0 ];
+
+	return OPLFile_out( stream, m + alChar, inst->mChar ) &&
+		OPLFile_out( stream, m + alScale, inst->mScale ) &&
+		OPLFile_out( stream, m + alAttack, inst->mAttack ) &&
+		OPLFile_out( stream, m + alSus, inst->mSus ) &&
+		OPLFile_out( stream, m + alWave, inst->mWave ) &&
+		OPLFile_out( stream, c + alChar, inst->cChar ) &&
+		OPLFile_out( stream, c + alScale, inst->cScale ) &&
+		OPLFile_out( stream, c + alAttack, inst->cAttack ) &&
+		OPLFile_out( stream, c + alSus, inst->cSus ) &&
+		OPLFile_out( stream, c + alWave, inst->cWave ) &&
+		OPLFile_out( stream, alFeedCon, 0 );
+}
+
+/**
+ * \brief Convert adlib sound to OPL register writes.
+ * \param[in] sound Valid pointer to AdLibSound structure.
+ * \param[in,out] stream Empty register stream, receives the writes ADLIB_DecodeSound() would make.
+ * \return On success true, otherwise false.
+ * \note No emulation is done, the stream also holds the writes of ADLIB_Init().
+ */
+PUBLIC wtBoolean ADLIB_ExportSound( AdLibSound *sound, oplStream_t *stream )
+{
+	W32 alLengthLeft;
+	W8 alBlock;
+	W8 *alSound, s;
+
+	alBlock = (W8)( ( (sound->block & 7) << 2 ) | 0x20 );
+
+	alLengthLeft = *((PW32)sound->common.length);
+	alLengthLeft = LittleLong( alLengthLeft );
+
+	alSound = sound->data;
+
+	if( ! OPLFile_out( stream, 0x01, 0x20 ) ||
+		! OPLFile_out( stream, 0x08, 0x00 ) ||
+		! OPLFile_out( stream, alFreqL, 0 ) ||
+		! OPLFile_out( stream, alFreqH, 0 ) ||
+		! ADLIB_ExportFXInst( stream, &sound->inst ) )
+	{
+		return false;
+	}
+
+	while( alLengthLeft )
+	{
+		s = *alSound++;
+		if( ! s )
+		{
+			if( ! OPLFile_out( stream, alFreqH+0, 0 ) )
+			{
+				return false;
+			}
+		}
+		else
+		{
+			if( ! OPLFile_out( stream, alFreqL+0, s ) ||
+				! OPLFile_out( stream, alFreqH+0, alBlock ) )
+			{
+				return false;
+			}
+		}
+		if( ! (--alLengthLeft) )
+		{
+			if( ! OPLFile_out( stream, alFreqH+0, 0 ) )
+			{
+				return false;
+			}
+		}
+		OPLFile_wait( stream, ADLIB_SOUND_TICKS );
+	}
+
+	return true;
+}
 
 
 
 
 
 
-PRIVATE W16 *sqHackPtr;
-PRIVATE W32 sqHackLen;
-PRIVATE W32 sqHackTime;
-PRIVATE W32 alTimeCount;
 
 #define ADLIB_MUSIC_SPEED	44100
 #define ADLIB_MUSIC_BYPS	(ADLIB_MUSIC_SPEED*2) // bytes per second (16 bit)
@@ -215,33 +311,38 @@ typedef	struct
 
 } musicGroup_t;
 
-musicGroup_t *music;
-
 
 /**
  * \brief Setup music decoder.
+ * \param[in] adlib AdLib instance.
  * \param[in] musbuffer musicGroup_t data structure.
  * \return Nothing.
  */
-PUBLIC void ADLIB_LoadMusic( void *musbuffer )
+PUBLIC void ADLIB_LoadMusic( adlib_t *adlib, void *musbuffer )
 {
-	music = (musicGroup_t *)musbuffer;
+	musicGroup_t *music = (musicGroup_t *)musbuffer;
 
-	sqHackPtr = music->values;
-	sqHackLen = LittleShort( music->length );
-	sqHackTime = 0;
-	alTimeCount = 0;
+	adlib->sqHackPtr = music->values;
+	adlib->sqHackLen = LittleShort( music->length );
+	adlib->sqHackTime = 0;
+	adlib->alTimeCount = 0;
 }
 
 /**
  * \brief Decode adlib music sound.
+ * \param[in] adlib AdLib instance, setup with ADLIB_LoadMusic().
  * \param[in] size Number of bytes to write to buffer.
  * \param[in,out] buffer Hold decoded sound data.
  * \return 1 on success, otherwise 0.
  * \note Data written to buffer is 44100/16/mono
  */
-PUBLIC W32 ADLIB_UpdateMusic( W32 size, void *buffer )
+PUBLIC W32 ADLIB_UpdateMusic( adlib_t *adlib, W32 size, void *buffer )
 {
+	FM_OPL *hAdLib = adlib->opl;
+	W16 *sqHackPtr = adlib->sqHackPtr;
+	W32 sqHackLen = adlib->sqHackLen;
+	W32 sqHackTime = adlib->sqHackTime;
+	W32 alTimeCount = adlib->alTimeCount;
 	W8 *al;		//[2] {a, v} (register, value)
 	W16 *ptr;
 	W32 n;
@@ -266,18 +367,101 @@ PUBLIC W32 ADLIB_UpdateMusic( W32 size, void *buffer )
 
 
 		/* Now we'll get AdLib Output */
-		YM3812UpdateOne( hAdLib, ptr, 63 );
-		ptr += 63;
+		YM3812UpdateOne( hAdLib, ptr, ADLIB_MUSIC_TICK );
+		ptr += ADLIB_MUSIC_TICK;
 
 		if( sqHackLen <= 0 )
 		{
-			return (INT_PTR)ptr - (INT_PTR)buffer;
+			break;
 		}
 	}
 
+	adlib->sqHackPtr = sqHackPtr;
+	adlib->sqHackLen = sqHackLen;
+	adlib->sqHackTime = sqHackTime;
+	adlib->alTimeCount = alTimeCount;
+
+	if( n < AdLibTicks )
+	{
+		return (INT_PTR)ptr - (INT_PTR)buffer;
+	}
+
 	return (AdLibTicks * ADLIB_MUSIC_BYPS / 700);
 }
 
+/**
+ * \brief Decode adlib music sound as float samples.
+ * \param[in] adlib AdLib instance, setup with ADLIB_LoadMusic().
+ * \param[in] ticks Maximum number of music ticks to decode.
+ * \param[out] buffer Room for ticks * ADLIB_MUSIC_TICK samples.
+ * \return Number of samples written, 0 once the song has ended.
+ * \note Samples are 44100/mono in the range [-1,1), the same values
+ *		ADLIB_UpdateMusic() gives divided by 32768. The song can be
+ *		decoded in as many calls as wanted.
+ */
+PUBLIC W32 ADLIB_UpdateMusicFloat( adlib_t *adlib, W32 ticks, float *buffer )
+{
+	SW16 tick[ ADLIB_MUSIC_TICK ];
+	W32 samples = 0;
+	W32 n, i;
+
+	for( n = 0 ; n < ticks && adlib->sqHackLen ; ++n )
+	{
+		ADLIB_UpdateMusic( adlib, 1, tick );
+
+		for( i = 0 ; i < ADLIB_MUSIC_TICK ; ++i )
+		{
+			buffer[ samples++ ] = tick[ i ] * (1.0f / 32768.0f);
+		}
+	}
+
+	return samples;
+}
+
+/**
+ * \brief Convert adlib music to OPL register writes.
+ * \param[in] musbuffer musicGroup_t data structure.
+ * \param[in,out] stream Empty register stream, receives the writes ADLIB_UpdateMusic() would make.
+ * \return On success true, otherwise false.
+ * \note No emulation is done, the stream also holds the writes of ADLIB_Init().
+ *		It ends one tick after the last write, where rendering stops.
+ */
+PUBLIC wtBoolean ADLIB_ExportMusic( void *musbuffer, oplStream_t *stream )
+{
+	W16 *ptr;
+	W32 length;
+	W8 *al;		//[2] {a, v} (register, value)
+
+	ptr = ((musicGroup_t*)musbuffer)->values;
+	length = LittleShort( ((musicGroup_t*)musbuffer)->length );
+
+	if( ! OPLFile_out( stream, 0x01, 0x20 ) ||
+		! OPLFile_out( stream, 0x08, 0x00 ) )
+	{
+		return false;
+	}
+
+	while( length >= 4 )
+	{
+		al = (PW8)ptr++;
+		if( ! OPLFile_out( stream, al[ 0 ], al[ 1 ] ) )
+		{
+			return false;
+		}
+
+		length -= 4;
+		if( length >= 4 )
+		{
+			OPLFile_wait( stream, LittleShort( *ptr ) );
+		}
+		ptr++;
+	}
+
+	OPLFile_wait( stream, 1 );
+
+	return true;
+}
+
 /**
  * \brief Get music length in milliseconds.
  * \param[in] musbuffer  musicGroup_t data structure.
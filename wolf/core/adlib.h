@@ -31,6 +31,7 @@
 
 
 #include "../../common/platform.h"
+#include "../../loaders/oplfile.h"
 
 
 
@@ -69,14 +70,35 @@ typedef	struct
 } AdLibSound;
 
 
-wtBoolean ADLIB_Init( W32 freq );
-void ADLIB_Shutdown();
+#define ADLIB_MUSIC_TICK	63	/* samples per 700Hz music tick at 44100Hz */
 
-void *ADLIB_DecodeSound( AdLibSound *sound, W32 *length );
+
+/* One emulated AdLib card, instances are independent of each other */
+typedef struct
+{
+	struct fm_opl_f *opl;	/* OPL emulator */
+
+	/* IMF sequencer */
+	W16 *sqHackPtr;
+	W32 sqHackLen;
+	W32 sqHackTime;
+	W32 alTimeCount;
+
+} adlib_t;
+
+
+wtBoolean ADLIB_Init( adlib_t *adlib, W32 freq );
+void ADLIB_Shutdown( adlib_t *adlib );
+
+void *ADLIB_DecodeSound( adlib_t *adlib, AdLibSound *sound, W32 *length );
 
 W32 ADLIB_getLength( void *musbuffer );
-void ADLIB_LoadMusic( void *musbuffer );
-W32 ADLIB_UpdateMusic( W32 size, void *buffer );
+void ADLIB_LoadMusic( adlib_t *adlib, void *musbuffer );
+W32 ADLIB_UpdateMusic( adlib_t *adlib, W32 size, void *buffer );
+W32 ADLIB_UpdateMusicFloat( adlib_t *adlib, W32 ticks, float *buffer );
+
+wtBoolean ADLIB_ExportSound( AdLibSound *sound, oplStream_t *stream );
+wtBoolean ADLIB_ExportMusic( void *musbuffer, oplStream_t *stream );
 
 
 #endif /* __ADLIB_H__ */
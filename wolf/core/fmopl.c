@@ -17,6 +17,13 @@
 
 #include "../../memory/memory.h"
 #include "../../common/platform.h"
+#include "../../common/cpu.h"
+
+#ifdef CPU_X86
+
+	#include <immintrin.h>
+
+#endif
 
 #ifndef INLINE
 
@@ -177,6 +184,8 @@ static INT32 *TL_TABLE;
 
 /* pointers to TL_TABLE with sinwave output offset */
 static INT32 **SIN_TABLE;
+/* the same as offsets from TL_TABLE, for the vector kernels */
+static INT32 *SIN_OFFSET;
 
 /* LFO table */
 static INT32 *AMS_TABLE;
@@ -204,25 +213,9 @@ static INT32 RATE_0[16]=
 /* -------------------- static state --------------------- */
 
 /* lock level of common table */
+/* the common tables are read only once built, all other state lives in FM_OPL */
 static int num_lock = 0;
 
-/* work table */
-static void *cur_chip = NULL;	/* current chip point */
-/* currenct chip state */
-/* static OPLSAMPLE  *bufL,*bufR; */
-static OPL_CH *S_CH;
-static OPL_CH *E_CH;
-OPL_SLOT *SLOT7_1,*SLOT7_2,*SLOT8_1,*SLOT8_2;
-
-static INT32 outd[1];
-static INT32 ams;
-static INT32 vib;
-INT32  *ams_table;
-INT32  *vib_table;
-static INT32 amsIncr;
-static INT32 vibIncr;
-static INT32 feedback2;		/* connect for SLOT 2 */
-
 /* log output level */
 #define LOG_ERR  3      /* ERROR       */
 #define LOG_WAR  2      /* WARNING     */
@@ -234,7 +227,7 @@ static INT32 feedback2;		/* connect for SLOT 2 */
 
 /* --------------------- subroutines  --------------------- */
 
-INLINE int Limit( int val, int max, int min ) {
+static INLINE int Limit( int val, int max, int min ) {
 	if ( val > max )
 		val = max;
 	else if ( val < min )
@@ -244,7 +237,7 @@ INLINE int Limit( int val, int max, int min ) {
 }
 
 /* ----- key on  ----- */
-INLINE void OPL_KEYON(OPL_SLOT *SLOT)
+static INLINE void OPL_KEYON(OPL_SLOT *SLOT)
 {
 	/* sine wave restart */
 	SLOT->Cnt = 0;
@@ -255,7 +248,7 @@ INLINE void OPL_KEYON(OPL_SLOT *SLOT)
 	SLOT->eve = EG_AED;
 }
 /* ----- key off ----- */
-INLINE void OPL_KEYOFF(OPL_SLOT *SLOT)
+static INLINE void OPL_KEYOFF(OPL_SLOT *SLOT)
 {
 	if( SLOT->evm > ENV_MOD_RR)
 	{
@@ -269,54 +262,69 @@ INLINE void OPL_KEYOFF(OPL_SLOT *SLOT)
 }
 
 /* ---------- Envelope Generator & Phase Generator ---------- */
-/* return : envelope output */
-INLINE UINT32 OPL_CALC_SLOT( OPL_SLOT *SLOT )
+/* envelope counter reached its end point, go to next phase */
+static INLINE void OPL_EG_NEXT( OPL_SLOT *SLOT )
 {
-	/* calculate envelope generator */
-	if( (SLOT->evc+=SLOT->evs) >= SLOT->eve )
-	{
-		switch( SLOT->evm ){
-		case ENV_MOD_AR: /* ATTACK -> DECAY1 */
-			/* next DR */
-			SLOT->evm = ENV_MOD_DR;
-			SLOT->evc = EG_DST;
-			SLOT->eve = SLOT->SL;
-			SLOT->evs = SLOT->evsd;
-			break;
-		case ENV_MOD_DR: /* DECAY -> SL or RR */
-			SLOT->evc = SLOT->SL;
-			SLOT->eve = EG_DED;
-			if(SLOT->eg_typ)
-			{
-				SLOT->evs = 0;
-			}
-			else
-			{
-				SLOT->evm = ENV_MOD_RR;
-				SLOT->evs = SLOT->evsr;
-			}
-			break;
-		case ENV_MOD_RR: /* RR -> OFF */
-			SLOT->evc = EG_OFF;
-			SLOT->eve = EG_OFF+1;
+	switch( SLOT->evm ){
+	case ENV_MOD_AR: /* ATTACK -> DECAY1 */
+		/* next DR */
+		SLOT->evm = ENV_MOD_DR;
+		SLOT->evc = EG_DST;
+		SLOT->eve = SLOT->SL;
+		SLOT->evs = SLOT->evsd;
+		break;
+	case ENV_MOD_DR: /* DECAY -> SL or RR */
+		SLOT->evc = SLOT->SL;
+		SLOT->eve = EG_DED;
+		if(SLOT->eg_typ)
+		{
 			SLOT->evs = 0;
-			break;
 		}
+		else
+		{
+			SLOT->evm = ENV_MOD_RR;
+			SLOT->evs = SLOT->evsr;
+		}
+		break;
+	case ENV_MOD_RR: /* RR -> OFF */
+		SLOT->evc = EG_OFF;
+		SLOT->eve = EG_OFF+1;
+		SLOT->evs = 0;
+		break;
 	}
+}
+
+/* return : envelope output */
+static INLINE UINT32 OPL_CALC_SLOT( OPL_SLOT *SLOT, INT32 ams )
+{
+	/* calculate envelope generator */
+	if( (SLOT->evc+=SLOT->evs) >= SLOT->eve )
+		OPL_EG_NEXT(SLOT);
 	/* calculate envelope */
 	return SLOT->TLL+ENV_CURVE[SLOT->evc>>ENV_BITS]+(SLOT->ams ? ams : 0);
 }
 
+/* channel is silent and its state no longer changes, it can be skipped */
+static INLINE int OPL_CH_IDLE( OPL_CH *CH )
+{
+	OPL_SLOT *MOD = &CH->SLOT[SLOT1];
+	OPL_SLOT *CAR = &CH->SLOT[SLOT2];
+
+	return MOD->evc == EG_OFF && MOD->evs == 0 && MOD->eve > EG_OFF &&
+	       CAR->evc == EG_OFF && CAR->evs == 0 && CAR->eve > EG_OFF &&
+	       CH->op1_out[0] == 0 && CH->op1_out[1] == 0;
+}
+
 /* set algorythm connection */
-static void set_algorythm( OPL_CH *CH)
+static void set_algorythm( FM_OPL *OPL, OPL_CH *CH)
 {
-	INT32 *carrier = &outd[0];
-	CH->connect1 = CH->CON ? carrier : &feedback2;
+	INT32 *carrier = &OPL->outd[0];
+	CH->connect1 = CH->CON ? carrier : &OPL->feedback2;
 	CH->connect2 = carrier;
 }
 
 /* ---------- frequency counter for operater update ---------- */
-INLINE void CALC_FCSLOT(OPL_CH *CH,OPL_SLOT *SLOT)
+static INLINE void CALC_FCSLOT(OPL_CH *CH,OPL_SLOT *SLOT)
 {
 	int ksr;
 
@@ -336,7 +344,7 @@ INLINE void CALC_FCSLOT(OPL_CH *CH,OPL_SLOT *SLOT)
 }
 
 /* set multi,am,vib,EG-TYP,KSR,mul */
-INLINE void set_mul(FM_OPL *OPL,int slot,int v)
+static INLINE void set_mul(FM_OPL *OPL,int slot,int v)
 {
 	OPL_CH   *CH   = &OPL->P_CH[slot/2];
 	OPL_SLOT *SLOT = &CH->SLOT[slot&1];
@@ -350,7 +358,7 @@ INLINE void set_mul(FM_OPL *OPL,int slot,int v)
 }
 
 /* set ksl & tl */
-INLINE void set_ksl_tl(FM_OPL *OPL,int slot,int v)
+static INLINE void set_ksl_tl(FM_OPL *OPL,int slot,int v)
 {
 	OPL_CH   *CH   = &OPL->P_CH[slot/2];
 	OPL_SLOT *SLOT = &CH->SLOT[slot&1];
@@ -366,7 +374,7 @@ INLINE void set_ksl_tl(FM_OPL *OPL,int slot,int v)
 }
 
 /* set attack rate & decay rate  */
-INLINE void set_ar_dr(FM_OPL *OPL,int slot,int v)
+static INLINE void set_ar_dr(FM_OPL *OPL,int slot,int v)
 {
 	OPL_CH   *CH   = &OPL->P_CH[slot/2];
 	OPL_SLOT *SLOT = &CH->SLOT[slot&1];
@@ -383,7 +391,7 @@ INLINE void set_ar_dr(FM_OPL *OPL,int slot,int v)
 }
 
 /* set sustain level & release rate */
-INLINE void set_sl_rr(FM_OPL *OPL,int slot,int v)
+static INLINE void set_sl_rr(FM_OPL *OPL,int slot,int v)
 {
 	OPL_CH   *CH   = &OPL->P_CH[slot/2];
 	OPL_SLOT *SLOT = &CH->SLOT[slot&1];
@@ -400,19 +408,19 @@ INLINE void set_sl_rr(FM_OPL *OPL,int slot,int v)
 /* operator output calculator */
 #define OP_OUT(slot,env,con)   slot->wavetable[((slot->Cnt+con)/(0x1000000/SIN_ENT))&(SIN_ENT-1)][env]
 /* ---------- calculate channel ---------- */
-PRIVATE INLINE void OPL_CALC_CH( OPL_CH *CH )
+PRIVATE INLINE void OPL_CALC_CH( FM_OPL *OPL, OPL_CH *CH )
 {
 	UINT32 env_out;
 	OPL_SLOT *SLOT;
 
-	feedback2 = 0;
+	OPL->feedback2 = 0;
 	/* SLOT 1 */
 	SLOT = &CH->SLOT[SLOT1];
-	env_out=OPL_CALC_SLOT(SLOT);
+	env_out=OPL_CALC_SLOT(SLOT,OPL->ams);
 	if( env_out < EG_ENT-1 )
 	{
 		/* PG */
-		if(SLOT->vib) SLOT->Cnt += (SLOT->Incr*vib/VIB_RATE);
+		if(SLOT->vib) SLOT->Cnt += (SLOT->Incr*OPL->vib/VIB_RATE);
 		else          SLOT->Cnt += SLOT->Incr;
 		/* connection */
 		if(CH->FB)
@@ -432,100 +440,479 @@ PRIVATE INLINE void OPL_CALC_CH( OPL_CH *CH )
 	}
 	/* SLOT 2 */
 	SLOT = &CH->SLOT[SLOT2];
-	env_out=OPL_CALC_SLOT(SLOT);
+	env_out=OPL_CALC_SLOT(SLOT,OPL->ams);
 	if( env_out < EG_ENT-1 )
 	{
 		/* PG */
-		if(SLOT->vib) SLOT->Cnt += (SLOT->Incr*vib/VIB_RATE);
+		if(SLOT->vib) SLOT->Cnt += (SLOT->Incr*OPL->vib/VIB_RATE);
 		else          SLOT->Cnt += SLOT->Incr;
 		/* connection */
-		outd[0] += OP_OUT(SLOT,env_out, feedback2);
+		OPL->outd[0] += OP_OUT(SLOT,env_out, OPL->feedback2);
 	}
 }
 
 /* ---------- calculate rythm block ---------- */
 #define WHITE_NOISE_db 6.0
-PRIVATE INLINE void OPL_CALC_RH( OPL_CH *CH )
+PRIVATE INLINE void OPL_CALC_RH( FM_OPL *OPL )
 {
+	OPL_CH *CH = OPL->P_CH;
+	OPL_SLOT *SLOT7_1 = &CH[7].SLOT[SLOT1];
+	OPL_SLOT *SLOT7_2 = &CH[7].SLOT[SLOT2];
+	OPL_SLOT *SLOT8_1 = &CH[8].SLOT[SLOT1];
+	OPL_SLOT *SLOT8_2 = &CH[8].SLOT[SLOT2];
 	UINT32 env_tam,env_sd,env_top,env_hh;
-	int whitenoise = (int)((rand()&1)*(WHITE_NOISE_db/EG_STEP));
+	int whitenoise;
 	INT32 tone8;
 
 	OPL_SLOT *SLOT;
 	int env_out;
 
+	/* per chip noise generator, so the output does not depend on other chips */
+	OPL->noise = OPL->noise * 1103515245 + 12345;
+	whitenoise = (int)(((OPL->noise>>16)&1)*(WHITE_NOISE_db/EG_STEP));
+
 	/* BD : same as FM serial mode and output level is large */
-	feedback2 = 0;
+	OPL->feedback2 = 0;
 	/* SLOT 1 */
 	SLOT = &CH[6].SLOT[SLOT1];
-	env_out=OPL_CALC_SLOT(SLOT);
+	env_out=OPL_CALC_SLOT(SLOT,OPL->ams);
 	if( env_out < EG_ENT-1 )
 	{
 		/* PG */
-		if(SLOT->vib) SLOT->Cnt += (SLOT->Incr*vib/VIB_RATE);
+		if(SLOT->vib) SLOT->Cnt += (SLOT->Incr*OPL->vib/VIB_RATE);
 		else          SLOT->Cnt += SLOT->Incr;
 		/* connectoion */
 		if(CH[6].FB)
 		{
 			int feedback1 = (CH[6].op1_out[0]+CH[6].op1_out[1])>>CH[6].FB;
 			CH[6].op1_out[1] = CH[6].op1_out[0];
-			feedback2 = CH[6].op1_out[0] = OP_OUT(SLOT,env_out,feedback1);
+			OPL->feedback2 = CH[6].op1_out[0] = OP_OUT(SLOT,env_out,feedback1);
 		}
 		else
 		{
-			feedback2 = OP_OUT(SLOT,env_out,0);
+			OPL->feedback2 = OP_OUT(SLOT,env_out,0);
 		}
 	}else
 	{
-		feedback2 = 0;
+		OPL->feedback2 = 0;
 		CH[6].op1_out[1] = CH[6].op1_out[0];
 		CH[6].op1_out[0] = 0;
 	}
 	/* SLOT 2 */
 	SLOT = &CH[6].SLOT[SLOT2];
-	env_out=OPL_CALC_SLOT(SLOT);
+	env_out=OPL_CALC_SLOT(SLOT,OPL->ams);
 	if( env_out < EG_ENT-1 )
 	{
 		/* PG */
-		if(SLOT->vib) SLOT->Cnt += (SLOT->Incr*vib/VIB_RATE);
+		if(SLOT->vib) SLOT->Cnt += (SLOT->Incr*OPL->vib/VIB_RATE);
 		else          SLOT->Cnt += SLOT->Incr;
 		/* connectoion */
-		outd[0] += OP_OUT(SLOT,env_out, feedback2)*2;
+		OPL->outd[0] += OP_OUT(SLOT,env_out, OPL->feedback2)*2;
 	}
 
 	// SD  (17) = mul14[fnum7] + white noise
 	// TAM (15) = mul15[fnum8]
 	// TOP (18) = fnum6(mul18[fnum8]+whitenoise)
 	// HH  (14) = fnum7(mul18[fnum8]+whitenoise) + white noise
-	env_sd =OPL_CALC_SLOT(SLOT7_2) + whitenoise;
-	env_tam=OPL_CALC_SLOT(SLOT8_1);
-	env_top=OPL_CALC_SLOT(SLOT8_2);
-	env_hh =OPL_CALC_SLOT(SLOT7_1) + whitenoise;
+	env_sd =OPL_CALC_SLOT(SLOT7_2,OPL->ams) + whitenoise;
+	env_tam=OPL_CALC_SLOT(SLOT8_1,OPL->ams);
+	env_top=OPL_CALC_SLOT(SLOT8_2,OPL->ams);
+	env_hh =OPL_CALC_SLOT(SLOT7_1,OPL->ams) + whitenoise;
 
 	/* PG */
-	if(SLOT7_1->vib) SLOT7_1->Cnt += (2*SLOT7_1->Incr*vib/VIB_RATE);
+	if(SLOT7_1->vib) SLOT7_1->Cnt += (2*SLOT7_1->Incr*OPL->vib/VIB_RATE);
 	else             SLOT7_1->Cnt += 2*SLOT7_1->Incr;
-	if(SLOT7_2->vib) SLOT7_2->Cnt += ((CH[7].fc*8)*vib/VIB_RATE);
+	if(SLOT7_2->vib) SLOT7_2->Cnt += ((CH[7].fc*8)*OPL->vib/VIB_RATE);
 	else             SLOT7_2->Cnt += (CH[7].fc*8);
-	if(SLOT8_1->vib) SLOT8_1->Cnt += (SLOT8_1->Incr*vib/VIB_RATE);
+	if(SLOT8_1->vib) SLOT8_1->Cnt += (SLOT8_1->Incr*OPL->vib/VIB_RATE);
 	else             SLOT8_1->Cnt += SLOT8_1->Incr;
-	if(SLOT8_2->vib) SLOT8_2->Cnt += ((CH[8].fc*48)*vib/VIB_RATE);
+	if(SLOT8_2->vib) SLOT8_2->Cnt += ((CH[8].fc*48)*OPL->vib/VIB_RATE);
 	else             SLOT8_2->Cnt += (CH[8].fc*48);
 
 	tone8 = OP_OUT(SLOT8_2,whitenoise,0 );
 
 	/* SD */
 	if( env_sd < EG_ENT-1 )
-		outd[0] += OP_OUT(SLOT7_1,env_sd, 0)*8;
+		OPL->outd[0] += OP_OUT(SLOT7_1,env_sd, 0)*8;
 	/* TAM */
 	if( env_tam < EG_ENT-1 )
-		outd[0] += OP_OUT(SLOT8_1,env_tam, 0)*2;
+		OPL->outd[0] += OP_OUT(SLOT8_1,env_tam, 0)*2;
 	/* TOP-CY */
 	if( env_top < EG_ENT-1 )
-		outd[0] += OP_OUT(SLOT7_2,env_top,tone8)*2;
+		OPL->outd[0] += OP_OUT(SLOT7_2,env_top,tone8)*2;
 	/* HH */
 	if( env_hh  < EG_ENT-1 )
-		outd[0] += OP_OUT(SLOT7_2,env_hh,tone8)*2;
+		OPL->outd[0] += OP_OUT(SLOT7_2,env_hh,tone8)*2;
+}
+
+/* ---------- SoA evaluation of the melodic channels ---------- */
+/*
+ * The vector kernels evaluate one channel per lane. YM3812UpdateOne copies
+ * the melodic channels into an OPL_LANES block, runs a kernel over up to
+ * OPL_BLOCK samples at a time and copies the state back, so the register
+ * interface keeps working on OPL_CH / OPL_SLOT. Every kernel produces
+ * exactly what OPL_CALC_CH does.
+ */
+#define OPL_NUM_LANES	8	/* channels the kernels evaluate, the 9th is done by OPL_CALC_CH */
+#define OPL_BLOCK	64	/* samples per kernel call */
+
+typedef struct
+{
+	/* operator state, [SLOT1] modulator , [SLOT2] carrier */
+	INT32  evc[2][OPL_NUM_LANES];
+	INT32  eve[2][OPL_NUM_LANES];
+	INT32  evs[2][OPL_NUM_LANES];
+	INT32  TLL[2][OPL_NUM_LANES];
+	UINT32 Cnt[2][OPL_NUM_LANES];
+	UINT32 Incr[2][OPL_NUM_LANES];
+	INT32  amsMask[2][OPL_NUM_LANES];	/* -1 when ams is on */
+	INT32  vibMask[2][OPL_NUM_LANES];	/* -1 when vib is on */
+	INT32  wave[2][OPL_NUM_LANES];		/* wave form offset in SIN_OFFSET */
+	/* channel state */
+	INT32  op1_out[2][OPL_NUM_LANES];
+	INT32  FB[OPL_NUM_LANES];
+	INT32  fbMask[OPL_NUM_LANES];		/* -1 when feedback is on */
+	INT32  conMask[OPL_NUM_LANES];		/* -1 for additive connection */
+	/* owner of each lane, for envelope phase changes */
+	OPL_SLOT *SLOT[2][OPL_NUM_LANES];
+} OPL_LANES;
+
+/* mix[i] = sum of the melodic channels for sample i */
+typedef void (*OPL_LANE_KERNEL)( OPL_LANES *L, int lanes, const INT32 *ams, const INT32 *vib, INT32 *mix, int length );
+
+/* NULL when there is no vector kernel for this CPU, set by OPL_LockTable */
+static OPL_LANE_KERNEL OPL_CALC_LANES = NULL;
+
+/* copy channels [0,lanes) into SoA form, padding lanes never sound */
+static void OPL_LANES_LOAD( FM_OPL *OPL, OPL_LANES *L, int lanes )
+{
+	int c,s;
+
+	memset( L, 0, sizeof( OPL_LANES ) );
+	for( c = 0 ; c < OPL_NUM_LANES ; c++ )
+	{
+		if( c >= lanes )
+		{
+			L->evc[SLOT1][c] = L->evc[SLOT2][c] = EG_OFF;
+			L->eve[SLOT1][c] = L->eve[SLOT2][c] = EG_OFF+1;
+			continue;
+		}
+		for( s = 0 ; s < 2 ; s++ )
+		{
+			OPL_SLOT *SLOT = &OPL->P_CH[c].SLOT[s];
+			L->evc[s][c]     = SLOT->evc;
+			L->eve[s][c]     = SLOT->eve;
+			L->evs[s][c]     = SLOT->evs;
+			L->TLL[s][c]     = SLOT->TLL;
+			L->Cnt[s][c]     = SLOT->Cnt;
+			L->Incr[s][c]    = SLOT->Incr;
+			L->amsMask[s][c] = SLOT->ams ? -1 : 0;
+			L->vibMask[s][c] = SLOT->vib ? -1 : 0;
+			L->wave[s][c]    = (INT32)(SLOT->wavetable - SIN_TABLE);
+			L->SLOT[s][c]    = SLOT;
+		}
+		L->op1_out[0][c] = OPL->P_CH[c].op1_out[0];
+		L->op1_out[1][c] = OPL->P_CH[c].op1_out[1];
+		L->FB[c]         = OPL->P_CH[c].FB;
+		L->fbMask[c]     = OPL->P_CH[c].FB ? -1 : 0;
+		L->conMask[c]    = OPL->P_CH[c].CON ? -1 : 0;
+	}
+}
+
+static void OPL_LANES_STORE( FM_OPL *OPL, OPL_LANES *L, int lanes )
+{
+	int c,s;
+
+	for( c = 0 ; c < lanes ; c++ )
+	{
+		for( s = 0 ; s < 2 ; s++ )
+		{
+			OPL_SLOT *SLOT = L->SLOT[s][c];
+			SLOT->evc = L->evc[s][c];
+			SLOT->eve = L->eve[s][c];
+			SLOT->evs = L->evs[s][c];
+			SLOT->Cnt = L->Cnt[s][c];
+		}
+		OPL->P_CH[c].op1_out[0] = L->op1_out[0][c];
+		OPL->P_CH[c].op1_out[1] = L->op1_out[1][c];
+	}
+}
+
+/* envelope end point reached in lane c of operator s */
+static void OPL_LANE_EG_NEXT( OPL_LANES *L, int s, int c )
+{
+	OPL_SLOT *SLOT = L->SLOT[s][c];
+
+	SLOT->evc = L->evc[s][c];
+	OPL_EG_NEXT(SLOT);
+	L->evc[s][c] = SLOT->evc;
+	L->eve[s][c] = SLOT->eve;
+	L->evs[s][c] = SLOT->evs;
+}
+
+#ifdef CPU_X86
+
+#if defined( __GNUC__ )
+	#define OPL_TARGET_AVX2	__attribute__(( target( "avx2" ) ))
+#else
+	#define OPL_TARGET_AVX2
+#endif
+
+/* ----- AVX2 : 8 channels per vector, gathers and per lane shifts ----- */
+
+OPL_TARGET_AVX2 static INLINE __m256i OPL_EG_AVX2( OPL_LANES *L, int s, int b, __m256i *evc, __m256i *evs, __m256i *eve )
+{
+	int k,mask;
+
+	*evc = _mm256_add_epi32( *evc, *evs );
+	mask = _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpgt_epi32( *eve, *evc ) ) ) ^ 255;
+	if( mask )
+	{
+		_mm256_storeu_si256( (__m256i *)&L->evc[s][b], *evc );
+		for( k = 0 ; k < 8 ; k++ )
+			if( mask & (1<<k) ) OPL_LANE_EG_NEXT( L, s, b+k );
+		*evc = _mm256_loadu_si256( (__m256i *)&L->evc[s][b] );
+		*evs = _mm256_loadu_si256( (__m256i *)&L->evs[s][b] );
+		*eve = _mm256_loadu_si256( (__m256i *)&L->eve[s][b] );
+	}
+	return _mm256_i32gather_epi32( ENV_CURVE, _mm256_srai_epi32( *evc, ENV_BITS ), 4 );
+}
+
+OPL_TARGET_AVX2 static INLINE __m256i OPL_OUT_AVX2( __m256i wave, __m256i phase, __m256i env, __m256i act )
+{
+	__m256i p;
+	if( _mm256_movemask_epi8( act ) == 0 )
+		return _mm256_setzero_si256();
+	p = _mm256_add_epi32( wave, _mm256_and_si256( _mm256_srli_epi32( phase, 13 ), _mm256_set1_epi32( SIN_ENT-1 ) ) );
+	env = _mm256_add_epi32( _mm256_i32gather_epi32( SIN_OFFSET, p, 4 ), _mm256_and_si256( act, env ) );
+	return _mm256_and_si256( act, _mm256_i32gather_epi32( TL_TABLE, env, 4 ) );
+}
+
+OPL_TARGET_AVX2 static void OPL_CALC_LANES_AVX2( OPL_LANES *L, int lanes, const INT32 *ams, const INT32 *vib, INT32 *mix, int length )
+{
+	const __m256i off = _mm256_set1_epi32( EG_ENT-1 );
+	int b,i;
+
+	for( i = 0 ; i < length ; i++ ) mix[i] = 0;
+
+	for( b = 0 ; b < lanes ; b += 8 )
+	{
+		__m256i evc1 = _mm256_loadu_si256( (__m256i *)&L->evc[SLOT1][b] );
+		__m256i evc2 = _mm256_loadu_si256( (__m256i *)&L->evc[SLOT2][b] );
+		__m256i evs1 = _mm256_loadu_si256( (__m256i *)&L->evs[SLOT1][b] );
+		__m256i evs2 = _mm256_loadu_si256( (__m256i *)&L->evs[SLOT2][b] );
+		__m256i eve1 = _mm256_loadu_si256( (__m256i *)&L->eve[SLOT1][b] );
+		__m256i eve2 = _mm256_loadu_si256( (__m256i *)&L->eve[SLOT2][b] );
+		__m256i cnt1 = _mm256_loadu_si256( (__m256i *)&L->Cnt[SLOT1][b] );
+		__m256i cnt2 = _mm256_loadu_si256( (__m256i *)&L->Cnt[SLOT2][b] );
+		__m256i op0  = _mm256_loadu_si256( (__m256i *)&L->op1_out[0][b] );
+		__m256i op1  = _mm256_loadu_si256( (__m256i *)&L->op1_out[1][b] );
+		const __m256i tll1  = _mm256_loadu_si256( (__m256i *)&L->TLL[SLOT1][b] );
+		const __m256i tll2  = _mm256_loadu_si256( (__m256i *)&L->TLL[SLOT2][b] );
+		const __m256i am1   = _mm256_loadu_si256( (__m256i *)&L->amsMask[SLOT1][b] );
+		const __m256i am2   = _mm256_loadu_si256( (__m256i *)&L->amsMask[SLOT2][b] );
+		const __m256i incr1 = _mm256_loadu_si256( (__m256i *)&L->Incr[SLOT1][b] );
+		const __m256i incr2 = _mm256_loadu_si256( (__m256i *)&L->Incr[SLOT2][b] );
+		const __m256i vib1  = _mm256_loadu_si256( (__m256i *)&L->vibMask[SLOT1][b] );
+		const __m256i vib2  = _mm256_loadu_si256( (__m256i *)&L->vibMask[SLOT2][b] );
+		const __m256i wave1 = _mm256_loadu_si256( (__m256i *)&L->wave[SLOT1][b] );
+		const __m256i wave2 = _mm256_loadu_si256( (__m256i *)&L->wave[SLOT2][b] );
+		const __m256i fbCnt = _mm256_loadu_si256( (__m256i *)&L->FB[b] );
+		const __m256i fbm   = _mm256_loadu_si256( (__m256i *)&L->fbMask[b] );
+		const __m256i conm  = _mm256_loadu_si256( (__m256i *)&L->conMask[b] );
+
+		for( i = 0 ; i < length ; i++ )
+		{
+			__m256i amsv = _mm256_set1_epi32( ams[i] );
+			__m256i vibv = _mm256_set1_epi32( vib[i] );
+			__m256i env,act,inc,fb,out1,out2,fb2,car;
+			__m128i sum;
+
+			/* SLOT 1 */
+			env = _mm256_add_epi32( _mm256_add_epi32( tll1, OPL_EG_AVX2( L, SLOT1, b, &evc1, &evs1, &eve1 ) ), _mm256_and_si256( amsv, am1 ) );
+			act = _mm256_cmpgt_epi32( off, env );
+			inc = _mm256_blendv_epi8( incr1, _mm256_srli_epi32( _mm256_mullo_epi32( incr1, vibv ), 8 ), vib1 );
+			cnt1 = _mm256_add_epi32( cnt1, _mm256_and_si256( act, inc ) );
+			fb = _mm256_and_si256( fbm, _mm256_srav_epi32( _mm256_add_epi32( op0, op1 ), fbCnt ) );
+			out1 = OPL_OUT_AVX2( wave1, _mm256_add_epi32( cnt1, fb ), env, act );
+			/* op1_out history, see OPL_CALC_CH */
+			{
+				__m256i keep = _mm256_andnot_si256( fbm, act );
+				__m256i new0 = _mm256_and_si256( act, _mm256_blendv_epi8( op0, out1, fbm ) );
+				op1 = _mm256_blendv_epi8( op0, op1, keep );
+				op0 = new0;
+			}
+			car = _mm256_and_si256( conm, out1 );
+			fb2 = _mm256_andnot_si256( conm, out1 );
+
+			/* SLOT 2 */
+			env = _mm256_add_epi32( _mm256_add_epi32( tll2, OPL_EG_AVX2( L, SLOT2, b, &evc2, &evs2, &eve2 ) ), _mm256_and_si256( amsv, am2 ) );
+			act = _mm256_cmpgt_epi32( off, env );
+			inc = _mm256_blendv_epi8( incr2, _mm256_srli_epi32( _mm256_mullo_epi32( incr2, vibv ), 8 ), vib2 );
+			cnt2 = _mm256_add_epi32( cnt2, _mm256_and_si256( act, inc ) );
+			out2 = OPL_OUT_AVX2( wave2, _mm256_add_epi32( cnt2, fb2 ), env, act );
+			car = _mm256_add_epi32( car, out2 );
+
+			sum = _mm_add_epi32( _mm256_castsi256_si128( car ), _mm256_extracti128_si256( car, 1 ) );
+			sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE(1,0,3,2) ) );
+			sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE(2,3,0,1) ) );
+			mix[i] += _mm_cvtsi128_si32( sum );
+		}
+
+		_mm256_storeu_si256( (__m256i *)&L->evc[SLOT1][b], evc1 );
+		_mm256_storeu_si256( (__m256i *)&L->evc[SLOT2][b], evc2 );
+		_mm256_storeu_si256( (__m256i *)&L->Cnt[SLOT1][b], cnt1 );
+		_mm256_storeu_si256( (__m256i *)&L->Cnt[SLOT2][b], cnt2 );
+		_mm256_storeu_si256( (__m256i *)&L->op1_out[0][b], op0 );
+		_mm256_storeu_si256( (__m256i *)&L->op1_out[1][b], op1 );
+	}
+}
+
+#endif /* CPU_X86 */
+
+/* ---------- update chip through the lane kernels ----------- */
+/* active : bit mask of the channels that are not idle */
+static void OPL_UPDATE_LANES( FM_OPL *OPL, OPLSAMPLE *buf, int length, UINT32 active )
+{
+	OPL_LANES L;
+	INT32 amsBuf[OPL_BLOCK];
+	INT32 vibBuf[OPL_BLOCK];
+	INT32 mix[OPL_BLOCK];
+	UINT32 amsCnt  = OPL->amsCnt;
+	UINT32 vibCnt  = OPL->vibCnt;
+	UINT32 amsIncr = OPL->amsIncr;
+	UINT32 vibIncr = OPL->vibIncr;
+	UINT8 rythm = OPL->rythm&0x20;
+	int lanes = rythm ? 6 : OPL_NUM_LANES;
+	int vector = (active & ((1<<lanes)-1)) != 0;
+	int tail = rythm || (active & (1<<8));
+	int done,n,i;
+
+	if( vector )
+		OPL_LANES_LOAD( OPL, &L, lanes );
+	for( done = 0 ; done < length ; done += n )
+	{
+		n = length - done;
+		if( n > OPL_BLOCK ) n = OPL_BLOCK;
+		/* LFO */
+		for( i = 0 ; i < n ; i++ )
+		{
+			amsBuf[i] = OPL->ams_table[(amsCnt+=amsIncr)>>AMS_SHIFT];
+			vibBuf[i] = OPL->vib_table[(vibCnt+=vibIncr)>>VIB_SHIFT];
+		}
+		/* FM part */
+		if( vector )
+			OPL_CALC_LANES( &L, lanes, amsBuf, vibBuf, mix, n );
+		else
+			memset( mix, 0, n * sizeof( INT32 ) );
+		/* Rythm part, or the channel left over */
+		for( i = 0 ; tail && i < n ; i++ )
+		{
+			OPL->ams = amsBuf[i];
+			OPL->vib = vibBuf[i];
+			OPL->outd[0] = mix[i];
+			if(rythm)
+				OPL_CALC_RH(OPL);
+			else
+				OPL_CALC_CH(OPL,&OPL->P_CH[8]);
+			mix[i] = OPL->outd[0];
+		}
+		/* limit check, store to sound buffer */
+		for( i = 0 ; i < n ; i++ )
+			buf[done+i] = Limit( mix[i] , OPL_MAXOUT, OPL_MINOUT ) >> OPL_OUTSB;
+	}
+	if( vector )
+		OPL_LANES_STORE( OPL, &L, lanes );
+
+	OPL->amsCnt = amsCnt;
+	OPL->vibCnt = vibCnt;
+}
+
+/* ---------- idle channels ---------- */
+/*
+ * Channels that are keyed off and whose envelope reached EG_OFF do not
+ * change any more and add nothing to the mix, YM3812UpdateOne leaves them
+ * out. Sound effects only use channel 0, so they get a path of their own,
+ * and when nothing sounds only the LFO counters move.
+ */
+#define OPL_IDLE_BLOCK	256	/* samples between two looks for idle channels */
+
+/* nothing sounds */
+static void OPL_UPDATE_SILENCE( FM_OPL *OPL, OPLSAMPLE *buf, int length )
+{
+	memset( buf, 0, length * sizeof( OPLSAMPLE ) );
+
+	OPL->amsCnt = (INT32)( (UINT32)OPL->amsCnt + (UINT32)OPL->amsIncr * length );
+	OPL->vibCnt = (INT32)( (UINT32)OPL->vibCnt + (UINT32)OPL->vibIncr * length );
+}
+
+/* a single melodic channel sounds */
+static void OPL_UPDATE_CH( FM_OPL *OPL, OPL_CH *CH, OPLSAMPLE *buf, int length )
+{
+	UINT32 amsCnt  = OPL->amsCnt;
+	UINT32 vibCnt  = OPL->vibCnt;
+	UINT32 amsIncr = OPL->amsIncr;
+	UINT32 vibIncr = OPL->vibIncr;
+	int lfo = CH->SLOT[SLOT1].ams || CH->SLOT[SLOT2].ams ||
+	          CH->SLOT[SLOT1].vib || CH->SLOT[SLOT2].vib;
+	int i;
+
+	for( i = 0 ; i < length ; i++ )
+	{
+		/* LFO, only looked up when the channel uses it */
+		amsCnt += amsIncr;
+		vibCnt += vibIncr;
+		if( lfo )
+		{
+			OPL->ams = OPL->ams_table[amsCnt>>AMS_SHIFT];
+			OPL->vib = OPL->vib_table[vibCnt>>VIB_SHIFT];
+		}
+		OPL->outd[0] = 0;
+		OPL_CALC_CH(OPL,CH);
+		/* limit check, store to sound buffer */
+		buf[i] = Limit( OPL->outd[0] , OPL_MAXOUT, OPL_MINOUT ) >> OPL_OUTSB;
+	}
+
+	OPL->amsCnt = amsCnt;
+	OPL->vibCnt = vibCnt;
+}
+
+/* any number of channels, without a vector kernel */
+static void OPL_UPDATE_SCALAR( FM_OPL *OPL, OPLSAMPLE *buf, int length, UINT32 active )
+{
+	UINT32 amsCnt  = OPL->amsCnt;
+	UINT32 vibCnt  = OPL->vibCnt;
+	UINT32 amsIncr = OPL->amsIncr;
+	UINT32 vibIncr = OPL->vibIncr;
+	const INT32 *ams_table = OPL->ams_table;
+	const INT32 *vib_table = OPL->vib_table;
+	UINT8 rythm = OPL->rythm&0x20;
+	OPL_CH *list[9];
+	int count = 0;
+	int i,c;
+
+	for( c = 0 ; c < 9 ; c++ )
+		if( active & (1<<c) )
+			list[count++] = &OPL->P_CH[c];
+
+	for( i=0; i < length ; i++ )
+	{
+		/* LFO */
+		OPL->ams = ams_table[(amsCnt+=amsIncr)>>AMS_SHIFT];
+		OPL->vib = vib_table[(vibCnt+=vibIncr)>>VIB_SHIFT];
+		OPL->outd[0] = 0;
+		/* FM part */
+		for( c = 0 ; c < count ; c++ )
+			OPL_CALC_CH(OPL,list[c]);
+		/* Rythn part */
+		if(rythm)
+			OPL_CALC_RH(OPL);
+		/* limit check, store to sound buffer */
+		buf[i] = Limit( OPL->outd[0] , OPL_MAXOUT, OPL_MINOUT ) >> OPL_OUTSB;
+	}
+
+	OPL->amsCnt = amsCnt;
+	OPL->vibCnt = vibCnt;
 }
 
 /* ----------- initialize time tabls ----------- */
@@ -587,6 +974,14 @@ static int OPLOpenTable( void )
 		MM_FREE(AMS_TABLE);
 		return 0;
 	}
+	if( (SIN_OFFSET = (INT32*)MM_MALLOC(SIN_ENT*4 *sizeof(INT32))) == NULL)
+	{
+		MM_FREE(TL_TABLE);
+		MM_FREE(SIN_TABLE);
+		MM_FREE(AMS_TABLE);
+		MM_FREE(VIB_TABLE);
+		return 0;
+	}
 	/* make total level table */
 	for (t = 0;t < EG_ENT-1 ;t++){
 		rate = ((1<<TL_BITS)-1)/pow(10,EG_STEP*t/20);	/* dB -> voltage */
@@ -619,6 +1014,8 @@ static int OPLOpenTable( void )
 		SIN_TABLE[SIN_ENT*2+s] = SIN_TABLE[s % (SIN_ENT/2)];
 		SIN_TABLE[SIN_ENT*3+s] = (s/(SIN_ENT/4))&1 ? &TL_TABLE[EG_ENT] : SIN_TABLE[SIN_ENT*2+s];
 	}
+	for (s = 0;s < SIN_ENT*4;s++)
+		SIN_OFFSET[s] = (INT32)(SIN_TABLE[s] - TL_TABLE);
 
 	/* envelope counter -> envelope output table */
 	for (i=0; i<EG_ENT; i++)
@@ -658,6 +1055,7 @@ static void OPLCloseTable()
 	MM_FREE(SIN_TABLE);
 	MM_FREE(AMS_TABLE);
 	MM_FREE(VIB_TABLE);
+	MM_FREE(SIN_OFFSET);
 }
 
 /* ---------- opl initialize ---------- */
@@ -843,7 +1241,7 @@ void OPLWrite(FM_OPL *OPL, int r, int v)
 		int feedback = (v>>1)&7;
 		CH->FB   = feedback ? (8+1) - feedback : 0;
 		CH->CON = v&1;
-		set_algorythm(CH);
+		set_algorythm(OPL,CH);
 		}
 		return;
 	case 0xe0: /* wave type */
@@ -865,13 +1263,22 @@ static int OPL_LockTable(void)
 	num_lock++;
 	if(num_lock>1) return 0;
 	/* first time */
-	cur_chip = NULL;
 	/* allocate total level table (128kb space) */
 	if( !OPLOpenTable() )
 	{
 		num_lock--;
 		return -1;
 	}
+	/* pick the channel kernel */
+	OPL_CALC_LANES = NULL;
+#ifdef CPU_X86
+	{
+		W32 features = CPU_features();
+		/* without gathers and per lane shifts the scalar loop is faster */
+		if( features & CPU_FEATURE_AVX2 )
+			OPL_CALC_LANES = OPL_CALC_LANES_AVX2;
+	}
+#endif
 	return 0;
 }
 
@@ -880,59 +1287,54 @@ static void OPL_UnLockTable(void)
 	if(num_lock) num_lock--;
 	if(num_lock) return;
 	/* last time */
-	cur_chip = NULL;
 	OPLCloseTable();
 }
 
 /* ---------- update chip ----------- */
 void YM3812UpdateOne(FM_OPL *OPL, void *buffer, int length)
 {
-    int i;
-	int data;
 	OPLSAMPLE *buf = (OPLSAMPLE *)buffer;
-	UINT32 amsCnt  = OPL->amsCnt;
-	UINT32 vibCnt  = OPL->vibCnt;
 	UINT8 rythm = OPL->rythm&0x20;
-	OPL_CH *CH,*R_CH;
-
-	if( (void *)OPL != cur_chip ){
-		cur_chip = (void *)OPL;
-		/* channel pointers */
-		S_CH = OPL->P_CH;
-		E_CH = &S_CH[9];
-		/* rythm slot */
-		SLOT7_1 = &S_CH[7].SLOT[SLOT1];
-		SLOT7_2 = &S_CH[7].SLOT[SLOT2];
-		SLOT8_1 = &S_CH[8].SLOT[SLOT1];
-		SLOT8_2 = &S_CH[8].SLOT[SLOT2];
-		/* LFO state */
-		amsIncr = OPL->amsIncr;
-		vibIncr = OPL->vibIncr;
-		ams_table = OPL->ams_table;
-		vib_table = OPL->vib_table;
-	}
-	R_CH = rythm ? &S_CH[6] : E_CH;
-    for( i=0; i < length ; i++ )
+	int chans = rythm ? 6 : 9;
+	UINT32 active;
+	int done,n,c;
+
+	for( done = 0 ; done < length ; done += n )
 	{
-		/*            channel A         channel B         channel C      */
-		/* LFO */
-		ams = ams_table[(amsCnt+=amsIncr)>>AMS_SHIFT];
-		vib = vib_table[(vibCnt+=vibIncr)>>VIB_SHIFT];
-		outd[0] = 0;
-		/* FM part */
-		for(CH=S_CH ; CH < R_CH ; CH++)
-			OPL_CALC_CH(CH);
-		/* Rythn part */
-		if(rythm)
-			OPL_CALC_RH(S_CH);
-		/* limit check */
-		data = Limit( outd[0] , OPL_MAXOUT, OPL_MINOUT );
-		/* store to sound buffer */
-		buf[i] = data >> OPL_OUTSB;
-	}
+		n = length - done;
+		if( n > OPL_IDLE_BLOCK ) n = OPL_IDLE_BLOCK;
 
-	OPL->amsCnt = amsCnt;
-	OPL->vibCnt = vibCnt;
+		/* find the channels that still sound */
+		active = 0;
+		for( c = 0 ; c < chans ; c++ )
+			if( ! OPL_CH_IDLE( &OPL->P_CH[c] ) )
+				active |= 1 << c;
+
+		if( rythm )
+		{
+			if( OPL_CALC_LANES )
+				OPL_UPDATE_LANES( OPL, buf+done, n, active );
+			else
+				OPL_UPDATE_SCALAR( OPL, buf+done, n, active );
+		}
+		else if( ! active )
+		{
+			OPL_UPDATE_SILENCE( OPL, buf+done, n );
+		}
+		else if( ! (active & (active-1)) )
+		{
+			for( c = 0 ; ! (active & (1<<c)) ; c++ ) ;
+			OPL_UPDATE_CH( OPL, &OPL->P_CH[c], buf+done, n );
+		}
+		else if( OPL_CALC_LANES )
+		{
+			OPL_UPDATE_LANES( OPL, buf+done, n, active );
+		}
+		else
+		{
+			OPL_UPDATE_SCALAR( OPL, buf+done, n, active );
+		}
+	}
 #ifdef OPL_OUTPUT_LOG
 	if(opl_dbg_fp)
 	{
@@ -989,7 +1391,11 @@ FM_OPL *OPLCreate(int type, int clock, int rate)
 
 	/* allocate memory block */
 	ptr = (char*)MM_MALLOC(state_size);
-	if(ptr==NULL) return NULL;
+	if(ptr==NULL)
+	{
+		OPL_UnLockTable();
+		return NULL;
+	}
 	/* clear */
 	memset(ptr,0,state_size);
 
@@ -1001,6 +1407,7 @@ FM_OPL *OPLCreate(int type, int clock, int rate)
 	OPL->clock = clock;
 	OPL->rate  = rate;
 	OPL->max_ch = max_ch;
+	OPL->noise = 1;
 	/* init grobal tables */
 	OPL_initalize(OPL);
 	/* reset chip */
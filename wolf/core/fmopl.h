@@ -102,8 +102,8 @@ typedef struct fm_opl_f {
 	/* Rythm sention */
 	UINT8 rythm;				/* Rythm mode , key flag */
 
-	INT32 AR_TABLE[75];			/* attack rate tables */
-	INT32 DR_TABLE[75];			/* decay rate tables   */
+	INT32 AR_TABLE[76];			/* attack rate tables */
+	INT32 DR_TABLE[76];			/* decay rate tables   */
 	UINT32 FN_TABLE[1024];  /* fnumber -> increment counter */
 	/* LFO */
 	INT32 *ams_table;
@@ -114,11 +114,20 @@ typedef struct fm_opl_f {
 	INT32 vibIncr;
 	/* wave selector enable flag */
 	UINT8 wavesel;
+	/* work area of YM3812UpdateOne */
+	INT32 outd[1];			/* carrier output    */
+	INT32 feedback2;		/* connect for SLOT 2 */
+	INT32 ams;					/* current LFO levels */
+	INT32 vib;
+	UINT32 noise;				/* white noise generator */
 } FM_OPL;
 
 /* ---------- Generic interface section ---------- */
 #define OPL_TYPE_YM3812 0
 
+/* Every chip keeps its own state, so chips can be updated from different threads at once.
+   OPLCreate and OPLDestroy share the common tables and must not run concurrently. */
+
 FM_OPL *OPLCreate(int type, int clock, int rate);
 void OPLDestroy(FM_OPL *OPL);
 
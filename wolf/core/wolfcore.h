@@ -76,6 +76,8 @@ void PageFile_Shutdown( void );
 void *PageFile_getPage( W32 pagenum, W32 *length );
 void *PageFile_decodeWall( W8 *data, W8 *palette );
 void *PageFile_decodeSprite( W8 *data, W8 *palette );
+void PageFile_decodeWall_Indexed( W8 *data, const W8 *remap, W8 *buffer );
+void PageFile_decodeSprite_Keyed( W8 *data, const W8 *remap, W16 *buffer );
 
 
 wtBoolean PageFile_ReduxDecodePageData( const char *vsfname, const char *wallPath, const char *spritePath, const char *soundPath, W8 *palette );
@@ -112,6 +114,36 @@ typedef struct
 
 } parTimes_t;
 
+/*
+	Redux map file, all values little endian:
+
+	0	char[4]	MAP_SIGNATURE
+	4	W16		MAP_VERSION
+	6	W16		width in tiles
+	8	W16		height in tiles
+	10	W16		number of planes, MAP_PLANES
+	12	W32		ceiling colour, 0xRRGGBB
+	16	W32		floor colour, 0xRRGGBB
+	20	W32[3]	file offset of each plane
+	32	W16		map name length
+	34	W16		music file name length
+	36	float	par time
+	40	char[5]	par time string
+	45			map name, music file name, zero padding to a multiple of four
+
+	Each plane is width * height W16 tiles, row by row, so a level is
+	loaded with a single read.
+
+	Sections of precomputed level data may follow the planes up to the end
+	of the file. Each is a char[4] id and a W32 length, then length bytes
+	of data and zero padding to a multiple of four.
+*/
+#define MAP_SIGNATURE	"WMAP"
+#define MAP_VERSION		2
+#define MAP_PLANES		3
+#define MAP_HEADER_SIZE	45
+#define MAP_SECTION_HEADER	8
+
 wtBoolean MapFile_ReduxDecodeMapData( const char *fmaphead, const char *fmap, const char *path,
                                              W8 *palette, const W32 *ceilingColour, char *musicFileName[], parTimes_t *parTimes, char *format );
 
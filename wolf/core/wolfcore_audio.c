@@ -28,18 +28,22 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "../../common/platform.h"
 #include "../../common/common_utils.h"
 #include "../../string/wtstring.h"
 #include "../../memory/memory.h"
 #include "../../filesys/file.h"
+#include "../../threads/threads.h"
 
 #include "../../console/console.h"
 
 
 #include "../core/adlib.h"
 #include "../../loaders/wav.h"
+#include "../../loaders/flac.h"
+#include "../../loaders/oplfile.h"
 #include "../../vorbis/vorbisenc_inter.h"
 
 #include "../wolfenstein/wolf.h"
@@ -50,6 +54,9 @@ PRIVATE W32 *audiostarts;
 
 extern wtBoolean _saveAudioAsWav;
 extern wtBoolean _saveMusicAsWav;
+extern wtBoolean _saveAudioAsFlac;
+extern W32 _oplFormat;
+extern vorbisSettings_t _vorbisSettings;
 
 /**
  * \brief Setup for audio decoding.
@@ -259,72 +266,389 @@ PRIVATE int GetSoundMappedIndex( int index )
     return mappedIndex;
 }
 
+/**
+ * \brief Save sound fx as OPL register streams.
+ * \param[in] start Start of sound fx chunks.
+ * \param[in] end End of sound fx chunks.
+ * \param[in] path Directory path to save file to.
+ * \return On success true, otherwise false.
+ */
+PRIVATE wtBoolean AudioFile_ExportSound( const W32 start, const W32 end, const W8 *path )
+{
+	SW8 *buffChunk;
+	oplStream_t stream;
+	char filename[ 1024 ];
+	W32 i;
+	wtBoolean result = true;
+
+	printf( "Exporting Sound FX..." );
+
+	for( i = start ; i < end ; ++i )
+	{
+		buffChunk = (PSW8) AudioFile_CacheAudioChunk( i );
+		if( buffChunk == NULL )
+		{
+			continue;
+		}
+
+		wt_snprintf( filename, sizeof( filename ), "%s%c%.3d", path, PATH_SEP, GetSoundMappedIndex( i - start ) );
+
+		OPLFile_init( &stream );
+
+		if( ! ADLIB_ExportSound( (AdLibSound *)buffChunk, &stream ) ||
+			! OPLFile_write( _oplFormat, filename, &stream ) )
+		{
+			result = false;
+		}
+
+		OPLFile_free( &stream );
+		MM_FREE( buffChunk );
+	}
+
+	printf( "Done\n" );
+
+	return result;
+}
+
+typedef struct
+{
+	adlib_t adlib;			/* every sound gets its own AdLib card */
+	SW8 *chunk;				/* AdLib sound chunk */
+	void *buffWav;			/* decoded 16 bit samples */
+	W32 length;				/* bytes in buffWav */
+	char filename[ 1024 ];
+	wtBoolean result;		/* false if the file could not be saved */
+
+} soundFX_t;
+
+
+/**
+ * \brief Thread pool job, renders one sound fx.
+ */
+PRIVATE void AudioFile_soundJob( void *param, W32 index, W32 threadId )
+{
+	soundFX_t *sound = (soundFX_t *)param + index;
+
+	(void)threadId;
+
+	sound->buffWav = ADLIB_DecodeSound( &sound->adlib, (AdLibSound *)sound->chunk, &sound->length );
+	if( sound->buffWav == NULL )
+	{
+		return;
+	}
+
+	if( _saveAudioAsFlac )
+	{
+		sound->result = FLAC_write( sound->filename, sound->buffWav, sound->length, 1, 22050, 16 );
+
+		return;
+	}
+
+
+#ifdef BIG_ENDIAN_SYSTEM
+
+	AudioFile_dataByteSwap( sound->buffWav, sound->length );
+
+#endif
+
+}
+
 /**
  * \brief Decode sound fx.
  * \param[in] start Start of sound fx chunks.
  * \param[in] end End of sound fx chunks.
  * \param[in] path Directory path to save file to.
  * \return On success true, otherwise false.
+ * \note Sounds are rendered, and encoded to Ogg Vorbis or FLAC, in parallel
+ *		across the worker thread pool. Each sound starts from a freshly reset card so
+ *		the output does not depend on the order they are rendered in.
  */
 PUBLIC wtBoolean AudioFile_ReduxDecodeSound( const W32 start, const W32 end, const W8 *path )
 {
 	SW8 *buffChunk;
-	void *buffWav;
+	soundFX_t *sounds;
+	soundFX_t *sound;
+	vorbisJob_t *jobs;
+	W32 numSounds;
+	W32 numJobs;
 	W32 i;
-	W32 length;
-	W8 filename[ 1024 ];
+	wtBoolean result = true;
+
+	if( end <= start )
+	{
+		return true;
+	}
+
+	if( _oplFormat != OPL_FILE_NONE )
+	{
+		return AudioFile_ExportSound( start, end, path );
+	}
 
 	printf( "Decoding Sound FX..." );
 
-	if( ! ADLIB_Init( 22050 ) )
+	sounds = (soundFX_t *) MM_MALLOC( (end - start) * sizeof( soundFX_t ) );
+	if( sounds == NULL )
 	{
 		return false;
 	}
 
-
+	/* Chunks are read and the emulators created up front, only rendering runs on the workers */
+	numSounds = 0;
 	for( i = start ; i < end ; ++i )
-	{
+	{
 		buffChunk = (PSW8) AudioFile_CacheAudioChunk( i );
 		if( buffChunk == NULL )
 		{
 			continue;
 		}
 
+		sound = &sounds[ numSounds ];
 
-		buffWav = ADLIB_DecodeSound( (AdLibSound *)buffChunk, &length );
-		if( buffWav == NULL )
+		if( ! ADLIB_Init( &sound->adlib, 22050 ) )
 		{
 			MM_FREE( buffChunk );
 
-			continue;
+			result = false;
+			break;
 		}
 
+		sound->chunk = buffChunk;
+		sound->buffWav = NULL;
+		sound->length = 0;
+		sound->result = true;
+
+		wt_snprintf( sound->filename, sizeof( sound->filename ), "%s%c%.3d.%s", path, PATH_SEP,
+				GetSoundMappedIndex( i - start ), _saveAudioAsFlac ? "flac" : _saveAudioAsWav ? "wav" : "ogg" );
+
+		numSounds++;
+	}
+
+
+	if( result && numSounds )
+	{
+		ThreadPool_Run( AudioFile_soundJob, sounds, numSounds );
+
+		/* FLAC files are written by the jobs */
+		if( _saveAudioAsWav && ! _saveAudioAsFlac )
+		{
+			for( i = 0 ; i < numSounds ; ++i )
+			{
+				if( sounds[ i ].buffWav &&
+					! wav_write( sounds[ i ].filename, sounds[ i ].buffWav, sounds[ i ].length, 1, 22050, 2 ) )
+				{
+					result = false;
+				}
+			}
+		}
+		else if( ! _saveAudioAsFlac )
+		{
+			jobs = (vorbisJob_t *) MM_MALLOC( numSounds * sizeof( vorbisJob_t ) );
+			if( jobs == NULL )
+			{
+				result = false;
+			}
+			else
+			{
+				numJobs = 0;
+				for( i = 0 ; i < numSounds ; ++i )
+				{
+					if( sounds[ i ].buffWav )
+					{
+						jobs[ numJobs ].filename = sounds[ i ].filename;
+						jobs[ numJobs ].data = sounds[ i ].buffWav;
+						jobs[ numJobs ].size = sounds[ i ].length;
+						jobs[ numJobs ].channels = 1;
+						jobs[ numJobs ].rate = 22050;
+						numJobs++;
+					}
+				}
+
+				result = vorbis_encodeBatch( jobs, numJobs, &_vorbisSettings );
+
+				MM_FREE( jobs );
+			}
+		}
+		else
+		{
+			for( i = 0 ; i < numSounds ; ++i )
+			{
+				if( ! sounds[ i ].result )
+				{
+					result = false;
+				}
+			}
+		}
+	}
+
+
+	for( i = 0 ; i < numSounds ; ++i )
+	{
+		ADLIB_Shutdown( &sounds[ i ].adlib );
+		MM_FREE( sounds[ i ].buffWav );
+		MM_FREE( sounds[ i ].chunk );
+	}
+
+	MM_FREE( sounds );
+
+	printf( "Done\n" );
+
+	return result;
+}
+
+
+typedef struct
+{
+	adlib_t adlib;			/* every song gets its own AdLib card */
+	SW8 *chunk;				/* IMF music chunk */
+	W32 length;				/* song length in milliseconds */
+	char filename[ 1024 ];
+	wtBoolean result;		/* false if the song could not be saved */
+
+} musicSong_t;
+
+
+/**
+ * \brief qsort compare function, longest song first.
+ */
+PRIVATE int AudioFile_compareSongs( const void *a, const void *b )
+{
+	const musicSong_t *songA = (const musicSong_t *)a;
+	const musicSong_t *songB = (const musicSong_t *)b;
+
+	if( songA->length != songB->length )
+	{
+		return ( songA->length < songB->length ) ? 1 : -1;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Music sample source of the Vorbis encoder, renders the next music ticks.
+ */
+PRIVATE SW32 AudioFile_readMusic( void *param, float **buffer, SW32 samples )
+{
+	musicSong_t *song = (musicSong_t *)param;
+
+	return ADLIB_UpdateMusicFloat( &song->adlib, samples / ADLIB_MUSIC_TICK, buffer[ 0 ] );
+}
+
+/**
+ * \brief Thread pool job, renders and saves one song.
+ * \note Ogg Vorbis output is rendered block by block while it is encoded,
+ *		wav and FLAC output hold the whole song in memory.
+ */
+PRIVATE void AudioFile_musicJob( void *param, W32 index, W32 threadId )
+{
+	musicSong_t *song = (musicSong_t *)param + index;
+	void *buffWav;
+	W32 length;
+
+	(void)threadId;
+
+	ADLIB_LoadMusic( &song->adlib, song->chunk );
+
+	if( ! _saveMusicAsWav && ! _saveAudioAsFlac )
+	{
+		vorbisEncoder_t encoder;
+
+		vorbis_encoderInit( &encoder, 1, 44100, AudioFile_readMusic, song );
+		encoder.settings = _vorbisSettings;
+
+		song->result = vorbis_encodeFile( song->filename, &encoder );
+
+		return;
+	}
+
+	buffWav = MM_MALLOC( song->length * 64 * 2 );
+	if( buffWav == NULL )
+	{
+		song->result = false;
+
+		return;
+	}
+
+	length = ADLIB_UpdateMusic( &song->adlib, song->length, buffWav );
+
+	if( _saveAudioAsFlac )
+	{
+		song->result = FLAC_write( song->filename, buffWav, length, 1, 44100, 16 );
+
+		MM_FREE( buffWav );
+
+		return;
+	}
 
 #ifdef BIG_ENDIAN_SYSTEM
 
-		AudioFile_dataByteSwap( buffWav, length );
+	AudioFile_dataByteSwap( buffWav, length );
 
 #endif
 
-        if( _saveAudioAsWav )
-        {
-		    wt_snprintf( filename, sizeof( filename ), "%s%c%.3d.wav", path, PATH_SEP, GetSoundMappedIndex( i - start ) );
-		    wav_write( filename, buffWav, length, 1, 22050, 2 );
-        }
-        else
-        {
-            wt_snprintf( filename, sizeof( filename ), "%s%c%.3d.ogg", path, PATH_SEP, GetSoundMappedIndex( i - start ) );
-            vorbis_encode( filename, buffWav, length, 1, 16, 22050, 0, 0, 0 );
-        }
-		MM_FREE( buffWav );
+
+	// Save audio buffer
+	song->result = wav_write( song->filename, buffWav, length, 1, 44100, 2 );
+
+	MM_FREE( buffWav );
+}
+
+/**
+ * \brief Save music chunks as OPL register streams.
+ * \param[in] start Start of music chunks.
+ * \param[in] end End of music chunks.
+ * \param[in] songNames Song titles.
+ * \return On success true, otherwise false.
+ */
+PRIVATE wtBoolean AudioFile_ExportMusic( const W32 start, const W32 end, const W8 *path, W8 *songNames[] )
+{
+	SW8 *buffChunk;
+	oplStream_t stream;
+	char filename[ 1024 ];
+	W32 i;
+	wtBoolean result = true;
+
+	printf( "Exporting Music..." );
+
+	for( i = start ; i < end ; ++i )
+	{
+		buffChunk = (PSW8) AudioFile_CacheAudioChunk( i );
+		if( buffChunk == NULL )
+		{
+			continue;
+		}
+
+		if( ADLIB_getLength( buffChunk ) <= 1 )
+		{
+			MM_FREE( buffChunk );
+
+			continue;
+		}
+
+		if( songNames )
+		{
+			wt_snprintf( filename, sizeof( filename ), "%s%c%s", path, PATH_SEP, songNames[ i - start ] );
+		}
+		else
+		{
+			wt_snprintf( filename, sizeof( filename ), "%s%c%d", path, PATH_SEP, i - start );
+		}
+
+		OPLFile_init( &stream );
+
+		if( ! ADLIB_ExportMusic( buffChunk, &stream ) ||
+			! OPLFile_write( _oplFormat, filename, &stream ) )
+		{
+			result = false;
+		}
+
+		OPLFile_free( &stream );
 		MM_FREE( buffChunk );
 	}
-	ADLIB_Shutdown();
 
 	printf( "Done\n" );
-	return true;
-}
 
+	return result;
+}
 
 /**
  * \brief Decode music chunks
@@ -332,28 +656,44 @@ PUBLIC wtBoolean AudioFile_ReduxDecodeSound( const W32 start, const W32 end, con
  * \param[in] end End of music chunks.
  * \param[in] songNames Song titles.
  * \return On success true, otherwise false.
+ * \note Songs are rendered and encoded in parallel across the worker thread pool.
  */
 PUBLIC wtBoolean AudioFile_ReduxDecodeMusic( const W32 start, const W32 end, const W8 *path, W8 *songNames[] )
 {
 	SW8 *buffChunk;
-	void *buffWav;
+	musicSong_t *songs;
+	musicSong_t *song;
+	W32 numSongs;
 	W32 i;
-	W32 length;
-	W8 filename[ 1024 ];
 	W32 uncompr_length;
+	const char *extension;
+	wtBoolean result = true;
 
 
+	if( end <= start )
+	{
+		return true;
+	}
+
+	if( _oplFormat != OPL_FILE_NONE )
+	{
+		return AudioFile_ExportMusic( start, end, path, songNames );
+	}
+
 	printf( "Decoding Music (This could take a while)..." );
 
-	if( ! ADLIB_Init( 44100 ) )
+	songs = (musicSong_t *) MM_MALLOC( (end - start) * sizeof( musicSong_t ) );
+	if( songs == NULL )
 	{
 		return false;
 	}
 
+	extension = _saveAudioAsFlac ? "flac" : _saveMusicAsWav ? "wav" : "ogg";
 
-
+	/* Chunks are read and the emulators created up front, only rendering runs on the workers */
+	numSongs = 0;
 	for( i = start ; i < end ; ++i )
-	{
+	{
 		buffChunk = (PSW8) AudioFile_CacheAudioChunk( i );
 		if( buffChunk == NULL )
 		{
@@ -370,69 +710,56 @@ PUBLIC wtBoolean AudioFile_ReduxDecodeMusic( const W32 start, const W32 end, con
 		}
 
 
-		ADLIB_LoadMusic( buffChunk );
-
+		song = &songs[ numSongs ];
 
-		buffWav = MM_MALLOC( uncompr_length * 64 * 2 );
-		if( buffWav == NULL )
+		if( ! ADLIB_Init( &song->adlib, 44100 ) )
 		{
 			MM_FREE( buffChunk );
 
-			continue;
+			result = false;
+			break;
 		}
 
-		length = ADLIB_UpdateMusic( uncompr_length, buffWav );
-
+		song->chunk = buffChunk;
+		song->length = uncompr_length;
+		song->result = true;
 
+		if( songNames )
+		{
+			wt_snprintf( song->filename, sizeof( song->filename ), "%s%c%s.%s", path, PATH_SEP, songNames[ i - start ], extension );
+		}
+		else
+		{
+			wt_snprintf( song->filename, sizeof( song->filename ), "%s%c%d.%s", path, PATH_SEP, i - start, extension );
+		}
 
+		numSongs++;
+	}
 
-#ifdef BIG_ENDIAN_SYSTEM
-
-		AudioFile_dataByteSwap( buffWav, length );
-
-#endif
-
-
-        // Save audio buffer
-        if( _saveMusicAsWav )
-        {
-
-            if( songNames )
-		    {
-			    wt_snprintf( filename, sizeof( filename ), "%s%c%s.wav", path, PATH_SEP, songNames[ i - start ] );
-		    }
-		    else
-		    {
-			    wt_snprintf( filename, sizeof( filename ), "%s%c%d.wav", path, PATH_SEP, i - start );
-		    }
-
-            wav_write( filename, buffWav, length, 1, 44100, 2 );
-        }
-        else
-        {
 
-            if( songNames )
-		    {
-			    wt_snprintf( filename, sizeof( filename ), "%s%c%s.ogg", path, PATH_SEP, songNames[ i - start ] );
-		    }
-		    else
-		    {
-			    wt_snprintf( filename, sizeof( filename ), "%s%c%d.ogg", path, PATH_SEP, i - start );
-		    }
+	if( result )
+	{
+		/* Longest songs first, so the run takes about as long as the longest song */
+		qsort( songs, numSongs, sizeof( musicSong_t ), AudioFile_compareSongs );
 
-		    vorbis_encode( filename, buffWav, length, 1, 16, 44100, 0, 0, 0 );
-        }
+		ThreadPool_Run( AudioFile_musicJob, songs, numSongs );
+	}
 
 
+	for( i = 0 ; i < numSongs ; ++i )
+	{
+		if( ! songs[ i ].result )
+		{
+			result = false;
+		}
 
-		MM_FREE( buffWav );
-		MM_FREE( buffChunk );
+		ADLIB_Shutdown( &songs[ i ].adlib );
+		MM_FREE( songs[ i ].chunk );
 	}
 
-
-	ADLIB_Shutdown();
+	MM_FREE( songs );
 
 	printf( "Done\n" );
 
-	return true;
+	return result;
 }
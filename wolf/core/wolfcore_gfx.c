@@ -34,6 +34,7 @@
 #include "../../string/wtstring.h"
 #include "../../memory/memory.h"
 #include "../../filesys/file.h"
+#include "../../filesys/writequeue.h"
 #include "../../loaders/tga.h"
 
 
@@ -728,7 +729,6 @@ PUBLIC wtBoolean GFXFile_decodeScript( W32 textId_start, W32 textId_end, const c
     W8 fileName[ 256 ];
 	SW32 length;
 	W32 i;
-	FILE *fHandle;
 
 	if( textId_start == 0 || textId_end == 0 || textId_end <= textId_start )
 	{
@@ -755,15 +755,7 @@ PUBLIC wtBoolean GFXFile_decodeScript( W32 textId_start, W32 textId_end, const c
         wt_snprintf( fileName, sizeof( fileName ), "%s%c%.3d.txt", path, PATH_SEP, i );
 
 
-        fHandle = fopen( fileName, "wb" );
-	    if( ! fHandle )
-	    {
-		    continue;
-	    }
-
-		fwrite( (const void *)text, 1, length, fHandle );
-
-        fclose( fHandle );
+        WriteQueue_Copy( (const char *)fileName, text, (W32)length );
 	}
 
 
@@ -35,13 +35,23 @@
 #include "../../memory/memory.h"
 #include "../../string/wtstring.h"
 #include "../../filesys/file.h"
+#include "../../memory/membuf.h"
+#include "../../threads/threads.h"
+#include "../../filesys/writequeue.h"
+#include "../../loaders/oplfile.h"
 #include "../wolfcore_decoder.h"
 
 
-PRIVATE FILE *map_file_handle = NULL;
+PRIVATE W8 *map_file_data = NULL;	/* whole map file */
+PRIVATE W32 map_file_size = 0;
 
 PRIVATE W32	headerOffsets[ 256 ];
 
+extern wtBoolean _mapSections;
+extern wtBoolean _saveMusicAsWav;
+extern wtBoolean _saveAudioAsFlac;
+extern W32 _oplFormat;
+
 
 /**
  * \brief Setup map files for decoding.
@@ -114,13 +124,13 @@ PUBLIC wtBoolean MapFile_Setup( const char *headFileName, const char *mapFileNam
 
 
 //
-// Open map data file.
+// Load map data file, maps are converted from memory.
 //
-	map_file_handle = fopen( wt_strupr( tempFileName ), "rb");
-	if( NULL == map_file_handle )
+	fileHandle = fopen( wt_strupr( tempFileName ), "rb");
+	if( NULL == fileHandle )
 	{
-		map_file_handle = fopen( wt_strlwr( tempFileName ), "rb");
-		if( NULL == map_file_handle )
+		fileHandle = fopen( wt_strlwr( tempFileName ), "rb");
+		if( NULL == fileHandle )
 		{
 			MM_FREE( tempFileName );
 
@@ -128,6 +138,21 @@ PUBLIC wtBoolean MapFile_Setup( const char *headFileName, const char *mapFileNam
 		}
 	}
 
+	fileSize = FS_FileLength( fileHandle );
+
+	map_file_data = (PW8) MM_MALLOC( fileSize > 0 ? fileSize : 1 );
+	if( map_file_data == NULL )
+	{
+		fclose( fileHandle );
+		MM_FREE( tempFileName );
+
+		return false;
+	}
+
+	map_file_size = (W32)fread( map_file_data, 1, fileSize > 0 ? fileSize : 0, fileHandle );
+
+	fclose( fileHandle );
+
 
 	*nTotalMaps = TotalMaps;
 
@@ -144,11 +169,8 @@ PUBLIC wtBoolean MapFile_Setup( const char *headFileName, const char *mapFileNam
  */
 PUBLIC void MapFile_Shutdown( void )
 {
-	if( map_file_handle )
-	{
-		fclose( map_file_handle );
-		map_file_handle = NULL;
-	}
+	MM_FREE( map_file_data );
+	map_file_size = 0;
 }
 
 
@@ -163,7 +185,7 @@ PUBLIC void *MapFile_getMapData( W32 chunkOffset, W32 chunkLength )
 {
 	void *mapdata;
 
-	if( map_file_handle == NULL )
+	if( map_file_data == NULL || chunkOffset > map_file_size || chunkLength > map_file_size - chunkOffset )
 	{
 		return NULL;
 	}
@@ -176,250 +198,823 @@ PUBLIC void *MapFile_getMapData( W32 chunkOffset, W32 chunkLength )
 		return NULL;
 	}
 
-	fseek( map_file_handle, chunkOffset, SEEK_SET );
-
-	fread( mapdata, 1, chunkLength, map_file_handle );
+	MM_MEMCPY( mapdata, map_file_data + chunkOffset, chunkLength );
 
 
 	return mapdata;
 }
 
+#define CARMACK_NEARTAG		0xA7	/* copy words from a byte offset back */
+#define CARMACK_FARTAG		0xA8	/* copy words from a word offset into the output */
+
+
 /**
- * \brief Convert map to Redux file format.
- * \param[in] fmaphead Map header file name.
- * \param[in] fmap Map file name.
- * \param[in] path Path to save redux map to.
- * \param[in] palette Pointer to palette array.
- * \param[in] ceilingColour Array of ceiling colours.
- * \param[in] musicFileName Array of music titles.
- * \param[in] parTimes Struct with the parTimes.
- * \return On success true, otherwise false.
- * \note Caller must free allocated data.
+ * \brief Expand Carmack compressed data.
+ * \param[in] source Compressed data, without the leading expanded length.
+ * \param[in] length Length of source in bytes.
+ * \param[out] dest Expanded words.
+ * \param[in] destLength Number of words to expand.
+ * \return On success true, false if the data is corrupt.
+ * \note Copies that do not overlap what they are copying are done with one
+ *		memory copy, overlapping ones repeat a pattern word by word.
  */
-PUBLIC wtBoolean MapFile_ReduxDecodeMapData( const char *fmaphead, const char *fmap, const char *path,
-                                             W8 *palette, const W32 *ceilingColour, char *musicFileName[], parTimes_t *parTimes, char *format )
+PRIVATE wtBoolean MapFile_CarmackExpand( const W8 *source, W32 length, W16 *dest, W32 destLength )
 {
-	W16 Rtag;
-	W32 totalMaps;
+	const W8 *end = source + length;
+	W32 out = 0;
+	W32 count, offset;
+	W16 word;
 
-	W32 i;
-	FILE *fout;
-	char filename[ 256 ];
-	W32 offset[ 3 ];
-	W32 offsetin[ 3 ];
-	W16 length[ 3 ];
-	W8 sig[ 5 ];
-	W16 w, h;
-	char name[ 32 ];
-	char musicName[ 64 ];
-	SW32 jmp;
-	W32 ceiling;
-	W32 floor;
-	W32 palOffset;
-	W32 temp;
-	float ftime;
-	char *stime;
-	W8 *data;
+	while( out < destLength )
+	{
+		if( source + 2 > end )
+		{
+			return false;
+		}
 
+		word = (W16)(source[ 0 ] | (source[ 1 ] << 8));
+		source += 2;
 
-	printf( "Decoding Map Data..." );
+		if( (word >> 8) != CARMACK_NEARTAG && (word >> 8) != CARMACK_FARTAG )
+		{
+			dest[ out++ ] = word;
+			continue;
+		}
 
+		count = word & 0xFF;
+		if( count == 0 )
+		{
+			/* a literal word with a tag as its high byte */
+			if( source >= end )
+			{
+				return false;
+			}
+			dest[ out++ ] = (W16)((word & 0xFF00) | *source++);
+			continue;
+		}
 
-	if( ! MapFile_Setup( fmaphead, fmap, &Rtag, &totalMaps ) )
-	{
-		return false;
+		if( (word >> 8) == CARMACK_NEARTAG )
+		{
+			if( source >= end || *source > out )
+			{
+				return false;
+			}
+			offset = out - *source++;
+		}
+		else
+		{
+			if( source + 2 > end )
+			{
+				return false;
+			}
+			offset = source[ 0 ] | (source[ 1 ] << 8);
+			source += 2;
+		}
+
+		if( offset >= out || count > destLength - out )
+		{
+			return false;
+		}
+
+		if( out - offset >= count )
+		{
+			MM_MEMCPY( dest + out, dest + offset, count * sizeof( W16 ) );
+			out += count;
+		}
+		else
+		{
+			while( count-- )
+			{
+				dest[ out++ ] = dest[ offset++ ];
+			}
+		}
 	}
 
+	return true;
+}
 
-	for( i = 0 ; i < totalMaps ; ++i ) {
-		if( fseek( map_file_handle, headerOffsets[ i ], SEEK_SET ) != 0 ) {
-			break;
+/**
+ * \brief Expand RLEW compressed data.
+ * \param[in] source Compressed words, without the leading expanded length.
+ * \param[in] length Number of words in source.
+ * \param[out] dest Expanded words.
+ * \param[in] destLength Number of words to expand.
+ * \param[in] RLEWtag Run length encoded word tag.
+ * \return On success true, false if the data is corrupt.
+ */
+PRIVATE wtBoolean MapFile_RLEWExpand( const W16 *source, W32 length, W16 *dest, W32 destLength, W16 RLEWtag )
+{
+	const W16 *end = source + length;
+	W16 *out = dest;
+	W16 *outEnd = dest + destLength;
+	W32 count;
+	W16 value;
+
+	while( out < outEnd )
+	{
+		if( source >= end )
+		{
+			return false;
 		}
-		wt_snprintf( filename, sizeof( filename ), format, path, i );
 
-		fout = fopen( filename, "wb");
-		if( NULL == fout ) {
+		if( *source != RLEWtag )
+		{
+			*out++ = *source++;
 			continue;
 		}
 
+		if( source + 3 > end )
+		{
+			return false;
+		}
 
-		// Get ceiling colour
-		palOffset = (ceilingColour[ i ] & 0xff) * 3;
-		ceiling = (palette[ palOffset ] << 16) | (palette[ palOffset + 1 ] << 8) | palette[ palOffset + 2 ];
+		count = source[ 1 ];
+		value = source[ 2 ];
+		source += 3;
 
+		if( count > (W32)(outEnd - out) )
+		{
+			return false;
+		}
 
+		while( count-- )
+		{
+			*out++ = value;
+		}
+	}
 
-		// Get floor colour
-		palOffset = 0x19 * 3;
-		floor = (palette[ palOffset ] << 16 ) | (palette[ palOffset + 1 ] << 8) | palette[ palOffset + 2 ];
+	return true;
+}
 
+/**
+ * \brief Expand one compressed map plane.
+ * \param[in] data Plane data as stored in the map file.
+ * \param[in] length Length of data in bytes.
+ * \param[in] carmack Is the plane Carmack compressed before RLEW?
+ * \param[in] RLEWtag Run length encoded word tag.
+ * \param[out] plane Expanded plane.
+ * \param[in] planeLength Number of tiles in the plane.
+ * \param[in,out] scratch Holds the RLEW data, reused from plane to plane.
+ * \return On success true, otherwise false.
+ */
+PRIVATE wtBoolean MapFile_ExpandPlane( const W8 *data, W32 length, wtBoolean carmack, W16 RLEWtag, W16 *plane, W32 planeLength, memBuffer_t *scratch )
+{
+	W16 *words;
+	W32 numWords;
+	W32 i;
+	wtBoolean result;
 
-		wt_snprintf( musicName, sizeof( musicName ), "%s/%s.ogg", DIR_MUSIC, musicFileName[ i ] );
+	if( length < 2 )
+	{
+		return false;
+	}
 
+	if( carmack )
+	{
+		numWords = (data[ 0 ] | (data[ 1 ] << 8)) / 2;
+		data += 2;
+		length -= 2;
+	}
+	else
+	{
+		numWords = length / 2;
+	}
 
-		ftime = parTimes[ i ].time;
-		stime = parTimes[ i ].timestr;
+	if( ! MemBuffer_Reserve( scratch, numWords * sizeof( W16 ) + sizeof( W16 ) ) )
+	{
+		return false;
+	}
+	words = (PW16) scratch->data;
 
+	if( carmack )
+	{
+		result = MapFile_CarmackExpand( data, length, words, numWords );
+	}
+	else
+	{
+		for( i = 0 ; i < numWords ; ++i )
+		{
+			words[ i ] = (W16)(data[ 2 * i ] | (data[ 2 * i + 1 ] << 8));
+		}
+		result = true;
+	}
 
-		//
-		// Read in map data
-		//
+	/* RLEW data starts with its expanded length in bytes */
+	result = result && numWords > 0 && words[ 0 ] == planeLength * 2 &&
+			MapFile_RLEWExpand( words + 1, numWords - 1, plane, planeLength, RLEWtag );
 
-		fread( &offsetin, sizeof( W32 ), 3, map_file_handle );
-		offsetin[ 0 ] = LittleLong( offsetin[ 0 ] );
-		offsetin[ 1 ] = LittleLong( offsetin[ 1 ] );
-		offsetin[ 2 ] = LittleLong( offsetin[ 2 ] );
-		fread( &length, sizeof( W16 ), 3, map_file_handle );
-		length[ 0 ] = LittleShort( length[ 0 ] );
-		length[ 1 ] = LittleShort( length[ 1 ] );
-		length[ 2 ] = LittleShort( length[ 2 ] );
+	return result;
+}
 
-		fread( &w, sizeof( W16 ), 1, map_file_handle );
-		w = LittleShort( w );
-		fread( &h, sizeof( W16 ), 1, map_file_handle );
-		h = LittleShort( h );
+/* Tiles of the wall plane */
+#define MAP_DOOR_FIRST		90		/* even doors are vertical, odd ones horizontal */
+#define MAP_DOOR_LAST		101
+#define MAP_AMBUSHTILE		106
+#define MAP_AREATILE		107		/* floor tiles are MAP_AREATILE + area number */
 
-		fread( name, sizeof( W8 ), 16, map_file_handle );
-		fread( sig, sizeof( W8 ), 4, map_file_handle );
+/* Tiles of the object plane */
+#define MAP_PLAYER_FIRST	19
+#define MAP_PLAYER_LAST		22
+#define MAP_STATIC_FIRST	23
+#define MAP_STATIC_LAST		74
+#define MAP_PUSHABLETILE	98
+#define MAP_ACTOR_FIRST		108
 
+#define MAP_NO_AREA			0xFF
 
-		//
-		// Output header
-		//
-		// Map file header signature
-		fwrite( sig, sizeof( W8 ), 4, fout );
 
-		// RLE Word tag
-		Rtag = LittleShort( Rtag );
-		fwrite( &Rtag, sizeof( W16 ), 1, fout );
+#define MAP_FILE_HEADER		38		/* size of a map header in the map file */
 
-		// Max Width
-		w = LittleShort( w );
-		fwrite( &w, sizeof( W16 ), 1, fout );
 
-		// Max Height
-		h = LittleShort( h );
-		fwrite( &h, sizeof( W16 ), 1, fout );
+/* Outcome of converting one map */
+#define MAP_CONVERT_FAILED		0
+#define MAP_CONVERT_WRITTEN		1
+#define MAP_CONVERT_EMPTY		2		/* no planes, nothing written */
 
-		// Ceiling Colour
-		ceiling = LittleLong( ceiling );
-		fwrite( &ceiling, sizeof( W32 ), 1, fout );
+/* One map on its way to a Redux map file */
+typedef struct
+{
+	W32 index;				/* map number */
+	W32 headerOffset;		/* of the map header in the map file */
+	W32 ceiling;
+	W32 floor;
+	float parTime;
+	const char *parTimeString;
+	char name[ 17 ];
+	char musicName[ 64 ];
 
-		// Floor Colour
-		floor = LittleLong( floor );
-		fwrite( &floor, sizeof( W32 ), 1, fout );
+	W16 width;
+	W16 height;
+	W16 *planes;			/* MAP_PLANES expanded planes */
+	memBuffer_t sections;	/* precomputed level data */
+	W32 status;				/* MAP_CONVERT_* */
 
-		// Length of layers
-		temp = LittleShort( length[ 0 ] );
-		fwrite( &temp, sizeof( W16 ), 1, fout );	// Length One
-		temp = LittleShort( length[ 1 ] );
-		fwrite( &temp, sizeof( W16 ), 1, fout );	// Length Two
-		temp = LittleShort( length[ 2 ] );
-		fwrite( &temp, sizeof( W16 ), 1, fout );	// Length Three
+} reduxMap_t;
 
-		jmp = ftell( fout );
+/* Settings shared by every map of a conversion */
+typedef struct
+{
+	reduxMap_t *maps;
+	W16 RLEWtag;
+	wtBoolean carmack;		/* are planes Carmack compressed before RLEW? */
+	const char *path;
+	const char *format;
 
-		temp = 0;
-		fwrite( &temp, sizeof( W32 ), 1, fout );	// Offset One
-		fwrite( &temp, sizeof( W32 ), 1, fout );	// Offset Two
-		fwrite( &temp, sizeof( W32 ), 1, fout );	// Offset Three
+} mapConvert_t;
 
 
-		// Map name length
-		temp = strlen( name );
-		fwrite( &temp, sizeof( W16 ), 1, fout );
+PRIVATE INLINECALL W32 MapFile_getShort( const W8 *ptr )
+{
+	return ptr[ 0 ] | (ptr[ 1 ] << 8);
+}
 
-		// Music name length
-		temp = strlen( musicName );
-		fwrite( &temp, sizeof( W16 ), 1, fout );
+PRIVATE INLINECALL W32 MapFile_getLong( const W8 *ptr )
+{
+	return ptr[ 0 ] | (ptr[ 1 ] << 8) | (ptr[ 2 ] << 16) | ((W32)ptr[ 3 ] << 24);
+}
+
+PRIVATE INLINECALL void MapFile_setShort( W8 *ptr, W32 value )
+{
+	ptr[ 0 ] = (W8)value;
+	ptr[ 1 ] = (W8)(value >> 8);
+}
+
+PRIVATE INLINECALL void MapFile_setLong( W8 *ptr, W32 value )
+{
+	ptr[ 0 ] = (W8)value;
+	ptr[ 1 ] = (W8)(value >> 8);
+	ptr[ 2 ] = (W8)(value >> 16);
+	ptr[ 3 ] = (W8)(value >> 24);
+}
+
+
+PRIVATE void MapFile_putShort( memBuffer_t *out, W32 value )
+{
+	W8 bytes[ 2 ];
 
-		// Par time Float
-		ftime = LittleFloat( ftime );
-		fwrite( &ftime, sizeof( float ), 1, fout );
+	bytes[ 0 ] = (W8)value;
+	bytes[ 1 ] = (W8)(value >> 8);
 
-		// Par time string
-		fwrite( stime, sizeof( W8 ), 5 , fout );
+	MemBuffer_Append( out, bytes, 2 );
+}
 
-		// Map name
-		fwrite( name, sizeof( W8 ), strlen( name ), fout );
+/**
+ * \brief Start a section, its length is filled in by MapFile_EndSection().
+ * \return Offset of the section in out.
+ */
+PRIVATE W32 MapFile_BeginSection( memBuffer_t *out, const char *id )
+{
+	W32 start = out->length;
+	W32 length = 0;
 
-		// Music file name
-		fwrite( musicName, sizeof( W8 ), strlen( musicName ), fout );
+	MemBuffer_Append( out, id, 4 );
+	MemBuffer_Append( out, &length, 4 );
 
+	return start;
+}
 
+PRIVATE void MapFile_EndSection( memBuffer_t *out, W32 start )
+{
+	W32 length = out->length - start - MAP_SECTION_HEADER;
+	W32 zero = 0;
 
+	MemBuffer_Append( out, &zero, (4 - (length & 3)) & 3 );
 
+	length = LittleLong( length );
+	MM_MEMCPY( out->data + start + 4, &length, 4 );
+}
 
-		data = (PW8) MM_MALLOC( length[ 0 ] );
-		if( data == NULL )
-		{
-			fclose( fout );
-			continue;
+/**
+ * \brief Area number of a tile, MAP_NO_AREA if it is not floor.
+ */
+PRIVATE W32 MapFile_GetArea( const reduxMap_t *map, SW32 x, SW32 y )
+{
+	W16 tile;
+
+	if( x < 0 || y < 0 || x >= map->width || y >= map->height )
+	{
+		return MAP_NO_AREA;
+	}
+
+	tile = map->planes[ y * map->width + x ];
+	if( tile < MAP_AREATILE || tile - MAP_AREATILE >= MAP_NO_AREA )
+	{
+		return MAP_NO_AREA;
+	}
+
+	return tile - MAP_AREATILE;
+}
+
+/**
+ * \brief Precompute the level data the engine would build at level load.
+ * \param[in,out] map Map with expanded planes, sections are appended to map->sections.
+ * \note The sections are:
+ *		"SOLD" one bit per tile, set for solid walls, rows of (width + 7) / 8 bytes.
+ *		"DOOR" W16 count, then W16 x, y, tile and W8 area on either side per door.
+ *		"PUSH" W16 count, then W16 x, y per pushwall.
+ *		"AREA" W16 number of areas n, then n * n W8 door counts between areas.
+ *		"SPWN" W16 counts of player starts, statics and actors, then W16 x, y,
+ *			tile of each in that order.
+ */
+PRIVATE void MapFile_BuildSections( reduxMap_t *map )
+{
+	const W16 *walls = map->planes;
+	const W16 *objects = map->planes + map->width * map->height;
+	memBuffer_t *out = &map->sections;
+	W8 *bits;
+	W8 *connect;
+	W32 rowBytes;
+	W32 numAreas;
+	W32 count[ 3 ];
+	W32 start, area1, area2;
+	W32 x, y, n, kind;
+	W16 tile;
+	W8 areas[ 2 ];
+
+	/* reserve enough for the largest map data, so no append below can fail */
+	if( ! MemBuffer_Reserve( out, 5 * (MAP_SECTION_HEADER + 3) + (map->width + 7) / 8 * map->height +
+							 20 * map->width * map->height + MAP_NO_AREA * MAP_NO_AREA + 8 ) )
+	{
+		return;
+	}
+
+	/* solid walls */
+	start = MapFile_BeginSection( out, "SOLD" );
+	rowBytes = (map->width + 7) / 8;
+	bits = out->data + out->length;
+	memset( bits, 0, rowBytes * map->height );
+
+	for( y = 0 ; y < map->height ; ++y )
+	{
+		for( x = 0 ; x < map->width ; ++x )
+		{
+			tile = walls[ y * map->width + x ];
+			if( tile && tile < MAP_AREATILE && tile != MAP_AMBUSHTILE &&
+				! (tile >= MAP_DOOR_FIRST && tile <= MAP_DOOR_LAST) )
+			{
+				bits[ y * rowBytes + (x >> 3) ] |= 1 << (x & 7);
+			}
 		}
+	}
 
-		offset[ 0 ] = ftell( fout );
+	out->length += rowBytes * map->height;
+	MapFile_EndSection( out, start );
 
-		fseek( map_file_handle, offsetin[ 0 ], SEEK_SET );
 
-		fread( data, 1, length[ 0 ], map_file_handle );
-		fwrite( data, 1, length[ 0 ], fout );
+	/* areas are numbered by floor tile */
+	numAreas = 0;
+	for( n = 0 ; n < (W32)map->width * map->height ; ++n )
+	{
+		if( walls[ n ] >= MAP_AREATILE && walls[ n ] - MAP_AREATILE < MAP_NO_AREA &&
+			walls[ n ] - MAP_AREATILE + 1U > numAreas )
+		{
+			numAreas = walls[ n ] - MAP_AREATILE + 1;
+		}
+	}
 
-		MM_FREE( data );
+	connect = (PW8) MM_MALLOC( numAreas * numAreas + 1 );
+	if( connect )
+	{
+		memset( connect, 0, numAreas * numAreas + 1 );
+	}
 
 
-		data = (PW8) MM_MALLOC( length[ 1 ] );
-		if( data == NULL )
+	/* doors, and the areas they connect */
+	start = MapFile_BeginSection( out, "DOOR" );
+	count[ 0 ] = 0;
+	for( n = 0 ; n < (W32)map->width * map->height ; ++n )
+	{
+		count[ 0 ] += (walls[ n ] >= MAP_DOOR_FIRST && walls[ n ] <= MAP_DOOR_LAST);
+	}
+	MapFile_putShort( out, count[ 0 ] );
+	for( y = 0 ; y < map->height ; ++y )
+	{
+		for( x = 0 ; x < map->width ; ++x )
 		{
-			MapFile_Shutdown();
-			fclose( fout );
+			tile = walls[ y * map->width + x ];
+			if( tile < MAP_DOOR_FIRST || tile > MAP_DOOR_LAST )
+			{
+				continue;
+			}
+
+			if( (tile & 1) == 0 )
+			{
+				area1 = MapFile_GetArea( map, x - 1, y );
+				area2 = MapFile_GetArea( map, x + 1, y );
+			}
+			else
+			{
+				area1 = MapFile_GetArea( map, x, y - 1 );
+				area2 = MapFile_GetArea( map, x, y + 1 );
+			}
+
+			MapFile_putShort( out, x );
+			MapFile_putShort( out, y );
+			MapFile_putShort( out, tile );
+			areas[ 0 ] = (W8)area1;
+			areas[ 1 ] = (W8)area2;
+			MemBuffer_Append( out, areas, 2 );
+
+			if( connect && area1 != MAP_NO_AREA && area2 != MAP_NO_AREA && area1 != area2 )
+			{
+				if( connect[ area1 * numAreas + area2 ] < 0xFF )
+				{
+					connect[ area1 * numAreas + area2 ]++;
+					connect[ area2 * numAreas + area1 ]++;
+				}
+			}
+		}
+	}
+	MapFile_EndSection( out, start );
 
-			return 0;
+
+	/* pushwalls */
+	start = MapFile_BeginSection( out, "PUSH" );
+	count[ 0 ] = 0;
+	for( n = 0 ; n < (W32)map->width * map->height ; ++n )
+	{
+		count[ 0 ] += (objects[ n ] == MAP_PUSHABLETILE);
+	}
+	MapFile_putShort( out, count[ 0 ] );
+	for( y = 0 ; y < map->height ; ++y )
+	{
+		for( x = 0 ; x < map->width ; ++x )
+		{
+			if( objects[ y * map->width + x ] == MAP_PUSHABLETILE )
+			{
+				MapFile_putShort( out, x );
+				MapFile_putShort( out, y );
+			}
 		}
+	}
+	MapFile_EndSection( out, start );
 
-		offset[ 1 ] = ftell( fout );
 
-		fseek( map_file_handle, offsetin[ 1 ], SEEK_SET );
+	/* area connectivity */
+	start = MapFile_BeginSection( out, "AREA" );
+	MapFile_putShort( out, connect ? numAreas : 0 );
+	if( connect )
+	{
+		MemBuffer_Append( out, connect, numAreas * numAreas );
+	}
+	MapFile_EndSection( out, start );
 
-		fread( data, 1, length[ 1 ], map_file_handle );
-		fwrite( data, 1, length[ 1 ], fout );
+	MM_FREE( connect );
 
-		MM_FREE( data );
 
-		data = (PW8) MM_MALLOC( length[ 2 ] );
-		if( data == NULL )
+	/* spawn lists */
+	start = MapFile_BeginSection( out, "SPWN" );
+	count[ 0 ] = count[ 1 ] = count[ 2 ] = 0;
+	for( n = 0 ; n < (W32)map->width * map->height ; ++n )
+	{
+		tile = objects[ n ];
+		if( tile >= MAP_PLAYER_FIRST && tile <= MAP_PLAYER_LAST )
+		{
+			count[ 0 ]++;
+		}
+		else if( tile >= MAP_STATIC_FIRST && tile <= MAP_STATIC_LAST )
+		{
+			count[ 1 ]++;
+		}
+		else if( tile >= MAP_ACTOR_FIRST )
+		{
+			count[ 2 ]++;
+		}
+	}
+	MapFile_putShort( out, count[ 0 ] );
+	MapFile_putShort( out, count[ 1 ] );
+	MapFile_putShort( out, count[ 2 ] );
+	for( kind = 0 ; kind < 3 ; ++kind )
+	{
+		for( y = 0 ; y < map->height ; ++y )
 		{
-			MapFile_Shutdown();
-			if(fout)
-			fclose(fout);
-			return 0;
+			for( x = 0 ; x < map->width ; ++x )
+			{
+				tile = objects[ y * map->width + x ];
+				if( (kind == 0 && tile >= MAP_PLAYER_FIRST && tile <= MAP_PLAYER_LAST) ||
+					(kind == 1 && tile >= MAP_STATIC_FIRST && tile <= MAP_STATIC_LAST) ||
+					(kind == 2 && tile >= MAP_ACTOR_FIRST) )
+				{
+					MapFile_putShort( out, x );
+					MapFile_putShort( out, y );
+					MapFile_putShort( out, tile );
+				}
+			}
 		}
+	}
+	MapFile_EndSection( out, start );
+}
 
-		offset[ 2 ] = ftell( fout );
+/**
+ * \brief Thread pool job, converts one map and queues its Redux map file.
+ * \note The file is assembled in one buffer. Its size and the plane offsets
+ *		are known from the map header, so the planes are expanded straight
+ *		into place. Sets map->status, maps without planes are left out.
+ */
+PRIVATE void MapFile_ConvertJob( void *param, W32 index, W32 threadId )
+{
+	mapConvert_t *convert = (mapConvert_t *)param;
+	reduxMap_t *map = convert->maps + index;
+	memBuffer_t out;
+	memBuffer_t scratch;
+	const W8 *header;
+	W32 offsetin[ MAP_PLANES ];
+	W32 length[ MAP_PLANES ];
+	W32 nameLength, musicLength;
+	W32 headerSize;
+	W32 planeLength;
+	W32 j;
+	float ftime;
+	char filename[ 256 ];
 
-		fseek( map_file_handle, offsetin[ 2 ], SEEK_SET );
-		fread( data, 1, length[ 2 ], map_file_handle );
+	(void)threadId;
 
-		fwrite( data, 1, length[ 2 ], fout );
+	map->status = MAP_CONVERT_FAILED;
 
-		MM_FREE( data );
+	if( map->headerOffset > map_file_size || map_file_size - map->headerOffset < MAP_FILE_HEADER )
+	{
+		fprintf( stderr, "[MapFile_ConvertJob]: Header of map %d is out of the map file\n", map->index );
 
+		return;
+	}
 
-		fseek( fout, jmp, SEEK_SET );
 
-		temp = LittleLong( offset[ 0 ] );
-		fwrite( &temp, sizeof( W32 ), 1, fout );	// Offset One
+	//
+	// Read in map header
+	//
+	header = map_file_data + map->headerOffset;
+	for( j = 0 ; j < MAP_PLANES ; ++j )
+	{
+		offsetin[ j ] = MapFile_getLong( header + j * 4 );
+		length[ j ] = MapFile_getShort( header + 12 + j * 2 );
 
-		temp = LittleLong( offset[ 1 ] );
-		fwrite( &temp, sizeof( W32 ), 1, fout );	// Offset Two
+		if( offsetin[ j ] > map_file_size || length[ j ] > map_file_size - offsetin[ j ] )
+		{
+			fprintf( stderr, "[MapFile_ConvertJob]: Plane %d of map %d is out of the map file\n", j, map->index );
+
+			return;
+		}
+	}
+
+	map->width = (W16)MapFile_getShort( header + 18 );
+	map->height = (W16)MapFile_getShort( header + 20 );
+
+	MM_MEMCPY( map->name, header + 22, 16 );
+	map->name[ 16 ] = '\0';
+
+	planeLength = (W32)map->width * map->height;
+	if( planeLength == 0 )
+	{
+		map->status = MAP_CONVERT_EMPTY;
+
+		return;
+	}
 
-		temp = LittleLong( offset[ 2 ] );
-		fwrite( &temp, sizeof( W32 ), 1, fout );	// Offset Three
 
-		fclose( fout );
+	// Planes follow the header and strings, aligned to four bytes
+	nameLength = (W32)strlen( map->name );
+	musicLength = (W32)strlen( map->musicName );
+	headerSize = (MAP_HEADER_SIZE + nameLength + musicLength + 3) & ~3;
+
+	MemBuffer_Init( &out );
+	MemBuffer_Init( &scratch );
+
+	if( ! MemBuffer_Reserve( &out, headerSize + MAP_PLANES * planeLength * sizeof( W16 ) ) )
+	{
+		return;
+	}
+
+
+	//
+	// Output header
+	//
+	memset( out.data, 0, headerSize );
+	MM_MEMCPY( out.data, MAP_SIGNATURE, 4 );
+	MapFile_setShort( out.data + 4, MAP_VERSION );
+	MapFile_setShort( out.data + 6, map->width );
+	MapFile_setShort( out.data + 8, map->height );
+	MapFile_setShort( out.data + 10, MAP_PLANES );
+	MapFile_setLong( out.data + 12, map->ceiling );
+	MapFile_setLong( out.data + 16, map->floor );
+	for( j = 0 ; j < MAP_PLANES ; ++j )
+	{
+		MapFile_setLong( out.data + 20 + j * 4, headerSize + j * planeLength * sizeof( W16 ) );
 	}
+	MapFile_setShort( out.data + 32, nameLength );
+	MapFile_setShort( out.data + 34, musicLength );
+	ftime = LittleFloat( map->parTime );
+	MM_MEMCPY( out.data + 36, &ftime, sizeof( float ) );
+	MM_MEMCPY( out.data + 40, map->parTimeString, 5 );
+	MM_MEMCPY( out.data + MAP_HEADER_SIZE, map->name, nameLength );
+	MM_MEMCPY( out.data + MAP_HEADER_SIZE + nameLength, map->musicName, musicLength );
+
+
+	//
+	// Expand planes
+	//
+	map->planes = (PW16)(out.data + headerSize);
+
+	for( j = 0 ; j < MAP_PLANES ; ++j )
+	{
+		if( ! MapFile_ExpandPlane( map_file_data + offsetin[ j ], length[ j ], convert->carmack, convert->RLEWtag,
+								   map->planes + j * planeLength, planeLength, &scratch ) )
+		{
+			fprintf( stderr, "[MapFile_ConvertJob]: Plane %d of map %d is corrupt\n", j, map->index );
+
+			MemBuffer_Free( &scratch );
+			MemBuffer_Free( &out );
+
+			return;
+		}
+	}
+
+	MemBuffer_Free( &scratch );
+
+	out.length = headerSize + MAP_PLANES * planeLength * sizeof( W16 );
+
+
+	if( _mapSections )
+	{
+		MapFile_BuildSections( map );
+	}
+
+#ifdef BIG_ENDIAN_SYSTEM
+
+	for( j = 0 ; j < MAP_PLANES * planeLength ; ++j )
+	{
+		map->planes[ j ] = LittleShort( map->planes[ j ] );
+	}
+
+#endif
+
+	map->planes = NULL;
+
+
+	// Precomputed level data
+	if( MemBuffer_Append( &out, map->sections.data, map->sections.length ) )
+	{
+		wt_snprintf( filename, sizeof( filename ), convert->format, convert->path, map->index );
+
+		if( WriteQueue_AddBuffer( filename, &out ) )
+		{
+			map->status = MAP_CONVERT_WRITTEN;
+		}
+	}
+
+	MemBuffer_Free( &map->sections );
+	MemBuffer_Free( &out );
+}
+
+/**
+ * \brief Convert map to Redux file format.
+ * \param[in] fmaphead Map header file name.
+ * \param[in] fmap Map file name.
+ * \param[in] path Path to save redux map to.
+ * \param[in] palette Pointer to palette array.
+ * \param[in] ceilingColour Array of ceiling colours.
+ * \param[in] musicFileName Array of music titles.
+ * \param[in] parTimes Struct with the parTimes.
+ * \return On success true, otherwise false.
+ * \note Planes are saved expanded, see MAP_SIGNATURE for the layout. Maps
+ *		in MAPTEMP files are only RLEW compressed, all others are Carmack
+ *		compressed too. The map file is read once, then every map is
+ *		converted, with its precomputed level data if _mapSections is set,
+ *		across the worker thread pool.
+ */
+PUBLIC wtBoolean MapFile_ReduxDecodeMapData( const char *fmaphead, const char *fmap, const char *path,
+                                             W8 *palette, const W32 *ceilingColour, char *musicFileName[], parTimes_t *parTimes, char *format )
+{
+	W16 Rtag;
+	W32 totalMaps;
+	W32 i;
+	W32 palOffset;
+	reduxMap_t *maps;
+	reduxMap_t *map;
+	mapConvert_t convert;
+	const char *musicExtension;
+	wtBoolean result = true;
+
+
+	printf( "Decoding Map Data..." );
+
+
+	if( ! MapFile_Setup( fmaphead, fmap, &Rtag, &totalMaps ) )
+	{
+		return false;
+	}
+
+	/* Music names point at the files AudioFile_ReduxDecodeMusic writes */
+	if( _oplFormat != OPL_FILE_NONE )
+	{
+		musicExtension = OPLFile_extension( _oplFormat );
+	}
+	else
+	{
+		musicExtension = _saveAudioAsFlac ? "flac" : _saveMusicAsWav ? "wav" : "ogg";
+	}
+
+	maps = (reduxMap_t *) MM_MALLOC( (totalMaps + 1) * sizeof( reduxMap_t ) );
+	if( maps == NULL )
+	{
+		MapFile_Shutdown();
+
+		return false;
+	}
+
+
+	for( i = 0 ; i < totalMaps ; ++i )
+	{
+		map = &maps[ i ];
+		map->index = i;
+		map->headerOffset = LittleLong( headerOffsets[ i ] );
+		map->planes = NULL;
+		MemBuffer_Init( &map->sections );
+
+
+		// Get ceiling colour
+		palOffset = (ceilingColour[ i ] & 0xff) * 3;
+		map->ceiling = (palette[ palOffset ] << 16) | (palette[ palOffset + 1 ] << 8) | palette[ palOffset + 2 ];
+
+
+
+		// Get floor colour
+		palOffset = 0x19 * 3;
+		map->floor = (palette[ palOffset ] << 16 ) | (palette[ palOffset + 1 ] << 8) | palette[ palOffset + 2 ];
+
+
+		wt_snprintf( map->musicName, sizeof( map->musicName ), "%s/%s.%s", DIR_MUSIC, musicFileName[ i ], musicExtension );
+
+
+		map->parTime = parTimes[ i ].time;
+		map->parTimeString = parTimes[ i ].timestr;
+	}
+
+
+	convert.maps = maps;
+	convert.RLEWtag = LittleShort( Rtag );
+	convert.carmack = wt_strnicmp( fmap, "MAPTEMP", 7 ) != 0;
+	convert.path = path;
+	convert.format = format;
+
+	ThreadPool_Run( MapFile_ConvertJob, &convert, totalMaps );
+
+	for( i = 0 ; i < totalMaps ; ++i )
+	{
+		if( maps[ i ].status == MAP_CONVERT_FAILED )
+		{
+			result = false;
+		}
+		else if( maps[ i ].status == MAP_CONVERT_EMPTY )
+		{
+			fprintf( stderr, "[MapFile_ReduxDecodeMapData]: Map %d has no planes, nothing written\n", i );
+		}
+	}
+
+
+	MM_FREE( maps );
+
 	MapFile_Shutdown();
 
 	printf( "Done\n" );
-	return true;
+	return result;
 }
-
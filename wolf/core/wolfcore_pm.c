@@ -34,9 +34,11 @@
 #include "../../string/wtstring.h"
 #include "../../memory/memory.h"
 #include "../../loaders/wav.h"
-#include "../../loaders/tga.h"
+#include "../../loaders/flac.h"
+#include "../../loaders/imagefile.h"
 #include "../../image/image.h"
-#include "../../image/hq2x.h"
+#include "../../image/scaler.h"
+#include "../../image/mipmap.h"
 
 #include "../../image/scalebit.h"
 
@@ -45,9 +47,15 @@
 
 PUBLIC const W32 SAMPLERATE  =    7000;    /* In Hz */
 
+/* Number of walls or sprites decoded and scaled together */
+#define PAGEFILE_BATCH	64
+
 extern wtBoolean _saveAudioAsWav;
+extern wtBoolean _saveAudioAsFlac;
 extern W32 _filterScale;
 extern W32 _filterScale_Sprites;
+extern wtBoolean _generateMipmaps;
+extern W32 _imageFormat;
 
 typedef	struct
 {
@@ -513,6 +521,72 @@ PUBLIC void *PageFile_decodeSprite_RGB32( W8 *data, W8 *palette )
 	return (void *)buffer;
 }
 
+/**
+ * \brief Decodes raw wall data into palette indices.
+ * \param[in] data Raw wall data.
+ * \param[in] remap Palette index remap table, see Palette_buildRemap.
+ * \param[out] buffer Receives the 64x64 index block.
+ * \return Nothing.
+ */
+PUBLIC void PageFile_decodeWall_Indexed( W8 *data, const W8 *remap, W8 *buffer )
+{
+	W32 x, y;
+
+	for( x = 0 ; x < 64 ; ++x )
+	{
+		for( y = 0 ; y < 64 ; ++y )
+		{
+			buffer[ (y << 6) + x ] = remap[ data[ (x << 6) + y ] ];
+		}
+	}
+}
+
+/**
+ * \brief Decodes raw sprite data into 16-bit palette keys.
+ * \param[in] data Raw sprite data.
+ * \param[in] remap Palette index remap table, see Palette_buildRemap.
+ * \param[out] buffer Receives the 64x64 key block.
+ * \return Nothing.
+ * \note Transparent texels are set to PALETTE_KEY_TRANSPARENT.
+ */
+PUBLIC void PageFile_decodeSprite_Keyed( W8 *data, const W8 *remap, W16 *buffer )
+{
+	W32 i;
+	W32 x, y;
+	W16 *cmdptr;
+	SW16 *linecmds;
+
+	t_compshape *shape;
+
+	W16 leftpix, rightpix;
+
+	/* all transparent at the beginning */
+	for( x = 0 ; x < 64 * 64 ; ++x )
+	{
+		buffer[ x ] = PALETTE_KEY_TRANSPARENT;
+	}
+
+	shape = (t_compshape *)data;
+
+	leftpix = LittleShort( shape->leftpix );
+	rightpix = LittleShort( shape->rightpix );
+
+	cmdptr = shape->dataofs;
+	for( x = leftpix ; x <= rightpix ; ++x )
+	{
+		linecmds = (PSW16)(data + LittleShort( *cmdptr ));
+		cmdptr++;
+		for( ; LittleShort( *linecmds ) ; linecmds += 3 )
+		{
+			i = (LittleShort( linecmds[ 2 ] ) / 2) + LittleShort( linecmds[ 1 ] );
+			for( y = (W32)(LittleShort( linecmds[ 2 ] ) / 2) ; y < (W32)(LittleShort( linecmds[ 0 ] ) / 2) ; ++y, ++i )
+			{
+				buffer[ y * 64 + x ] = remap[ data[ i ] ];
+			}
+		}
+	}
+}
+
 /**
  * \brief Remap sprite index number based on game version
  * \param[in] index Sprite index.
@@ -613,6 +687,64 @@ PRIVATE int GetWallMappedIndex( int index )
 	return returnValue;
 }
 
+/**
+ * \brief List the image files of a wall or sprite.
+ * \param[out] images Receives the base level, followed by the mip levels.
+ * \param[in] path Directory to save to.
+ * \param[in] index Mapped wall or sprite index.
+ * \param[in] size Width and height of the base level in pixels.
+ * \param[in] bpp Bytes per pixel, 3 or 4.
+ * \param[in] tile Base level image data.
+ * \param[in] chain Mip chain as built by Mipmap_buildTiles, or NULL.
+ * \return Number of images listed.
+ * \note Level n is saved as XXX_mipn next to the base level XXX, unless
+ *		the image file format stores the mip chain with the base level.
+ */
+PRIVATE W32 PageFile_listImages( imageFile_t *images, const char *path, int index, W32 size, W32 bpp, const W8 *tile, const W8 *chain )
+{
+	W32 level = 0;
+
+	if( ImageFile_hasMipChain( _imageFormat ) )
+	{
+		wt_snprintf( images[ 0 ].filename, sizeof( images[ 0 ].filename ), "%s%c%.3d", path, PATH_SEP, index );
+		images[ 0 ].bpp = (W16)(bpp * 8);
+		images[ 0 ].width = size;
+		images[ 0 ].height = size;
+		images[ 0 ].data = tile;
+		images[ 0 ].mips = chain;
+
+		return 1;
+	}
+
+	do
+	{
+		if( level == 0 )
+		{
+			wt_snprintf( images[ level ].filename, sizeof( images[ level ].filename ), "%s%c%.3d", path, PATH_SEP, index );
+			images[ level ].data = tile;
+		}
+		else
+		{
+			size >>= 1;
+
+			wt_snprintf( images[ level ].filename, sizeof( images[ level ].filename ), "%s%c%.3d_mip%d", path, PATH_SEP, index, level );
+			images[ level ].data = chain;
+
+			chain += size * size * bpp;
+		}
+
+		images[ level ].bpp = (W16)(bpp * 8);
+		images[ level ].width = size;
+		images[ level ].height = size;
+		images[ level ].mips = NULL;
+
+		++level;
+
+	} while( chain && size > 1 );
+
+	return level;
+}
+
 /**
  * \brief Redux the Page file data.
  * \param[in] vsfname data file name.
@@ -626,7 +758,6 @@ PRIVATE int GetWallMappedIndex( int index )
 PUBLIC wtBoolean PageFile_ReduxDecodePageData( const char *vsfname, const char *wallPath, const char *spritePath, const char *soundPath, W8 *palette )
 {
 	void *data;
-	void *decdata;
 	W32 length;
 	char tempFileName[ 1024 ];
 	W32 i;
@@ -634,6 +765,16 @@ PUBLIC wtBoolean PageFile_ReduxDecodePageData( const char *vsfname, const char *
 	W32 soundBufferSize;
 	W8 *soundBuffer;
 	W32 totallength;
+	W8 remap[ 256 ];
+	W8 *batchSrc;
+	W8 *batchDest;
+	W32 batchIds[ PAGEFILE_BATCH ];
+	W32 count, j;
+	W32 wallSize, spriteSize;
+	W8 *batchMips = NULL;
+	wtBoolean haveMips;
+	imageFile_t *images;
+	W32 numImages;
 
 
 	printf( "Decoding Page Data..." );
@@ -645,123 +786,175 @@ PUBLIC wtBoolean PageFile_ReduxDecodePageData( const char *vsfname, const char *
 		return false;
 	}
 
-    // ////////////////////////////////////////////////////////////////////////
-    // Decode Walls
+	Palette_buildRemap( palette, remap );
 
-	for( i = 0 ; i < SpriteStart ; ++i )
-	{
-		data = PageFile_getPage( i, &length );
-		if( data == NULL )
+	wallSize = 64 * Scaler_factor( _filterScale );
+	spriteSize = 64 * Scaler_factor( _filterScale_Sprites );
+
+	/* batch buffers are shared by walls and sprites, size them for the larger of the two */
+	batchSrc = (PW8) MM_MALLOC( PAGEFILE_BATCH * 64 * 64 * sizeof( W16 ) );
+	length = wallSize * wallSize * 3;
+	if( spriteSize * spriteSize * 4 > length )
+	{
+		length = spriteSize * spriteSize * 4;
+	}
+
+	batchDest = (PW8) MM_MALLOC( PAGEFILE_BATCH * length );
+
+	/* room for every tile and its mip levels */
+	length = (wallSize > spriteSize) ? wallSize : spriteSize;
+	images = (imageFile_t *) MM_MALLOC( PAGEFILE_BATCH * (Mipmap_levels( length, length ) + 1) * sizeof( imageFile_t ) );
+
+	if( NULL == batchSrc || NULL == batchDest || NULL == images )
+	{
+		MM_FREE( batchSrc );
+		MM_FREE( batchDest );
+		MM_FREE( images );
+		PageFile_Shutdown();
+
+		return false;
+	}
+
+	if( _generateMipmaps )
+	{
+		length = Mipmap_chainSize( wallSize, wallSize, 3 );
+		if( Mipmap_chainSize( spriteSize, spriteSize, 4 ) > length )
 		{
-			continue;
+			length = Mipmap_chainSize( spriteSize, spriteSize, 4 );
 		}
 
-		decdata = PageFile_decodeWall_RGB32( (PW8)data, palette );
-		if( decdata == NULL )
+		batchMips = (PW8) MM_MALLOC( PAGEFILE_BATCH * length );
+		if( NULL == batchMips )
 		{
-			fprintf( stderr, "[PageFile_ReduxDecodePageData]: Unable to decode wall (%d).\n", i );
+			MM_FREE( batchSrc );
+			MM_FREE( batchDest );
+			MM_FREE( images );
+			PageFile_Shutdown();
 
-			MM_FREE( data );
-
-			continue;
+			return false;
 		}
+	}
 
+    // ////////////////////////////////////////////////////////////////////////
+    // Decode Walls
 
-		if( _filterScale > 0 )
+	for( i = 0 ; i < SpriteStart ; )
+	{
+		/* gather a batch of walls as palette indices */
+		for( count = 0 ; i < SpriteStart && count < PAGEFILE_BATCH ; ++i )
 		{
-			void *scaledImgBuf;
-
-			scaledImgBuf = (void *) MM_MALLOC( 128 * 128 * 4 );
-			if( NULL == scaledImgBuf )
-			{
-				MM_FREE( data );
-				MM_FREE( decdata );
+			data = PageFile_getPage( i, &length );
+			if( data == NULL )
+			{
 				continue;
 			}
 
+			PageFile_decodeWall_Indexed( (PW8)data, remap, batchSrc + count * 64 * 64 );
+			batchIds[ count++ ] = i;
 
-			// Scale2x
-		        if( _filterScale == 1 )
-			{
-		                scale( 2, (void *)scaledImgBuf, 128 * 4, decdata, 64 * 4, 4, 64, 64 );
-				RGB32toRGB24( (const PW8)scaledImgBuf, (PW8)scaledImgBuf, 128 * 128 * 4 );
-			} else {
-		                // hq2x
-		                RGB32toRGB24( (const PW8)decdata, (PW8)decdata, 64 * 64 * 4 );
-		                RGB24toBGR565( decdata, decdata, 64 * 64 * 3 );
-				hq2x_32( (PW8)decdata, (PW8)scaledImgBuf, 64, 64, 64 * 2 * 4  );
-        		        RGB32toRGB24( (const PW8)scaledImgBuf, (PW8)scaledImgBuf, 128 * 128 * 4 );
+			MM_FREE( data );
+		}
 
-        		}
+		if( ! Scaler_scaleTiles( _filterScale, batchSrc, SCALER_SRC_INDEX8, 64, 64, count, palette, batchDest, 3 ) )
+		{
+			fprintf( stderr, "[PageFile_ReduxDecodePageData]: Unable to scale walls\n" );
 
-    		        wt_snprintf( tempFileName, sizeof( tempFileName ), "%s%c%.3d.tga", wallPath, PATH_SEP, GetWallMappedIndex( i ) );
-			TGA_write( tempFileName, 24, 128, 128, scaledImgBuf, 0, 1 );
+			MM_FREE( batchSrc );
+			MM_FREE( batchDest );
+			MM_FREE( batchMips );
+			MM_FREE( images );
+			PageFile_Shutdown();
 
-			MM_FREE( scaledImgBuf );
+			return false;
+		}
 
-		} else {
-		        wt_snprintf( tempFileName, sizeof( tempFileName ), "%s%c%.3d.tga", wallPath, PATH_SEP, GetWallMappedIndex( i ) );
+		haveMips = batchMips && Mipmap_buildTiles( batchDest, wallSize, wallSize, 3, count, batchMips );
 
-		        RGB32toRGB24( (const PW8)decdata, (PW8)decdata, 64 * 64 * 4 );
-			TGA_write( tempFileName, 24, 64, 64, decdata, 0, 1 );
+		numImages = 0;
+		for( j = 0 ; j < count ; ++j )
+		{
+			numImages += PageFile_listImages( images + numImages, wallPath, GetWallMappedIndex( batchIds[ j ] ), wallSize, 3,
+											batchDest + j * wallSize * wallSize * 3,
+											haveMips ? batchMips + j * Mipmap_chainSize( wallSize, wallSize, 3 ) : NULL );
 		}
 
+		if( ! ImageFile_writeBatch( _imageFormat, images, numImages ) )
+		{
+			fprintf( stderr, "[PageFile_ReduxDecodePageData]: Unable to write walls\n" );
 
-		MM_FREE( data );
-		MM_FREE( decdata );
+			MM_FREE( batchSrc );
+			MM_FREE( batchDest );
+			MM_FREE( batchMips );
+			MM_FREE( images );
+			PageFile_Shutdown();
+
+			return false;
+		}
 	}
 
 
     // ////////////////////////////////////////////////////////////////////////
     // Decode Sprites
 
-	for( i = SpriteStart ; i < SoundStart ; ++i )
-	{
-		data = PageFile_getPage( i, &length );
-		if( data == NULL )
+	for( i = SpriteStart ; i < SoundStart ; )
+	{
+		/* gather a batch of sprites as 16-bit palette keys, which keep transparency distinct from every colour */
+		for( count = 0 ; i < SoundStart && count < PAGEFILE_BATCH ; ++i )
 		{
-			continue;
-		}
+			data = PageFile_getPage( i, &length );
+			if( data == NULL )
+			{
+				continue;
+			}
+
+			PageFile_decodeSprite_Keyed( (PW8)data, remap, (PW16)batchSrc + count * 64 * 64 );
+			batchIds[ count++ ] = i;
 
-		decdata = PageFile_decodeSprite_RGB32( (PW8)data, palette );
-		if( decdata == NULL )
-		{
 			MM_FREE( data );
+		}
 
-			continue;
+		if( ! Scaler_scaleTiles( _filterScale_Sprites, batchSrc, SCALER_SRC_KEY16, 64, 64, count, palette, batchDest, 4 ) )
+		{
+			fprintf( stderr, "[PageFile_ReduxDecodePageData]: Unable to scale sprites\n" );
+
+			MM_FREE( batchSrc );
+			MM_FREE( batchDest );
+			MM_FREE( batchMips );
+			MM_FREE( images );
+			PageFile_Shutdown();
+
+			return false;
 		}
 
-		if( _filterScale_Sprites > 0 )
+		haveMips = batchMips && Mipmap_buildTiles( batchDest, spriteSize, spriteSize, 4, count, batchMips );
+
+		numImages = 0;
+		for( j = 0 ; j < count ; ++j )
 		{
-			W8 *scaledImgBuf;
+			numImages += PageFile_listImages( images + numImages, spritePath, GetSpriteMappedIndex( batchIds[ j ] - SpriteStart ), spriteSize, 4,
+											batchDest + j * spriteSize * spriteSize * 4,
+											haveMips ? batchMips + j * Mipmap_chainSize( spriteSize, spriteSize, 4 ) : NULL );
+		}
 
-			scaledImgBuf = (PW8) MM_MALLOC( 128 * 128 * 4 );
-			if( NULL == scaledImgBuf ) {
-				MM_FREE( data );
-				MM_FREE( decdata );
-				continue;
-			}
-			if( _filterScale_Sprites == 1 ) {
-				scale( 2, (void *)scaledImgBuf, 128 * 4, decdata, 64 * 4, 4, 64, 64 );
-			} else {
-			// hq2x
-				RGB32toRGB24( (const PW8)decdata, (PW8)decdata, 64 * 64 * 4 );
-				RGB24toBGR565( decdata, decdata, 64 * 64 * 3 );
-				hq2x_32( (PW8)decdata, (PW8)scaledImgBuf, 64, 64, 64 * 2 * 4  );
-				ReduxAlphaChannel_hq2x( scaledImgBuf, 128, 128 );
-			}
+		if( ! ImageFile_writeBatch( _imageFormat, images, numImages ) )
+		{
+			fprintf( stderr, "[PageFile_ReduxDecodePageData]: Unable to write sprites\n" );
+
+			MM_FREE( batchSrc );
+			MM_FREE( batchDest );
+			MM_FREE( batchMips );
+			MM_FREE( images );
+			PageFile_Shutdown();
 
-			wt_snprintf( tempFileName, sizeof( tempFileName ), "%s%c%.3d.tga", spritePath, PATH_SEP, GetSpriteMappedIndex( i - SpriteStart ) );
-			TGA_write( tempFileName, 32, 128, 128, scaledImgBuf, 0, 1 );
-			MM_FREE( scaledImgBuf );
-		} else {
-			wt_snprintf( tempFileName, sizeof( tempFileName ), "%s%c%.3d.tga", spritePath, PATH_SEP, GetSpriteMappedIndex( i - SpriteStart )  );
-			TGA_write( tempFileName, 32, 64, 64, decdata, 0, 1 );
+			return false;
 		}
-		MM_FREE( data );
-		MM_FREE( decdata );
 	}
 
+	MM_FREE( batchSrc );
+	MM_FREE( batchDest );
+	MM_FREE( batchMips );
+	MM_FREE( images );
+
 
     // ////////////////////////////////////////////////////////////////////////
     // Decode SFX
@@ -804,8 +997,16 @@ PUBLIC wtBoolean PageFile_ReduxDecodePageData( const char *vsfname, const char *
 		if( length < 4096 )
 		{
 
-			wt_snprintf( tempFileName, sizeof( tempFileName ), "%s%c%.3d.wav", soundPath, PATH_SEP, i - SoundStart );
-			wav_write( tempFileName, soundBuffer, totallength, 1, SAMPLERATE, 1 );
+			if( _saveAudioAsFlac )
+			{
+				wt_snprintf( tempFileName, sizeof( tempFileName ), "%s%c%.3d.flac", soundPath, PATH_SEP, i - SoundStart );
+				FLAC_write( tempFileName, soundBuffer, totallength, 1, SAMPLERATE, 8 );
+			}
+			else
+			{
+				wt_snprintf( tempFileName, sizeof( tempFileName ), "%s%c%.3d.wav", soundPath, PATH_SEP, i - SoundStart );
+				wav_write( tempFileName, soundBuffer, totallength, 1, SAMPLERATE, 1 );
+			}
 
 
 			totallength = 0;
@@ -39,7 +39,7 @@
 #include "../../loaders/tga.h"
 
 #include "../../image/image.h"
-#include "../../image/hq2x.h"
+#include "../../image/scaler.h"
 #include "../../image/scalebit.h"
 
 #include "../wolfcore_decoder.h"
@@ -48,6 +48,89 @@
 extern W32 _filterScale;
 
 
+/**
+ * \brief Scale an RGB32 image without the fused pipelines.
+ * \param[in] filter Scale filter (SCALER_FILTER_*).
+ * \param[out] dest Destination buffer, sized for the filter's scale factor.
+ * \param[in] src RGB32 image data.
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \return Nothing.
+ * \note Used for images the pipelines reject, wider than SCALER_MAX_WIDTH or
+ *		thinner than 2 pixels. Scale2x goes through scalebit, which only
+ *		has the 2x kernels. Every other filter, and images thinner than
+ *		scalebit takes, are enlarged with nearest-neighbour.
+ */
+PRIVATE void ReduxScale_fallback( W32 filter, void *dest, void *src, W32 width, W32 height )
+{
+	W32 factor = Scaler_factor( filter );
+	W32 x, y;
+	PW32 out = (PW32)dest;
+	const W32 *in = (const W32 *)src;
+
+	if( filter == SCALER_FILTER_SCALE2X && scale_precondition( 2, 4, width, height ) == 0 )
+	{
+		scale( 2, dest, width * 2 * 4, src, width * 4, 4, width, height );
+
+		return;
+	}
+
+	for( y = 0 ; y < height * factor ; ++y )
+	{
+		for( x = 0 ; x < width * factor ; ++x )
+		{
+			*out++ = in[ (y / factor) * width + (x / factor) ];
+		}
+	}
+}
+
+/**
+ * \brief Scale an RGB32 image with the selected scale filter.
+ * \param[in] filter Scale filter (SCALER_FILTER_*).
+ * \param[out] dest Destination buffer, sized for the filter's scale factor.
+ * \param[in] src RGB32 image data.
+ * \param[in] width Width of image in pixels.
+ * \param[in] height Height of image in pixels.
+ * \return Nothing.
+ * \note Scale2x, Scale3x and Scale4x only test pixels for equality, so scaling
+ *		the indices and expanding once gives the same result as scaling RGB32
+ *		directly. Images with more than 256 distinct colours fall back to the
+ *		32-bit kernels.
+ * \note Rows are scaled in bands across the worker thread pool.
+ * \note Images the pipelines reject go through ReduxScale_fallback, so dest
+ *		is always filled.
+ */
+PRIVATE void ReduxScale_RGB32( W32 filter, void *dest, void *src, W32 width, W32 height )
+{
+	W8 colourTable[ 256 * 4 ];
+	W8 *indexBuf;
+
+	if( filter == SCALER_FILTER_HQ2X || filter == SCALER_FILTER_HQ4X )
+	{
+		if( ! Scaler_scaleImage( filter, src, SCALER_SRC_RGB32, width, height, NULL, (PW8)dest, 4 ) )
+		{
+			ReduxScale_fallback( filter, dest, src, width, height );
+		}
+
+		return;
+	}
+
+	indexBuf = (PW8) MM_MALLOC( width * height );
+
+	if( NULL == indexBuf ||
+		! RGB32_toIndexed( (PW8)src, indexBuf, width * height, colourTable ) ||
+		! Scaler_scaleImage( filter, indexBuf, SCALER_SRC_TABLE8, width, height, colourTable, (PW8)dest, 4 ) )
+	{
+		if( ! Scaler_scaleImage( filter, src, SCALER_SRC_RGB32, width, height, NULL, (PW8)dest, 4 ) )
+		{
+			ReduxScale_fallback( filter, dest, src, width, height );
+		}
+	}
+
+	MM_FREE( indexBuf );
+}
+
+
 /**
  * \brief Scale and/or reassemble image chunks.
  * \param[in] chunkid Chunk id of data.
@@ -127,24 +210,14 @@ PUBLIC void *wolfcore_ReduxGFX( const W32 chunkId, void *data, W32 *width, W32 *
 
         if( _filterScale > 0 )
         {
+            W32 factor = Scaler_factor( _filterScale );
 
-            W8 *scaledImgBuf = (PW8) MM_MALLOC( (width*2) * (height*2) * 4 );
-
-            if( 2 == _filterScale ) // hq2x
-            {
-                RGB32toRGB24( normalBuffer, normalBuffer, width * height * 4 );
-                RGB24toBGR565( normalBuffer, normalBuffer, width * height * 3 );
+            W8 *scaledImgBuf = (PW8) MM_MALLOC( (width*factor) * (height*factor) * 4 );
 
-                hq2x_32( (PW8)normalBuffer, (PW8)scaledImgBuf, width, height, width * 2 * bytesPerPixel  );
+            ReduxScale_RGB32( _filterScale, scaledImgBuf, normalBuffer, width, height );
 
-            }
-            else if( 1 == _filterScale ) // Scale2x
-            {
-                scale( 2, (void *)scaledImgBuf, (width*2) * bytesPerPixel, normalBuffer, width * bytesPerPixel, bytesPerPixel, width, height );
-            }
-
-            width *= 2;
-            height *= 2;
+            width *= factor;
+            height *= factor;
 
             MM_FREE( normalBuffer );
 
@@ -171,24 +244,14 @@ PUBLIC void *wolfcore_ReduxGFX( const W32 chunkId, void *data, W32 *width, W32 *
 
 		if( _filterScale > 0 )
         {
+            W32 factor = Scaler_factor( _filterScale );
 
-            W8 *scaledImgBuf = (PW8) MM_MALLOC( (width*2) * (height*2) * 4 );
-
-            if( 2 == _filterScale ) // hq2x
-            {
-                RGB32toRGB24( normalBuffer, normalBuffer, width * height * 4 );
-                RGB24toBGR565( normalBuffer, normalBuffer, width * height * 3 );
-
-                hq2x_32( (PW8)normalBuffer, (PW8)scaledImgBuf, width, height, width * 2 * bytesPerPixel  );
+            W8 *scaledImgBuf = (PW8) MM_MALLOC( (width*factor) * (height*factor) * 4 );
 
-            }
-            else if( 1 == _filterScale ) // Scale2x
-            {
-                scale( 2, (void *)scaledImgBuf, (width*2) * bytesPerPixel, normalBuffer, width * bytesPerPixel, bytesPerPixel, width, height );
-            }
+            ReduxScale_RGB32( _filterScale, scaledImgBuf, normalBuffer, width, height );
 
-            width *= 2;
-            height *= 2;
+            width *= factor;
+            height *= factor;
 
 
             MM_FREE( normalBuffer );
@@ -409,8 +472,9 @@ PUBLIC void *wolfcore_ReduxGFX( const W32 chunkId, void *data, W32 *width, W32 *
 
     if( _filterScale > 0  )
     {
+        W32 factor = Scaler_factor( _filterScale );
 
-        scaledImgBuf = MM_MALLOC( (width_out * 2) * (height_out * 2) * bytesPerPixel );
+        scaledImgBuf = MM_MALLOC( (width_out * factor) * (height_out * factor) * bytesPerPixel );
         if( scaledImgBuf == NULL )
         {
 		if( buffer ) {
@@ -423,21 +487,10 @@ PUBLIC void *wolfcore_ReduxGFX( const W32 chunkId, void *data, W32 *width, W32 *
         // ////////////////////////////////////////////////////////////////////////
         // Scale Image
 
-        if( 2 == _filterScale ) // hq2x
-        {
-            RGB32toRGB24( ptr, ptr, width_out * height_out * 4 );
-            RGB24toBGR565( ptr, ptr, width_out * height_out * 3 );
-
-            hq2x_32( (PW8)ptr, (PW8)scaledImgBuf, width_out, height_out, width_out * 2 * bytesPerPixel  );
-
-        }
-        else if( 1 == _filterScale ) // Scale2x
-        {
-            scale( 2, (void *)scaledImgBuf, (width_out*2) * bytesPerPixel, ptr, width_out * bytesPerPixel, bytesPerPixel, width_out, height_out );
-        }
+        ReduxScale_RGB32( _filterScale, scaledImgBuf, ptr, width_out, height_out );
 
-        width_out *= 2;
-        height_out *= 2;
+        width_out *= factor;
+        height_out *= factor;
 
         if( buffer )
         {
@@ -71,37 +71,43 @@
 
 
 
+/* general purpose bit flag */
+#define ZIP_FLAG_DATA_DESCRIPTOR	0x0008	/* crc and sizes follow the file data */
+
+/* sizes and offsets at or above these limits need ZIP64 records */
+#define ZIP64_LIMIT				0xFFFFFFFFUL
+#define ZIP64_ENTRY_LIMIT		0xFFFF
+
+#define ZIP_VERSION_DEFLATE		20
+#define ZIP_VERSION_ZIP64		45
+
+
+/**
+ * \brief Zip entry as kept until the central directory is written.
+ * \note Only the fields that differ between entries are stored, everything
+ * else is constant for the archives we write.
+ */
 typedef struct zipHead_s
 {
-	W16 versionmadeby;
-	W16 versionneeded;
-	W16 flag;
-	W16 compression_method;
-	W32 timedate;
+	W64 compressed_size;
+	W64 uncompressed_size;
+	W64 offset;				/* Offset of local header */
 	W32 crc32;
-	W32 compressed_size;
-	SW32 uncompressed_size;
+	W32 timedate;
+	char *filename;
 	W16 filename_length;
-	W16 extrafield_length;
-	W16 centralextra_length;
-	W16 comment_length;
-	W16 disknumstart;
-	W16 internalattribute;
-	W16 localflag;
-	W32 externalattribute;
-	W32 offset;
+	W16 compression_method;
+	W16 flag;
+	wtBoolean zip64;		/* Local header and data descriptor use 64-bit sizes */
 	wtBoolean deletefile;
-	char filename[ 256 ];
-	char extrafield[ 256 ];
-	char centralextra[ 256 ];
-	char comment[ 256 ];
 
 } zipHead_t;
 
 
 wtBoolean zip_WriteLocalChunk( zipHead_t *z, FILE *f );
+wtBoolean zip_WriteDataDescriptor( zipHead_t *z, FILE *f );
 wtBoolean zip_WriteCentralChunk( zipHead_t *z, FILE *f );
-wtBoolean zip_WriteEndChunk( W16 num, W32 size, W32 offset, W16 len, char *comment, FILE *f );
+wtBoolean zip_WriteEndChunk( W64 num, W64 size, W64 offset, W16 len, char *comment, FILE *f );
 
 
 
@@ -39,137 +39,247 @@
 #define SIG_END				0x06054b50L
 #define SIG_EXTENDLOCAL		0x08074b50L
 #define SIG_EXTENDSPLOCAL	0x30304b50L
+#define SIG_END64			0x06064b50L
+#define SIG_END64LOCATOR	0x07064b50L
 
 /* Length of header (not counting the signature) */
 #define LOCALHEAD_SIZE		26
 #define CENTRALHEAD_SIZE	42
 #define ENDHEAD_SIZE		18
+#define END64HEAD_SIZE		52
+#define END64LOCATOR_SIZE	16
+
+/* ZIP64 extended information extra field */
+#define EXTRA_ZIP64			0x0001
+#define EXTRA_ZIP64_SIZE	28		/* Header id, length and up to three 64-bit values */
+
+/* Largest fixed part of a header we write, the name is written separately. */
+#define ZIP_HEADBUF_SIZE	(4 + CENTRALHEAD_SIZE + EXTRA_ZIP64_SIZE)
 
 
 /**
- * \brief Write local header to file.
- * \param[in] z zip entry to write local header for.
- * \param[in] f File to write to.
- * \return On success true, otherwise false.
+ * \brief Store 16-bit value in little-endian byte order.
+ * \param[in] p Destination.
+ * \param[in] v Value to store.
+ * \return Pointer just past the stored value.
  */
-PUBLIC wtBoolean zip_WriteLocalChunk( zipHead_t *z, FILE *f )
+PRIVATE INLINECALL W8 *zip_PutShort( W8 *p, W16 v )
 {
-	W32 temp32;
-	W16 temp16;
-	W32 retval;
+	p[ 0 ] = (W8)v;
+	p[ 1 ] = (W8)(v >> 8);
 
-	temp32 = LittleLong( SIG_LOCAL );
-	retval = fwrite( &temp32, 1, 4, f );
+	return p + 2;
+}
 
-	temp16 = LittleShort( z->versionneeded );
-	retval += fwrite( &temp16, 1, 2, f );
+/**
+ * \brief Store 32-bit value in little-endian byte order.
+ * \param[in] p Destination.
+ * \param[in] v Value to store.
+ * \return Pointer just past the stored value.
+ */
+PRIVATE INLINECALL W8 *zip_PutLong( W8 *p, W32 v )
+{
+	p = zip_PutShort( p, (W16)v );
 
-	temp16 = LittleShort( z->localflag );
-	retval += fwrite( &temp16, 1, 2, f );
+	return zip_PutShort( p, (W16)(v >> 16) );
+}
 
-	temp16 = LittleShort( z->compression_method );
-	retval += fwrite( &temp16, 1, 2, f );
+/**
+ * \brief Store 64-bit value in little-endian byte order.
+ * \param[in] p Destination.
+ * \param[in] v Value to store.
+ * \return Pointer just past the stored value.
+ */
+PRIVATE INLINECALL W8 *zip_PutLongLong( W8 *p, W64 v )
+{
+	p = zip_PutLong( p, (W32)v );
 
-	temp32 = LittleLong( z->timedate );
-	retval += fwrite( &temp32, 1, 4, f );
+	return zip_PutLong( p, (W32)(v >> 32) );
+}
 
-	temp32 = LittleLong( z->crc32 );
-	retval += fwrite( &temp32, 1, 4, f );
+/**
+ * \brief Store 64-bit size in a 32-bit header field.
+ * \param[in] p Destination.
+ * \param[in] v Value to store.
+ * \return Pointer just past the stored value.
+ * \note Values that do not fit are stored as 0xFFFFFFFF, the real value
+ *  then goes into the ZIP64 extra field.
+ */
+PRIVATE INLINECALL W8 *zip_PutClampedLong( W8 *p, W64 v )
+{
+	return zip_PutLong( p, v >= ZIP64_LIMIT ? (W32)ZIP64_LIMIT : (W32)v );
+}
 
-	temp32 = LittleLong( z->compressed_size );
-	retval += fwrite( &temp32, 1, 4, f );
+/**
+ * \brief Write header followed by the entry file name.
+ * \param[in] head Header data.
+ * \param[in] length Length of header data in bytes.
+ * \param[in] z zip entry that holds the file name.
+ * \param[in] f File to write to.
+ * \return On success true, otherwise false.
+ */
+PRIVATE wtBoolean zip_WriteHeader( const W8 *head, W32 length, zipHead_t *z, FILE *f )
+{
+	if( fwrite( head, 1, length, f ) != length )
+	{
+		return false;
+	}
 
-	temp32 = LittleLong( z->uncompressed_size );
-	retval += fwrite( &temp32, 1, 4, f );
+	return fwrite( z->filename, 1, z->filename_length, f ) == z->filename_length;
+}
 
-	temp16 = LittleShort( z->filename_length );
-	retval += fwrite( &temp16, 1, 2, f );
+/**
+ * \brief Write local header to file.
+ * \param[in] z zip entry to write local header for.
+ * \param[in] f File to write to.
+ * \return On success true, otherwise false.
+ * \note If ZIP_FLAG_DATA_DESCRIPTOR is set the crc and sizes are written
+ *  as zero and follow the file data in a data descriptor instead.
+ *  ZIP64 entries get an extra field with both 64-bit sizes.
+ */
+PUBLIC wtBoolean zip_WriteLocalChunk( zipHead_t *z, FILE *f )
+{
+	W8 head[ ZIP_HEADBUF_SIZE ];
+	W8 *p = head;
+	wtBoolean deferred = (z->flag & ZIP_FLAG_DATA_DESCRIPTOR) != 0;
+
+	p = zip_PutLong( p, SIG_LOCAL );
+	p = zip_PutShort( p, z->zip64 ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFLATE );
+	p = zip_PutShort( p, z->flag );
+	p = zip_PutShort( p, z->compression_method );
+	p = zip_PutLong( p, z->timedate );
+	p = zip_PutLong( p, deferred ? 0 : z->crc32 );
+
+	if( z->zip64 )
+	{
+		p = zip_PutLong( p, (W32)ZIP64_LIMIT );
+		p = zip_PutLong( p, (W32)ZIP64_LIMIT );
+	}
+	else
+	{
+		p = zip_PutLong( p, deferred ? 0 : (W32)z->compressed_size );
+		p = zip_PutLong( p, deferred ? 0 : (W32)z->uncompressed_size );
+	}
 
-	temp16 = LittleShort( z->extrafield_length );
-	retval += fwrite( &temp16, 1, 2, f );
+	p = zip_PutShort( p, z->filename_length );
+	p = zip_PutShort( p, z->zip64 ? 20 : 0 );
 
-	if( retval != LOCALHEAD_SIZE + 4 )
+	if( ! zip_WriteHeader( head, (W32)(p - head), z, f ) )
 	{
 		return false;
 	}
 
-	if( fwrite( z->filename, 1, z->filename_length, f ) != z->filename_length ||
-		(z->extrafield && ( fwrite( z->extrafield, 1, z->extrafield_length, f) != z->extrafield_length) ) )
+	if( z->zip64 )
 	{
-		return false;
+		p = head;
+		p = zip_PutShort( p, EXTRA_ZIP64 );
+		p = zip_PutShort( p, 16 );
+		p = zip_PutLongLong( p, deferred ? 0 : z->uncompressed_size );
+		p = zip_PutLongLong( p, deferred ? 0 : z->compressed_size );
+
+		if( fwrite( head, 1, p - head, f ) != (size_t)(p - head) )
+		{
+			return false;
+		}
 	}
 
 	return true;
 }
 
 /**
- * \brief Write central header to file.
- * \param[in] z zip entry to write central header for.
+ * \brief Write data descriptor to file.
+ * \param[in] z zip entry to write data descriptor for.
  * \param[in] f File to write to.
  * \return On success true, otherwise false.
+ * \note Must directly follow the file data of an entry written with
+ *  ZIP_FLAG_DATA_DESCRIPTOR set.
  */
-PUBLIC wtBoolean zip_WriteCentralChunk( zipHead_t *z, FILE *f )
+PUBLIC wtBoolean zip_WriteDataDescriptor( zipHead_t *z, FILE *f )
 {
-	W32 temp32;
-	W16 temp16;
-	W32 retval;
-
-	temp32 = LittleLong( SIG_CENTRAL );
-	retval = fwrite( &temp32, 1, 4, f );
-
-	temp16 = LittleShort( z->versionmadeby );
-	retval += fwrite( &temp16, 1, 2, f );
-
-	temp16 = LittleShort( z->versionneeded );
-	retval += fwrite( &temp16, 1, 2, f );
-
-	temp16 = LittleShort( z->flag );
-	retval += fwrite( &temp16, 1, 2, f );
-
-	temp16 = LittleShort( z->compression_method );
-	retval += fwrite( &temp16, 1, 2, f );
-
-	temp32 = LittleLong( z->timedate );
-	retval += fwrite( &temp32, 1, 4, f );
-
-	temp32 = LittleLong( z->crc32 );
-	retval += fwrite( &temp32, 1, 4, f );
-
-	temp32 = LittleLong( z->compressed_size );
-	retval += fwrite( &temp32, 1, 4, f );
-
-	temp32 = LittleLong( z->uncompressed_size );
-	retval += fwrite( &temp32, 1, 4, f );
-
-	temp16 = LittleShort( z->filename_length );
-	retval += fwrite( &temp16, 1, 2, f );
+	W8 head[ 24 ];
+	W8 *p = head;
 
-	temp16 = LittleShort( z->centralextra_length );
-	retval += fwrite( &temp16, 1, 2, f );
+	p = zip_PutLong( p, SIG_EXTENDLOCAL );
+	p = zip_PutLong( p, z->crc32 );
 
-	temp16 = LittleShort( z->comment_length );
-	retval += fwrite( &temp16, 1, 2, f );
+	if( z->zip64 )
+	{
+		p = zip_PutLongLong( p, z->compressed_size );
+		p = zip_PutLongLong( p, z->uncompressed_size );
+	}
+	else
+	{
+		p = zip_PutLong( p, (W32)z->compressed_size );
+		p = zip_PutLong( p, (W32)z->uncompressed_size );
+	}
 
-	temp16 = LittleShort( z->disknumstart );
-	retval += fwrite( &temp16, 1, 2, f );
+	return fwrite( head, 1, p - head, f ) == (size_t)(p - head);
+}
 
-	temp16 = LittleShort( z->internalattribute );
-	retval += fwrite( &temp16, 1, 2, f );
+/**
+ * \brief Write central header to file.
+ * \param[in] z zip entry to write central header for.
+ * \param[in] f File to write to.
+ * \return On success true, otherwise false.
+ * \note Sizes and offset that do not fit into 32 bits are moved into a
+ *  ZIP64 extra field.
+ */
+PUBLIC wtBoolean zip_WriteCentralChunk( zipHead_t *z, FILE *f )
+{
+	W8 head[ ZIP_HEADBUF_SIZE ];
+	W8 extra[ EXTRA_ZIP64_SIZE ];
+	W8 *p = extra + 4;
+	W16 extra_length;
 
-	temp32 = LittleLong( z->externalattribute );
-	retval += fwrite( &temp32, 1, 4, f );
+	/* ZIP64 extra field holds only the values that overflowed, in this order */
+	if( z->uncompressed_size >= ZIP64_LIMIT )
+	{
+		p = zip_PutLongLong( p, z->uncompressed_size );
+	}
+	if( z->compressed_size >= ZIP64_LIMIT )
+	{
+		p = zip_PutLongLong( p, z->compressed_size );
+	}
+	if( z->offset >= ZIP64_LIMIT )
+	{
+		p = zip_PutLongLong( p, z->offset );
+	}
 
-	temp32 = LittleLong( z->offset );
-	retval += fwrite( &temp32, 1, 4, f );
+	extra_length = (W16)(p - extra);
+	if( extra_length == 4 )
+	{
+		extra_length = 0;
+	}
+	else
+	{
+		zip_PutShort( extra, EXTRA_ZIP64 );
+		zip_PutShort( extra + 2, extra_length - 4 );
+	}
 
-	if( retval != CENTRALHEAD_SIZE + 4 )
+	p = head;
+	p = zip_PutLong( p, SIG_CENTRAL );
+	p = zip_PutShort( p, (VMB_MSDOS_FAT << 8) | ZIP_VERSION_ZIP64 );
+	p = zip_PutShort( p, (extra_length || z->zip64) ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFLATE );
+	p = zip_PutShort( p, z->flag );
+	p = zip_PutShort( p, z->compression_method );
+	p = zip_PutLong( p, z->timedate );
+	p = zip_PutLong( p, z->crc32 );
+	p = zip_PutClampedLong( p, z->compressed_size );
+	p = zip_PutClampedLong( p, z->uncompressed_size );
+	p = zip_PutShort( p, z->filename_length );
+	p = zip_PutShort( p, extra_length );
+	p = zip_PutShort( p, 0 );		/* comment length */
+	p = zip_PutShort( p, 0 );		/* disk number start */
+	p = zip_PutShort( p, 0 );		/* internal attributes */
+	p = zip_PutLong( p, 0 );		/* external attributes */
+	p = zip_PutClampedLong( p, z->offset );
+
+	if( ! zip_WriteHeader( head, (W32)(p - head), z, f ) )
 	{
 		return false;
 	}
 
-	if( fwrite(z->filename, 1, z->filename_length, f) != z->filename_length ||
-		(z->centralextra_length && fwrite(z->centralextra, 1, z->centralextra_length, f) != z->centralextra_length) ||
-		(z->comment_length && fwrite(z->comment, 1, z->comment_length, f) != z->comment_length) )
+	if( extra_length && fwrite( extra, 1, extra_length, f ) != extra_length )
 	{
 		return false;
 	}
@@ -186,43 +296,48 @@ PUBLIC wtBoolean zip_WriteCentralChunk( zipHead_t *z, FILE *f )
  * \param[in] comment Zip file comment if len != 0.
  * \param[in] f File to write to.
  * \return On success true, otherwise false.
+ * \note Must directly follow the central directory. If any value does not
+ *  fit the classic record a ZIP64 end of central directory record and
+ *  locator are written first.
  */
-PUBLIC wtBoolean zip_WriteEndChunk( W16 num, W32 size, W32 offset, W16 len, char *comment, FILE *f )
+PUBLIC wtBoolean zip_WriteEndChunk( W64 num, W64 size, W64 offset, W16 len, char *comment, FILE *f )
 {
-	W32 temp32;
-	W16 temp16;
-	W32 retval;
-
-	temp32 = LittleLong( SIG_END );
-	retval = fwrite( &temp32, 1, 4, f );
-
-	temp16 = 0;
-	retval += fwrite( &temp16, 1, 2, f );
-
-	temp16 = 0;
-	retval += fwrite( &temp16, 1, 2, f );
-
-	temp16 = LittleShort( num );
-	retval += fwrite( &temp16, 1, 2, f );
+	W8 head[ 4 + END64HEAD_SIZE + 4 + END64LOCATOR_SIZE + 4 + ENDHEAD_SIZE ];
+	W8 *p = head;
 
-	temp16 = LittleShort( num );
-	retval += fwrite( &temp16, 1, 2, f );
-
-	temp32 = LittleLong( size );
-	retval += fwrite( &temp32, 1, 4, f );
-
-	temp32 = LittleLong( offset );
-	retval += fwrite( &temp32, 1, 4, f );
+	if( num >= ZIP64_ENTRY_LIMIT || size >= ZIP64_LIMIT || offset >= ZIP64_LIMIT )
+	{
+		p = zip_PutLong( p, SIG_END64 );
+		p = zip_PutLongLong( p, END64HEAD_SIZE - 8 );
+		p = zip_PutShort( p, (VMB_MSDOS_FAT << 8) | ZIP_VERSION_ZIP64 );
+		p = zip_PutShort( p, ZIP_VERSION_ZIP64 );
+		p = zip_PutLong( p, 0 );		/* number of this disk */
+		p = zip_PutLong( p, 0 );		/* disk with central directory */
+		p = zip_PutLongLong( p, num );
+		p = zip_PutLongLong( p, num );
+		p = zip_PutLongLong( p, size );
+		p = zip_PutLongLong( p, offset );
+
+		p = zip_PutLong( p, SIG_END64LOCATOR );
+		p = zip_PutLong( p, 0 );		/* disk with ZIP64 end record */
+		p = zip_PutLongLong( p, offset + size );
+		p = zip_PutLong( p, 1 );		/* total number of disks */
+	}
 
-	temp16 = LittleShort( len );
-	retval += fwrite( &temp16, 1, 2, f );
+	p = zip_PutLong( p, SIG_END );
+	p = zip_PutShort( p, 0 );
+	p = zip_PutShort( p, 0 );
+	p = zip_PutShort( p, num >= ZIP64_ENTRY_LIMIT ? ZIP64_ENTRY_LIMIT : (W16)num );
+	p = zip_PutShort( p, num >= ZIP64_ENTRY_LIMIT ? ZIP64_ENTRY_LIMIT : (W16)num );
+	p = zip_PutClampedLong( p, size );
+	p = zip_PutClampedLong( p, offset );
+	p = zip_PutShort( p, len );
 
-	if( retval != ENDHEAD_SIZE + 4 )
+	if( fwrite( head, 1, p - head, f ) != (size_t)(p - head) )
 	{
 		return false;
 	}
 
-
 	if( len && fwrite( comment, 1, len, f ) != len )
 	{
 		return false;